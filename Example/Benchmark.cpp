@@ -0,0 +1,463 @@
+#include <GeoMag/Core.hpp>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace geomag;
+
+// 運用と同じ形の負荷を決定的な合成データで計測するマクロベンチマーク
+// 使い方: benchmark [scenario|all] [scale] [threads] [exact|fast|approximate]
+//   scale   負荷の大きさの倍率 (1で下記の本来の大きさ)
+//   threads 評価スレッド数 (0でハードウェアの並列数)
+
+namespace {
+
+// 決定的な疑似乱数 (SplitMix64)
+class SplitMix64 {
+  public:
+	explicit SplitMix64(std::uint64_t seed) : m_state(seed) {}
+
+	std::uint64_t next() {
+		std::uint64_t z = (m_state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	// [lower, upper)
+	double uniform(double lower, double upper) { return lower + (upper - lower) * static_cast<double>(next() >> 11) / 9007199254740992.0; }
+
+  private:
+	std::uint64_t m_state;
+};
+
+using Clock = std::chrono::steady_clock;
+
+auto seconds(Clock::time_point begin, Clock::time_point end) -> double { return std::chrono::duration<double>(end - begin).count(); }
+
+// プロセス開始からの最大常駐メモリ [MiB] (シナリオは子プロセスで動くので、そのシナリオだけの最大値になる)
+auto peakRssMiB() -> double {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+// 段ごとの所要時間 (generateは合成データの作成なのでスループットに含めない)
+class Stages {
+  public:
+	template <typename Func>
+	void measure(const std::string& name, Func&& func) {
+		const auto begin = Clock::now();
+		func();
+		add(name, seconds(begin, Clock::now()));
+	}
+
+	void add(const std::string& name, double time) {
+		for (auto& stage : m_stages) {
+			if (stage.first == name) {
+				stage.second += time;
+				return;
+			}
+		}
+		m_stages.emplace_back(name, time);
+	}
+
+	// generateを除いた合計
+	auto measured() const -> double {
+		double total = 0.0;
+		for (const auto& stage : m_stages) {
+			total += stage.first == "generate" ? 0.0 : stage.second;
+		}
+		return total;
+	}
+
+	const std::vector<std::pair<std::string, double>>& stages() const { return m_stages; }
+
+  private:
+	std::vector<std::pair<std::string, double>> m_stages;
+};
+
+struct Result {
+	std::string name;
+	std::size_t points = 0;
+	double seconds = 0.0; // generateを除いた時間
+	double peak_rss = 0.0; // シナリオを実行した子プロセスの最大常駐メモリ [MiB]
+	double checksum = 0.0; // 全点の全磁力の和 (版の間で結果が変わっていないかの確認用)
+};
+
+// 子プロセスから親に返す数値
+struct Measurement {
+	std::size_t points;
+	double seconds;
+	double peak_rss;
+	double checksum;
+};
+
+struct Options {
+	double scale = 1.0;
+	std::size_t threads = 0;
+	Accuracy accuracy = Accuracy::Exact;
+};
+
+// 磁場の要素を求めて集計する (偏角・伏角・全磁力の図や表を作るのに相当する)
+auto reduce(const std::vector<Eigen::Vector3d>& fluxes, double& checksum) -> void {
+	double sum = 0.0;
+	for (const auto& bf : fluxes) {
+		const MagFluxComponent b{bf};
+		sum += b.total;
+	}
+	checksum += sum;
+}
+
+auto report(const std::string& description, const Stages& stages, Result& result) -> void {
+	result.peak_rss = peakRssMiB();
+	std::printf("== %s: %s (%zu points)\n", result.name.c_str(), description.c_str(), result.points);
+	for (const auto& stage : stages.stages()) {
+		std::printf("   %-10s %9.3f s\n", stage.first.c_str(), stage.second);
+	}
+	std::printf("   throughput %.0f points/s, peak RSS %.1f MiB, checksum %.9e\n", result.points / result.seconds, result.peak_rss,
+				result.checksum);
+	std::fflush(stdout);
+}
+
+auto makeFlux(const Options& options) -> GeoMagFlux {
+	GeoMagFlux gmag{MagFluxUnit::NanoTesla};
+	gmag.setAccuracy(options.accuracy);
+	return gmag;
+}
+
+// 0.25度の全球格子 x 20高度
+auto globalGrid(const Options& options) -> Result {
+	Result result{"grid"};
+	const double step = 0.25 / std::sqrt(options.scale);
+	const std::size_t rows = static_cast<std::size_t>(std::round(180.0 / step)) + 1;
+	const std::size_t columns = static_cast<std::size_t>(std::round(360.0 / step));
+	const DateTime epoch(2024, 1, 1, 0, 0, 0);
+	auto gmag = makeFlux(options);
+
+	Stages stages;
+	std::vector<Wgs84> positions;
+	std::vector<Eigen::Vector3d> fluxes;
+	for (int level = 0; level < 20; level++) {
+		const double altitude = level * 50e3;
+		stages.measure("generate", [&] {
+			positions.clear();
+			positions.reserve(rows * columns);
+			for (std::size_t i = 0; i < rows; i++) {
+				const double lat = -90.0 + 180.0 * i / (rows - 1);
+				for (std::size_t j = 0; j < columns; j++) {
+					positions.emplace_back(epoch, Degree{-180.0 + 360.0 * j / columns}, Degree{lat}, altitude);
+				}
+			}
+		});
+		stages.measure("evaluate", [&] { gmag.evaluate(positions, fluxes, options.threads); });
+		stages.measure("reduce", [&] { reduce(fluxes, result.checksum); });
+		result.points += positions.size();
+	}
+	result.seconds = stages.measured();
+	report("0.25 deg global grid x 20 altitudes", stages, result);
+	return result;
+}
+
+// 7日間の低軌道を10Hzで (ECI -> ECEF -> 磁場)
+auto leoOrbit(const Options& options) -> Result {
+	Result result{"orbit"};
+	constexpr double mu = 3.986004418e14;
+	constexpr double radius = 6378137.0 + 420e3;
+	const double inclination = 51.64 * constant::pi / 180.0;
+	const double mean_motion = std::sqrt(mu / (radius * radius * radius));
+	const std::size_t samples = static_cast<std::size_t>(7 * 86400 * 10 * options.scale);
+	constexpr std::size_t block = 36000; // 1時間分
+	DateTime epoch(2024, 3, 1, 0, 0, 0);
+	auto gmag = makeFlux(options);
+
+	Stages stages;
+	std::vector<Eci> inertial;
+	std::vector<Ecef> positions;
+	std::vector<Eigen::Vector3d> fluxes;
+	for (std::size_t begin = 0; begin < samples; begin += block) {
+		const std::size_t end = std::min(begin + block, samples);
+		stages.measure("generate", [&] {
+			inertial.clear();
+			for (std::size_t k = begin; k < end; k++) {
+				const double t = k * 0.1;
+				const double u = mean_motion * t;
+				inertial.emplace_back(epoch.addTicks(static_cast<std::int64_t>(k) * constant::ticks_per_second / 10), radius * std::cos(u),
+									  radius * std::sin(u) * std::cos(inclination), radius * std::sin(u) * std::sin(inclination));
+			}
+		});
+		stages.measure("convert", [&] {
+			positions.clear();
+			for (const auto& position : inertial) {
+				positions.push_back(position.toEcef());
+			}
+		});
+		stages.measure("evaluate", [&] { gmag.evaluate(positions, fluxes, options.threads); });
+		stages.measure("reduce", [&] { reduce(fluxes, result.checksum); });
+		result.points += positions.size();
+	}
+	result.seconds = stages.measured();
+	report("7-day LEO orbit at 10 Hz", stages, result);
+	return result;
+}
+
+// 100観測所 x 50年の日平均値の時系列
+auto observatorySeries(const Options& options) -> Result {
+	Result result{"observatory"};
+	const std::size_t stations = std::max<std::size_t>(static_cast<std::size_t>(100 * options.scale), 1);
+	const std::size_t days = static_cast<std::size_t>(50 * 365.25);
+	DateTime first(1975, 1, 1, 12, 0, 0);
+	auto gmag = makeFlux(options);
+	SplitMix64 random(83);
+
+	Stages stages;
+	std::vector<Wgs84> positions;
+	std::vector<Eigen::Vector3d> fluxes;
+	for (std::size_t station = 0; station < stations; station++) {
+		const double lat = std::asin(random.uniform(-1.0, 1.0)) * 180.0 / constant::pi;
+		const double lon = random.uniform(-180.0, 180.0);
+		const double altitude = random.uniform(0.0, 3000.0);
+		stages.measure("generate", [&] {
+			positions.clear();
+			for (std::size_t day = 0; day < days; day++) {
+				positions.emplace_back(first.addTicks(static_cast<std::int64_t>(day) * constant::ticks_per_day), Degree{lon}, Degree{lat},
+									   altitude);
+			}
+		});
+		stages.measure("evaluate", [&] { gmag.evaluate(positions, fluxes, options.threads); });
+		stages.measure("reduce", [&] { reduce(fluxes, result.checksum); });
+		result.points += positions.size();
+	}
+	result.seconds = stages.measured();
+	report("100 stations x 50 years of daily values", stages, result);
+	return result;
+}
+
+// 時刻も位置もばらばらな問い合わせ
+auto randomQueries(const Options& options) -> Result {
+	Result result{"random"};
+	const std::size_t queries = static_cast<std::size_t>(1000000 * options.scale);
+	constexpr std::size_t block = 65536;
+	auto gmag = makeFlux(options);
+	SplitMix64 random(2024);
+
+	Stages stages;
+	std::vector<Wgs84> positions;
+	std::vector<Eigen::Vector3d> fluxes;
+	for (std::size_t begin = 0; begin < queries; begin += block) {
+		const std::size_t end = std::min(begin + block, queries);
+		stages.measure("generate", [&] {
+			positions.clear();
+			for (std::size_t k = begin; k < end; k++) {
+				const int year = 1900 + static_cast<int>(random.uniform(0.0, 125.0));
+				const DateTime epoch(year, random.uniform(1.0, 365.0));
+				const double lat = std::asin(random.uniform(-1.0, 1.0)) * 180.0 / constant::pi;
+				positions.emplace_back(epoch, Degree{random.uniform(-180.0, 180.0)}, Degree{lat}, random.uniform(0.0, 1000e3));
+			}
+		});
+		stages.measure("evaluate", [&] { gmag.evaluate(positions, fluxes, options.threads); });
+		stages.measure("reduce", [&] { reduce(fluxes, result.checksum); });
+		result.points += positions.size();
+	}
+	result.seconds = stages.measured();
+	report("mixed-epoch random query stream", stages, result);
+	return result;
+}
+
+// CSVを読み、バイナリ (北・東・下 [nT] のdouble) で書き出すストリーム処理
+auto csvStream(const Options& options) -> Result {
+	Result result{"stream"};
+	const std::size_t lines = static_cast<std::size_t>(1000000 * options.scale);
+	const char* tmpdir = std::getenv("TMPDIR");
+	const std::string directory = tmpdir != nullptr ? tmpdir : "/tmp";
+	const std::string input_path = directory + "/geomag_benchmark_input.csv";
+	const std::string output_path = directory + "/geomag_benchmark_output.bin";
+
+	Stages stages;
+	stages.measure("generate", [&] {
+		SplitMix64 random(81);
+		AsyncFileWriter output(input_path);
+		DateTime epoch(2000, 1, 1, 0, 0, 0);
+		for (std::size_t k = 0; k < lines; k++) {
+			const DateTime dt = epoch.addTicks(static_cast<std::int64_t>(random.uniform(0.0, 25.0 * 365.25)) * constant::ticks_per_day);
+			char* buffer = output.reserve(64);
+			const int n = std::snprintf(buffer, 64, "%04d-%02d-%02dT%02d:%02d:%02d,%.5f,%.5f,%.1f\n", dt.year(), dt.month(), dt.day(), dt.hour(),
+										dt.minute(), dt.second(), std::asin(random.uniform(-1.0, 1.0)) * 180.0 / constant::pi,
+										random.uniform(-180.0, 180.0), random.uniform(0.0, 800e3));
+			output.commit(static_cast<std::size_t>(n));
+		}
+		output.close();
+	});
+
+	const std::size_t evaluate_threads = Parallel::threadCount(options.threads);
+	const std::size_t parse_threads = std::max<std::size_t>(evaluate_threads / 4, 1);
+	std::vector<GeoMagFlux> evaluators(evaluate_threads, makeFlux(options));
+	AsyncLineReader input(input_path);
+	AsyncFileWriter output(output_path);
+	Pipeline pipeline;
+
+	auto& text = pipeline.source<std::string>("read", [&input](std::vector<std::string>& batch) {
+		const char* line;
+		std::size_t length;
+		while (batch.size() < 1024) {
+			if (!input.next(line, length)) {
+				return false;
+			}
+			batch.emplace_back(line, length);
+		}
+		return true;
+	});
+	auto& positions = pipeline.stage<Wgs84>("parse", text, parse_threads, [](std::size_t, std::vector<std::string>& in, std::vector<Wgs84>& out) {
+		out.reserve(in.size());
+		for (auto& line : in) {
+			const std::size_t comma = line.find(',');
+			if (comma == std::string::npos) {
+				throw std::runtime_error("Format Error: " + line);
+			}
+			char* end = &line[comma];
+			const double lat = std::strtod(end + 1, &end);
+			const double lon = std::strtod(end + 1, &end);
+			const double alt = std::strtod(end + 1, &end);
+			out.emplace_back(DateTime(line.substr(0, comma)), Degree{lon}, Degree{lat}, alt);
+		}
+	});
+	auto& fluxes = pipeline.stage<Eigen::Vector3d>(
+	  "evaluate", positions, evaluate_threads,
+	  [&evaluators](std::size_t thread_index, std::vector<Wgs84>& in, std::vector<Eigen::Vector3d>& out) {
+		  auto& gmag = evaluators[thread_index];
+		  out.reserve(in.size());
+		  for (const auto& position : in) {
+			  out.push_back(gmag(position));
+		  }
+	  });
+	pipeline.sink("write", fluxes, [&output, &result](std::vector<Eigen::Vector3d>& batch) {
+		for (const auto& bf : batch) {
+			output.write(reinterpret_cast<const char*>(bf.data()), 3 * sizeof(double));
+			result.checksum += bf.norm();
+		}
+		result.points += batch.size();
+	});
+
+	const auto begin = Clock::now();
+	pipeline.run();
+	output.close();
+	const double wall = seconds(begin, Clock::now());
+
+	// 段は並行して動くので、各段の実働時間 (全スレッドの合計) と全体の経過時間を示す
+	for (const auto& stats : pipeline.stats()) {
+		stages.add(stats.name, stats.busy_seconds);
+	}
+	stages.add("wall", wall);
+	result.seconds = wall;
+	report("CSV in, binary out streaming (" + std::string(input.backend()) + ")", stages, result);
+
+	std::remove(input_path.c_str());
+	std::remove(output_path.c_str());
+	return result;
+}
+
+// シナリオを子プロセスで実行する
+// ru_maxrssはプロセスが終わるまで下がらないので、同じプロセスで続けて実行すると前のシナリオの最大値が残る
+auto runIsolated(const std::string& name, Result (*scenario)(const Options&), const Options& options) -> Result {
+	int fds[2];
+	if (pipe(fds) != 0) {
+		throw std::runtime_error(name + ": pipe failed");
+	}
+	std::fflush(stdout);
+	const pid_t pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		throw std::runtime_error(name + ": fork failed");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		int status = 0;
+		try {
+			const Result result = scenario(options);
+			const Measurement measurement{result.points, result.seconds, result.peak_rss, result.checksum};
+			if (write(fds[1], &measurement, sizeof(measurement)) != static_cast<ssize_t>(sizeof(measurement))) {
+				status = 1;
+			}
+		} catch (std::exception& e) {
+			std::cerr << name << ": " << e.what() << std::endl;
+			status = 1;
+		}
+		std::fflush(stdout);
+		_exit(status);
+	}
+
+	close(fds[1]);
+	Measurement measurement;
+	const ssize_t n = read(fds[0], &measurement, sizeof(measurement));
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (n != static_cast<ssize_t>(sizeof(measurement)) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		throw std::runtime_error(name + ": scenario failed");
+	}
+	Result result{name};
+	result.points = measurement.points;
+	result.seconds = measurement.seconds;
+	result.peak_rss = measurement.peak_rss;
+	result.checksum = measurement.checksum;
+	return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const std::vector<std::pair<std::string, Result (*)(const Options&)>> scenarios = {
+	  {"grid", globalGrid}, {"orbit", leoOrbit}, {"observatory", observatorySeries}, {"random", randomQueries}, {"stream", csvStream}};
+
+	std::string selected = argc >= 2 ? argv[1] : "all";
+	Options options;
+	try {
+		if (argc >= 3) {
+			options.scale = std::stod(argv[2]);
+		}
+		if (argc >= 4) {
+			options.threads = std::stoul(argv[3]);
+		}
+		if (argc >= 5) {
+			const std::string accuracy = argv[4];
+			options.accuracy = accuracy == "fast" ? Accuracy::Fast : accuracy == "approximate" ? Accuracy::Approximate : Accuracy::Exact;
+		}
+	} catch (std::exception& e) {
+		std::cerr << "Format Error: " << e.what() << std::endl;
+		return 1;
+	}
+	bool known = selected == "all";
+	for (const auto& scenario : scenarios) {
+		known = known || scenario.first == selected;
+	}
+	if (argc > 5 || options.scale <= 0.0 || !known) {
+		std::cerr << "Usage: " << argv[0] << " [grid|orbit|observatory|random|stream|all] [scale] [threads] [exact|fast|approximate]" << std::endl;
+		return 1;
+	}
+
+	std::printf("threads %zu, scale %g\n", Parallel::threadCount(options.threads), options.scale);
+	std::vector<Result> results;
+	try {
+		for (const auto& scenario : scenarios) {
+			if (selected == "all" || selected == scenario.first) {
+				results.push_back(runIsolated(scenario.first, scenario.second, options));
+			}
+		}
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	// 版どうしを比べやすいように、最後に1行1シナリオでまとめる
+	std::printf("\n%-12s %12s %10s %14s %16s %18s\n", "scenario", "points", "seconds", "points/s", "child peak RSS", "checksum");
+	for (const auto& result : results) {
+		std::printf("%-12s %12zu %10.3f %14.0f %12.1f MiB %18.9e\n", result.name.c_str(), result.points, result.seconds,
+					result.points / result.seconds, result.peak_rss, result.checksum);
+	}
+}
@@ -0,0 +1,104 @@
+#include <GeoMag/Core.hpp>
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+using namespace geomag;
+
+// 入力: 1行に "date lat lon alt" (CalcGeoMagと同じ形式)
+// 出力: 1行に "north east down total horizontal inclination declination"
+int main(int argc, char** argv) {
+	std::size_t evaluate_threads = 0;
+	std::size_t batch_size = 1024;
+	if (argc >= 2) {
+		evaluate_threads = std::stoul(argv[1]);
+	}
+	if (argc >= 3) {
+		batch_size = std::max<std::size_t>(std::stoul(argv[2]), 1);
+	}
+	if (argc > 3) {
+		std::cerr << "Usage: " << argv[0] << " [evaluate_threads] [batch_size] < input > output" << std::endl;
+		return 1;
+	}
+
+	AsyncLineReader input(STDIN_FILENO);
+	AsyncFileWriter output(STDOUT_FILENO);
+	evaluate_threads = Parallel::threadCount(evaluate_threads);
+	const std::size_t convert_threads = std::max<std::size_t>(evaluate_threads / 4, 1);
+	const std::size_t encode_threads = std::max<std::size_t>(evaluate_threads / 4, 1);
+
+	std::vector<GeoMagFlux> evaluators(evaluate_threads, GeoMagFlux{MagFluxUnit::NanoTesla});
+	Pipeline pipeline;
+
+	auto& lines = pipeline.source<std::string>("parse", [batch_size, &input](std::vector<std::string>& batch) {
+		const char* line;
+		std::size_t length;
+		while (batch.size() < batch_size) {
+			if (!input.next(line, length)) {
+				return false;
+			}
+			if (length > 0) {
+				batch.emplace_back(line, length);
+			}
+		}
+		return true;
+	});
+
+	auto& positions = pipeline.stage<Wgs84>("convert", lines, convert_threads,
+											[](std::size_t, std::vector<std::string>& input, std::vector<Wgs84>& output) {
+												output.reserve(input.size());
+												for (const auto& line : input) {
+													std::istringstream iss(line);
+													std::string date;
+													double lat, lon, alt;
+													if (!(iss >> date >> lat >> lon >> alt)) {
+														throw std::runtime_error("Format Error: " + line);
+													}
+													output.emplace_back(DateTime(date), Degree{lon}, Degree{lat}, alt);
+												}
+											});
+
+	auto& fluxes = pipeline.stage<Eigen::Vector3d>("evaluate", positions, evaluate_threads,
+												   [&evaluators](std::size_t thread_index, std::vector<Wgs84>& input, std::vector<Eigen::Vector3d>& output) {
+													   auto& gmag = evaluators[thread_index];
+													   output.reserve(input.size());
+													   for (const auto& position : input) {
+														   output.push_back(gmag(position));
+													   }
+												   });
+
+	auto& records = pipeline.stage<std::string>("encode", fluxes, encode_threads,
+												[](std::size_t, std::vector<Eigen::Vector3d>& input, std::vector<std::string>& output) {
+													char buffer[256];
+													output.reserve(input.size());
+													for (const auto& bf : input) {
+														const MagFluxComponent b{bf};
+														const int n = std::snprintf(buffer, sizeof(buffer), "%.3f %.3f %.3f %.3f %.3f %.6f %.6f\n", b.north, b.east,
+																					b.down, b.total, b.horizontal, b.inclination.degrees(), b.declination.degrees());
+														output.emplace_back(buffer, static_cast<std::size_t>(n));
+													}
+												});
+
+	pipeline.sink("write", records, [&output](std::vector<std::string>& batch) {
+		for (const auto& record : batch) {
+			output.write(record);
+		}
+	});
+
+	const std::string input_backend = input.backend(), output_backend = output.backend();
+	try {
+		pipeline.run();
+		output.close();
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	for (const auto& stats : pipeline.stats()) {
+		std::fprintf(stderr, "%-9s threads %2zu items %10llu busy %8.3f s in-wait %8.3f s out-wait %8.3f s utilization %5.1f %%\n",
+					 stats.name.c_str(), stats.threads, static_cast<unsigned long long>(stats.items), stats.busy_seconds, stats.input_wait_seconds,
+					 stats.output_wait_seconds, stats.utilization() * 100.0);
+	}
+	std::fprintf(stderr, "input: %s, output: %s\n", input_backend.c_str(), output_backend.c_str());
+}
@@ -0,0 +1,174 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ブラウザの代わりにタイルサーバへ要求を送り、タイルごとの待ち時間を測る
+// 1. 表示範囲 (columns x rows枚) を並列の接続で要求する (最初の描画)
+// 2. 先読みを待ってから1枚分東へ移動した範囲を要求する
+// 3. 最初の範囲をもう一度要求する (キャッシュ)
+namespace {
+
+struct Connection {
+	int fd = -1;
+	std::string buffer;
+
+	explicit Connection(int port) {
+		fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(static_cast<std::uint16_t>(port));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			throw std::runtime_error(std::string("connect: ") + std::strerror(errno));
+		}
+		const int enable = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	}
+
+	~Connection() {
+		if (fd >= 0) {
+			::close(fd);
+		}
+	}
+
+	// 応答の本文の大きさを返す (200以外は例外)
+	std::size_t get(const std::string& path) {
+		const std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+		if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+			throw std::runtime_error("send failed");
+		}
+		std::size_t end;
+		while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+			receive();
+		}
+		const std::string header = buffer.substr(0, end);
+		buffer.erase(0, end + 4);
+		const std::size_t length_at = header.find("Content-Length: ");
+		if (header.compare(0, 12, "HTTP/1.1 200") != 0 || length_at == std::string::npos) {
+			throw std::runtime_error(path + ": " + header.substr(0, header.find("\r\n")));
+		}
+		const std::size_t length = std::stoul(header.substr(length_at + 16));
+		while (buffer.size() < length) {
+			receive();
+		}
+		buffer.erase(0, length);
+		return length;
+	}
+
+	void receive() {
+		char chunk[65536];
+		const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+		if (n <= 0) {
+			throw std::runtime_error("connection closed");
+		}
+		buffer.append(chunk, static_cast<std::size_t>(n));
+	}
+};
+
+// 範囲のタイルをconnections本の接続で要求し、タイルごとの要求から応答までの時間[ms]を返す
+std::vector<double> requestView(int port, const std::string& prefix, int z, int x0, int y0, int columns, int rows, std::size_t connections,
+								double& view_ms) {
+	std::vector<std::string> paths;
+	for (int y = y0; y < y0 + rows; y++) {
+		for (int x = x0; x < x0 + columns; x++) {
+			paths.push_back(prefix + "/" + std::to_string(z) + "/" + std::to_string(((x % (1 << z)) + (1 << z)) % (1 << z)) + "/" + std::to_string(y) + ".rgba");
+		}
+	}
+	std::vector<double> latencies(paths.size());
+	std::atomic<std::size_t> next{0};
+	std::mutex error_mutex;
+	std::string error;
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (std::size_t c = 0; c < connections; c++) {
+		threads.emplace_back([&] {
+			try {
+				Connection connection(port);
+				for (std::size_t i = next++; i < paths.size(); i = next++) {
+					const auto sent = std::chrono::steady_clock::now();
+					connection.get(paths[i]);
+					latencies[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count();
+				}
+			} catch (std::exception& e) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				error = e.what();
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+	view_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return latencies;
+}
+
+void report(const char* name, std::vector<double> latencies, double view_ms) {
+	std::sort(latencies.begin(), latencies.end());
+	double sum = 0.0;
+	for (double latency : latencies) {
+		sum += latency;
+	}
+	std::printf("%-12s tiles %3zu  per tile: mean %7.2f ms  median %7.2f ms  max %7.2f ms  view complete %7.2f ms\n", name, latencies.size(),
+				sum / latencies.size(), latencies[latencies.size() / 2], latencies.back(), view_ms);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	int port = 8080, z = 3;
+	std::string layer = "declination", date = "2024-01-01T00:00:00";
+	std::size_t connections = 6; // ブラウザの1ホストあたりの同時接続数
+	if (argc >= 2) {
+		port = std::stoi(argv[1]);
+	}
+	if (argc >= 3) {
+		layer = argv[2];
+	}
+	if (argc >= 4) {
+		date = argv[3];
+	}
+	if (argc >= 5) {
+		z = std::stoi(argv[4]);
+	}
+	if (argc >= 6) {
+		connections = std::max<std::size_t>(std::stoul(argv[5]), 1);
+	}
+	if (argc > 6 || z < 2) {
+		std::cerr << "Usage: " << argv[0] << " [port] [layer] [date] [zoom >= 2] [connections]" << std::endl;
+		return 1;
+	}
+
+	const int columns = 4, rows = 3; // 1024x768の表示範囲
+	const int x0 = (1 << z) / 2 - columns / 2, y0 = (1 << z) / 2 - rows / 2;
+	const std::string prefix = "/" + layer + "/" + date;
+	try {
+		auto view = [&](const char* name, int x) {
+			double view_ms = 0.0;
+			const std::vector<double> latencies = requestView(port, prefix, z, x, y0, columns, rows, connections, view_ms);
+			report(name, latencies, view_ms);
+		};
+		view("first paint", x0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500)); // 先読みを待つ
+		view("pan east", x0 + 1);
+		view("revisit", x0);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,212 @@
+#include <GeoMag/Core.hpp>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace geomag;
+
+// GET /{layer}/{date}/{z}/{x}/{y}.{f32|rgba|ppm}
+//   layer: declination, inclination, total, horizontal, north, east, down
+//   date: ISO8601 (例: 2024-01-01T00:00:00)
+//   f32: float32の値 (角度[deg], 磁束密度[nT])、rgba: 色付けした画素、ppm: 色付けしたPPM画像
+namespace {
+
+constexpr std::size_t max_header_size = 8192; // これを超えるリクエストヘッダには431を返して切断する
+
+bool parseQuantity(const std::string& name, FieldQuantity& quantity) {
+	static const std::pair<const char*, FieldQuantity> names[] = {
+	  {"north", FieldQuantity::North},			 {"east", FieldQuantity::East},				{"down", FieldQuantity::Down},
+	  {"total", FieldQuantity::Total},			 {"horizontal", FieldQuantity::Horizontal}, {"inclination", FieldQuantity::Inclination},
+	  {"declination", FieldQuantity::Declination},
+	};
+	for (const auto& entry : names) {
+		if (name == entry.first) {
+			quantity = entry.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+// 10進の符号なし整数 (std::stoulと違い、空・符号・余計な文字・32bitを超える値を受け付けない)
+bool parseIndex(const std::string& text, std::uint32_t& value) {
+	if (text.empty() || text.size() > 10) {
+		return false;
+	}
+	std::uint64_t v = 0;
+	for (const char c : text) {
+		if (c < '0' || c > '9') {
+			return false;
+		}
+		v = v * 10 + static_cast<std::uint64_t>(c - '0');
+	}
+	if (v > 0xffffffffu) {
+		return false;
+	}
+	value = static_cast<std::uint32_t>(v);
+	return true;
+}
+
+bool sendAll(int fd, const char* data, std::size_t size) {
+	while (size > 0) {
+		const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= static_cast<std::size_t>(n);
+	}
+	return true;
+}
+
+bool respond(int fd, int status, const char* reason, const char* type, const std::string& body, double elapsed_ms, std::size_t tile_size) {
+	char header[512];
+	const int n = std::snprintf(header, sizeof(header),
+								"HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nAccess-Control-Allow-Origin: *\r\n"
+								"X-Tile-Size: %zu\r\nServer-Timing: tile;dur=%.3f\r\n\r\n",
+								status, reason, type, body.size(), tile_size, elapsed_ms);
+	return sendAll(fd, header, static_cast<std::size_t>(n)) && sendAll(fd, body.data(), body.size());
+}
+
+void serve(int fd, TileService& service) {
+	std::string buffer;
+	char chunk[4096];
+	for (;;) {
+		std::size_t end;
+		while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+			if (buffer.size() > max_header_size) {
+				respond(fd, 431, "Request Header Fields Too Large", "text/plain", "request header too large\n", 0.0, 0);
+				::close(fd);
+				return;
+			}
+			const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+			if (n <= 0) {
+				::close(fd);
+				return;
+			}
+			buffer.append(chunk, static_cast<std::size_t>(n));
+		}
+		if (end > max_header_size) {
+			respond(fd, 431, "Request Header Fields Too Large", "text/plain", "request header too large\n", 0.0, 0);
+			::close(fd);
+			return;
+		}
+		const std::string request = buffer.substr(0, end);
+		buffer.erase(0, end + 4);
+
+		const auto start = std::chrono::steady_clock::now();
+		std::istringstream iss(request);
+		std::string method, path;
+		iss >> method >> path;
+		const std::size_t tile_size = service.config().tile_size;
+
+		int status = 200;
+		const char* reason = "OK";
+		const char* type = "application/octet-stream";
+		std::string body;
+		try {
+			std::vector<std::string> parts;
+			std::istringstream segments(path);
+			for (std::string part; std::getline(segments, part, '/');) {
+				if (!part.empty()) {
+					parts.push_back(part);
+				}
+			}
+			FieldQuantity quantity;
+			const std::size_t dot = parts.size() == 5 ? parts[4].find('.') : std::string::npos;
+			if (method != "GET" || dot == std::string::npos || !parseQuantity(parts[0], quantity)) {
+				throw std::invalid_argument("not found");
+			}
+			const std::string format = parts[4].substr(dot + 1);
+			std::uint32_t z, x, y;
+			if (!parseIndex(parts[2], z) || !parseIndex(parts[3], x) || !parseIndex(parts[4].substr(0, dot), y)) {
+				throw std::runtime_error("bad tile index: " + path);
+			}
+			if (parts[1].size() < 10) {
+				throw std::runtime_error("bad date: " + parts[1]);
+			}
+			const TileKey key = service.key(quantity, DateTime(parts[1]), z, x, y);
+			if (format == "f32") {
+				const TileService::Tile tile = service.tile(key);
+				body.assign(reinterpret_cast<const char*>(tile->data()), tile->size() * sizeof(float));
+			} else if (format == "rgba") {
+				const std::vector<std::uint8_t> image = service.rgba(key);
+				body.assign(image.begin(), image.end());
+			} else if (format == "ppm") {
+				const std::vector<std::uint8_t> image = service.rgba(key);
+				body = "P6\n" + std::to_string(tile_size) + " " + std::to_string(tile_size) + "\n255\n";
+				for (std::size_t i = 0; i < image.size(); i += 4) {
+					body.append(reinterpret_cast<const char*>(image.data() + i), 3);
+				}
+				type = "image/x-portable-pixmap";
+			} else {
+				throw std::invalid_argument("not found");
+			}
+		} catch (std::invalid_argument&) {
+			status = 404;
+			reason = "Not Found";
+			type = "text/plain";
+			body = "usage: /{layer}/{date}/{z}/{x}/{y}.{f32|rgba|ppm}\n";
+		} catch (std::exception& e) {
+			status = 400;
+			reason = "Bad Request";
+			type = "text/plain";
+			body = std::string(e.what()) + "\n";
+		}
+		const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (!respond(fd, status, reason, type, body, elapsed, tile_size) || request.find("Connection: close") != std::string::npos) {
+			::close(fd);
+			return;
+		}
+	}
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	int port = 8080;
+	TileServiceConfig config;
+	if (argc >= 2) {
+		port = std::stoi(argv[1]);
+	}
+	if (argc >= 3) {
+		config.num_threads = std::stoul(argv[2]);
+	}
+	if (argc > 3) {
+		std::cerr << "Usage: " << argv[0] << " [port] [prefetch_threads]" << std::endl;
+		return 1;
+	}
+
+	const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+	const int enable = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<std::uint16_t>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 64) != 0) {
+		std::perror("tileserver");
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	TileService service(GeoMagFlux{}, config);
+	std::fprintf(stderr, "listening on http://127.0.0.1:%d/{layer}/{date}/{z}/{x}/{y}.{f32|rgba|ppm}\n", port);
+	for (;;) {
+		const int fd = ::accept(listener, nullptr, nullptr);
+		if (fd < 0) {
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		std::thread([fd, &service] { serve(fd, service); }).detach();
+	}
+}
@@ -13,3 +13,28 @@
 
 #include "src/Essential.hpp"
 #include "src/GeoMagFlux.hpp"
+#include "src/FieldEphemeris.hpp"
+#include "src/SphericalCap.hpp"
+#include "src/FastMath.hpp"
+#include "src/Route.hpp"
+#include "src/Pipeline.hpp"
+#include "src/FileHandle.hpp"
+#include "src/AsyncIo.hpp"
+#include "src/Survey.hpp"
+#include "src/Views.hpp"
+#include "src/Workspace.hpp"
+#include "src/MemoCache.hpp"
+#include "src/MappedFile.hpp"
+#include "src/Geoid.hpp"
+#include "src/ClusterFlux.hpp"
+#include "src/Reduction.hpp"
+#include "src/TiledRaster.hpp"
+#include "src/TileService.hpp"
+#include "src/FieldAligned.hpp"
+#include "src/OrbitEphemeris.hpp"
+#include "src/SpatialOrder.hpp"
+#include "src/AnomalyGrid.hpp"
+#include "src/FieldLine.hpp"
+#include "src/LStar.hpp"
+#include "src/CutoffRigidity.hpp"
+#include "src/Footprint.hpp"
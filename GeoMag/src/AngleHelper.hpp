@@ -16,6 +16,7 @@
 #include <sstream>
 
 #include "Essential.hpp"
+#include "FastMath.hpp"
 
 GEOMAG_NAMESPACE_BEGIN
 
@@ -321,6 +322,40 @@ class Angle {
 	 */
 	auto tan() const -> double { return std::tan(m_angle_radian); }
 
+	/**
+	 * @brief 指定した精度で正弦を返す
+	 *
+	 * @tparam A 精度
+	 * @return double
+	 */
+	template <Accuracy A>
+	auto sin() const -> double {
+		return FastMath::sin<A>(m_angle_radian);
+	}
+
+	/**
+	 * @brief 指定した精度で余弦を返す
+	 *
+	 * @tparam A 精度
+	 * @return double
+	 */
+	template <Accuracy A>
+	auto cos() const -> double {
+		return FastMath::cos<A>(m_angle_radian);
+	}
+
+	/**
+	 * @brief 指定した精度で正弦と余弦を同時に返す
+	 *
+	 * @tparam A 精度
+	 * @param s 正弦
+	 * @param c 余弦
+	 */
+	template <Accuracy A = Accuracy::Exact>
+	auto sincos(double& s, double& c) const -> void {
+		FastMath::sincos<A>(m_angle_radian, s, c);
+	}
+
 	/**
 	 * @brief 正弦を返す
 	 *
@@ -373,6 +408,17 @@ class Angle {
 	 */
 	static auto atan2(const double y, const double x) -> Angle { return Angle(std::atan2(y, x), AngleUnit::Radian); }
 
+	/**
+	 * @brief 指定した精度で逆正接を返す
+	 *
+	 * @tparam A 精度
+	 * @return Angle
+	 */
+	template <Accuracy A>
+	static auto atan2(const double y, const double x) -> Angle {
+		return Angle(FastMath::atan2<A>(y, x), AngleUnit::Radian);
+	}
+
 	/**
 	 * @brief 角度0を返す
 	 *
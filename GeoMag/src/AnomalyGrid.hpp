@@ -0,0 +1,623 @@
+/**
+ * @file AnomalyGrid.hpp
+ * @author Kaiji Takeuchi
+ * @brief 地殻磁気異常の格子 (EMAG2等) と上方接続の近似、主磁場への加算
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "MappedFile.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 異常格子の配置 (格子点は南の行から、各行は西から並ぶ)
+ *
+ */
+struct AnomalyGridGeometry {
+	std::size_t rows = 0;
+	std::size_t cols = 0;
+	double south = 0.0; // 最初の行の緯度 [deg]
+	double west = 0.0;	// 最初の列の経度 [deg]
+	double dlat = 1.0;	// 緯度の間隔 [deg]
+	double dlon = 1.0;	// 経度の間隔 [deg]
+
+	/**
+	 * @brief EMAG2v3の全球2分格子 (セル中心)
+	 *
+	 */
+	static AnomalyGridGeometry emag2() {
+		constexpr double step = 2.0 / 60.0;
+		return AnomalyGridGeometry{5400, 10800, -90.0 + step / 2, -180.0 + step / 2, step, step};
+	}
+};
+
+/**
+ * @brief 異常格子の設定
+ *
+ */
+struct AnomalyGridConfig {
+	double altitude = 0.0;			 // 格子の値の高度 [m] (EMAG2v3のSeaLevelは0、UpContは4000)
+	double continuation_scale = 0.5; // 第k層を上方接続する高さ (第k層の緯度方向のセルの大きさに対する倍率)
+	std::size_t max_levels = 16;	 // 層の数の上限 (元の格子を含む)
+	std::size_t num_threads = 0;	 // 層を作るスレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief 異常格子のバイナリ形式のヘッダ (64 byte)
+ * @remark ヘッダの後に層の表 (AnomalyLevelHeaderが層の数だけ)、その後に各層のfloat32の値 [nT] が64 byte境界から並ぶ。バイト順はホストの順
+ *
+ */
+struct AnomalyGridHeader {
+	static constexpr std::uint32_t current_version = 1;
+
+	static const char* magicString() { return "GMANOM1"; } // 終端の0を含めて8 byte
+
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t levels;
+	double altitude; // 元の格子の値の高度 [m]
+	std::uint64_t reserved[5];
+};
+
+struct AnomalyLevelHeader {
+	std::uint32_t rows;
+	std::uint32_t cols;
+	double south;
+	double west;
+	double dlat;
+	double dlon;
+	double height;		  // 元の格子から上方接続した高さ [m]
+	std::uint64_t offset; // ファイルの先頭からの値の位置 [byte]
+	std::uint64_t reserved;
+};
+
+static_assert(sizeof(AnomalyGridHeader) == 64, "AnomalyGridHeader: unexpected padding");
+static_assert(sizeof(AnomalyLevelHeader) == 64, "AnomalyLevelHeader: unexpected padding");
+
+/**
+ * @brief 全磁力異常の格子と、上方接続した層のピラミッド
+ * @remark 第k層は第k-1層を平滑化して2x2点ずつ平均したもので、元の格子の高度から (continuation_scale x 第k層のセルの大きさ) だけ上方接続した値を持つ。
+ *         上方接続のポアソン核は、波数1/hでの減衰が等しいガウス核 (sigma = sqrt(2) h) で近似する (波長30-1600km・高度400kmまでで振幅の誤差は1割程度)。
+ *         任意の高度では上下の層を双線形補間してから高さ方向に線形補間する。元の格子より低い高度には下方接続せず元の格子の値を使い、
+ *         最上層より高い高度では最上層の高さの2倍で0になるよう線形に弱める。欠測 (NaN) は0として扱う
+ *
+ */
+class AnomalyGrid {
+  public:
+	/**
+	 * @brief バイナリ形式のファイルを割り当てる
+	 *
+	 * @param path ファイルのパス (saveで書き出したもの)
+	 */
+	explicit AnomalyGrid(const std::string& path) : m_file(path, MappedFile::Access::Random) {
+		if (m_file.size() < sizeof(AnomalyGridHeader)) {
+			throw std::runtime_error("AnomalyGrid: " + path + " is too small");
+		}
+		AnomalyGridHeader header;
+		std::memcpy(&header, m_file.data(), sizeof(header));
+		if (std::memcmp(header.magic, AnomalyGridHeader::magicString(), sizeof(header.magic)) != 0) {
+			throw std::runtime_error("AnomalyGrid: " + path + " is not an anomaly grid");
+		}
+		if (header.version != AnomalyGridHeader::current_version || header.levels == 0 ||
+			m_file.size() < sizeof(AnomalyGridHeader) + header.levels * sizeof(AnomalyLevelHeader)) {
+			throw std::runtime_error("AnomalyGrid: unsupported version of " + path);
+		}
+		m_altitude = header.altitude;
+		for (std::uint32_t k = 0; k < header.levels; k++) {
+			AnomalyLevelHeader entry;
+			std::memcpy(&entry, m_file.data() + sizeof(AnomalyGridHeader) + k * sizeof(AnomalyLevelHeader), sizeof(entry));
+			if (entry.offset + std::uint64_t{entry.rows} * entry.cols * sizeof(float) > m_file.size() || entry.offset % alignof(float) != 0) {
+				throw std::runtime_error("AnomalyGrid: level of " + path + " is outside the file");
+			}
+			m_levels.push_back(makeLevel(AnomalyGridGeometry{entry.rows, entry.cols, entry.south, entry.west, entry.dlat, entry.dlon}, entry.height,
+										 reinterpret_cast<const float*>(m_file.data() + entry.offset)));
+		}
+	}
+
+	/**
+	 * @brief 値を与えて層を作る
+	 *
+	 * @param geometry 格子の配置
+	 * @param values 南の行から順に並べた全磁力異常 [nT] (欠測はNaN)
+	 * @param config 設定
+	 */
+	AnomalyGrid(const AnomalyGridGeometry& geometry, std::vector<float> values, const AnomalyGridConfig& config = AnomalyGridConfig{})
+	  : m_altitude(config.altitude) {
+		if (values.size() != geometry.rows * geometry.cols) {
+			throw std::runtime_error("AnomalyGrid: number of values does not match the grid size");
+		}
+		if (!(config.continuation_scale > 0.0) || config.max_levels == 0) {
+			throw std::runtime_error("AnomalyGrid: invalid configuration");
+		}
+		for (auto& v : values) {
+			if (!std::isfinite(v)) {
+				v = 0.0f;
+			}
+		}
+		m_storage.push_back(std::move(values));
+		m_levels.push_back(makeLevel(geometry, 0.0, m_storage.back().data()));
+		buildPyramid(config);
+	}
+
+	/**
+	 * @brief 経度・緯度・値の列を持つテキスト (EMAG2v3のCSVなど) を読み込む
+	 * @remark 区切りはカンマか空白。格子点に当たらない行や数値でない行 (見出し) は読み飛ばす。nodata以上の絶対値は欠測とする
+	 *
+	 * @param is 入力ストリーム
+	 * @param geometry 格子の配置
+	 * @param lon_column 経度の列 (0から数える。EMAG2v3は2)
+	 * @param lat_column 緯度の列 (EMAG2v3は3)
+	 * @param value_column 値の列 (EMAG2v3はSeaLevelが4、UpContが5)
+	 * @param config 設定 (UpContを使う場合はaltitudeを4000にする)
+	 * @param nodata 欠測値 (EMAG2v3は99999)
+	 */
+	static AnomalyGrid readColumns(std::istream& is, const AnomalyGridGeometry& geometry, std::size_t lon_column = 2, std::size_t lat_column = 3,
+								   std::size_t value_column = 4, const AnomalyGridConfig& config = AnomalyGridConfig{}, double nodata = 99999.0) {
+		const std::size_t columns = std::max({lon_column, lat_column, value_column}) + 1;
+		std::vector<float> values(geometry.rows * geometry.cols, std::numeric_limits<float>::quiet_NaN());
+		std::vector<double> fields(columns);
+		std::string line;
+		while (std::getline(is, line)) {
+			const char* p = line.c_str();
+			std::size_t n = 0;
+			while (n < columns) {
+				while (*p == ' ' || *p == '\t' || *p == ',') {
+					p++;
+				}
+				char* end;
+				fields[n] = std::strtod(p, &end);
+				if (end == p) {
+					break;
+				}
+				p = end;
+				n++;
+			}
+			if (n < columns) {
+				continue;
+			}
+			const double row = (fields[lat_column] - geometry.south) / geometry.dlat;
+			double col = (fields[lon_column] - geometry.west) / geometry.dlon;
+			col -= std::floor(col / (360.0 / geometry.dlon)) * (360.0 / geometry.dlon);
+			const long long r = std::llround(row), c = std::llround(col);
+			if (r < 0 || c < 0 || r >= static_cast<long long>(geometry.rows) || c >= static_cast<long long>(geometry.cols) ||
+				std::fabs(row - r) > 1e-3 || std::fabs(col - c) > 1e-3) {
+				continue;
+			}
+			const double value = fields[value_column];
+			values[static_cast<std::size_t>(r) * geometry.cols + static_cast<std::size_t>(c)] =
+			  std::fabs(value) >= nodata ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>(value);
+		}
+		return AnomalyGrid(geometry, std::move(values), config);
+	}
+
+	AnomalyGrid(AnomalyGrid&&) = default;
+	AnomalyGrid& operator=(AnomalyGrid&&) = default;
+
+	/**
+	 * @brief バイナリ形式で書き出す
+	 *
+	 * @param path ファイルのパス
+	 */
+	void save(const std::string& path) const {
+		AnomalyGridHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, AnomalyGridHeader::magicString(), sizeof(header.magic));
+		header.version = AnomalyGridHeader::current_version;
+		header.levels = static_cast<std::uint32_t>(m_levels.size());
+		header.altitude = m_altitude;
+
+		std::vector<AnomalyLevelHeader> entries(m_levels.size());
+		std::uint64_t offset = sizeof(AnomalyGridHeader) + entries.size() * sizeof(AnomalyLevelHeader);
+		for (std::size_t k = 0; k < m_levels.size(); k++) {
+			const Level& level = m_levels[k];
+			offset = (offset + alignment - 1) / alignment * alignment;
+			entries[k] = AnomalyLevelHeader{static_cast<std::uint32_t>(level.rows), static_cast<std::uint32_t>(level.cols), level.south, level.west,
+											level.dlat, level.dlon, level.height, offset, 0};
+			offset += level.rows * level.cols * sizeof(float);
+		}
+
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		ofs.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(AnomalyLevelHeader)));
+		std::uint64_t written = sizeof(AnomalyGridHeader) + entries.size() * sizeof(AnomalyLevelHeader);
+		const char padding[alignment] = {};
+		for (std::size_t k = 0; k < m_levels.size(); k++) {
+			ofs.write(padding, static_cast<std::streamsize>(entries[k].offset - written));
+			const std::size_t bytes = m_levels[k].rows * m_levels[k].cols * sizeof(float);
+			ofs.write(reinterpret_cast<const char*>(m_levels[k].values), static_cast<std::streamsize>(bytes));
+			written = entries[k].offset + bytes;
+		}
+		if (!ofs) {
+			throw std::runtime_error("AnomalyGrid: failed to write " + path);
+		}
+	}
+
+	/**
+	 * @brief 全磁力異常を求める
+	 *
+	 * @param latitude 緯度 [deg]
+	 * @param longitude 経度 [deg]
+	 * @param altitude 高度 [m]
+	 * @return double 全磁力異常 [nT]
+	 */
+	auto anomaly(double latitude, double longitude, double altitude) const -> double {
+		const double height = altitude - m_altitude;
+		if (height <= 0.0 || m_levels.size() == 1) {
+			return m_levels.front().bilinear(latitude, longitude);
+		}
+		const Level& top = m_levels.back();
+		if (height >= top.height) {
+			const double fade = 2.0 - height / top.height;
+			return fade > 0.0 ? fade * top.bilinear(latitude, longitude) : 0.0;
+		}
+		// 層の高さは倍々なので、log2で層を選んでから前後を確かめる
+		std::size_t k = static_cast<std::size_t>(std::max(std::log2(height / m_levels[1].height) + 1.0, 0.0));
+		k = std::min(k, m_levels.size() - 2);
+		while (k > 0 && m_levels[k].height > height) {
+			k--;
+		}
+		while (m_levels[k + 1].height <= height) {
+			k++;
+		}
+		const Level& lower = m_levels[k];
+		const Level& upper = m_levels[k + 1];
+		const double t = (height - lower.height) / (upper.height - lower.height);
+		const double a = lower.bilinear(latitude, longitude);
+		return a + (upper.bilinear(latitude, longitude) - a) * t;
+	}
+
+	auto anomaly(const Wgs84& position) const -> double {
+		return anomaly(position.latitude().degrees(), position.longitude().degrees(), position.altitude());
+	}
+
+	/**
+	 * @brief 全磁力異常をまとめて求める
+	 *
+	 * @param latitudes 緯度の配列 [deg]
+	 * @param longitudes 経度の配列 [deg]
+	 * @param altitudes 高度の配列 [m]
+	 * @param anomalies 全磁力異常を書き込む配列 [nT]
+	 * @param count 要素数
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	void anomalies(const double* latitudes, const double* longitudes, const double* altitudes, double* anomalies, std::size_t count,
+				   std::size_t num_threads = 0) const {
+		Parallel::forEachChunk(
+		  0, count, 4096,
+		  [&](std::size_t, std::size_t begin, std::size_t end) {
+			  for (std::size_t i = begin; i < end; i++) {
+				  anomalies[i] = anomaly(latitudes[i], longitudes[i], altitudes[i]);
+			  }
+		  },
+		  num_threads);
+	}
+
+	std::size_t levels() const { return m_levels.size(); }
+	double altitude() const { return m_altitude; }
+
+	/**
+	 * @brief 層の配置
+	 *
+	 */
+	AnomalyGridGeometry geometry(std::size_t level) const {
+		const Level& l = m_levels.at(level);
+		return AnomalyGridGeometry{l.rows, l.cols, l.south, l.west, l.dlat, l.dlon};
+	}
+
+	/**
+	 * @brief 層を上方接続した高さ [m]
+	 *
+	 */
+	double height(std::size_t level) const { return m_levels.at(level).height; }
+
+	/**
+	 * @brief 格子点の値 [nT]
+	 *
+	 */
+	float value(std::size_t level, std::size_t row, std::size_t col) const {
+		const Level& l = m_levels.at(level);
+		return l.values[row * l.cols + col];
+	}
+
+  private:
+	static constexpr std::size_t alignment = 64;
+	static constexpr double meters_per_degree = 6371.2e3 * constant::pi_180;
+
+	/**
+	 * @brief 1つの層 (GeoidGridと同じ双線形補間)
+	 *
+	 */
+	struct Level {
+		std::size_t rows = 0, cols = 0;
+		double south = 0.0, west = 0.0, dlat = 1.0, dlon = 1.0;
+		double height = 0.0;
+		std::size_t period = 0; // 360度に当たる列数 (全球でなければ0)
+		const float* values = nullptr;
+
+		auto bilinear(double latitude, double longitude) const -> double {
+			const double y = std::min(std::max((latitude - south) / dlat, 0.0), static_cast<double>(rows - 1));
+			const std::size_t row = std::min(static_cast<std::size_t>(y), rows - 2);
+			const double ty = y - static_cast<double>(row);
+			double x = (longitude - west) / dlon;
+			std::size_t col, col1;
+			if (period > 0) {
+				const double p = static_cast<double>(period);
+				x -= std::floor(x / p) * p;
+				col = std::min(static_cast<std::size_t>(x), period - 1);
+				col1 = col + 1 == period ? 0 : col + 1;
+			} else {
+				x = std::min(std::max(x, 0.0), static_cast<double>(cols - 1));
+				col = std::min(static_cast<std::size_t>(x), cols - 2);
+				col1 = col + 1;
+			}
+			const double tx = x - static_cast<double>(col);
+			const float* lower = values + row * cols;
+			const float* upper = lower + cols;
+			const double v0 = lower[col] + (lower[col1] - lower[col]) * tx;
+			const double v1 = upper[col] + (upper[col1] - upper[col]) * tx;
+			return v0 + (v1 - v0) * ty;
+		}
+	};
+
+	MappedFile m_file;
+	std::vector<std::vector<float>> m_storage;
+	std::vector<Level> m_levels;
+	double m_altitude = 0.0;
+
+	static Level makeLevel(const AnomalyGridGeometry& geometry, double height, const float* values) {
+		if (geometry.rows < 2 || geometry.cols < 2 || !(geometry.dlat > 0.0) || !(geometry.dlon > 0.0)) {
+			throw std::runtime_error("AnomalyGrid: grid must have at least 2x2 points and positive spacing");
+		}
+		Level level;
+		level.rows = geometry.rows;
+		level.cols = geometry.cols;
+		level.south = geometry.south;
+		level.west = geometry.west;
+		level.dlat = geometry.dlat;
+		level.dlon = geometry.dlon;
+		level.height = height;
+		level.values = values;
+		const double period = 360.0 / geometry.dlon;
+		const std::size_t columns = static_cast<std::size_t>(std::llround(period));
+		level.period = std::fabs(period - static_cast<double>(columns)) < 1.0e-6 && geometry.cols >= columns ? columns : 0;
+		return level;
+	}
+
+	/**
+	 * @brief 平滑化と間引きを繰り返して層を作る
+	 *
+	 */
+	void buildPyramid(const AnomalyGridConfig& config) {
+		const std::size_t threads = Parallel::threadCount(config.num_threads);
+		double sigma = 0.0; // 元の格子に対する平滑化の大きさ [m]
+		while (m_levels.size() < config.max_levels) {
+			const Level& fine = m_levels.back();
+			if (fine.rows < 4 || fine.cols < 4 || (fine.period > 0 && fine.period % 2 != 0)) {
+				break;
+			}
+			const double height = config.continuation_scale * 2.0 * fine.dlat * meters_per_degree;
+			const double target = std::sqrt(2.0) * height;
+			std::vector<float> smoothed(fine.values, fine.values + fine.rows * fine.cols);
+			blur(fine, smoothed, std::sqrt(target * target - sigma * sigma), threads);
+			sigma = target;
+
+			AnomalyGridGeometry geometry{fine.rows / 2, fine.period > 0 ? fine.period / 2 : fine.cols / 2, fine.south + fine.dlat / 2,
+										 fine.west + fine.dlon / 2, 2 * fine.dlat, 2 * fine.dlon};
+			std::vector<float> coarse(geometry.rows * geometry.cols);
+			for (std::size_t r = 0; r < geometry.rows; r++) {
+				const float* a = smoothed.data() + 2 * r * fine.cols;
+				const float* b = a + fine.cols;
+				float* out = coarse.data() + r * geometry.cols;
+				for (std::size_t c = 0; c < geometry.cols; c++) {
+					out[c] = 0.25f * (a[2 * c] + a[2 * c + 1] + b[2 * c] + b[2 * c + 1]);
+				}
+			}
+			m_storage.push_back(std::move(coarse));
+			m_levels.push_back(makeLevel(geometry, height, m_storage.back().data()));
+		}
+	}
+
+	/**
+	 * @brief ガウス核で平滑化する (緯度方向は端で打ち切り、経度方向は全球なら周期的)
+	 * @remark 経度方向の幅は緯度ごとに1/cos(緯度)で広げる
+	 *
+	 */
+	static void blur(const Level& level, std::vector<float>& values, double sigma, std::size_t threads) {
+		const std::size_t rows = level.rows, cols = level.cols;
+		// 経度方向 (行ごと)
+		Parallel::forEach(
+		  0, rows,
+		  [&](std::size_t, std::size_t r) {
+			  const double latitude = level.south + level.dlat * static_cast<double>(r);
+			  const double cell = level.dlon * meters_per_degree * std::max(std::cos(latitude * constant::pi_180), 1e-6);
+			  const double sigma_cells = sigma / cell;
+			  float* row = values.data() + r * cols;
+			  const std::size_t n = level.period > 0 ? level.period : cols;
+			  if (level.period > 0 && 2.0 * sigma_cells >= static_cast<double>(n)) {
+				  // 核が全周を覆う極付近では行の平均に置き換える
+				  double sum = 0.0;
+				  for (std::size_t c = 0; c < n; c++) {
+					  sum += row[c];
+				  }
+				  std::fill(row, row + cols, static_cast<float>(sum / static_cast<double>(n)));
+				  return;
+			  }
+			  std::vector<float> buffer(n);
+			  blurLine(row, buffer.data(), n, sigma_cells, level.period > 0);
+			  for (std::size_t c = n; c < cols; c++) {
+				  row[c] = row[c % n];
+			  }
+		  },
+		  threads);
+
+		// 緯度方向 (列の塊ごと)
+		const double sigma_cells = sigma / (level.dlat * meters_per_degree);
+		Parallel::forEachChunk(
+		  0, cols, 256,
+		  [&](std::size_t, std::size_t begin, std::size_t end) {
+			  std::vector<float> column(rows), buffer(rows);
+			  for (std::size_t c = begin; c < end; c++) {
+				  for (std::size_t r = 0; r < rows; r++) {
+					  column[r] = values[r * cols + c];
+				  }
+				  blurLine(column.data(), buffer.data(), rows, sigma_cells, false);
+				  for (std::size_t r = 0; r < rows; r++) {
+					  values[r * cols + c] = column[r];
+				  }
+			  }
+		  },
+		  threads);
+	}
+
+	/**
+	 * @brief 1列を標準偏差sigma_cells [セル] のガウス核で平滑化する
+	 * @remark 核が短い場合は直接畳み込み、長い場合 (高緯度の経度方向) は3回の移動平均で近似して1点あたりの演算を定数に抑える
+	 *
+	 * @param line 平滑化する列 (結果で上書きする)
+	 * @param buffer 作業領域 (n要素)
+	 */
+	static void blurLine(float* line, float* buffer, std::size_t n, double sigma_cells, bool periodic) {
+		constexpr std::ptrdiff_t max_kernel_radius = 24;
+		const std::ptrdiff_t size = static_cast<std::ptrdiff_t>(n);
+		const auto at = [&](std::ptrdiff_t i) -> double {
+			if (periodic) {
+				i %= size;
+				i += i < 0 ? size : 0;
+			} else {
+				i = std::min(std::max<std::ptrdiff_t>(i, 0), size - 1);
+			}
+			return line[static_cast<std::size_t>(i)];
+		};
+		if (sigma_cells < 0.1) {
+			return;
+		}
+
+		const std::ptrdiff_t kernel_radius = static_cast<std::ptrdiff_t>(std::ceil(3.0 * sigma_cells));
+		if (kernel_radius <= max_kernel_radius) {
+			double kernel[max_kernel_radius + 1];
+			double total = 0.0;
+			for (std::ptrdiff_t j = 0; j <= kernel_radius; j++) {
+				kernel[j] = std::exp(-0.5 * static_cast<double>(j * j) / (sigma_cells * sigma_cells));
+				total += j == 0 ? kernel[j] : 2.0 * kernel[j];
+			}
+			for (std::ptrdiff_t i = 0; i < size; i++) {
+				double sum = kernel[0] * line[i];
+				for (std::ptrdiff_t j = 1; j <= kernel_radius; j++) {
+					sum += kernel[j] * (at(i - j) + at(i + j));
+				}
+				buffer[i] = static_cast<float>(sum / total);
+			}
+			std::copy(buffer, buffer + n, line);
+			return;
+		}
+
+		// 幅2r+1の移動平均を3回かけた分散は r (r + 1)
+		const std::ptrdiff_t r = std::llround(std::sqrt(sigma_cells * sigma_cells + 0.25) - 0.5);
+		const double scale = 1.0 / static_cast<double>(2 * r + 1);
+		for (int pass = 0; pass < 3; pass++) {
+			double sum = 0.0;
+			for (std::ptrdiff_t i = -r; i <= r; i++) {
+				sum += at(i);
+			}
+			for (std::ptrdiff_t i = 0; i < size; i++) {
+				buffer[i] = static_cast<float>(sum * scale);
+				sum += at(i + r + 1) - at(i - r);
+			}
+			std::copy(buffer, buffer + n, line);
+		}
+	}
+};
+
+/**
+ * @brief 主磁場に地殻磁気異常を加えた評価器
+ * @remark 格子の全磁力異常dFは異常ベクトルの主磁場方向の成分なので、主磁場の単位ベクトルにdFをかけたものを加える。
+ *         格子はスレッド間で共有し、評価器自体はスレッドごとに用意する
+ *
+ */
+class AnomalyGeoMagFlux {
+  public:
+	/**
+	 * @brief Construct a new Anomaly Geo Mag Flux object
+	 *
+	 * @param flux 主磁場の評価器 (出力単位もこれに従う)
+	 * @param grid 異常格子
+	 */
+	AnomalyGeoMagFlux(const GeoMagFlux& flux, std::shared_ptr<const AnomalyGrid> grid) : m_flux(flux), m_grid(std::move(grid)) {
+		if (!m_grid) {
+			throw std::runtime_error("AnomalyGeoMagFlux: grid is null");
+		}
+	}
+
+	/**
+	 * @brief 磁束密度を取得する
+	 *
+	 * @param position WGS84座標系での位置
+	 * @return Eigen::Vector3d 磁束密度 (測地座標系のNED成分)
+	 */
+	Eigen::Vector3d operator()(const Wgs84& position) { return addAnomaly(m_flux(position), m_grid->anomaly(position)); }
+
+	/**
+	 * @brief 磁束密度を取得する
+	 *
+	 * @param position ECEF座標系での位置
+	 * @return Eigen::Vector3d 磁束密度 (地心球座標系のNED成分)
+	 */
+	Eigen::Vector3d operator()(const Ecef& position) { return addAnomaly(m_flux(position), m_grid->anomaly(position.toWgs84())); }
+
+	/**
+	 * @brief 複数の位置での磁束密度をまとめて取得する
+	 *
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& positions, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) const {
+		constexpr std::size_t chunk = 256;
+		mag_densities.resize(positions.size());
+		std::vector<AnomalyGeoMagFlux> evaluators(std::min(Parallel::threadCount(num_threads), positions.size() / chunk + 1), *this);
+		Parallel::forEachChunk(
+		  0, positions.size(), chunk,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  auto& evaluator = evaluators[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  mag_densities[i] = evaluator(positions[i]);
+			  }
+		  },
+		  evaluators.size());
+	}
+
+	const AnomalyGrid& grid() const { return *m_grid; }
+
+  private:
+	GeoMagFlux m_flux;
+	std::shared_ptr<const AnomalyGrid> m_grid;
+
+	Eigen::Vector3d addAnomaly(const Eigen::Vector3d& main, double anomaly) const {
+		const double norm = main.norm();
+		return norm > 0.0 ? Eigen::Vector3d(main * (1.0 + anomaly * m_flux.unitScale() / norm)) : main;
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,851 @@
+/**
+ * @file AsyncIo.hpp
+ * @author Kaiji Takeuchi
+ * @brief 先読み・後書きを行う非同期ファイル入出力 (io_uring / スレッド)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include "Essential.hpp"
+
+#if GEOMAG_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FileHandle.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 非同期入出力の実装
+ *
+ */
+enum class AsyncIoBackend {
+	Auto,	 // io_uringが使えればio_uring、使えなければスレッド
+	IoUring, // io_uring (登録済みバッファ。Linux以外では例外)
+	Threads, // pread/pwriteを行うスレッドプール
+};
+
+/**
+ * @brief 非同期入出力の設定
+ *
+ */
+struct AsyncIoConfig {
+	std::size_t chunk_size = 1 << 20; // 1回の読み書きの大きさ [byte] (ページ境界に切り上げる)
+	std::size_t depth = 4;			  // 同時に発行する読み書きの数
+	std::size_t threads = 2;		  // スレッド実装のスレッド数
+	AsyncIoBackend backend = AsyncIoBackend::Auto;
+};
+
+/**
+ * @brief ページ境界に揃えたバッファ
+ * @remark 1ページ余分に確保して、先頭をページ境界まで進める
+ *
+ */
+class AlignedBuffer {
+  public:
+	static constexpr std::size_t alignment = 4096;
+
+	AlignedBuffer() = default;
+
+	explicit AlignedBuffer(std::size_t size) : m_storage(new char[roundUp(size) + alignment]), m_size(roundUp(size)) {
+		const auto address = reinterpret_cast<std::uintptr_t>(m_storage.get());
+		m_data = m_storage.get() + (alignment - address % alignment) % alignment;
+	}
+
+	char* data() { return m_data; }
+	const char* data() const { return m_data; }
+	std::size_t size() const { return m_size; }
+
+	static auto roundUp(std::size_t size) -> std::size_t { return (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment; }
+
+  private:
+	std::unique_ptr<char[]> m_storage;
+	char* m_data = nullptr; // m_storageの中のページ境界
+	std::size_t m_size = 0;
+};
+
+/**
+ * @brief スロット単位で読み書きを発行・待機する入出力エンジン
+ * @remark スロットiは常にi番目のバッファを使い、同時に1つの要求しか持たない
+ *
+ */
+class AsyncIoEngine {
+  public:
+	virtual ~AsyncIoEngine() = default;
+
+	/**
+	 * @brief 読み書きを発行する
+	 *
+	 * @param slot スロット番号
+	 * @param write trueなら書き込み
+	 * @param size 大きさ [byte]
+	 * @param offset ファイル上の位置 (逐次デバイスでは無視する)
+	 */
+	virtual void submit(std::size_t slot, bool write, std::size_t size, std::int64_t offset) = 0;
+
+	/**
+	 * @brief 完了を待つ
+	 *
+	 * @return std::size_t 読み書きした大きさ (読み込みでsizeより小さければ終端)
+	 */
+	virtual auto wait(std::size_t slot) -> std::size_t = 0;
+
+	virtual auto pending(std::size_t slot) const -> bool = 0;
+	virtual auto name() const -> const char* = 0;
+
+	/**
+	 * @brief 発行済みの要求をすべて待つ (エラーは無視する)
+	 *
+	 */
+	void drain(std::size_t slots) {
+		for (std::size_t slot = 0; slot < slots; slot++) {
+			if (pending(slot)) {
+				try {
+					wait(slot);
+				} catch (std::exception&) {
+				}
+			}
+		}
+	}
+
+  protected:
+	/**
+	 * @brief 1つの要求の状態
+	 *
+	 */
+	struct Request {
+		char* data = nullptr;
+		std::size_t size = 0;
+		std::size_t done = 0;
+		std::int64_t offset = 0;
+		bool write = false;
+		bool pending = false;
+		bool finished = false;
+		int error = 0;
+	};
+
+	static void throwError(const char* name, int error) { throw std::runtime_error(std::string(name) + ": " + std::strerror(error)); }
+};
+
+#if GEOMAG_HAS_IO_URING
+/**
+ * @brief io_uringによる入出力エンジン
+ * @remark liburingを使わずにシステムコールを直接呼ぶ。バッファは登録済みバッファとして固定し、
+ *         登録できない場合 (RLIMIT_MEMLOCKなど) は通常のREAD/WRITEを使う。Linuxでだけ使える
+ *
+ */
+class IoUringEngine : public AsyncIoEngine {
+  public:
+	IoUringEngine(int fd, std::vector<AlignedBuffer>& buffers) : m_fd(fd), m_requests(buffers.size()) {
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		const int ring = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(buffers.size()), &params));
+		if (ring < 0) {
+			throwError("IoUringEngine: io_uring_setup", errno);
+		}
+		m_ring = ring;
+
+		m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap) {
+			m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+		}
+		m_sq_ptr = map(m_sq_size, IORING_OFF_SQ_RING);
+		m_cq_ptr = single_mmap ? m_sq_ptr : map(m_cq_size, IORING_OFF_CQ_RING);
+		m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = static_cast<io_uring_sqe*>(map(m_sqes_size, IORING_OFF_SQES));
+
+		char* sq = static_cast<char*>(m_sq_ptr);
+		m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		char* cq = static_cast<char*>(m_cq_ptr);
+		m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		std::vector<iovec> iov(buffers.size());
+		for (std::size_t i = 0; i < buffers.size(); i++) {
+			iov[i].iov_base = buffers[i].data();
+			iov[i].iov_len = buffers[i].size();
+			m_requests[i].data = buffers[i].data();
+		}
+		m_fixed = syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(iov.size())) == 0;
+	}
+
+	IoUringEngine(const IoUringEngine&) = delete;
+	IoUringEngine& operator=(const IoUringEngine&) = delete;
+
+	~IoUringEngine() override {
+		drain(m_requests.size());
+		unmap();
+	}
+
+	void submit(std::size_t slot, bool write, std::size_t size, std::int64_t offset) override {
+		auto& request = m_requests[slot];
+		request.size = size;
+		request.done = 0;
+		request.offset = offset;
+		request.write = write;
+		request.pending = true;
+		request.finished = false;
+		request.error = 0;
+		if (size == 0) {
+			request.finished = true;
+			return;
+		}
+		push(slot);
+	}
+
+	auto wait(std::size_t slot) -> std::size_t override {
+		auto& request = m_requests[slot];
+		while (!request.finished) {
+			if (!reap()) {
+				if (syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+					throwError("IoUringEngine: io_uring_enter", errno);
+				}
+			}
+		}
+		request.pending = false;
+		if (request.error != 0) {
+			throwError("IoUringEngine", request.error);
+		}
+		return request.done;
+	}
+
+	auto pending(std::size_t slot) const -> bool override { return m_requests[slot].pending; }
+	auto name() const -> const char* override { return m_fixed ? "io_uring (registered buffers)" : "io_uring"; }
+
+  private:
+	int m_fd;
+	int m_ring = -1;
+	bool m_fixed = false;
+	std::vector<Request> m_requests;
+
+	void* m_sq_ptr = MAP_FAILED;
+	void* m_cq_ptr = MAP_FAILED;
+	std::size_t m_sq_size = 0, m_cq_size = 0, m_sqes_size = 0;
+	io_uring_sqe* m_sqes = nullptr;
+	unsigned* m_sq_tail = nullptr;
+	unsigned* m_sq_array = nullptr;
+	unsigned m_sq_mask = 0;
+	unsigned* m_cq_head = nullptr;
+	unsigned* m_cq_tail = nullptr;
+	unsigned m_cq_mask = 0;
+	io_uring_cqe* m_cqes = nullptr;
+
+	auto map(std::size_t size, off_t offset) -> void* {
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, offset);
+		if (ptr == MAP_FAILED) {
+			const int error = errno;
+			unmap();
+			throwError("IoUringEngine: mmap", error);
+		}
+		return ptr;
+	}
+
+	void unmap() {
+		if (m_sqes != nullptr) {
+			munmap(m_sqes, m_sqes_size);
+		}
+		if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) {
+			munmap(m_cq_ptr, m_cq_size);
+		}
+		if (m_sq_ptr != MAP_FAILED) {
+			munmap(m_sq_ptr, m_sq_size);
+		}
+		if (m_ring >= 0) {
+			close(m_ring);
+		}
+	}
+
+	/**
+	 * @brief 要求の残りをSQに積んでカーネルに渡す
+	 *
+	 */
+	void push(std::size_t slot) {
+		const auto& request = m_requests[slot];
+		const unsigned tail = *m_sq_tail; // SQのtailはこのスレッドだけが更新する
+		const unsigned index = tail & m_sq_mask;
+		io_uring_sqe& sqe = m_sqes[index];
+		std::memset(&sqe, 0, sizeof(sqe));
+		if (m_fixed) {
+			sqe.opcode = request.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+			sqe.buf_index = static_cast<std::uint16_t>(slot);
+		} else {
+			sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+		}
+		sqe.fd = m_fd;
+		sqe.off = static_cast<std::uint64_t>(request.offset) + request.done;
+		sqe.addr = reinterpret_cast<std::uint64_t>(request.data + request.done);
+		sqe.len = static_cast<std::uint32_t>(request.size - request.done);
+		sqe.user_data = slot;
+		m_sq_array[index] = index;
+		__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+		while (syscall(__NR_io_uring_enter, m_ring, 1, 0, 0, nullptr, 0) < 0) {
+			if (errno != EINTR && errno != EAGAIN) {
+				throwError("IoUringEngine: io_uring_enter", errno);
+			}
+		}
+	}
+
+	/**
+	 * @brief CQから完了を取り出す。読み書きが途中で終わった要求は残りを再発行する
+	 *
+	 * @return bool 1つ以上取り出したか
+	 */
+	auto reap() -> bool {
+		unsigned head = *m_cq_head;
+		const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			return false;
+		}
+
+		std::vector<std::size_t> resubmit;
+		for (; head != tail; head++) {
+			const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+			auto& request = m_requests[cqe.user_data];
+			if (cqe.res < 0) {
+				if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+					resubmit.push_back(cqe.user_data);
+				} else {
+					request.error = -cqe.res;
+					request.finished = true;
+				}
+			} else {
+				request.done += static_cast<std::size_t>(cqe.res);
+				if (cqe.res == 0 || request.done == request.size) {
+					request.finished = true;
+				} else {
+					resubmit.push_back(cqe.user_data);
+				}
+			}
+		}
+		__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+
+		for (auto slot : resubmit) {
+			push(slot);
+		}
+		return true;
+	}
+};
+#endif
+
+/**
+ * @brief スレッドプールによる入出力エンジン
+ * @remark io_uringが使えない環境 (Linux以外を含む) や、パイプなどの逐次デバイスに使う。逐次デバイスでは
+ *         要求を発行順に1スレッドで処理する
+ *
+ */
+class ThreadIoEngine : public AsyncIoEngine {
+  public:
+	ThreadIoEngine(const FileHandle& file, std::vector<AlignedBuffer>& buffers, std::size_t threads, bool seekable)
+		: m_file(file), m_seekable(seekable), m_requests(buffers.size()) {
+		for (std::size_t i = 0; i < buffers.size(); i++) {
+			m_requests[i].data = buffers[i].data();
+		}
+		threads = seekable ? std::max<std::size_t>(std::min(threads, buffers.size()), 1) : 1;
+		for (std::size_t i = 0; i < threads; i++) {
+			m_threads.emplace_back([this] { work(); });
+		}
+	}
+
+	ThreadIoEngine(const ThreadIoEngine&) = delete;
+	ThreadIoEngine& operator=(const ThreadIoEngine&) = delete;
+
+	~ThreadIoEngine() override {
+		drain(m_requests.size());
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_submitted.notify_all();
+		for (auto& thread : m_threads) {
+			thread.join();
+		}
+	}
+
+	void submit(std::size_t slot, bool write, std::size_t size, std::int64_t offset) override {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto& request = m_requests[slot];
+			request.size = size;
+			request.done = 0;
+			request.offset = offset;
+			request.write = write;
+			request.pending = true;
+			request.finished = false;
+			request.error = 0;
+			m_queue.push_back(slot);
+		}
+		m_submitted.notify_one();
+	}
+
+	auto wait(std::size_t slot) -> std::size_t override {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto& request = m_requests[slot];
+		m_completed.wait(lock, [&request] { return request.finished; });
+		request.pending = false;
+		if (request.error != 0) {
+			throwError("ThreadIoEngine", request.error);
+		}
+		return request.done;
+	}
+
+	auto pending(std::size_t slot) const -> bool override { return m_requests[slot].pending; }
+	auto name() const -> const char* override { return "threads"; }
+
+  private:
+	const FileHandle& m_file;
+	bool m_seekable;
+	std::vector<Request> m_requests;
+	std::vector<std::thread> m_threads;
+	std::deque<std::size_t> m_queue;
+	std::mutex m_mutex;
+	std::condition_variable m_submitted;
+	std::condition_variable m_completed;
+	bool m_stop = false;
+
+	void work() {
+		for (;;) {
+			std::size_t slot;
+			Request request;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_submitted.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+				if (m_queue.empty()) {
+					return;
+				}
+				slot = m_queue.front();
+				m_queue.pop_front();
+				request = m_requests[slot];
+			}
+
+			// 要求した大きさに達するか終端に着くまで読み書きを繰り返す
+			while (request.done < request.size) {
+				char* data = request.data + request.done;
+				const std::size_t size = request.size - request.done;
+				const std::int64_t offset = request.offset + static_cast<std::int64_t>(request.done);
+				std::ptrdiff_t n;
+				if (request.write) {
+					n = m_seekable ? m_file.writeAt(data, size, offset) : m_file.write(data, size);
+				} else {
+					n = m_seekable ? m_file.readAt(data, size, offset) : m_file.read(data, size);
+				}
+				if (n < 0) {
+					if (errno == EINTR || errno == EAGAIN) {
+						continue;
+					}
+					request.error = errno;
+					break;
+				}
+				if (n == 0) {
+					break;
+				}
+				request.done += static_cast<std::size_t>(n);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_requests[slot].done = request.done;
+				m_requests[slot].error = request.error;
+				m_requests[slot].finished = true;
+			}
+			m_completed.notify_all();
+		}
+	}
+};
+
+/**
+ * @brief 入出力エンジンを選ぶ
+ *
+ */
+struct AsyncIoHelper {
+	static auto createEngine(const FileHandle& file, bool seekable, std::vector<AlignedBuffer>& buffers, const AsyncIoConfig& config)
+		-> std::unique_ptr<AsyncIoEngine> {
+		if (config.backend == AsyncIoBackend::IoUring && !seekable) {
+			throw std::runtime_error("AsyncIoHelper: io_uring backend requires a regular file");
+		}
+#if GEOMAG_HAS_IO_URING
+		if (config.backend != AsyncIoBackend::Threads && seekable) {
+			try {
+				return std::unique_ptr<AsyncIoEngine>(new IoUringEngine(file.fd(), buffers));
+			} catch (std::runtime_error&) {
+				if (config.backend == AsyncIoBackend::IoUring) {
+					throw;
+				}
+			}
+		}
+#else
+		if (config.backend == AsyncIoBackend::IoUring) {
+			throw std::runtime_error("AsyncIoHelper: io_uring backend is not available on this platform");
+		}
+#endif
+		return std::unique_ptr<AsyncIoEngine>(new ThreadIoEngine(file, buffers, config.threads, seekable));
+	}
+
+	static auto createBuffers(const AsyncIoConfig& config) -> std::vector<AlignedBuffer> {
+		std::vector<AlignedBuffer> buffers;
+		const std::size_t depth = std::max<std::size_t>(config.depth, 1);
+		for (std::size_t i = 0; i < depth; i++) {
+			buffers.emplace_back(config.chunk_size);
+		}
+		return buffers;
+	}
+};
+
+/**
+ * @brief 先読みするファイル読み込み
+ * @remark depth個のチャンクを常に読み込み中にしておき、読み終えたチャンクをコピーせずに渡す
+ *
+ */
+class AsyncFileReader {
+  public:
+	/**
+	 * @brief ファイルを開いて読み込む
+	 *
+	 */
+	explicit AsyncFileReader(const std::string& path, const AsyncIoConfig& config = AsyncIoConfig{})
+		: AsyncFileReader(FileHandle(path, FileHandle::Mode::Read, "AsyncFileReader"), true, config) {}
+
+#if GEOMAG_HAS_POSIX
+	/**
+	 * @brief 開いているファイル記述子 (標準入力など) の現在位置から読み込む
+	 * @remark ファイル記述子は閉じない
+	 *
+	 */
+	explicit AsyncFileReader(int fd, const AsyncIoConfig& config = AsyncIoConfig{}) : AsyncFileReader(FileHandle(fd), false, config) {}
+#endif
+
+	AsyncFileReader(const AsyncFileReader&) = delete;
+	AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+	~AsyncFileReader() {
+		m_engine.reset();
+		if (m_seekable && !m_owns_file) {
+			m_file.seek(m_consumed); // 渡したところまで読んだことにする
+		}
+	}
+
+	/**
+	 * @brief 次のチャンクを受け取る
+	 *
+	 * @param data チャンクの先頭 (次に呼ぶまで有効)
+	 * @param size チャンクの大きさ
+	 * @return bool 終端に達していればfalse
+	 */
+	auto next(const char*& data, std::size_t& size) -> bool {
+		if (m_released) {
+			// 前回渡したバッファを次の読み込みに回す
+			m_released = false;
+			const std::size_t previous = (m_current + m_buffers.size() - 1) % m_buffers.size();
+			if (!m_eof) {
+				issue(previous);
+			}
+		}
+		if (m_eof && !m_engine->pending(m_current)) {
+			return false;
+		}
+
+		const std::size_t n = m_engine->wait(m_current);
+		if (n < m_buffers[m_current].size()) {
+			m_eof = true;
+		}
+		if (n == 0) {
+			return false;
+		}
+		data = m_buffers[m_current].data();
+		size = n;
+		m_consumed += static_cast<std::int64_t>(n);
+		m_current = (m_current + 1) % m_buffers.size();
+		m_released = true;
+		return true;
+	}
+
+	auto backend() const -> const char* { return m_engine->name(); }
+	auto chunkSize() const -> std::size_t { return m_buffers.front().size(); }
+
+  private:
+	FileHandle m_file;
+	bool m_owns_file;
+	bool m_seekable;
+	std::vector<AlignedBuffer> m_buffers;
+	std::unique_ptr<AsyncIoEngine> m_engine;
+	std::int64_t m_offset = 0;	 // 次に発行する読み込みの位置
+	std::int64_t m_consumed = 0; // 渡し終えた位置
+	std::size_t m_current = 0;
+	bool m_released = false;
+	bool m_eof = false;
+
+	AsyncFileReader(FileHandle&& file, bool owns_file, const AsyncIoConfig& config)
+		: m_file(std::move(file)), m_owns_file(owns_file), m_seekable(m_file.seekable()), m_buffers(AsyncIoHelper::createBuffers(config)) {
+		m_engine = AsyncIoHelper::createEngine(m_file, m_seekable, m_buffers, config);
+		if (m_seekable) {
+			m_offset = m_consumed = m_file.position();
+			m_file.adviseSequential();
+		}
+		for (std::size_t slot = 0; slot < m_buffers.size(); slot++) {
+			issue(slot);
+		}
+	}
+
+	void issue(std::size_t slot) {
+		m_engine->submit(slot, false, m_buffers[slot].size(), m_offset);
+		m_offset += static_cast<std::int64_t>(m_buffers[slot].size());
+	}
+};
+
+/**
+ * @brief 後書きするファイル書き込み
+ * @remark 書き込みはチャンク単位でまとめて発行し、depth個まで完了を待たずに進む
+ *
+ */
+class AsyncFileWriter {
+  public:
+	/**
+	 * @brief ファイルを作成して書き込む
+	 *
+	 */
+	explicit AsyncFileWriter(const std::string& path, const AsyncIoConfig& config = AsyncIoConfig{})
+		: AsyncFileWriter(FileHandle(path, FileHandle::Mode::Write, "AsyncFileWriter"), true, config) {}
+
+#if GEOMAG_HAS_POSIX
+	/**
+	 * @brief 開いているファイル記述子 (標準出力など) の現在位置から書き込む
+	 * @remark ファイル記述子は閉じない
+	 *
+	 */
+	explicit AsyncFileWriter(int fd, const AsyncIoConfig& config = AsyncIoConfig{}) : AsyncFileWriter(FileHandle(fd), false, config) {}
+#endif
+
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	~AsyncFileWriter() {
+		try {
+			close();
+		} catch (std::exception&) {
+		}
+	}
+
+	/**
+	 * @brief 書き込むデータを追加する
+	 *
+	 */
+	void write(const char* data, std::size_t size) {
+		while (size > 0) {
+			const std::size_t n = std::min(size, m_buffers[m_current].size() - m_fill);
+			std::memcpy(m_buffers[m_current].data() + m_fill, data, n);
+			m_fill += n;
+			data += n;
+			size -= n;
+			if (m_fill == m_buffers[m_current].size()) {
+				flush();
+			}
+		}
+	}
+
+	void write(const std::string& data) { write(data.data(), data.size()); }
+
+	/**
+	 * @brief バッファに直接書き込む領域を確保する
+	 * @remark 書き込んだ後にcommitを呼ぶ
+	 *
+	 * @param size 必要な大きさ (chunkSize以下)
+	 * @return char* 書き込む位置
+	 */
+	auto reserve(std::size_t size) -> char* {
+		if (size > m_buffers[m_current].size()) {
+			throw std::runtime_error("AsyncFileWriter: reserve size exceeds chunk size");
+		}
+		if (m_buffers[m_current].size() - m_fill < size) {
+			flush();
+		}
+		return m_buffers[m_current].data() + m_fill;
+	}
+
+	void commit(std::size_t size) {
+		m_fill += size;
+		if (m_fill == m_buffers[m_current].size()) {
+			flush();
+		}
+	}
+
+	/**
+	 * @brief 残りを書き込み、すべての完了を待つ
+	 *
+	 */
+	void close() {
+		if (!m_engine) {
+			return;
+		}
+		try {
+			if (m_fill > 0) {
+				flush();
+			}
+			for (std::size_t slot = 0; slot < m_buffers.size(); slot++) {
+				if (m_engine->pending(slot)) {
+					complete(slot);
+				}
+			}
+		} catch (...) {
+			release();
+			throw;
+		}
+		release();
+	}
+
+	auto backend() const -> const char* { return m_engine ? m_engine->name() : "closed"; }
+	auto chunkSize() const -> std::size_t { return m_buffers.front().size(); }
+
+  private:
+	FileHandle m_file;
+	bool m_owns_file;
+	bool m_seekable;
+	std::vector<AlignedBuffer> m_buffers;
+	std::vector<std::size_t> m_sizes;
+	std::unique_ptr<AsyncIoEngine> m_engine;
+	std::int64_t m_offset = 0;
+	std::size_t m_current = 0;
+	std::size_t m_fill = 0;
+
+	AsyncFileWriter(FileHandle&& file, bool owns_file, const AsyncIoConfig& config)
+		: m_file(std::move(file)), m_owns_file(owns_file), m_seekable(m_file.seekable()), m_buffers(AsyncIoHelper::createBuffers(config)),
+		  m_sizes(m_buffers.size(), 0) {
+		m_engine = AsyncIoHelper::createEngine(m_file, m_seekable, m_buffers, config);
+		if (m_seekable) {
+			m_offset = m_file.position();
+		}
+	}
+
+	/**
+	 * @brief 現在のバッファの書き込みを発行し、次のバッファが空くのを待つ
+	 *
+	 */
+	void flush() {
+		m_engine->submit(m_current, true, m_fill, m_offset);
+		m_sizes[m_current] = m_fill;
+		m_offset += static_cast<std::int64_t>(m_fill);
+		m_current = (m_current + 1) % m_buffers.size();
+		m_fill = 0;
+		if (m_engine->pending(m_current)) {
+			complete(m_current);
+		}
+	}
+
+	void complete(std::size_t slot) {
+		if (m_engine->wait(slot) != m_sizes[slot]) {
+			throw std::runtime_error("AsyncFileWriter: short write");
+		}
+	}
+
+	void release() {
+		m_engine.reset();
+		if (m_seekable && !m_owns_file) {
+			m_file.seek(m_offset);
+		}
+		m_file.close();
+	}
+};
+
+/**
+ * @brief 非同期読み込みしたチャンクを行に分割する
+ * @remark チャンク内に収まる行はバッファを直接指し、チャンクをまたぐ行だけをコピーする
+ *
+ */
+class AsyncLineReader {
+  public:
+	explicit AsyncLineReader(const std::string& path, const AsyncIoConfig& config = AsyncIoConfig{}) : m_reader(path, config) {}
+#if GEOMAG_HAS_POSIX
+	explicit AsyncLineReader(int fd, const AsyncIoConfig& config = AsyncIoConfig{}) : m_reader(fd, config) {}
+#endif
+
+	/**
+	 * @brief 次の行を受け取る
+	 *
+	 * @param line 行の先頭 (改行を含まない。次に呼ぶまで有効)
+	 * @param length 行の長さ
+	 * @return bool 終端に達していればfalse
+	 */
+	auto next(const char*& line, std::size_t& length) -> bool {
+		for (;;) {
+			if (m_begin != m_end) {
+				const char* newline = static_cast<const char*>(std::memchr(m_begin, '\n', static_cast<std::size_t>(m_end - m_begin)));
+				if (newline != nullptr) {
+					if (m_carry.empty()) {
+						line = m_begin;
+						length = static_cast<std::size_t>(newline - m_begin);
+					} else {
+						m_carry.append(m_begin, newline);
+						m_line.swap(m_carry);
+						m_carry.clear();
+						line = m_line.data();
+						length = m_line.size();
+					}
+					m_begin = newline + 1;
+					trimCarriageReturn(line, length);
+					return true;
+				}
+				m_carry.append(m_begin, m_end); // チャンクをまたぐ行
+			}
+
+			std::size_t size;
+			if (!m_reader.next(m_begin, size)) {
+				m_begin = m_end = nullptr;
+				if (m_carry.empty()) {
+					return false;
+				}
+				m_line.swap(m_carry);
+				m_carry.clear();
+				line = m_line.data();
+				length = m_line.size();
+				trimCarriageReturn(line, length);
+				return true;
+			}
+			m_end = m_begin + size;
+		}
+	}
+
+	auto backend() const -> const char* { return m_reader.backend(); }
+
+  private:
+	AsyncFileReader m_reader;
+	const char* m_begin = nullptr;
+	const char* m_end = nullptr;
+	std::string m_carry;
+	std::string m_line;
+
+	static void trimCarriageReturn(const char* line, std::size_t& length) {
+		if (length > 0 && line[length - 1] == '\r') {
+			length--;
+		}
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,314 @@
+/**
+ * @file ClusterFlux.hpp
+ * @author Kaiji Takeuchi
+ * @brief 密集した点群の磁場を重心でのテイラー展開で求める評価器
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief テイラー展開の設定
+ *
+ */
+struct ClusterConfig {
+	double tolerance = 1.0;	  // 許容する誤差の上限 [出力単位]
+	double step = 200.0;	  // 微分を求める差分の刻み [m]
+	double max_radius = 20e3; // 展開を使う重心からの最大距離 [m]
+	bool hessian = true;	  // 2次の項まで展開する (falseの場合は1次まで)
+};
+
+/**
+ * @brief 直前の評価の内訳
+ *
+ */
+struct ClusterStats {
+	std::size_t expanded = 0; // 展開で求めた点の数
+	std::size_t fallback = 0; // モデルで評価し直した点の数
+	double radius = 0.0;	  // 誤差が許容値に収まる重心からの距離 [m]
+};
+
+/**
+ * @brief 重心でのテイラー展開で点群の磁場を求める評価器
+ * @remark 重心で磁場・勾配・ヘッセ行列 (ECEF成分) をモデルから1回だけ求め、各点は2次のテイラー展開で求める。
+ *         誤差の上限は、各次数の磁場の大きさを係数から上から抑え、調和関数の微分の評価 |D^k u| <= (3k/ρ)^k sup|u| を使って
+ *         剰余項と差分の誤差を抑えたもの。上限が許容値を超える距離の点はモデルで評価する
+ *
+ */
+class ClusterGeoMagFlux {
+  public:
+	static constexpr double reference_radius = 6371.2e3; // IGRFの基準半径 [m]
+	static constexpr double rounding = 1e-12;			 // モデルの評価の丸め誤差として見込む相対誤差
+
+	/**
+	 * @brief Construct a new Cluster Geo Mag Flux object
+	 *
+	 * @param flux 評価器 (展開できない点はこれと同じ設定で評価する)
+	 * @param config 設定
+	 */
+	explicit ClusterGeoMagFlux(const GeoMagFlux& flux, const ClusterConfig& config = ClusterConfig{}) : m_flux(flux), m_config(config) {
+		if (!(config.tolerance > 0.0) || !(config.step > 0.0) || !(config.max_radius > 0.0)) {
+			throw std::runtime_error("ClusterGeoMagFlux: tolerance, step and max_radius must be positive");
+		}
+	}
+
+	/**
+	 * @brief 展開の中心を決めて、磁場とその微分を求める
+	 * @remark 1次までなら7回、2次までなら11回モデルを評価する
+	 *
+	 * @param center 展開の中心
+	 */
+	void expandAt(const Ecef& center) {
+		const Accuracy accuracy = m_flux.accuracy();
+		m_flux.setAccuracy(Accuracy::Exact); // 差分をとるので近似しない
+		const DateTime& epoch = center.epoch();
+		const Eigen::Vector3d& c = center.elements();
+		const double h = m_config.step;
+		auto field = [&](const Eigen::Vector3d& offset) { return m_flux.ecefFlux(Ecef(epoch, c + offset)); };
+
+		m_center = center;
+		m_field = field(Eigen::Vector3d::Zero());
+		std::array<Eigen::Vector3d, 3> plus, minus;
+		for (int k = 0; k < 3; k++) {
+			plus[k] = field(h * Eigen::Vector3d::Unit(k));
+			minus[k] = field(-h * Eigen::Vector3d::Unit(k));
+			m_gradient.col(k) = (plus[k] - minus[k]) / (2.0 * h);
+		}
+		// 磁場はポテンシャルの勾配なので、勾配テンソルは対称でトレースが0になる (この射影で誤差は増えない)
+		m_gradient = (m_gradient + m_gradient.transpose()).eval() / 2.0;
+		m_gradient -= Eigen::Matrix3d::Identity() * (m_gradient.trace() / 3.0);
+
+		if (m_config.hessian) {
+			// ヘッセ行列 T_ijk = ∂²B_i/∂x_j∂x_k も添字について完全対称なので、独立な10成分のうち
+			// 9成分 (T_ikk) は軸方向の2階差分から、残りのT_xyzは斜め方向の4点から求める
+			double t[3][3][3];
+			auto set = [&t](int i, int j, int k, double value) {
+				t[i][j][k] = t[i][k][j] = t[j][i][k] = t[j][k][i] = t[k][i][j] = t[k][j][i] = value;
+			};
+			for (int k = 0; k < 3; k++) {
+				const Eigen::Vector3d second = (plus[k] - 2.0 * m_field + minus[k]) / (h * h);
+				for (int i = 0; i < 3; i++) {
+					set(i, k, k, second(i));
+				}
+			}
+			const Eigen::Vector3d pp = field(Eigen::Vector3d{0.0, h, h}), pm = field(Eigen::Vector3d{0.0, h, -h});
+			const Eigen::Vector3d mp = field(Eigen::Vector3d{0.0, -h, h}), mm = field(Eigen::Vector3d{0.0, -h, -h});
+			set(0, 1, 2, (pp.x() - pm.x() - mp.x() + mm.x()) / (4.0 * h * h));
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					for (int k = 0; k < 3; k++) {
+						m_hessian[i](j, k) = t[i][j][k];
+					}
+				}
+			}
+		} else {
+			for (auto& hessian : m_hessian) {
+				hessian.setZero();
+			}
+		}
+		m_flux.setAccuracy(accuracy);
+
+		// 誤差の上限の係数
+		const double r = c.norm();
+		const double epsilon = rounding * m_field.norm();
+		const double m3_step = derivativeBound(3, r - 2.0 * h, epoch);
+		m_gradient_error = 3.0 * (h * h / 6.0 * m3_step + epsilon / h); // ||ΔG||_F
+		m_constant_error = epsilon;
+		if (m_config.hessian) {
+			const double m4_step = derivativeBound(4, r - 2.0 * h, epoch);
+			m_hessian_error = 1.5 * std::sqrt(3.0) * (h * h / 3.0 * m4_step + 4.0 * epsilon / (h * h)); // |ΔT(δ,δ)|/2 / |δ|²
+			m_remainder = derivativeBound(3, r - m_config.max_radius, epoch) / 6.0;
+		} else {
+			m_hessian_error = 0.0;
+			m_remainder = derivativeBound(2, r - m_config.max_radius, epoch) / 2.0;
+		}
+
+		// 誤差の上限が許容値に収まる距離
+		if (errorBound(m_config.max_radius) <= m_config.tolerance) {
+			m_radius = m_config.max_radius;
+		} else if (errorBound(0.0) > m_config.tolerance) {
+			m_radius = 0.0;
+		} else {
+			double low = 0.0, high = m_config.max_radius;
+			for (int i = 0; i < 60; i++) {
+				const double mid = (low + high) / 2.0;
+				(errorBound(mid) <= m_config.tolerance ? low : high) = mid;
+			}
+			m_radius = low;
+		}
+		m_stats.radius = m_radius;
+		m_expanded = true;
+	}
+
+	/**
+	 * @brief 展開から磁束密度を求める
+	 *
+	 * @param position ECEF座標系での位置 [m]
+	 * @return Eigen::Vector3d 磁束密度 (ECEF成分)
+	 */
+	auto expand(const Eigen::Vector3d& position) const -> Eigen::Vector3d {
+		const Eigen::Vector3d d = position - m_center.elements();
+		Eigen::Vector3d b = m_field + m_gradient * d;
+		if (m_config.hessian) {
+			b += 0.5 * Eigen::Vector3d{d.dot(m_hessian[0] * d), d.dot(m_hessian[1] * d), d.dot(m_hessian[2] * d)};
+		}
+		return b;
+	}
+
+	/**
+	 * @brief 重心から距離distanceの点での展開の誤差の上限
+	 *
+	 * @param distance 距離 [m] (max_radius以下)
+	 * @return double 誤差の上限 [出力単位]
+	 */
+	auto errorBound(double distance) const -> double {
+		const double d = distance;
+		return m_constant_error + m_gradient_error * d + (m_hessian_error + m_remainder * d) * d * d;
+	}
+
+	/**
+	 * @brief 点群の磁束密度を求める
+	 * @remark 点群のECEFでの重心で展開し直す。重心から validRadius() より遠い点と、重心と時刻が違う点はモデルで評価する
+	 *
+	 * @tparam Position 位置の型 (EcefまたはWgs84)
+	 * @param particles 点群 (時刻は先頭の点のものを使う)
+	 * @param mag_densities 磁束密度 (GeoMagFluxと同じくEcefなら地心球座標系、Wgs84なら測地座標系のNED成分)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& particles, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) {
+		constexpr std::size_t chunk = 1024;
+		const std::size_t size = particles.size();
+		mag_densities.resize(size);
+		m_stats = ClusterStats{};
+		if (size == 0) {
+			return;
+		}
+
+		const std::size_t threads = std::min(Parallel::threadCount(num_threads), size / chunk + 1);
+		while (m_evaluators.size() < threads) {
+			m_evaluators.push_back(m_flux);
+		}
+		m_fallbacks.assign(threads, 0);
+
+		m_positions.resize(size);
+		Parallel::forEachChunk(
+		  0, size, chunk,
+		  [&](std::size_t, std::size_t begin, std::size_t end) {
+			  for (std::size_t i = begin; i < end; i++) {
+				  m_positions[i] = particles[i].toEcef().elements();
+			  }
+		  },
+		  threads);
+		Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+		for (const auto& position : m_positions) {
+			centroid += position;
+		}
+		expandAt(Ecef(particles.front().epoch(), centroid / static_cast<double>(size)));
+
+		const double radius2 = m_radius * m_radius;
+		Parallel::forEachChunk(
+		  0, size, chunk,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  for (std::size_t i = begin; i < end; i++) {
+				  if ((m_positions[i] - m_center.elements()).squaredNorm() <= radius2 && particles[i].epoch() == m_center.epoch()) {
+					  mag_densities[i] = toNed(particles[i], m_positions[i], expand(m_positions[i]));
+				  } else {
+					  mag_densities[i] = m_evaluators[thread_index](particles[i]);
+					  m_fallbacks[thread_index]++;
+				  }
+			  }
+		  },
+		  threads);
+
+		for (std::size_t fallback : m_fallbacks) {
+			m_stats.fallback += fallback;
+		}
+		m_stats.expanded = size - m_stats.fallback;
+	}
+
+	bool expanded() const { return m_expanded; }
+	const Ecef& center() const { return m_center; }
+	const Eigen::Vector3d& field() const { return m_field; }			   // 重心での磁束密度 (ECEF成分)
+	const Eigen::Matrix3d& gradient() const { return m_gradient; }		   // ∂B_i/∂x_j [出力単位/m]
+	const Eigen::Matrix3d& hessian(std::size_t i) const { return m_hessian[i]; } // ∂²B_i/∂x_j∂x_k [出力単位/m²]
+	double validRadius() const { return m_radius; }
+	const ClusterStats& stats() const { return m_stats; }
+	const ClusterConfig& config() const { return m_config; }
+
+  private:
+	GeoMagFlux m_flux;
+	ClusterConfig m_config;
+	bool m_expanded = false;
+	Ecef m_center;
+	Eigen::Vector3d m_field = Eigen::Vector3d::Zero();
+	Eigen::Matrix3d m_gradient = Eigen::Matrix3d::Zero();
+	std::array<Eigen::Matrix3d, 3> m_hessian;
+	double m_constant_error = 0.0; // 重心での値の誤差
+	double m_gradient_error = 0.0; // 勾配の誤差による項の係数 (距離の1乗)
+	double m_hessian_error = 0.0;  // ヘッセ行列の誤差による項の係数 (距離の2乗)
+	double m_remainder = 0.0;	   // 剰余項の係数 (2次なら距離の3乗、1次なら2乗)
+	double m_radius = 0.0;
+	ClusterStats m_stats;
+	std::vector<Eigen::Vector3d> m_positions;
+	std::vector<GeoMagFlux> m_evaluators;
+	std::vector<std::size_t> m_fallbacks;
+
+	/**
+	 * @brief 地心距離r以上の点での磁束密度の任意方向のk階微分の上限
+	 * @remark 次数nの項は |B_n| <= (a/r)^(n+2) S_n sqrt((n+1)(2n+1)) (S_nはその次数の係数の二乗和の平方根) で抑えられる。
+	 *         半径ρの球で微分の評価を使い、ρは次数ごとに k r / (n + k + 2) とする
+	 *
+	 * @param k 微分の階数
+	 * @param r 地心距離 [m]
+	 * @param epoch 時刻
+	 * @return double 上限 [出力単位/m^k]
+	 */
+	auto derivativeBound(int k, double r, const DateTime& epoch) -> double {
+		if (!(r > 0.0)) {
+			return std::numeric_limits<double>::infinity();
+		}
+		const Model& model = m_flux.model(epoch);
+		double bound = 0.0;
+		for (std::size_t n = 1; n <= Model::max_degree; n++) {
+			double power = 0.0;
+			for (std::size_t i = n * n - 1; i < (n + 1) * (n + 1) - 1; i++) {
+				power += model.coefficients[i] * model.coefficients[i];
+			}
+			const double rho = k * r / (n + k + 2.0);
+			bound += std::pow(3.0 * k / rho, k) * std::pow(reference_radius / (r - rho), n + 2.0) * std::sqrt(power * (n + 1.0) * (2.0 * n + 1.0));
+		}
+		return bound * m_flux.unitScale();
+	}
+
+	static auto toNed(const Ecef&, const Eigen::Vector3d& ecef, const Eigen::Vector3d& mag_density) -> Eigen::Vector3d {
+		const double p = std::sqrt(ecef.x() * ecef.x() + ecef.y() * ecef.y());
+		const double r = std::sqrt(p * p + ecef.z() * ecef.z());
+		return GeoMagFlux::ecefToNed(mag_density, ecef.z() / r, p / r, p > 0.0 ? ecef.y() / p : 0.0, p > 0.0 ? ecef.x() / p : 1.0);
+	}
+
+	static auto toNed(const Wgs84& position, const Eigen::Vector3d&, const Eigen::Vector3d& mag_density) -> Eigen::Vector3d {
+		const double lat = position.latitude().radians(), lon = position.longitude().radians();
+		return GeoMagFlux::ecefToNed(mag_density, std::sin(lat), std::cos(lat), std::sin(lon), std::cos(lon));
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -109,6 +109,8 @@ class Ecef : public CoordinateBase<Eigen::Vector3d> {
 	Ecef toEcef() const { return *this; }
 	GeocentricSpherical toGeocentricSpherical() const;
 	Wgs84 toWgs84() const;
+	template <Accuracy A>
+	Wgs84 toWgs84() const;
 
 	std::string toString() const override {
 		std::stringstream ss;
@@ -380,26 +382,41 @@ inline GeocentricSpherical Ecef::toGeocentricSpherical() const {
 	return GeocentricSpherical(m_epoch, GeocentricSphericalPosition{Radian(phi), Radian(theta), r});
 }
 
+inline Wgs84 Ecef::toWgs84() const {
+	return toWgs84<Accuracy::Exact>();
+}
+
+template <Accuracy A>
 inline Wgs84 Ecef::toWgs84() const {
 	constexpr double a = constant::wgs84_a;
 	constexpr double b = constant::wgs84_b;
 	constexpr double e2 = (a * a - b * b) / (a * a);
+	// 反復の収束判定は近似の誤差に合わせて緩める
+	constexpr double tolerance = A == Accuracy::Exact ? 1e-10 : (A == Accuracy::Fast ? 1e-9 : 1e-6);
 
-	const double p = std::sqrt(m_data.x() * m_data.x() + m_data.y() * m_data.y());
+	const double p = FastMath::sqrt<A>(m_data.x() * m_data.x() + m_data.y() * m_data.y());
 
-	double phi = std::atan2(p, m_data.z()); // geocentric latitude
+	double phi = FastMath::atan2<A>(p, m_data.z()); // geocentric latitude
 	double lat = phi;
 	std::int32_t i = 0;
 	do {
 		phi = lat;
-		const double sin_phi = std::sin(phi);
-		const double N = a / std::sqrt(1 - e2 * sin_phi * sin_phi);
-		lat = std::atan2(m_data.z() + N * e2 * sin_phi, p);
+		const double sin_phi = FastMath::sin<A>(phi);
+		const double N = a / FastMath::sqrt<A>(1 - e2 * sin_phi * sin_phi);
+		lat = FastMath::atan2<A>(m_data.z() + N * e2 * sin_phi, p);
 		i++;
-	} while (std::abs(lat - phi) > 1e-10 && i < 10); // 4回くらいで収束する
-
-	const double lon = std::atan2(m_data.y(), m_data.x());
-	const double alt = p / std::cos(phi) - a / std::sqrt(1 - e2 * std::sin(phi) * std::sin(phi));
+	} while (std::abs(lat - phi) > tolerance && i < 10); // 4回くらいで収束する
+
+	const double lon = FastMath::atan2<A>(m_data.y(), m_data.x());
+	double alt;
+	if (A == Accuracy::Exact) {
+		alt = p / std::cos(phi) - a / std::sqrt(1 - e2 * std::sin(phi) * std::sin(phi));
+	} else {
+		// 近似では緯度の誤差が高度に1次で効かない形を使う
+		double sin_lat, cos_lat;
+		FastMath::sincos<A>(lat, sin_lat, cos_lat);
+		alt = p * cos_lat + m_data.z() * sin_lat - a * FastMath::sqrt<A>(1 - e2 * sin_lat * sin_lat);
+	}
 
 	return Wgs84(m_epoch, Wgs84Position{Radian(lon), Radian(lat), alt});
 }
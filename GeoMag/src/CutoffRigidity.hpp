@@ -0,0 +1,503 @@
+/**
+ * @file CutoffRigidity.hpp
+ * @author Kaiji Takeuchi
+ * @brief 荷電粒子の軌道の逆追跡による地磁気カットオフ剛度の計算
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "../../Eigen/Core"
+#include "../../Eigen/Geometry"
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 粒子が到来する方向
+ *
+ */
+struct CutoffDirection {
+	Angle zenith = Degree{0.0};	 // 天頂角 (0で鉛直)
+	Angle azimuth = Degree{0.0}; // 方位角 (北から東回り)
+};
+
+/**
+ * @brief カットオフ剛度の計算の設定
+ *
+ */
+struct CutoffConfig {
+	double rigidity_step = 0.01;	// 剛度の走査の刻み [GV]
+	double min_rigidity = 0.01;		// 走査する剛度の下限 [GV]
+	double max_rigidity = 60.0;		// 走査を始める剛度の上限 [GV]
+	double forbidden_width = 2.0;	// 禁止がこの幅 [GV] だけ続いたら、それより低い剛度は禁止とみなして走査をやめる
+	double step = 0.1;				// 積分の刻み (1刻みあたりのジャイロ位相 [rad])
+	double max_step = 0.05;			// 積分の刻みの上限 (地心距離に対する比)
+	double escape_radius = 25.0;	// これより遠くに達した軌道は許容 [地球半径]
+	double max_path = 100.0;		// これより長い軌道は捕捉されたとみなして禁止 [地球半径]
+	double impact_altitude = 20e3;	// これより低く戻った軌道は禁止 [m]
+	int charge_sign = 1;			// 粒子の電荷の符号 (陽子・原子核は1)
+	std::size_t lanes = 16;			// 1スレッドが同時に進める軌道の数
+	std::size_t num_threads = 0;	// スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief カットオフ剛度 (Cooke et al. 1991 の定義)
+ *
+ */
+struct CutoffResult {
+	double upper = std::numeric_limits<double>::quiet_NaN();	 // 最も高い禁止の剛度 RU [GV]
+	double lower = std::numeric_limits<double>::quiet_NaN();	 // 最も低い許容の剛度 RL [GV]
+	double effective = std::numeric_limits<double>::quiet_NaN(); // 実効カットオフ剛度 RC = RU - (半影の許容の数) x 刻み [GV]
+	std::size_t trajectories = 0;								 // 追跡した軌道の数
+};
+
+/**
+ * @brief 観測点ごとに剛度を走査し、反粒子を外向きに追跡してカットオフ剛度を求める
+ * @remark 軌道は経路長を変数とするBoris法で積分し、刻みはジャイロ位相と地心距離で適応的に決める。
+ *         各スレッドは lanes 本の軌道を同時に1刻みずつ進め、終わった軌道の枠にすぐ次の剛度や観測点の軌道を詰める。
+ *         観測点は共有のカーソルから取り、残りがなくなったスレッドは他のスレッドの観測点の剛度を引き受けるので、
+ *         軌道の長さが観測点ごとに大きく違っても最後の観測点だけが残ることがない。剛度は高い方から走査し、
+ *         最も高い剛度が禁止なら走査の開始を上げてやり直す
+ *
+ */
+class CutoffRigidityEngine {
+  public:
+	/**
+	 * @brief Construct a new Cutoff Rigidity Engine object
+	 *
+	 * @param flux 磁場の評価器 (精度の設定もそのまま使う)
+	 * @param config 設定
+	 */
+	CutoffRigidityEngine(const GeoMagFlux& flux, const CutoffConfig& config = CutoffConfig{}) : m_flux(flux), m_config(config) {
+		if (!(config.rigidity_step > 0.0) || !(config.min_rigidity > 0.0) || !(config.max_rigidity > config.min_rigidity) ||
+			!(config.step > 0.0) || !(config.max_step > 0.0) || !(config.escape_radius > 1.0) || config.lanes == 0 ||
+			(config.charge_sign != 1 && config.charge_sign != -1)) {
+			throw std::runtime_error("CutoffRigidityEngine: invalid configuration");
+		}
+		m_flux.setOutputUnit(MagFluxUnit::Tesla);
+	}
+
+	/**
+	 * @brief 1つの観測点のカットオフ剛度を求める
+	 *
+	 * @param site 観測点 (高度は軌道を始める高さ)
+	 * @param direction 到来方向
+	 */
+	CutoffResult operator()(const Wgs84& site, const CutoffDirection& direction = CutoffDirection{}) const {
+		std::vector<CutoffResult> results;
+		evaluate(std::vector<Wgs84>{site}, direction, results);
+		return results.front();
+	}
+
+	/**
+	 * @brief 複数の観測点 (全球の格子など) のカットオフ剛度をまとめて求める
+	 * @remark 同じ時刻の観測点をまとめると、スレッドごとの磁場のモデルを作り直さずに済む
+	 *
+	 * @param sites 観測点の配列
+	 * @param direction 到来方向 (観測点の局所的な北・東・上に対して)
+	 * @param results 結果の配列 (sitesと同じ大きさに変更される)
+	 */
+	void evaluate(const std::vector<Wgs84>& sites, const CutoffDirection& direction, std::vector<CutoffResult>& results) const {
+		results.assign(sites.size(), CutoffResult{});
+		if (sites.empty()) {
+			return;
+		}
+		Schedule schedule(sites.size());
+		for (std::size_t n = 0; n < sites.size(); n++) {
+			schedule.cells[n].reset(new Cell(n, launch(sites[n], direction)));
+		}
+		// 1つの番号が1つのスレッドの処理全体になる
+		const std::size_t threads = Parallel::threadCount(m_config.num_threads);
+		Parallel::forEach(
+		  0, threads,
+		  [&](std::size_t, std::size_t) {
+			  try {
+				  run(schedule, results);
+			  } catch (...) {
+				  schedule.abort = true;
+				  schedule.signal();
+				  throw;
+			  }
+		  },
+		  threads);
+	}
+
+  private:
+	static constexpr double speed_of_light = 299792458.0; // [m/s]
+	static constexpr double reference_radius = 6371.2e3;  // 地球半径の単位 [m]
+
+	/**
+	 * @brief 1つの観測点の走査の状態 (スレッド間で共有し、mutexで守る)
+	 *
+	 */
+	struct Cell {
+		struct Launch {
+			Eigen::Vector3d position;
+			Eigen::Vector3d direction;
+			DateTime epoch;
+			double start; // 走査を始める剛度 [GV]
+		};
+
+		Cell(std::size_t i, const Launch& l) : site(i), launch(l) {}
+
+		std::mutex mutex;
+		std::size_t site; // 結果を書き込む番号
+		Launch launch;
+		std::vector<signed char> outcomes; // 剛度の番号ごとの結果 (0: 未了, 1: 許容, -1: 禁止)
+		std::size_t issued = 0;			   // 割り当てた剛度の数
+		std::size_t inflight = 0;		   // 追跡中の軌道の数
+		std::size_t frontier = 0;		   // 先頭から結果が揃った剛度の数
+		std::size_t forbidden_run = 0;	   // frontierの直前で続いている禁止の数
+		std::size_t generation = 0;		   // 走査をやり直した回数 (古い軌道の結果を捨てる)
+		std::size_t trajectories = 0;
+		bool exhausted = false; // これ以上剛度を割り当てない
+		bool finished = false;
+	};
+
+	/**
+	 * @brief 観測点の割り当ての状態
+	 *
+	 */
+	struct Schedule {
+		explicit Schedule(std::size_t size) : cells(size), remaining(size) {}
+
+		/**
+		 * @brief 走査のやり直し・観測点の終了・中断を待っているスレッドに知らせる
+		 *
+		 */
+		void signal() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				changes++;
+			}
+			wake.notify_all();
+		}
+
+		std::vector<std::unique_ptr<Cell>> cells;
+		std::atomic<std::size_t> next{0};	  // まだ誰も始めていない観測点
+		std::atomic<std::size_t> remaining{0}; // 終わっていない観測点の数
+		std::atomic<bool> abort{false};
+
+		std::mutex mutex;			  // open, changesを守る (Cell::mutexより先にとる)
+		std::condition_variable wake; // 割り当てる軌道がないスレッドを待たせる
+		std::vector<Cell*> open;	  // 始まっていて、まだ剛度を割り当てられる観測点
+		std::size_t changes = 0;	  // signalの回数
+	};
+
+	/**
+	 * @brief 同時に進める1本の軌道
+	 *
+	 */
+	struct Lane {
+		Eigen::Vector3d position;
+		Eigen::Vector3d velocity; // 単位ベクトル
+		double wavenumber = 0.0;  // 磁束密度1Tあたりのジャイロ波数 -q c / (p c) [1/(T m)] (逆追跡なので符号を反転)
+		double field = 0.0;		  // 直前の磁束密度の大きさ [T] (刻みを決める)
+		double path = 0.0;		  // 経路長 [m]
+		Cell* cell = nullptr;
+		std::size_t index = 0;
+		std::size_t generation = 0;
+	};
+
+	GeoMagFlux m_flux;
+	CutoffConfig m_config;
+
+	double rigidity(const Cell& cell, std::size_t index) const {
+		return cell.launch.start - m_config.rigidity_step * static_cast<double>(index);
+	}
+
+	/**
+	 * @brief 観測点の位置・方向と、Størmerの式から走査を始める剛度を求める
+	 *
+	 */
+	Cell::Launch launch(const Wgs84& site, const CutoffDirection& direction) const {
+		Cell::Launch l;
+		l.epoch = site.epoch();
+		l.position = site.toEcef().elements();
+		const double sin_lat = site.latitude().sin(), cos_lat = site.latitude().cos();
+		const double sin_lon = site.longitude().sin(), cos_lon = site.longitude().cos();
+		const Eigen::Vector3d up{cos_lat * cos_lon, cos_lat * sin_lon, sin_lat};
+		const Eigen::Vector3d east{-sin_lon, cos_lon, 0.0};
+		const Eigen::Vector3d north = up.cross(east);
+		const double sin_zenith = std::sin(direction.zenith.radians());
+		l.direction = (sin_zenith * (std::cos(direction.azimuth.radians()) * north + std::sin(direction.azimuth.radians()) * east) +
+					   std::cos(direction.zenith.radians()) * up)
+						.normalized();
+
+		// 双極子のStørmerの式で、方位によらないカットオフの上限を見積もる
+		GeoMagFlux flux(m_flux);
+		const Model& model = flux.model(l.epoch);
+		const Eigen::Vector3d moment{model.coefficients[1], model.coefficients[2], model.coefficients[0]};
+		const double dipole_field = moment.norm() * 1.0e-9;
+		const double r = l.position.norm() / reference_radius;
+		const double sin_dipole_lat = l.position.normalized().dot(-moment.normalized());
+		const double cos_dipole_lat = std::sqrt(std::max(1.0 - sin_dipole_lat * sin_dipole_lat, 0.0));
+		const double denominator = 1.0 + std::sqrt(std::max(1.0 - sin_zenith * std::pow(cos_dipole_lat, 3), 0.0));
+		const double stormer =
+		  speed_of_light * dipole_field * reference_radius * std::pow(cos_dipole_lat, 4) / (r * r * denominator * denominator) * 1.0e-9;
+		l.start = std::min(m_config.max_rigidity, 1.5 * stormer + 1.0);
+		l.start = std::max(l.start, m_config.min_rigidity);
+		return l;
+	}
+
+	/**
+	 * @brief 1つのスレッドの処理 (軌道の枠を埋めて、全部の軌道を1刻みずつ進める)
+	 *
+	 */
+	void run(Schedule& schedule, std::vector<CutoffResult>& results) const {
+		GeoMagFlux flux(m_flux);
+		std::vector<Lane> lanes(m_config.lanes);
+		std::vector<Eigen::Vector3d> midpoints(m_config.lanes), fields(m_config.lanes);
+		std::vector<double> steps(m_config.lanes);
+		std::size_t active = 0;
+		std::size_t seen = 0;
+		Cell* current = nullptr;
+
+		while (!schedule.abort) {
+			while (active < lanes.size() && issue(schedule, current, lanes[active], seen)) {
+				active++;
+			}
+			if (active == 0) {
+				// 他のスレッドの軌道の結果で走査がやり直しになるか、全部の観測点が終わるのを待つ
+				std::unique_lock<std::mutex> lock(schedule.mutex);
+				schedule.wake.wait(lock, [&] { return schedule.abort || schedule.remaining == 0 || schedule.changes != seen; });
+				if (schedule.remaining == 0) {
+					return;
+				}
+				continue;
+			}
+
+			// 全部の軌道の中点で磁場をまとめて評価する
+			for (std::size_t k = 0; k < active; k++) {
+				Lane& lane = lanes[k];
+				steps[k] = stepLength(lane);
+				midpoints[k] = lane.position + 0.5 * steps[k] * lane.velocity;
+				lane.path += steps[k];
+			}
+			for (std::size_t k = 0; k < active; k++) {
+				fields[k] = flux.ecefFlux(Ecef{lanes[k].cell->launch.epoch, midpoints[k]});
+			}
+
+			for (std::size_t k = 0; k < active;) {
+				Lane& lane = lanes[k];
+				const double ds = steps[k];
+				// Borisの回転 (du/ds = u x (wavenumber B))
+				const Eigen::Vector3d t = (0.5 * ds * lane.wavenumber) * fields[k];
+				const Eigen::Vector3d s = (2.0 / (1.0 + t.squaredNorm())) * t;
+				const Eigen::Vector3d v = lane.velocity + lane.velocity.cross(t);
+				lane.velocity = (lane.velocity + v.cross(s)).normalized();
+				lane.position = midpoints[k] + 0.5 * ds * lane.velocity;
+				lane.field = fields[k].norm();
+
+				const int outcome = classify(lane);
+				if (outcome == 0) {
+					k++;
+					continue;
+				}
+				record(schedule, results, lane, outcome);
+				lanes[k] = lanes[--active];
+				midpoints[k] = midpoints[active];
+				fields[k] = fields[active];
+				steps[k] = steps[active];
+			}
+		}
+	}
+
+	/**
+	 * @brief 刻み (ジャイロ位相が step になる長さと、地心距離に比例する上限の小さい方)
+	 *
+	 */
+	double stepLength(const Lane& lane) const {
+		const double gyration = m_config.step / (std::fabs(lane.wavenumber) * lane.field);
+		return std::min(gyration, m_config.max_step * lane.position.norm());
+	}
+
+	/**
+	 * @brief 軌道の状態 (0: 継続, 1: 脱出して許容, -1: 地表に戻ったか捕捉されて禁止)
+	 *
+	 */
+	int classify(const Lane& lane) const {
+		const double r = lane.position.norm();
+		if (r > m_config.escape_radius * reference_radius) {
+			return 1;
+		}
+		constexpr double flattening = 1.0 - constant::wgs84_b / constant::wgs84_a;
+		const double sin_lat = lane.position.z() / r;
+		if (r < constant::wgs84_a * (1.0 - flattening * sin_lat * sin_lat) + m_config.impact_altitude) {
+			return -1;
+		}
+		if (lane.path > m_config.max_path * reference_radius) {
+			return -1;
+		}
+		return 0;
+	}
+
+	/**
+	 * @brief 空いた枠に次の軌道を割り当てる
+	 * @remark 自分の観測点 → まだ始まっていない観測点 → 他のスレッドの観測点 (Schedule::open) の順に探す。
+	 *         openからは割り当てられなくなった観測点を見つけた時点で外すので、探索は観測点の総数によらない
+	 *
+	 * @param seen 割り当てられなかった場合に、探した時点のSchedule::changesを書き込む (待つときに使う)
+	 */
+	bool issue(Schedule& schedule, Cell*& current, Lane& lane, std::size_t& seen) const {
+		if (current != nullptr && take(*current, lane)) {
+			return true;
+		}
+		for (;;) {
+			const std::size_t n = schedule.next.fetch_add(1);
+			if (n >= schedule.cells.size()) {
+				break;
+			}
+			current = schedule.cells[n].get();
+			if (take(*current, lane)) {
+				std::lock_guard<std::mutex> lock(schedule.mutex);
+				schedule.open.push_back(current);
+				return true;
+			}
+		}
+		std::lock_guard<std::mutex> lock(schedule.mutex);
+		while (!schedule.open.empty()) {
+			Cell* cell = schedule.open.back();
+			if (take(*cell, lane)) {
+				current = cell;
+				return true;
+			}
+			schedule.open.pop_back(); // 終わったか、割り当てる剛度が尽きた (やり直しにはならない)
+		}
+		seen = schedule.changes;
+		return false;
+	}
+
+	/**
+	 * @brief 観測点の次の剛度の軌道を始める
+	 *
+	 */
+	bool take(Cell& cell, Lane& lane) const {
+		std::lock_guard<std::mutex> lock(cell.mutex);
+		if (cell.finished || cell.exhausted) {
+			return false;
+		}
+		const double r = rigidity(cell, cell.issued);
+		if (r < m_config.min_rigidity - 1e-9) {
+			cell.exhausted = true;
+			return false;
+		}
+		lane.position = cell.launch.position;
+		lane.velocity = cell.launch.direction;
+		lane.wavenumber = -m_config.charge_sign * speed_of_light / (r * 1.0e9);
+		lane.field = 5.0e-5; // 最初の刻みは地表付近の磁束密度で決める
+		lane.path = 0.0;
+		lane.cell = &cell;
+		lane.index = cell.issued++;
+		lane.generation = cell.generation;
+		cell.outcomes.push_back(0);
+		cell.inflight++;
+		cell.trajectories++;
+		return true;
+	}
+
+	/**
+	 * @brief 軌道の結果を記録し、走査の終わりとやり直しを判定する
+	 *
+	 */
+	void record(Schedule& schedule, std::vector<CutoffResult>& results, const Lane& lane, int outcome) const {
+		if (update(schedule, results, lane, outcome)) {
+			schedule.signal();
+		}
+	}
+
+	/**
+	 * @brief recordの本体 (観測点のmutexをとって更新する)
+	 *
+	 * @return bool 走査をやり直したか観測点が終わった (待っているスレッドに知らせる)
+	 */
+	bool update(Schedule& schedule, std::vector<CutoffResult>& results, const Lane& lane, int outcome) const {
+		Cell& cell = *lane.cell;
+		std::lock_guard<std::mutex> lock(cell.mutex);
+		bool changed = false;
+		cell.inflight--;
+		if (lane.generation == cell.generation && !cell.finished) {
+			cell.outcomes[lane.index] = static_cast<signed char>(outcome);
+			while (cell.frontier < cell.issued && cell.outcomes[cell.frontier] != 0 && !cell.exhausted) {
+				if (cell.frontier == 0 && cell.outcomes[0] < 0 && cell.launch.start < m_config.max_rigidity) {
+					// 最も高い剛度が禁止なので、カットオフはもっと高い
+					cell.launch.start = std::min(m_config.max_rigidity, 1.5 * cell.launch.start + 1.0);
+					cell.generation++;
+					cell.outcomes.clear();
+					cell.issued = cell.frontier = cell.forbidden_run = 0;
+					changed = true;
+					break;
+				}
+				cell.forbidden_run = cell.outcomes[cell.frontier] < 0 ? cell.forbidden_run + 1 : 0;
+				cell.frontier++;
+				if (static_cast<double>(cell.forbidden_run) * m_config.rigidity_step >= m_config.forbidden_width) {
+					cell.exhausted = true;
+				}
+			}
+		}
+		if (cell.inflight == 0 && !cell.finished && (cell.exhausted || rigidity(cell, cell.issued) < m_config.min_rigidity - 1e-9)) {
+			// 割り当て済みの軌道がすべて終わったので、結果の揃った範囲からカットオフを求める
+			while (cell.frontier < cell.issued && cell.outcomes[cell.frontier] != 0) {
+				cell.frontier++;
+			}
+			cell.finished = true;
+			results[cell.site] = summarize(cell);
+			schedule.remaining--;
+			changed = true;
+		}
+		return changed;
+	}
+
+	/**
+	 * @brief 走査の結果からRU, RL, RCを求める
+	 *
+	 */
+	CutoffResult summarize(const Cell& cell) const {
+		CutoffResult result;
+		result.trajectories = cell.trajectories;
+		const std::size_t count = cell.frontier;
+		std::size_t first_forbidden = count, last_allowed = count;
+		for (std::size_t i = 0; i < count; i++) {
+			if (cell.outcomes[i] < 0 && first_forbidden == count) {
+				first_forbidden = i;
+			}
+			if (cell.outcomes[i] > 0) {
+				last_allowed = i;
+			}
+		}
+		if (first_forbidden == count) {
+			// 走査の下限まですべて許容
+			result.upper = result.lower = result.effective = count > 0 ? rigidity(cell, count - 1) : m_config.min_rigidity;
+			return result;
+		}
+		std::size_t penumbra = 0;
+		for (std::size_t i = first_forbidden; i < count; i++) {
+			penumbra += cell.outcomes[i] > 0 ? 1 : 0;
+		}
+		result.upper = rigidity(cell, first_forbidden);
+		result.lower = last_allowed != count && last_allowed > first_forbidden ? rigidity(cell, last_allowed) : result.upper;
+		result.effective = result.upper - m_config.rigidity_step * static_cast<double>(penumbra);
+		return result;
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,210 @@
+/**
+ * @file FastMath.hpp
+ * @author Kaiji Takeuchi
+ * @brief 精度を選択できる初等関数
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "Essential.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 計算精度の段階
+ * @remark 誤差はExactに対する最大相対誤差 (README参照)
+ *
+ */
+enum class Accuracy {
+	Exact,		 // 標準ライブラリ
+	Fast,		 // 多項式近似 (sin/cos ~5e-11, atan2 ~6e-10, sqrt ~3e-11)
+	Approximate, // 低次の多項式近似 (sin/cos ~3e-8, atan2 ~5e-6, sqrt ~3e-11)
+};
+
+/**
+ * @brief 精度を選択できる初等関数
+ * @remark 多項式の係数は縮約区間でのLawson法による最良近似で求めた
+ *
+ */
+struct FastMath {
+	/**
+	 * @brief sinとcosを同時に計算する
+	 *
+	 * @tparam A 精度
+	 * @param x 角度 [rad]
+	 * @param s sin(x)
+	 * @param c cos(x)
+	 */
+	template <Accuracy A>
+	static auto sincos(double x, double& s, double& c) -> void {
+		if (A == Accuracy::Exact) {
+			s = std::sin(x);
+			c = std::cos(x);
+			return;
+		}
+
+		// Cody-Waite法で [-π/4, π/4] に縮約する
+		constexpr double two_over_pi = 0.63661977236758134308;
+		constexpr double pio2_1 = 1.57079632673412561417e+00;
+		constexpr double pio2_2 = 6.07710050650619224932e-11;
+		constexpr double pio2_3 = 2.02226624879595063154e-21;
+		const double q = x * two_over_pi;
+		const std::int64_t k = static_cast<std::int64_t>(q >= 0.0 ? q + 0.5 : q - 0.5);
+		const double kd = static_cast<double>(k);
+		const double r = ((x - kd * pio2_1) - kd * pio2_2) - kd * pio2_3;
+		const double u = r * r;
+
+		double sr, cr;
+		if (A == Accuracy::Fast) {
+			sr = r * (9.99999999995450412e-01 +
+					  u * (-1.66666666304464810e-01 + u * (8.33332869017530373e-03 + u * (-1.98391783616862870e-04 + u * 2.71715285626741863e-06))));
+			cr = 9.99999999943937896e-01 +
+				 u * (-4.99999995715596326e-01 + u * (4.16666132336879866e-02 + u * (-1.38865291525202244e-03 + u * 2.43726796020853978e-05)));
+		} else {
+			sr = r *
+				 (9.99999986179296196e-01 + u * (-1.66666367542142896e-01 + u * (8.33158460296891737e-03 + u * -1.94621166049352889e-04)));
+			cr = 9.99999972438426643e-01 + u * (-4.99998567150831630e-01 + u * (4.16550274959714001e-02 + u * -1.35859140647981566e-03));
+		}
+
+		switch (k & 3) {
+			case 0:
+				s = sr;
+				c = cr;
+				break;
+			case 1:
+				s = cr;
+				c = -sr;
+				break;
+			case 2:
+				s = -sr;
+				c = -cr;
+				break;
+			default:
+				s = -cr;
+				c = sr;
+				break;
+		}
+	}
+
+	template <Accuracy A>
+	static auto sin(double x) -> double {
+		if (A == Accuracy::Exact) {
+			return std::sin(x);
+		}
+		double s, c;
+		sincos<A>(x, s, c);
+		return s;
+	}
+
+	template <Accuracy A>
+	static auto cos(double x) -> double {
+		if (A == Accuracy::Exact) {
+			return std::cos(x);
+		}
+		double s, c;
+		sincos<A>(x, s, c);
+		return c;
+	}
+
+	/**
+	 * @brief 4象限の逆正接
+	 *
+	 * @tparam A 精度
+	 * @param y
+	 * @param x
+	 * @return double [-π, π]
+	 */
+	template <Accuracy A>
+	static auto atan2(double y, double x) -> double {
+		if (A == Accuracy::Exact) {
+			return std::atan2(y, x);
+		}
+
+		const double ax = std::abs(x), ay = std::abs(y);
+		const double num = ay < ax ? ay : ax, den = ay < ax ? ax : ay;
+		if (den == 0.0) {
+			return std::atan2(y, x); // 原点 (符号付きゼロの扱いは標準ライブラリに任せる)
+		}
+		double t = num / den; // [0, 1]
+		double a;
+		if (A == Accuracy::Fast) {
+			// tan(π/8)より大きければ atan(t) = π/4 + atan((t-1)/(t+1)) で縮約する
+			constexpr double tan_pio8 = 0.41421356237309504880;
+			double offset = 0.0;
+			if (t > tan_pio8) {
+				t = (t - 1.0) / (t + 1.0);
+				offset = constant::pi / 4;
+			}
+			const double u = t * t;
+			a = offset + t * (9.99999999396670072e-01 +
+							  u * (-3.33333076258298977e-01 +
+								   u * (1.99982169471311213e-01 +
+										u * (-1.42400830010358417e-01 + u * (1.05734797590742274e-01 + u * -6.03479024957873152e-02)))));
+		} else {
+			const double u = t * t;
+			a = t * (9.99995629598960715e-01 +
+					 u * (-3.32994596547926623e-01 +
+						  u * (1.95635922460525082e-01 +
+							   u * (-1.21239064241100263e-01 + u * (5.74773063359908484e-02 + u * -1.34804667038286002e-02)))));
+		}
+
+		if (ay > ax) {
+			a = constant::pi / 2 - a;
+		}
+		if (x < 0.0) {
+			a = constant::pi - a;
+		}
+		return y < 0.0 ? -a : a;
+	}
+
+	/**
+	 * @brief 平方根の逆数
+	 * @remark ビット演算による初期値をニュートン法で3回改良する (地心距離の誤差は(a/r)^(n+2)で増幅されるので、Approximateでも回数を減らさない)
+	 *
+	 * @tparam A 精度
+	 * @param x 正の値
+	 */
+	template <Accuracy A>
+	static auto rsqrt(double x) -> double {
+		if (A == Accuracy::Exact) {
+			return 1.0 / std::sqrt(x);
+		}
+
+		std::uint64_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		bits = 0x5fe6eb50c7b537a9ULL - (bits >> 1);
+		double y;
+		std::memcpy(&y, &bits, sizeof(y));
+
+		const double half_x = 0.5 * x;
+		y = y * (1.5 - half_x * y * y);
+		y = y * (1.5 - half_x * y * y);
+		y = y * (1.5 - half_x * y * y);
+		return y;
+	}
+
+	/**
+	 * @brief 平方根
+	 *
+	 * @tparam A 精度
+	 * @param x 0以上の値
+	 */
+	template <Accuracy A>
+	static auto sqrt(double x) -> double {
+		if (A == Accuracy::Exact) {
+			return std::sqrt(x);
+		}
+		return x > 0.0 ? x * rsqrt<A>(x) : 0.0;
+	}
+};
+
+GEOMAG_NAMESPACE_END
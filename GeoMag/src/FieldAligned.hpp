@@ -0,0 +1,289 @@
+/**
+ * @file FieldAligned.hpp
+ * @author Kaiji Takeuchi
+ * @brief 磁力計の観測値を磁力線に沿った座標系 (FAC / MFA) へ一括で回転する
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "FieldEphemeris.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 平行方向の基準にする磁場
+ *
+ */
+enum class FacReference {
+	Model,	   // 衛星位置でのモデル磁場 (FAC)
+	MeanField, // 観測値の移動平均 (MFA)
+};
+
+/**
+ * @brief FAC変換の設定
+ *
+ */
+struct FacConfig {
+	FacReference reference = FacReference::Model;
+	bool residual = false;					 // 観測値からモデル磁場を引いてから回転する
+	/**
+	 * @brief モデルの係数を求める時刻の刻み (0で刻まない)
+	 * @remark 直接評価 (model_cadence = 0) では、サンプルの時刻をこの刻みの最も近い倍数に丸めた時刻のモデルを使う。
+	 *         既定の10分では最大5分ずれた時刻の係数になり、永年変化 (~100 nT/年) による差は1e-3 nT程度。
+	 *         正確な時刻のモデルが必要なら0にする
+	 *
+	 */
+	TimeSpan model_epoch_step = Minutes(10);
+	double model_cadence = 0.0;				 // 正の場合、この間隔 [s] に間引いた軌道からエフェメリスを作りモデル磁場を補間する (0で全サンプルを直接評価)
+	double ephemeris_tolerance = 0.05;		 // エフェメリスの許容誤差 [出力単位]
+	double mean_window = 60.0;				 // MeanFieldで平均をとる時間幅 [s] (サンプルを中心とする)
+	std::size_t num_threads = 0;			 // スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief FAC変換の結果
+ *
+ */
+struct FacResult {
+	std::vector<Eigen::Vector3d> fac;		// (平行, 垂直東向き, 垂直外向き) の成分
+	std::vector<Eigen::Vector3d> model;		// モデル磁場 (軌道の座標系の成分)
+	std::vector<Eigen::Vector3d> reference; // 平行方向を決めた磁場 (軌道の座標系の成分)
+};
+
+/**
+ * @brief 軌道に沿って観測値をFAC/MFAへ回転する
+ * @remark 基底は b = B/|B|、e = b × r / |b × r| (垂直東向き)、o = e × b (垂直外向き)。rは衛星の位置ベクトル。
+ *         磁場が動径方向と平行な点では e を地理的な東向き (z × r) で代用する。観測値と結果の単位は評価器の出力単位
+ *
+ */
+class FieldAlignedTransformer {
+  public:
+	/**
+	 * @brief Construct a new Field Aligned Transformer object
+	 *
+	 * @param flux 磁場モデル (出力単位もこれに従う)
+	 * @param config 設定
+	 */
+	FieldAlignedTransformer(const GeoMagFlux& flux, const FacConfig& config = {}) : m_flux(flux), m_config(config) {
+		if (m_config.model_epoch_step.ticks() < 0 || m_config.model_cadence < 0.0 || !(m_config.mean_window > 0.0)) {
+			throw std::runtime_error("FieldAlignedTransformer: invalid configuration.");
+		}
+	}
+
+	/**
+	 * @brief ECEF座標系の軌道と観測値を変換する
+	 *
+	 * @param trajectory 時刻順に並んだ軌道
+	 * @param observed 観測値 (ECEF成分)
+	 * @return FacResult
+	 */
+	FacResult transform(const std::vector<Ecef>& trajectory, const std::vector<Eigen::Vector3d>& observed) const {
+		return transformImpl(trajectory, observed, EphemerisFrame::Ecef);
+	}
+
+	/**
+	 * @brief ECI座標系の軌道と観測値を変換する
+	 *
+	 * @param trajectory 時刻順に並んだ軌道
+	 * @param observed 観測値 (ECI成分)
+	 * @return FacResult
+	 */
+	FacResult transform(const std::vector<Eci>& trajectory, const std::vector<Eigen::Vector3d>& observed) const {
+		return transformImpl(trajectory, observed, EphemerisFrame::Eci);
+	}
+
+	/**
+	 * @brief 軌道に沿ったモデル磁場を求める
+	 *
+	 * @param trajectory 時刻順に並んだ軌道
+	 * @return std::vector<Eigen::Vector3d> モデル磁場 (軌道の座標系の成分)
+	 */
+	std::vector<Eigen::Vector3d> modelField(const std::vector<Ecef>& trajectory) const { return modelFieldImpl(trajectory, EphemerisFrame::Ecef); }
+	std::vector<Eigen::Vector3d> modelField(const std::vector<Eci>& trajectory) const { return modelFieldImpl(trajectory, EphemerisFrame::Eci); }
+
+	/**
+	 * @brief 位置と基準磁場から基底を作り、ベクトルを回転する
+	 * @remark サンプルごとの基底はその場で作ってすぐ使うので保存しない。
+	 *         分岐は、磁場が動径方向と平行な点でeを地理的な東向きに切り替える三項演算子だけ
+	 *
+	 * @param positions 位置ベクトル
+	 * @param reference 平行方向を決める磁場
+	 * @param vectors 回転するベクトル
+	 * @param count サンプル数
+	 * @param fac (平行, 垂直東向き, 垂直外向き) の成分
+	 */
+	static void rotate(const Eigen::Vector3d* positions, const Eigen::Vector3d* reference, const Eigen::Vector3d* vectors, std::size_t count,
+					   Eigen::Vector3d* fac) {
+		for (std::size_t i = 0; i < count; i++) {
+			const Eigen::Vector3d b = reference[i].normalized();
+			const Eigen::Vector3d r = positions[i];
+			const Eigen::Vector3d east = b.cross(r);
+			const Eigen::Vector3d geographic_east{-r.y(), r.x(), 0.0}; // z × r
+			const double east_norm2 = east.squaredNorm();
+			const bool degenerate = east_norm2 <= 1e-20 * r.squaredNorm();
+			const Eigen::Vector3d e = degenerate ? geographic_east.normalized() : Eigen::Vector3d(east / std::sqrt(east_norm2));
+			const Eigen::Vector3d o = e.cross(b);
+			const Eigen::Vector3d& v = vectors[i];
+			fac[i] = Eigen::Vector3d{v.dot(b), v.dot(e), v.dot(o)};
+		}
+	}
+
+  private:
+	static constexpr std::size_t chunk = 1024;
+
+	GeoMagFlux m_flux;
+	FacConfig m_config;
+
+	template <class Position>
+	FacResult transformImpl(const std::vector<Position>& trajectory, const std::vector<Eigen::Vector3d>& observed, EphemerisFrame frame) const {
+		if (trajectory.size() != observed.size()) {
+			throw std::runtime_error("FieldAlignedTransformer: trajectory and observed sizes differ.");
+		}
+		const std::size_t size = trajectory.size();
+		const std::vector<double> t = seconds(trajectory);
+
+		FacResult result;
+		result.model = modelFieldImpl(trajectory, frame);
+		result.reference = m_config.reference == FacReference::Model ? result.model : meanField(t, observed, m_config.mean_window);
+		result.fac.resize(size);
+
+		const std::size_t threads = Parallel::threadCount(m_config.num_threads);
+		Parallel::forEachChunk(
+		  0, size, chunk,
+		  [&](std::size_t, std::size_t b, std::size_t e) {
+			  Eigen::Vector3d positions[chunk], vectors[chunk];
+			  for (std::size_t i = b; i < e; i++) {
+				  positions[i - b] = trajectory[i].elements();
+				  vectors[i - b] = m_config.residual ? Eigen::Vector3d(observed[i] - result.model[i]) : observed[i];
+			  }
+			  rotate(positions, result.reference.data() + b, vectors, e - b, result.fac.data() + b);
+		  },
+		  threads);
+		return result;
+	}
+
+	template <class Position>
+	std::vector<Eigen::Vector3d> modelFieldImpl(const std::vector<Position>& trajectory, EphemerisFrame frame) const {
+		const std::size_t size = trajectory.size();
+		std::vector<Eigen::Vector3d> model(size);
+		if (size == 0) {
+			return model;
+		}
+		const std::size_t threads = Parallel::threadCount(m_config.num_threads);
+
+		if (m_config.model_cadence > 0.0 && size >= 2) {
+			// 間引いた軌道でエフェメリスを作り、各サンプルの時刻で補間する
+			const std::vector<double> t = seconds(trajectory);
+			std::vector<Position> nodes{trajectory.front()};
+			double last = t.front();
+			for (std::size_t i = 1; i + 1 < size; i++) {
+				if (t[i] - last >= m_config.model_cadence) {
+					nodes.push_back(trajectory[i]);
+					last = t[i];
+				}
+			}
+			nodes.push_back(trajectory.back());
+
+			FieldEphemerisConfig config;
+			config.frame = frame;
+			config.tolerance = m_config.ephemeris_tolerance;
+			config.num_threads = m_config.num_threads;
+			const FieldEphemeris ephemeris = FieldEphemerisGenerator(m_flux, config).generate(nodes);
+			const double offset = (trajectory.front().epoch() - ephemeris.epoch).ticks() / static_cast<double>(constant::ticks_per_second);
+			Parallel::forEachChunk(
+			  0, size, chunk,
+			  [&](std::size_t, std::size_t b, std::size_t e) {
+				  ChebyshevFieldEvaluator evaluator = ephemeris.evaluator();
+				  double value[3];
+				  for (std::size_t i = b; i < e; i++) {
+					  if (!evaluator(t[i] + offset, value)) {
+						  throw std::runtime_error("FieldAlignedTransformer: sample outside the model ephemeris.");
+					  }
+					  model[i] = Eigen::Vector3d{value[0], value[1], value[2]};
+				  }
+			  },
+			  threads);
+			return model;
+		}
+
+		std::vector<GeoMagFlux> fluxes(std::min(threads, size / chunk + 1), m_flux);
+		Parallel::forEachChunk(
+		  0, size, chunk,
+		  [&](std::size_t thread_index, std::size_t b, std::size_t e) {
+			  GeoMagFlux& flux = fluxes[thread_index];
+			  for (std::size_t i = b; i < e; i++) {
+				  const Ecef position = trajectory[i].toEcef();
+				  // 刻みに丸めた時刻で評価すると、連続するサンプルで係数の補間を省ける
+				  const Eigen::Vector3d b_ecef = flux.ecefFlux(Ecef(modelEpoch(position.epoch()), position.elements()));
+				  model[i] = frame == EphemerisFrame::Eci ? ecefToEci(position.epoch(), b_ecef) : b_ecef;
+			  }
+		  },
+		  fluxes.size());
+		return model;
+	}
+
+	DateTime modelEpoch(const DateTime& epoch) const {
+		const std::int64_t step = m_config.model_epoch_step.ticks();
+		if (step <= 0) {
+			return epoch;
+		}
+		const std::int64_t ticks = epoch.ticks();
+		return DateTime((ticks + step / 2) / step * step);
+	}
+
+	template <class Position>
+	static std::vector<double> seconds(const std::vector<Position>& trajectory) {
+		std::vector<double> t(trajectory.size());
+		for (std::size_t i = 0; i < trajectory.size(); i++) {
+			t[i] = (trajectory[i].epoch() - trajectory.front().epoch()).ticks() / static_cast<double>(constant::ticks_per_second);
+			if (i > 0 && t[i] < t[i - 1]) {
+				throw std::runtime_error("FieldAlignedTransformer: trajectory epochs must be non-decreasing.");
+			}
+		}
+		return t;
+	}
+
+	/**
+	 * @brief 各サンプルを中心とする時間幅の観測値の平均
+	 *
+	 */
+	static std::vector<Eigen::Vector3d> meanField(const std::vector<double>& t, const std::vector<Eigen::Vector3d>& observed, double window) {
+		const std::size_t size = t.size();
+		std::vector<Eigen::Vector3d> mean(size);
+		Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+		std::size_t first = 0, last = 0; // [first, last) が窓に入るサンプル
+		for (std::size_t i = 0; i < size; i++) {
+			while (last < size && t[last] <= t[i] + window / 2) {
+				sum += observed[last++];
+			}
+			while (t[first] < t[i] - window / 2) {
+				sum -= observed[first++];
+			}
+			mean[i] = sum / static_cast<double>(last - first);
+		}
+		return mean;
+	}
+
+	static Eigen::Vector3d ecefToEci(const DateTime& dt, const Eigen::Vector3d& v) {
+		const double theta = dt.greenwichSiderealTime().radians();
+		const double c = std::cos(theta), s = std::sin(theta);
+		return Eigen::Vector3d{v.x() * c - v.y() * s, v.x() * s + v.y() * c, v.z()};
+	}
+};
+
+GEOMAG_NAMESPACE_END
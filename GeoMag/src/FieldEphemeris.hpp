@@ -0,0 +1,459 @@
+/**
+ * @file FieldEphemeris.hpp
+ * @author Kaiji Takeuchi
+ * @brief 軌道に沿った磁束密度のチェビシェフ多項式エフェメリス
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "../../Eigen/Cholesky"
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief エフェメリスに格納する磁束密度の座標系
+ *
+ */
+enum class EphemerisFrame {
+	Ned,  // WGS84測地座標系でのNED
+	Ecef, // ECEF
+	Eci,  // ECI
+};
+
+/**
+ * @brief 1区間分のチェビシェフ係数
+ * @remark 搭載計算機へそのまま転送できるよう固定長のPODとしている
+ *
+ */
+struct ChebyshevSegment {
+	static constexpr std::size_t max_degree = 15;
+	static constexpr std::uint32_t tolerance_exceeded = 1u; // 1サンプル間隔まで分割しても許容誤差に収まらなかった
+
+	double begin;													// 区間の開始時刻 [s] (エフェメリスのエポックからの経過秒)
+	double end;														// 区間の終了時刻 [s]
+	std::uint32_t degree;											// 多項式の次数
+	std::uint32_t flags;											// tolerance_exceededなど
+	double max_error;												// サンプルとその中点での最大残差 [出力単位]
+	std::array<std::array<double, max_degree + 1>, 3> coefficients; // 成分ごとのチェビシェフ係数
+};
+
+/**
+ * @brief チェビシェフエフェメリスの評価器
+ * @remark 動的メモリ確保を行わない。時刻が単調に進む場合は区間探索が定数時間になる
+ *
+ */
+class ChebyshevFieldEvaluator {
+  public:
+	/**
+	 * @brief Construct a new Chebyshev Field Evaluator object
+	 *
+	 * @param segments 時刻順に並んだ区間の先頭
+	 * @param size 区間の数
+	 */
+	ChebyshevFieldEvaluator(const ChebyshevSegment* segments, std::size_t size) noexcept
+	  : m_segments(segments), m_size(size), m_index(0), m_offset(0.0), m_scale(0.0) {
+		if (m_size != 0) {
+			select(0);
+		}
+	}
+
+	/**
+	 * @brief 磁束密度を評価する
+	 *
+	 * @param t エフェメリスのエポックからの経過秒 [s]
+	 * @param mag_density 磁束密度 [出力単位]
+	 * @return true 評価できた
+	 * @return false 時刻が範囲外
+	 */
+	bool operator()(double t, double (&mag_density)[3]) noexcept {
+		if (!locate(t)) {
+			return false;
+		}
+
+		const ChebyshevSegment& s = m_segments[m_index];
+		const double x = (t - m_offset) * m_scale;
+		const double x2 = 2.0 * x;
+
+		// Clenshaw recurrence (3成分を同時に回す)
+		double b0[3] = {0.0, 0.0, 0.0}, b1[3] = {0.0, 0.0, 0.0}, b2[3];
+		for (std::size_t k = s.degree; k >= 1; k--) {
+			for (std::size_t c = 0; c < 3; c++) {
+				b2[c] = b1[c];
+				b1[c] = b0[c];
+				b0[c] = x2 * b1[c] - b2[c] + s.coefficients[c][k];
+			}
+		}
+		for (std::size_t c = 0; c < 3; c++) {
+			mag_density[c] = x * b0[c] - b1[c] + s.coefficients[c][0];
+		}
+		return true;
+	}
+
+	/**
+	 * @brief 評価可能な時刻範囲の先頭 [s]
+	 *
+	 */
+	double begin() const noexcept { return m_size == 0 ? 0.0 : m_segments[0].begin; }
+
+	/**
+	 * @brief 評価可能な時刻範囲の末尾 [s]
+	 *
+	 */
+	double end() const noexcept { return m_size == 0 ? 0.0 : m_segments[m_size - 1].end; }
+
+  private:
+	const ChebyshevSegment* m_segments;
+	std::size_t m_size;
+	std::size_t m_index;
+	double m_offset; // 区間中心 [s]
+	double m_scale;	 // [s] -> [-1, 1]
+
+	void select(std::size_t index) noexcept {
+		const ChebyshevSegment& s = m_segments[index];
+		m_index = index;
+		m_offset = 0.5 * (s.begin + s.end);
+		m_scale = s.end > s.begin ? 2.0 / (s.end - s.begin) : 0.0;
+	}
+
+	bool locate(double t) noexcept {
+		if (m_size == 0 || t < m_segments[0].begin || t > m_segments[m_size - 1].end) {
+			return false;
+		}
+
+		std::size_t i = m_index;
+		if (t >= m_segments[i].begin && t <= m_segments[i].end) {
+			return true;
+		}
+
+		// 前後の区間を先に確認し、外れた場合は二分探索する
+		if (i + 1 < m_size && t >= m_segments[i + 1].begin && t <= m_segments[i + 1].end) {
+			i++;
+		} else {
+			std::size_t lo = 0, hi = m_size - 1;
+			while (lo < hi) {
+				const std::size_t mid = (lo + hi) / 2;
+				if (m_segments[mid].end < t) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			i = lo;
+		}
+		select(i);
+		return true;
+	}
+};
+
+/**
+ * @brief 軌道に沿った磁束密度のチェビシェフエフェメリス
+ *
+ */
+struct FieldEphemeris {
+	static constexpr std::uint32_t file_magic = 0x45434d47; // "GMCE"
+	static constexpr std::uint32_t file_version = 1;
+
+	DateTime epoch;							// 時刻の基準
+	EphemerisFrame frame;					// 磁束密度の座標系
+	std::vector<ChebyshevSegment> segments; // 時刻順の区間
+
+	/**
+	 * @brief 評価器を取得する
+	 * @remark 評価器はsegmentsを参照するので、エフェメリスより長く使用しないこと
+	 *
+	 */
+	ChebyshevFieldEvaluator evaluator() const { return ChebyshevFieldEvaluator{segments.data(), segments.size()}; }
+
+	/**
+	 * @brief 全区間での最大残差を取得する
+	 *
+	 */
+	double maxError() const {
+		double err = 0.0;
+		for (const auto& s : segments) {
+			err = std::max(err, s.max_error);
+		}
+		return err;
+	}
+
+	/**
+	 * @brief 許容誤差に収まらなかった区間の数を取得する
+	 * @remark 軌道のサンプル間隔が粗すぎると、1サンプル間隔まで分割しても収まらない
+	 *
+	 */
+	std::size_t exceededSegments() const {
+		std::size_t count = 0;
+		for (const auto& s : segments) {
+			if (s.flags & ChebyshevSegment::tolerance_exceeded) {
+				count++;
+			}
+		}
+		return count;
+	}
+
+	/**
+	 * @brief アップロード用のバイナリイメージを書き出す
+	 * @remark ヘッダ(magic, version, frame, 区間数, エポック[ticks])に続いて区間を生のまま並べる。バイトオーダーはホスト依存
+	 *
+	 * @param os 出力ストリーム
+	 */
+	void write(std::ostream& os) const {
+		const std::uint32_t header[4] = {file_magic, file_version, static_cast<std::uint32_t>(frame),
+										 static_cast<std::uint32_t>(segments.size())};
+		const std::int64_t ticks = epoch.ticks();
+		os.write(reinterpret_cast<const char*>(header), sizeof(header));
+		os.write(reinterpret_cast<const char*>(&ticks), sizeof(ticks));
+		os.write(reinterpret_cast<const char*>(segments.data()), static_cast<std::streamsize>(segments.size() * sizeof(ChebyshevSegment)));
+	}
+};
+
+/**
+ * @brief エフェメリス生成の設定
+ *
+ */
+struct FieldEphemerisConfig {
+	EphemerisFrame frame = EphemerisFrame::Ecef; // 磁束密度の座標系
+	std::size_t degree = 9;						 // 多項式の次数
+	double tolerance = 1.0;						 // 許容する最大残差 [出力単位]
+	double max_segment_duration = 1200.0;		 // 区間長の上限 [s]
+	std::size_t num_threads = 0;				 // スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief 軌道からチェビシェフエフェメリスを生成する
+ *
+ */
+class FieldEphemerisGenerator {
+  public:
+	/**
+	 * @brief Construct a new Field Ephemeris Generator object
+	 *
+	 * @param flux 使用する磁場モデル (出力単位もこれに従う)
+	 * @param config 生成の設定
+	 */
+	FieldEphemerisGenerator(const GeoMagFlux& flux, const FieldEphemerisConfig& config = {}) : m_flux(flux), m_config(config) {
+		if (m_config.degree > ChebyshevSegment::max_degree) {
+			throw std::runtime_error("FieldEphemerisGenerator: degree exceeds ChebyshevSegment::max_degree.");
+		}
+		if (!(m_config.tolerance > 0.0) || !(m_config.max_segment_duration > 0.0)) {
+			throw std::runtime_error("FieldEphemerisGenerator: tolerance and max_segment_duration must be positive.");
+		}
+	}
+
+	/**
+	 * @brief ECEF座標系の軌道からエフェメリスを生成する
+	 *
+	 * @param trajectory 時刻順に並んだ軌道
+	 * @return FieldEphemeris
+	 */
+	FieldEphemeris generate(const std::vector<Ecef>& trajectory) const { return generateImpl(trajectory); }
+
+	/**
+	 * @brief ECI座標系の軌道からエフェメリスを生成する
+	 *
+	 * @param trajectory 時刻順に並んだ軌道
+	 * @return FieldEphemeris
+	 */
+	FieldEphemeris generate(const std::vector<Eci>& trajectory) const { return generateImpl(trajectory); }
+
+  private:
+	static constexpr std::size_t sample_chunk = 256;
+
+	GeoMagFlux m_flux;
+	FieldEphemerisConfig m_config;
+
+	struct Range {
+		std::size_t first; // 区間先頭のサンプル
+		std::size_t last;  // 区間末尾のサンプル (次の区間の先頭と共有する)
+	};
+
+	template <class Position>
+	FieldEphemeris generateImpl(const std::vector<Position>& trajectory) const {
+		if (trajectory.size() < 2) {
+			throw std::runtime_error("FieldEphemerisGenerator: trajectory needs at least two samples.");
+		}
+
+		FieldEphemeris ephemeris;
+		ephemeris.epoch = trajectory.front().epoch();
+		ephemeris.frame = m_config.frame;
+
+		const std::size_t size = trajectory.size();
+		std::vector<double> t(size);
+		for (std::size_t i = 0; i < size; i++) {
+			t[i] = (trajectory[i].epoch() - ephemeris.epoch).ticks() / static_cast<double>(constant::ticks_per_second);
+			if (i > 0 && !(t[i] > t[i - 1])) {
+				throw std::runtime_error("FieldEphemerisGenerator: trajectory epochs must be strictly increasing.");
+			}
+		}
+
+		// 全サンプルでの磁束密度
+		const std::size_t threads = Parallel::threadCount(m_config.num_threads);
+		std::vector<GeoMagFlux> fluxes(threads, m_flux);
+		std::vector<Eigen::Vector3d> samples(size);
+		Parallel::forEachChunk(
+		  0, size, sample_chunk,
+		  [&](std::size_t thread_index, std::size_t b, std::size_t e) {
+			  for (std::size_t i = b; i < e; i++) {
+				  samples[i] = sample(fluxes[thread_index], trajectory[i]);
+			  }
+		  },
+		  threads);
+
+		// サンプル間の中点での磁束密度 (フィッティングには使わず、残差の確認だけに使う)
+		std::vector<Eigen::Vector3d> midpoints(size - 1);
+		Parallel::forEachChunk(
+		  0, size - 1, sample_chunk,
+		  [&](std::size_t thread_index, std::size_t b, std::size_t e) {
+			  for (std::size_t i = b; i < e; i++) {
+				  midpoints[i] = sample(fluxes[thread_index], midpoint(trajectory, t, i));
+			  }
+		  },
+		  threads);
+
+		// 区間長の上限で初期分割し、区間ごとに並列でフィッティングする
+		std::vector<Range> ranges;
+		for (std::size_t first = 0; first + 1 < size;) {
+			std::size_t last = first + 1;
+			while (last + 1 < size && t[last + 1] - t[first] <= m_config.max_segment_duration) {
+				last++;
+			}
+			ranges.push_back({first, last});
+			first = last;
+		}
+
+		std::vector<std::vector<ChebyshevSegment>> fitted(ranges.size());
+		Parallel::forEach(
+		  0, ranges.size(), [&](std::size_t, std::size_t i) { fitRange(t, samples, midpoints, ranges[i], fitted[i]); }, threads);
+
+		for (auto& f : fitted) {
+			ephemeris.segments.insert(ephemeris.segments.end(), f.begin(), f.end());
+		}
+		return ephemeris;
+	}
+
+	Eigen::Vector3d sample(GeoMagFlux& flux, const Ecef& position) const {
+		switch (m_config.frame) {
+			case EphemerisFrame::Ned: return flux(position.toWgs84());
+			case EphemerisFrame::Ecef: return flux.ecefFlux(position);
+			case EphemerisFrame::Eci: return ecefToEci(position.epoch(), flux.ecefFlux(position));
+			default: throw std::runtime_error("FieldEphemerisGenerator: invalid frame.");
+		}
+	}
+
+	Eigen::Vector3d sample(GeoMagFlux& flux, const Eci& position) const { return sample(flux, position.toEcef()); }
+
+	/**
+	 * @brief サンプルiとi+1の中間時刻の位置を前後4点 (端では3点) のラグランジュ補間で求める
+	 *
+	 */
+	template <class Position>
+	static Position midpoint(const std::vector<Position>& trajectory, const std::vector<double>& t, std::size_t i) {
+		const std::size_t first = i == 0 ? 0 : i - 1;
+		const std::size_t last = std::min(i + 2, trajectory.size() - 1);
+		const double time = 0.5 * (t[i] + t[i + 1]);
+		Eigen::Vector3d position = Eigen::Vector3d::Zero();
+		for (std::size_t j = first; j <= last; j++) {
+			double weight = 1.0;
+			for (std::size_t k = first; k <= last; k++) {
+				if (k != j) {
+					weight *= (time - t[k]) / (t[j] - t[k]);
+				}
+			}
+			position += weight * trajectory[j].elements();
+		}
+		DateTime epoch = trajectory[i].epoch();
+		return Position{epoch.addTicks((trajectory[i + 1].epoch() - trajectory[i].epoch()).ticks() / 2), position};
+	}
+
+	static Eigen::Vector3d ecefToEci(const DateTime& dt, const Eigen::Vector3d& v) {
+		const double theta = dt.greenwichSiderealTime().radians();
+		const double c = std::cos(theta), s = std::sin(theta);
+		return Eigen::Vector3d{v.x() * c - v.y() * s, v.x() * s + v.y() * c, v.z()};
+	}
+
+	/**
+	 * @brief 区間をフィッティングし、許容誤差を超える場合は二分割して再帰する
+	 * @remark サンプルが次数より少ない区間は次数を下げて当てはめ、中点の残差で確かめる。
+	 *         1サンプル間隔まで分割しても収まらない区間にはtolerance_exceededを立てる
+	 *
+	 */
+	void fitRange(const std::vector<double>& t, const std::vector<Eigen::Vector3d>& samples, const std::vector<Eigen::Vector3d>& midpoints,
+				  const Range& range, std::vector<ChebyshevSegment>& out) const {
+		ChebyshevSegment segment;
+		fitSegment(t, samples, midpoints, range, segment);
+
+		if (segment.max_error <= m_config.tolerance) {
+			out.push_back(segment);
+		} else if (range.last - range.first >= 2) {
+			const std::size_t mid = range.first + (range.last - range.first) / 2;
+			fitRange(t, samples, midpoints, Range{range.first, mid}, out);
+			fitRange(t, samples, midpoints, Range{mid, range.last}, out);
+		} else {
+			segment.flags |= ChebyshevSegment::tolerance_exceeded;
+			out.push_back(segment);
+		}
+	}
+
+	/**
+	 * @brief 区間内のサンプルに最小二乗でチェビシェフ多項式を当てはめる
+	 * @remark 残差はサンプルに加えて、当てはめに使っていないサンプル間の中点でも求める
+	 *
+	 */
+	void fitSegment(const std::vector<double>& t, const std::vector<Eigen::Vector3d>& samples,
+					const std::vector<Eigen::Vector3d>& midpoints, const Range& range, ChebyshevSegment& segment) const {
+		const std::size_t count = range.last - range.first + 1;
+		const std::size_t degree = std::min(m_config.degree, count - 1);
+		const double begin = t[range.first], end = t[range.last];
+		const double offset = 0.5 * (begin + end), scale = 2.0 / (end - begin);
+
+		// 先頭count行がサンプル、残りのcount - 1行が中点
+		Eigen::MatrixXd a(2 * count - 1, degree + 1);
+		Eigen::MatrixXd y(2 * count - 1, 3);
+		for (std::size_t i = 0; i < 2 * count - 1; i++) {
+			const std::size_t j = range.first + (i < count ? i : i - count);
+			const double time = i < count ? t[j] : 0.5 * (t[j] + t[j + 1]);
+			const double x = (time - offset) * scale;
+			a(i, 0) = 1.0;
+			if (degree >= 1) {
+				a(i, 1) = x;
+			}
+			for (std::size_t k = 2; k <= degree; k++) {
+				a(i, k) = 2.0 * x * a(i, k - 1) - a(i, k - 2);
+			}
+			y.row(i) = (i < count ? samples[j] : midpoints[j]).transpose();
+		}
+
+		// チェビシェフ基底はサンプル上でほぼ直交するので正規方程式で十分に安定
+		const auto nodes = a.topRows(count);
+		const Eigen::MatrixXd c = (nodes.transpose() * nodes).ldlt().solve(nodes.transpose() * y.topRows(count));
+		const Eigen::MatrixXd residual = a * c - y;
+
+		segment = ChebyshevSegment{};
+		segment.begin = begin;
+		segment.end = end;
+		segment.degree = static_cast<std::uint32_t>(degree);
+		segment.max_error = residual.cwiseAbs().maxCoeff();
+		for (std::size_t comp = 0; comp < 3; comp++) {
+			for (std::size_t k = 0; k <= degree; k++) {
+				segment.coefficients[comp][k] = c(k, comp);
+			}
+		}
+	}
+};
+
+GEOMAG_NAMESPACE_END
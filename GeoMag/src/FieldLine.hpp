@@ -0,0 +1,72 @@
+/**
+ * @file FieldLine.hpp
+ * @author Kaiji Takeuchi
+ * @brief 磁力線の方向の積分 (L*と足跡の計算で共有する)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "../../Eigen/Core"
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Model.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 1つの時刻の磁場で磁力線の方向をRK4で1刻みずつ進める
+ * @remark 磁束密度は[nT]、位置はECEF [m] で扱う。刻みの決め方と打ち切りは使う側 (FieldLineTracer, FootprintTracer) が持つ
+ *
+ */
+class FieldLineStepper {
+  public:
+	explicit FieldLineStepper(const GeoMagFlux& flux) : m_flux(flux) { m_flux.setOutputUnit(MagFluxUnit::NanoTesla); }
+
+	void setEpoch(const DateTime& epoch) { m_epoch = epoch; }
+	const DateTime& epoch() const { return m_epoch; }
+
+	/**
+	 * @brief 時刻epochのモデルの係数
+	 *
+	 */
+	const Model& model(const DateTime& epoch) { return m_flux.model(epoch); }
+
+	/**
+	 * @brief 磁束密度 [nT] (ECEF成分)
+	 *
+	 */
+	Eigen::Vector3d field(const Eigen::Vector3d& position) { return m_flux.ecefFlux(Ecef{m_epoch, position}); }
+
+	/**
+	 * @brief 磁力線の方向に1刻み進める (進んだ先の磁場も返し、次の刻みの最初の評価に使う)
+	 *
+	 * @param x 位置 [m]
+	 * @param b xでの磁束密度 [nT]
+	 * @param h 刻み [m] (負なら磁場と逆向きに進む)
+	 * @param b_next 進んだ先での磁束密度 [nT]
+	 * @return Eigen::Vector3d 進んだ先の位置 [m]
+	 */
+	Eigen::Vector3d advance(const Eigen::Vector3d& x, const Eigen::Vector3d& b, double h, Eigen::Vector3d& b_next) {
+		const Eigen::Vector3d k1 = b.normalized();
+		const Eigen::Vector3d k2 = field(x + 0.5 * h * k1).normalized();
+		const Eigen::Vector3d k3 = field(x + 0.5 * h * k2).normalized();
+		const Eigen::Vector3d k4 = field(x + h * k3).normalized();
+		const Eigen::Vector3d x_next = x + h / 6.0 * (k1 + 2.0 * k2 + 2.0 * k3 + k4);
+		b_next = field(x_next);
+		return x_next;
+	}
+
+  private:
+	GeoMagFlux m_flux;
+	DateTime m_epoch{std::int64_t{0}};
+};
+
+GEOMAG_NAMESPACE_END
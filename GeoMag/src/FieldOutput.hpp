@@ -0,0 +1,58 @@
+/**
+ * @file FieldOutput.hpp
+ * @author Kaiji Takeuchi
+ * @brief 磁場の評価で求める量をコンパイル時に選ぶためのビットマスク
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include "../../Eigen/Core"
+#include "Essential.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 求める量 (組み合わせてテンプレート引数に渡す)
+ * @remark 要求しない量に必要な漸化式・和・回転はコンパイル時に取り除かれる。
+ *         Geodeticがない場合の成分は地心球座標系のNED (Wgs84入力でも測地座標系へ回転しない)
+ *
+ */
+enum class FieldOutput : unsigned {
+	None = 0,
+	North = 1u << 0,			// 北向き成分
+	East = 1u << 1,				// 東向き成分
+	Down = 1u << 2,				// 下向き成分
+	Vector = North | East | Down,
+	Potential = 1u << 3,		// スカラーポテンシャル
+	SecularVariation = 1u << 4, // 要求した成分の時間微分
+	RadialGradient = 1u << 5,	// 要求した成分の地心動径方向の微分
+	Geodetic = 1u << 6,			// 成分を測地座標系のNEDにする
+	Field = Vector | Geodetic,	// operator()と同じ磁束密度
+};
+
+constexpr FieldOutput operator|(FieldOutput a, FieldOutput b) { return static_cast<FieldOutput>(static_cast<unsigned>(a) | static_cast<unsigned>(b)); }
+constexpr FieldOutput operator&(FieldOutput a, FieldOutput b) { return static_cast<FieldOutput>(static_cast<unsigned>(a) & static_cast<unsigned>(b)); }
+
+/**
+ * @brief outputsがflagのビットを1つでも含むか
+ *
+ */
+constexpr bool hasFieldOutput(FieldOutput outputs, FieldOutput flag) { return (outputs & flag) != FieldOutput::None; }
+
+/**
+ * @brief 選んだ量の評価結果 (要求しなかった量は0のまま)
+ *
+ */
+struct FieldSample {
+	Eigen::Vector3d field = Eigen::Vector3d::Zero();			 // 磁束密度のNED成分 [出力単位]
+	Eigen::Vector3d secular_variation = Eigen::Vector3d::Zero(); // 磁束密度の時間微分 [出力単位/year]
+	Eigen::Vector3d radial_gradient = Eigen::Vector3d::Zero();	 // 磁束密度の地心動径方向の微分 [出力単位/m]
+	double potential = 0.0;										 // スカラーポテンシャル (B = -∇V) [出力単位 m]
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,276 @@
+/**
+ * @file FileHandle.hpp
+ * @author Kaiji Takeuchi
+ * @brief 位置を指定して読み書きできるファイル (POSIX / 標準ライブラリ)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include "Essential.hpp"
+
+#if GEOMAG_HAS_POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <mutex>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 位置を指定して読み書きできるファイル
+ * @remark POSIXではファイル記述子にpread/pwriteを使い、複数のスレッドから同時に読み書きできる。
+ *         それ以外の環境では標準ライブラリのファイルをシークして読み書きし、1度に1つの操作だけを行う。
+ *         読み書きの関数は失敗するとerrnoを設定して-1を返す
+ *
+ */
+class FileHandle {
+  public:
+	enum class Mode {
+		Read,  // 読み込み
+		Write, // 作成して書き込む (既存の内容は消す)
+	};
+
+	FileHandle() = default;
+
+	/**
+	 * @brief ファイルを開く
+	 *
+	 * @param path ファイルのパス
+	 * @param mode 読み込みか書き込みか
+	 * @param name エラーメッセージに付ける名前
+	 */
+	FileHandle(const std::string& path, Mode mode, const char* name) {
+#if GEOMAG_HAS_POSIX
+		const int flags = mode == Mode::Read ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC;
+		m_fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+		if (m_fd < 0) {
+			throw std::runtime_error(std::string(name) + ": cannot open " + path + ": " + std::strerror(errno));
+		}
+		m_owns = true;
+#else
+		m_state.reset(new State);
+		const auto flags = mode == Mode::Read ? std::ios::in : std::ios::out | std::ios::trunc;
+		if (m_state->file.open(path, flags | std::ios::binary) == nullptr) {
+			m_state.reset();
+			throw std::runtime_error(std::string(name) + ": cannot open " + path);
+		}
+#endif
+	}
+
+#if GEOMAG_HAS_POSIX
+	/**
+	 * @brief 開いているファイル記述子 (標準入出力など) を使う
+	 * @remark ファイル記述子は閉じない
+	 *
+	 */
+	explicit FileHandle(int fd) : m_fd(fd) {}
+
+	int fd() const { return m_fd; }
+#endif
+
+	FileHandle(const FileHandle&) = delete;
+	FileHandle& operator=(const FileHandle&) = delete;
+
+#if GEOMAG_HAS_POSIX
+	FileHandle(FileHandle&& other) noexcept : m_fd(other.m_fd), m_owns(other.m_owns) {
+		other.m_fd = -1;
+		other.m_owns = false;
+	}
+
+	FileHandle& operator=(FileHandle&& other) noexcept {
+		if (this != &other) {
+			std::swap(m_fd, other.m_fd);
+			std::swap(m_owns, other.m_owns);
+		}
+		return *this;
+	}
+#else
+	FileHandle(FileHandle&&) = default;
+	FileHandle& operator=(FileHandle&&) = default;
+#endif
+
+	~FileHandle() {
+		try {
+			close();
+		} catch (std::exception&) {
+		}
+	}
+
+	auto isOpen() const -> bool {
+#if GEOMAG_HAS_POSIX
+		return m_fd >= 0;
+#else
+		return m_state != nullptr;
+#endif
+	}
+
+	/**
+	 * @brief オフセットを指定して読み書きできるか
+	 * @remark O_APPENDのファイルは位置指定の書き込みでも末尾に追記されるので逐次として扱う
+	 *
+	 */
+	auto seekable() const -> bool {
+#if GEOMAG_HAS_POSIX
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+			return false;
+		}
+		const int flags = fcntl(m_fd, F_GETFL);
+		return flags >= 0 && (flags & O_APPEND) == 0;
+#else
+		return isOpen(); // パスから開いた通常のファイルだけを扱う
+#endif
+	}
+
+	/**
+	 * @brief 現在位置 (位置指定の読み書きは現在位置を動かさない)
+	 *
+	 */
+	auto position() const -> std::int64_t {
+#if GEOMAG_HAS_POSIX
+		return std::max<std::int64_t>(lseek(m_fd, 0, SEEK_CUR), 0);
+#else
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return std::max<std::int64_t>(static_cast<std::int64_t>(m_state->file.pubseekoff(0, std::ios::cur)), 0);
+#endif
+	}
+
+	void seek(std::int64_t offset) {
+#if GEOMAG_HAS_POSIX
+		lseek(m_fd, static_cast<off_t>(offset), SEEK_SET);
+#else
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		m_state->file.pubseekpos(static_cast<std::streamoff>(offset));
+#endif
+	}
+
+	/**
+	 * @brief 先頭から順に読むことを伝える (先読みを増やす)
+	 *
+	 */
+	void adviseSequential() const {
+#if GEOMAG_HAS_POSIX && defined(POSIX_FADV_SEQUENTIAL)
+		posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+
+	auto readAt(char* data, std::size_t size, std::int64_t offset) const -> std::ptrdiff_t {
+#if GEOMAG_HAS_POSIX
+		return pread(m_fd, data, size, static_cast<off_t>(offset));
+#else
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		if (!seekTo(offset)) {
+			return -1;
+		}
+		return transferred(m_state->file.sgetn(data, static_cast<std::streamsize>(size)), size, false);
+#endif
+	}
+
+	auto writeAt(const char* data, std::size_t size, std::int64_t offset) const -> std::ptrdiff_t {
+#if GEOMAG_HAS_POSIX
+		return pwrite(m_fd, data, size, static_cast<off_t>(offset));
+#else
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		if (!seekTo(offset)) {
+			return -1;
+		}
+		return transferred(m_state->file.sputn(data, static_cast<std::streamsize>(size)), size, true);
+#endif
+	}
+
+	/**
+	 * @brief 現在位置から読む (逐次デバイス用)
+	 *
+	 */
+	auto read(char* data, std::size_t size) const -> std::ptrdiff_t {
+#if GEOMAG_HAS_POSIX
+		return ::read(m_fd, data, size);
+#else
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return transferred(m_state->file.sgetn(data, static_cast<std::streamsize>(size)), size, false);
+#endif
+	}
+
+	auto write(const char* data, std::size_t size) const -> std::ptrdiff_t {
+#if GEOMAG_HAS_POSIX
+		return ::write(m_fd, data, size);
+#else
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		return transferred(m_state->file.sputn(data, static_cast<std::streamsize>(size)), size, true);
+#endif
+	}
+
+	/**
+	 * @brief 自分で開いたファイルを閉じる
+	 *
+	 */
+	void close() {
+#if GEOMAG_HAS_POSIX
+		const int fd = m_fd;
+		const bool owns = m_owns;
+		m_fd = -1;
+		m_owns = false;
+		if (owns && ::close(fd) != 0) {
+			throw std::runtime_error(std::string("FileHandle: close: ") + std::strerror(errno));
+		}
+#else
+		std::unique_ptr<State> state = std::move(m_state);
+		if (state != nullptr && state->file.close() == nullptr) {
+			throw std::runtime_error("FileHandle: close failed");
+		}
+#endif
+	}
+
+  private:
+#if GEOMAG_HAS_POSIX
+	int m_fd = -1;
+	bool m_owns = false;
+#else
+	struct State {
+		std::filebuf file;
+		std::mutex mutex;
+	};
+
+	std::unique_ptr<State> m_state;
+
+	auto seekTo(std::int64_t offset) const -> bool {
+		if (m_state->file.pubseekpos(static_cast<std::streamoff>(offset)) == std::streampos(std::streamoff(-1))) {
+			errno = EIO;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief 読み書きした大きさを返す。書き込みが1バイトも進まなければ失敗とする
+	 *
+	 */
+	static auto transferred(std::streamsize n, std::size_t size, bool write) -> std::ptrdiff_t {
+		if (write && n <= 0 && size > 0) {
+			errno = EIO;
+			return -1;
+		}
+		return static_cast<std::ptrdiff_t>(std::max<std::streamsize>(n, 0));
+	}
+#endif
+};
+
+GEOMAG_NAMESPACE_END
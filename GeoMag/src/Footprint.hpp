@@ -0,0 +1,907 @@
+/**
+ * @file Footprint.hpp
+ * @author Kaiji Takeuchi
+ * @brief 磁力線の足跡と磁気共役点の表 (モデルの時刻ごと)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../Eigen/Core"
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "FieldLine.hpp"
+#include "GeoMagFlux.hpp"
+#include "MappedFile.hpp"
+#include "Model.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 足跡の表の格子 (測地緯度・経度・高度の直方体)
+ *
+ */
+struct FootprintLattice {
+	std::size_t rows = 2;	// 緯度方向の格子点数 (2以上)
+	std::size_t cols = 2;	// 経度方向の格子点数 (2以上)
+	std::size_t levels = 2; // 高度方向の格子点数 (2以上)
+	double south = 0.0;		// 南端の緯度 [deg]
+	double west = 0.0;		// 西端の経度 [deg]
+	double dlat = 1.0;		// 緯度の間隔 [deg]
+	double dlon = 1.0;		// 経度の間隔 [deg]
+	double bottom = 0.0;	// 最も低い高度 [m]
+	double dalt = 1.0e3;	// 高度の間隔 [m]
+};
+
+/**
+ * @brief 足跡の計算の設定
+ *
+ */
+struct FootprintConfig {
+	double footprint_altitude = 110e3;	// 足跡を求める高度 (WGS84楕円体から) [m]
+	double step = 0.02;					// 磁力線の積分の刻み (地心距離に対する比)
+	std::size_t max_steps = 20000;		// 片側の刻みの数の上限
+	double max_radius = 30.0;			// これより遠くに達した磁力線は開いているとみなす [地球半径]
+	double tolerance = 2e3;				// 補間の誤差の見積りの許容値 [m] (超えるセルは細分し、それでも超えれば直接たどる)
+	std::size_t refine_factor = 4;		// 細分で1つのセルを各方向に何分割するか
+	std::size_t max_refinements = 4096; // 細分したセルを保持する数の上限
+	std::size_t num_threads = 0;		// 表を作るスレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief 足跡を何から求めたか
+ *
+ */
+enum class FootprintSource {
+	Table,	 // 表の補間
+	Refined, // 細分した表の補間
+	Traced,	 // 磁力線を直接たどった
+};
+
+/**
+ * @brief 足跡と磁気共役点
+ *
+ */
+struct FootprintResult {
+	Wgs84 north;			  // 北側の足跡 (磁場の向きにたどった先。無効ならNaN)
+	Wgs84 south;			  // 南側の足跡 (磁場と逆向きにたどった先)
+	bool north_valid = false; // 北側の足跡がある (磁力線が閉じている)
+	bool south_valid = false;
+	bool northern = true;	// 問い合わせた点は北側の足跡に近い
+	double error = 0.0;		// 足跡の位置の誤差の見積り [m] (空間の補間の分だけで、表の時刻の間の補間の誤差は含まない)
+	FootprintSource source = FootprintSource::Table;
+
+	/**
+	 * @brief 磁気共役点 (問い合わせた点と反対側の足跡)
+	 *
+	 */
+	const Wgs84& conjugate() const { return northern ? south : north; }
+	bool conjugateValid() const { return northern ? south_valid : north_valid; }
+};
+
+/**
+ * @brief 1点の両側の足跡 (地心方向の単位ベクトル)
+ *
+ */
+struct FootprintSample {
+	Eigen::Vector3d north = Eigen::Vector3d::Zero();
+	Eigen::Vector3d south = Eigen::Vector3d::Zero();
+	bool north_valid = false;
+	bool south_valid = false;
+	double error = 0.0;	   // 誤差の見積り [m]
+	std::size_t cell = 0; // 表のセルの番号
+};
+
+/**
+ * @brief 1つの時刻の磁場で磁力線をたどり、足跡の高度の面との交点を求める
+ * @remark 磁力線の方向をFieldLineStepper (RK4) で積分し、刻みは地心距離と足跡の面までの高さに比例させる。
+ *         磁場の向きに進んで面を下向きに横切る点を北側、逆向きに進んで下向きに横切る点を南側の足跡とするので、
+ *         面より低い点 (地上の観測点など) からも両側の足跡が求まる
+ *
+ */
+class FootprintTracer {
+  public:
+	static constexpr double reference_radius = 6371.2e3; // 地球半径の単位 [m]
+
+	FootprintTracer(const GeoMagFlux& flux, const FootprintConfig& config) : m_stepper(flux), m_config(config) {}
+
+	void setEpoch(const DateTime& epoch) { m_stepper.setEpoch(epoch); }
+	const DateTime& epoch() const { return m_stepper.epoch(); }
+
+	/**
+	 * @brief 点を通る磁力線の両側の足跡を求める
+	 *
+	 * @param start 磁力線上の点 (ECEF) [m]
+	 */
+	FootprintSample trace(const Eigen::Vector3d& start) {
+		FootprintSample sample;
+		const double outer = m_config.max_radius * reference_radius;
+		const double start_height = height(start);
+		const double floor = std::min(start_height, 0.0) - 10e3; // 出発点より下へ進み続ける側は打ち切る
+		const Eigen::Vector3d b0 = m_stepper.field(start);
+
+		for (int side = 0; side < 2; side++) {
+			const double direction = side == 0 ? 1.0 : -1.0;
+			Eigen::Vector3d x = start, b = b0;
+			double g = start_height;
+			for (std::size_t n = 0; n < m_config.max_steps; n++) {
+				// 足跡の面の近くでは刻みを縮めて交点を正確にする
+				const double h = m_config.step * std::min(x.norm(), 2.0 * std::fabs(g) + 0.01 * reference_radius);
+				Eigen::Vector3d b_next;
+				const Eigen::Vector3d x_next = m_stepper.advance(x, b, direction * h, b_next);
+				if (x_next.norm() > outer) {
+					break;
+				}
+				const double g_next = height(x_next);
+				if ((g >= 0.0) != (g_next >= 0.0)) {
+					const Eigen::Vector3d crossing = (x + g / (g - g_next) * (x_next - x)).normalized();
+					if ((g_next < 0.0) == (direction > 0.0)) {
+						if (!sample.north_valid) {
+							sample.north = crossing;
+							sample.north_valid = true;
+						}
+					} else if (!sample.south_valid) {
+						sample.south = crossing;
+						sample.south_valid = true;
+					}
+					if (g_next < 0.0) {
+						break;
+					}
+				}
+				if (g_next < floor) {
+					break;
+				}
+				x = x_next;
+				b = b_next;
+				g = g_next;
+			}
+		}
+		return sample;
+	}
+
+	/**
+	 * @brief 地心方向の単位ベクトルから足跡の面の上の点 (ECEF) [m] を求める
+	 *
+	 */
+	Eigen::Vector3d shellPoint(const Eigen::Vector3d& direction) const {
+		return (ellipsoidRadius(direction) + m_config.footprint_altitude) * direction;
+	}
+
+	/**
+	 * @brief 足跡の面からの高さ (地心方向に測る) [m]
+	 *
+	 */
+	double height(const Eigen::Vector3d& position) const {
+		return position.norm() - ellipsoidRadius(position) - m_config.footprint_altitude;
+	}
+
+	/**
+	 * @brief 地心方向に沿ったWGS84楕円体の半径 [m]
+	 *
+	 */
+	static double ellipsoidRadius(const Eigen::Vector3d& direction) {
+		constexpr double a = constant::wgs84_a;
+		constexpr double b = constant::wgs84_b;
+		const double p2 = direction.x() * direction.x() + direction.y() * direction.y();
+		const double z2 = direction.z() * direction.z();
+		return a * b * std::sqrt((p2 + z2) / (b * b * p2 + a * a * z2));
+	}
+
+  private:
+	FieldLineStepper m_stepper;
+	FootprintConfig m_config;
+};
+
+/**
+ * @brief 足跡の表のファイルのヘッダ (128 byte)
+ * @remark ヘッダの後の64 byte境界から格子点ごとのfloat32 x 6 (北・南の足跡の地心方向の単位ベクトル。足跡がなければNaN) が
+ *         高度・緯度・経度の順 (経度が最も内側) に並び、その後の64 byte境界からセルごとの誤差の見積り (float32 [m]) が同じ順に並ぶ。
+ *         バイト順はホストの順
+ *
+ */
+struct FootprintTableHeader {
+	static constexpr std::uint32_t current_version = 1;
+
+	static const char* magicString() { return "GMFOOT1"; } // 終端の0を含めて8 byte
+
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t rows;
+	std::uint32_t cols;
+	std::uint32_t levels;
+	std::int64_t epoch; // 表の時刻 [tick]
+	double footprint_altitude;
+	double south;
+	double west;
+	double dlat;
+	double dlon;
+	double bottom;
+	double dalt;
+	std::uint64_t nodes_offset;	 // ファイルの先頭からの格子点の値の位置 [byte]
+	std::uint64_t errors_offset; // ファイルの先頭からのセルの誤差の位置 [byte]
+	std::uint64_t reserved[3];
+};
+
+static_assert(sizeof(FootprintTableHeader) == 128, "FootprintTableHeader: unexpected padding");
+
+/**
+ * @brief 1つの時刻の足跡の表
+ * @remark 格子点の足跡を三線形補間し、単位ベクトルに戻す。各セルの誤差は作るときにセルの中心と6つの面の中点を直接たどって
+ *         補間と比べた距離の最大値で、格子点の足跡の有無が混ざるセルは無限大になる
+ *
+ */
+class FootprintTable {
+  public:
+	static constexpr std::size_t node_floats = 6;
+
+	/**
+	 * @brief バイナリ形式のファイルを割り当てる
+	 *
+	 * @param path ファイルのパス (saveで書き出したもの)
+	 */
+	explicit FootprintTable(const std::string& path) : m_file(path, MappedFile::Access::Random) {
+		if (m_file.size() < sizeof(FootprintTableHeader)) {
+			throw std::runtime_error("FootprintTable: " + path + " is too small");
+		}
+		FootprintTableHeader header;
+		std::memcpy(&header, m_file.data(), sizeof(header));
+		if (std::memcmp(header.magic, FootprintTableHeader::magicString(), sizeof(header.magic)) != 0) {
+			throw std::runtime_error("FootprintTable: " + path + " is not a footprint table");
+		}
+		if (header.version != FootprintTableHeader::current_version) {
+			throw std::runtime_error("FootprintTable: unsupported version of " + path);
+		}
+		m_lattice = FootprintLattice{header.rows,	  header.cols, header.levels, header.south, header.west,
+									 header.dlat, header.dlon, header.bottom, header.dalt};
+		checkLattice(m_lattice);
+		m_epoch = DateTime(header.epoch);
+		m_footprint_altitude = header.footprint_altitude;
+		if (header.nodes_offset + nodes() * node_floats * sizeof(float) > m_file.size() ||
+			header.errors_offset + cells() * sizeof(float) > m_file.size() || header.nodes_offset % alignof(float) != 0 ||
+			header.errors_offset % alignof(float) != 0) {
+			throw std::runtime_error("FootprintTable: values of " + path + " are outside the file");
+		}
+		m_nodes = reinterpret_cast<const float*>(m_file.data() + header.nodes_offset);
+		m_errors = reinterpret_cast<const float*>(m_file.data() + header.errors_offset);
+	}
+
+	/**
+	 * @brief 格子点の磁力線をたどって表を作る
+	 *
+	 * @param flux 磁場の評価器
+	 * @param epoch 表の時刻
+	 * @param lattice 格子
+	 * @param config 設定
+	 */
+	static FootprintTable build(const GeoMagFlux& flux, const DateTime& epoch, const FootprintLattice& lattice,
+								const FootprintConfig& config = FootprintConfig{}) {
+		std::vector<FootprintTracer> tracers(Parallel::threadCount(config.num_threads), FootprintTracer(flux, config));
+		return build(tracers, epoch, lattice, config.footprint_altitude);
+	}
+
+	/**
+	 * @brief 格子点の磁力線をたどって表を作る (スレッドごとの追跡器を与える)
+	 *
+	 */
+	static FootprintTable build(std::vector<FootprintTracer>& tracers, const DateTime& epoch, const FootprintLattice& lattice,
+								double footprint_altitude) {
+		checkLattice(lattice);
+		FootprintTable table(lattice, epoch, footprint_altitude);
+		for (auto& tracer : tracers) {
+			tracer.setEpoch(epoch);
+		}
+		float* nodes = table.m_storage.data();
+		float* errors = nodes + table.nodes() * node_floats;
+		const std::size_t rows = lattice.rows, cols = lattice.cols;
+
+		Parallel::forEachChunk(
+		  0, table.nodes(), 16,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  for (std::size_t n = begin; n < end; n++) {
+				  const std::size_t level = n / (rows * cols), row = n / cols % rows, col = n % cols;
+				  const FootprintSample sample = tracers[thread_index].trace(position(lattice, epoch, row, col, level, 0.0, 0.0, 0.0));
+				  store(sample, nodes + n * node_floats);
+			  }
+		  },
+		  tracers.size());
+
+		// セルの中心と面の中点を直接たどって、補間の誤差を見積もる。
+		// 面の上の補間はその面の4つの格子点だけで決まるので、面の中点は隣り合うセルで共有して1度だけたどる
+		const std::size_t levels = lattice.levels;
+		const std::size_t cells = table.cells();
+		const std::size_t row_faces = (levels - 1) * rows * (cols - 1); // 行の方向に垂直な面
+		const std::size_t col_faces = (levels - 1) * (rows - 1) * cols; // 列の方向に垂直な面
+		const std::size_t level_faces = levels * (rows - 1) * (cols - 1);
+		std::vector<float> sampled(cells + row_faces + col_faces + level_faces);
+		const double shell = constant::wgs84_a + footprint_altitude;
+		Parallel::forEachChunk(
+		  0, sampled.size(), 16,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  for (std::size_t s = begin; s < end; s++) {
+				  std::size_t level, row, col;
+				  double tr = 0.5, tc = 0.5, tl = 0.5;
+				  if (s < cells) {
+					  level = s / ((rows - 1) * (cols - 1)), row = s / (cols - 1) % (rows - 1), col = s % (cols - 1);
+				  } else if (s < cells + row_faces) {
+					  const std::size_t f = s - cells;
+					  level = f / (rows * (cols - 1)), row = f / (cols - 1) % rows, col = f % (cols - 1);
+					  tr = row == rows - 1 ? 1.0 : 0.0;
+					  row -= row == rows - 1 ? 1 : 0;
+				  } else if (s < cells + row_faces + col_faces) {
+					  const std::size_t f = s - cells - row_faces;
+					  level = f / ((rows - 1) * cols), row = f / cols % (rows - 1), col = f % cols;
+					  tc = col == cols - 1 ? 1.0 : 0.0;
+					  col -= col == cols - 1 ? 1 : 0;
+				  } else {
+					  const std::size_t f = s - cells - row_faces - col_faces;
+					  level = f / ((rows - 1) * (cols - 1)), row = f / (cols - 1) % (rows - 1), col = f % (cols - 1);
+					  tl = level == levels - 1 ? 1.0 : 0.0;
+					  level -= level == levels - 1 ? 1 : 0;
+				  }
+				  const FootprintSample exact = tracers[thread_index].trace(position(lattice, epoch, row, col, level, tr, tc, tl));
+				  FootprintSample approx;
+				  interpolate(nodes, lattice, row, col, level, tr, tc, tl, approx);
+				  const double north = distance(approx.north_valid, approx.north, exact.north_valid, exact.north);
+				  const double south = distance(approx.south_valid, approx.south, exact.south_valid, exact.south);
+				  sampled[s] = static_cast<float>(std::max(approx.error, std::max(north, south) * shell));
+			  }
+		  },
+		  tracers.size());
+
+		// セルの誤差は中心と6つの面の中点の誤差の最大値
+		for (std::size_t c = 0; c < cells; c++) {
+			const std::size_t level = c / ((rows - 1) * (cols - 1)), row = c / (cols - 1) % (rows - 1), col = c % (cols - 1);
+			const float* row_face = sampled.data() + cells + (level * rows + row) * (cols - 1) + col;
+			const float* col_face = sampled.data() + cells + row_faces + (level * (rows - 1) + row) * cols + col;
+			const float* level_face = sampled.data() + cells + row_faces + col_faces + c;
+			errors[c] = std::max({sampled[c], row_face[0], row_face[cols - 1], col_face[0], col_face[1], level_face[0],
+								  level_face[(rows - 1) * (cols - 1)]});
+		}
+		return table;
+	}
+
+	FootprintTable(FootprintTable&&) = default;
+	FootprintTable& operator=(FootprintTable&&) = default;
+
+	/**
+	 * @brief バイナリ形式で書き出す
+	 *
+	 * @param path ファイルのパス
+	 */
+	void save(const std::string& path) const {
+		FootprintTableHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, FootprintTableHeader::magicString(), sizeof(header.magic));
+		header.version = FootprintTableHeader::current_version;
+		header.rows = static_cast<std::uint32_t>(m_lattice.rows);
+		header.cols = static_cast<std::uint32_t>(m_lattice.cols);
+		header.levels = static_cast<std::uint32_t>(m_lattice.levels);
+		header.epoch = m_epoch.ticks();
+		header.footprint_altitude = m_footprint_altitude;
+		header.south = m_lattice.south;
+		header.west = m_lattice.west;
+		header.dlat = m_lattice.dlat;
+		header.dlon = m_lattice.dlon;
+		header.bottom = m_lattice.bottom;
+		header.dalt = m_lattice.dalt;
+		const std::size_t node_bytes = nodes() * node_floats * sizeof(float);
+		header.nodes_offset = (sizeof(header) + alignment - 1) / alignment * alignment;
+		header.errors_offset = (header.nodes_offset + node_bytes + alignment - 1) / alignment * alignment;
+
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		const char padding[alignment] = {};
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		ofs.write(padding, static_cast<std::streamsize>(header.nodes_offset - sizeof(header)));
+		ofs.write(reinterpret_cast<const char*>(m_nodes), static_cast<std::streamsize>(node_bytes));
+		ofs.write(padding, static_cast<std::streamsize>(header.errors_offset - header.nodes_offset - node_bytes));
+		ofs.write(reinterpret_cast<const char*>(m_errors), static_cast<std::streamsize>(cells() * sizeof(float)));
+		if (!ofs) {
+			throw std::runtime_error("FootprintTable: failed to write " + path);
+		}
+	}
+
+	const DateTime& epoch() const { return m_epoch; }
+	const FootprintLattice& lattice() const { return m_lattice; }
+	double footprintAltitude() const { return m_footprint_altitude; }
+	std::size_t nodes() const { return m_lattice.rows * m_lattice.cols * m_lattice.levels; }
+	std::size_t cells() const { return (m_lattice.rows - 1) * (m_lattice.cols - 1) * (m_lattice.levels - 1); }
+
+	/**
+	 * @brief セルの誤差の見積り [m]
+	 *
+	 */
+	double cellError(std::size_t cell) const { return m_errors[cell]; }
+
+	/**
+	 * @brief 点の足跡を補間する
+	 *
+	 * @param latitude 測地緯度 [deg]
+	 * @param longitude 経度 [deg]
+	 * @param altitude 高度 [m]
+	 * @param sample 補間した足跡 (errorはセルの誤差の見積り)
+	 * @return bool 点が格子の中にあったか
+	 */
+	bool sample(double latitude, double longitude, double altitude, FootprintSample& sample) const {
+		constexpr double margin = 1e-9;
+		const double fr = (latitude - m_lattice.south) / m_lattice.dlat;
+		double lon = longitude - m_lattice.west;
+		lon -= std::floor(lon / 360.0) * 360.0;
+		if (lon > (m_lattice.cols - 1) * m_lattice.dlon + margin) {
+			lon -= 360.0; // 西端のわずかに西
+		}
+		const double fc = lon / m_lattice.dlon;
+		const double fl = (altitude - m_lattice.bottom) / m_lattice.dalt;
+		if (!(fr >= -margin && fr <= m_lattice.rows - 1 + margin && fc >= -margin && fc <= m_lattice.cols - 1 + margin && fl >= -margin &&
+			  fl <= m_lattice.levels - 1 + margin)) {
+			return false;
+		}
+		const std::size_t row = std::min(static_cast<std::size_t>(std::max(fr, 0.0)), m_lattice.rows - 2);
+		const std::size_t col = std::min(static_cast<std::size_t>(std::max(fc, 0.0)), m_lattice.cols - 2);
+		const std::size_t level = std::min(static_cast<std::size_t>(std::max(fl, 0.0)), m_lattice.levels - 2);
+		interpolate(m_nodes, m_lattice, row, col, level, fr - row, fc - col, fl - level, sample);
+		sample.cell = (level * (m_lattice.rows - 1) + row) * (m_lattice.cols - 1) + col;
+		sample.error = std::max(sample.error, static_cast<double>(m_errors[sample.cell]));
+		return true;
+	}
+
+	/**
+	 * @brief セルを各方向にfactor分割した格子 (細分に使う)
+	 *
+	 */
+	FootprintLattice cellLattice(std::size_t cell, std::size_t factor) const {
+		const std::size_t level = cell / ((m_lattice.rows - 1) * (m_lattice.cols - 1));
+		const std::size_t row = cell / (m_lattice.cols - 1) % (m_lattice.rows - 1), col = cell % (m_lattice.cols - 1);
+		const double f = static_cast<double>(factor);
+		return FootprintLattice{factor + 1,
+								factor + 1,
+								factor + 1,
+								m_lattice.south + row * m_lattice.dlat,
+								m_lattice.west + col * m_lattice.dlon,
+								m_lattice.dlat / f,
+								m_lattice.dlon / f,
+								m_lattice.bottom + level * m_lattice.dalt,
+								m_lattice.dalt / f};
+	}
+
+  private:
+	static constexpr std::size_t alignment = 64;
+
+	MappedFile m_file;
+	std::vector<float> m_storage;
+	FootprintLattice m_lattice;
+	DateTime m_epoch{std::int64_t{0}};
+	double m_footprint_altitude = 0.0;
+	const float* m_nodes = nullptr;
+	const float* m_errors = nullptr;
+
+	FootprintTable(const FootprintLattice& lattice, const DateTime& epoch, double footprint_altitude)
+	  : m_lattice(lattice), m_epoch(epoch), m_footprint_altitude(footprint_altitude) {
+		m_storage.assign(nodes() * node_floats + cells(), 0.0f);
+		m_nodes = m_storage.data();
+		m_errors = m_storage.data() + nodes() * node_floats;
+	}
+
+	static void checkLattice(const FootprintLattice& lattice) {
+		if (lattice.rows < 2 || lattice.cols < 2 || lattice.levels < 2 || !(lattice.dlat > 0.0) || !(lattice.dlon > 0.0) ||
+			!(lattice.dalt > 0.0) || lattice.south < -90.0 || lattice.south + (lattice.rows - 1) * lattice.dlat > 90.0 + 1e-9 ||
+			(lattice.cols - 1) * lattice.dlon > 360.0 + 1e-9) {
+			throw std::runtime_error("FootprintTable: invalid lattice");
+		}
+	}
+
+	/**
+	 * @brief 格子点 (row, col, level) から (tr, tc, tl) だけ進んだ点のECEF座標 [m]
+	 *
+	 */
+	static Eigen::Vector3d position(const FootprintLattice& lattice, const DateTime& epoch, std::size_t row, std::size_t col,
+									std::size_t level, double tr, double tc, double tl) {
+		return Wgs84(epoch, Degree{lattice.west + (col + tc) * lattice.dlon}, Degree{lattice.south + (row + tr) * lattice.dlat},
+					 lattice.bottom + (level + tl) * lattice.dalt)
+		  .toEcef()
+		  .elements();
+	}
+
+	static void store(const FootprintSample& sample, float* node) {
+		constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+		for (int k = 0; k < 3; k++) {
+			node[k] = sample.north_valid ? static_cast<float>(sample.north[k]) : nan;
+			node[3 + k] = sample.south_valid ? static_cast<float>(sample.south[k]) : nan;
+		}
+	}
+
+	/**
+	 * @brief 単位ベクトルの間の距離 (有無が違えば無限大、どちらもなければ0)
+	 *
+	 */
+	static double distance(bool valid_a, const Eigen::Vector3d& a, bool valid_b, const Eigen::Vector3d& b) {
+		if (valid_a != valid_b) {
+			return std::numeric_limits<double>::infinity();
+		}
+		return valid_a ? (a - b).norm() : 0.0;
+	}
+
+	/**
+	 * @brief セルの8つの格子点から三線形補間する (足跡の有無が混ざる側があればerrorを無限大にする)
+	 *
+	 */
+	static void interpolate(const float* nodes, const FootprintLattice& lattice, std::size_t row, std::size_t col, std::size_t level,
+							double tr, double tc, double tl, FootprintSample& sample) {
+		sample.north.setZero();
+		sample.south.setZero();
+		sample.error = 0.0;
+		int north_count = 0, south_count = 0;
+		for (int corner = 0; corner < 8; corner++) {
+			const std::size_t dr = corner & 1, dc = (corner >> 1) & 1, dl = corner >> 2;
+			const double weight = (dr ? tr : 1.0 - tr) * (dc ? tc : 1.0 - tc) * (dl ? tl : 1.0 - tl);
+			const float* node = nodes + (((level + dl) * lattice.rows + row + dr) * lattice.cols + col + dc) * node_floats;
+			if (!std::isnan(node[0])) {
+				sample.north += weight * Eigen::Vector3d{node[0], node[1], node[2]};
+				north_count++;
+			}
+			if (!std::isnan(node[3])) {
+				sample.south += weight * Eigen::Vector3d{node[3], node[4], node[5]};
+				south_count++;
+			}
+		}
+		sample.north_valid = north_count == 8;
+		sample.south_valid = south_count == 8;
+		if ((north_count != 0 && north_count != 8) || (south_count != 0 && south_count != 8)) {
+			sample.error = std::numeric_limits<double>::infinity();
+		}
+		if (sample.north_valid) {
+			sample.north.normalize();
+		}
+		if (sample.south_valid) {
+			sample.south.normalize();
+		}
+	}
+};
+
+/**
+ * @brief モデルの時刻ごとの足跡の表から、任意の時刻・位置の足跡と磁気共役点を求める
+ * @remark 表はModelSetの各モデルの時刻 (永年変化で外挿する場合はその先も同じ間隔) に1つずつ作り、前後の表の補間を時刻で線形に補間する。
+ *         誤差の見積りがtoleranceを超えるセルは、そのセルを細分した小さな表を初めて必要になったときに作って使う。
+ *         それでも超える場合、格子の外の点、前後の表で足跡の有無が違う場合は磁力線を直接たどる。
+ *         表と細分は複製 (evaluateのスレッドごとの複製を含む) で共有する
+ *
+ */
+class FootprintAtlas {
+  public:
+	/**
+	 * @brief Construct a new Footprint Atlas object
+	 *
+	 * @param models 磁場のモデル (各モデルの時刻に表を作る)
+	 * @param lattice 表の格子
+	 * @param config 設定
+	 */
+	FootprintAtlas(const ModelSet& models, const FootprintLattice& lattice, const FootprintConfig& config = FootprintConfig{})
+	  : m_tracer(GeoMagFlux(models, MagFluxUnit::NanoTesla), config), m_lattice(lattice), m_config(config),
+		m_shared(std::make_shared<Shared>()) {
+		if (!(config.step > 0.0) || config.max_steps == 0 || !(config.max_radius > 1.0) || config.refine_factor < 2) {
+			throw std::runtime_error("FootprintAtlas: invalid configuration");
+		}
+		std::int64_t sv_epoch = 0;
+		for (const Model& model : models) {
+			if (model.type == ModelType::Sv) {
+				m_extrapolated = true;
+				sv_epoch = model.epoch.ticks();
+			} else {
+				m_epochs.push_back(model.epoch);
+			}
+		}
+		if (m_epochs.empty()) {
+			throw std::runtime_error("FootprintAtlas: ModelSet is empty");
+		}
+		// 外挿する期間の表は、永年変化のモデルの時刻 (IGRFでは次の改訂の時刻) の間隔で置く
+		m_interval = sv_epoch > m_epochs.back().ticks() ? sv_epoch - m_epochs.back().ticks()
+						: (m_epochs.size() > 1 ? m_epochs.back().ticks() - m_epochs[m_epochs.size() - 2].ticks() : Days(5 * 365).ticks());
+		// ModelSet::selectは最初のモデルの時刻ちょうどを選べないので、1 tick後の磁場で表を作る
+		m_epochs.front() = DateTime(m_epochs.front().ticks() + 1);
+	}
+
+	/**
+	 * @brief 点の足跡と磁気共役点を求める
+	 *
+	 * @param position 点 (時刻も使う)
+	 */
+	FootprintResult operator()(const Wgs84& position) { return lookup(position, Parallel::threadCount(m_config.num_threads)); }
+
+	template <typename Position>
+	FootprintResult operator()(const Position& position) {
+		return operator()(position.toWgs84());
+	}
+
+	/**
+	 * @brief 複数の点の足跡をまとめて求める
+	 * @remark 必要な表を先に (並列に) 作ってから、点を並列に補間する
+	 *
+	 * @param positions 点の配列
+	 * @param results 結果の配列 (positionsと同じ大きさに変更される)
+	 */
+	void evaluate(const std::vector<Wgs84>& positions, std::vector<FootprintResult>& results) {
+		results.resize(positions.size());
+		std::int64_t prepared[2] = {std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::min()};
+		for (const auto& position : positions) {
+			DateTime before, after;
+			bracket(position.epoch(), before, after);
+			if (before.ticks() != prepared[0] || after.ticks() != prepared[1]) {
+				table(before);
+				table(after);
+				prepared[0] = before.ticks();
+				prepared[1] = after.ticks();
+			}
+		}
+		std::vector<FootprintAtlas> atlases(std::min(Parallel::threadCount(m_config.num_threads), positions.size() + 1), *this);
+		Parallel::forEachChunk(
+		  0, positions.size(), 64,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  for (std::size_t i = begin; i < end; i++) {
+				  results[i] = atlases[thread_index].lookup(positions[i], 1);
+			  }
+		  },
+		  atlases.size());
+	}
+
+	/**
+	 * @brief 期間の補間に必要な表の時刻
+	 *
+	 */
+	std::vector<DateTime> tableEpochs(const DateTime& begin, const DateTime& end) const {
+		std::vector<DateTime> epochs;
+		DateTime before, after;
+		bracket(begin, before, after);
+		epochs.push_back(before);
+		while (epochs.back() < end) {
+			const DateTime current = epochs.back();
+			bracket(DateTime(current.ticks() + 1), before, after);
+			epochs.push_back(after);
+		}
+		return epochs;
+	}
+
+	/**
+	 * @brief 表の時刻の表を取得する (なければ作る)
+	 *
+	 * @param epoch 表の時刻 (tableEpochsの値)
+	 */
+	std::shared_ptr<const FootprintTable> table(const DateTime& epoch) { return table(epoch, Parallel::threadCount(m_config.num_threads)); }
+
+	/**
+	 * @brief 作っておいた表 (ファイルから割り当てたものなど) を使わせる
+	 *
+	 */
+	void setTable(std::shared_ptr<const FootprintTable> table) {
+		DateTime before, after;
+		if (bracket(table->epoch(), before, after) != 0.0 || std::fabs(table->footprintAltitude() - m_config.footprint_altitude) > 1e-6) {
+			throw std::runtime_error("FootprintAtlas: table does not match the model epochs or the footprint altitude");
+		}
+		std::promise<std::shared_ptr<const FootprintTable>> ready;
+		ready.set_value(table);
+		std::lock_guard<std::mutex> lock(m_shared->mutex);
+		m_shared->tables[table->epoch().ticks()] = ready.get_future().share();
+	}
+
+  private:
+	/**
+	 * @brief 複製で共有する状態
+	 *
+	 */
+	using TableFuture = std::shared_future<std::shared_ptr<const FootprintTable>>;
+
+	/**
+	 * @brief 複製で共有する状態 (作成中の表も含む)
+	 *
+	 */
+	struct Shared {
+		std::mutex mutex;
+		std::map<std::int64_t, TableFuture> tables;
+		std::map<std::pair<std::int64_t, std::size_t>, TableFuture> refinements;
+	};
+
+	FootprintTracer m_tracer;
+	FootprintLattice m_lattice;
+	FootprintConfig m_config;
+	std::shared_ptr<Shared> m_shared;
+	std::vector<DateTime> m_epochs;
+	std::int64_t m_interval = 0; // 最後のモデルより後の表の間隔 [tick]
+	bool m_extrapolated = false;
+	std::shared_ptr<const FootprintTable> m_recent[2]; // 直近に使った表 (共有の状態をロックせずに済ませる)
+
+	FootprintResult lookup(const Wgs84& position, std::size_t threads) {
+		DateTime before, after;
+		const double weight = bracket(position.epoch(), before, after);
+		FootprintSample sample, later;
+		FootprintSource source = FootprintSource::Table;
+		bool found = sampleTable(before, position, sample, source, threads) &&
+					 (weight == 0.0 || sampleTable(after, position, later, source, threads));
+		if (found && weight > 0.0) {
+			if (sample.north_valid != later.north_valid || sample.south_valid != later.south_valid) {
+				found = false;
+			} else {
+				sample.north = ((1.0 - weight) * sample.north + weight * later.north).normalized();
+				sample.south = ((1.0 - weight) * sample.south + weight * later.south).normalized();
+				sample.error = std::max(sample.error, later.error);
+			}
+		}
+		if (!found) {
+			m_tracer.setEpoch(position.epoch());
+			sample = m_tracer.trace(position.toEcef().elements());
+			source = FootprintSource::Traced;
+		}
+		return result(position, sample, source);
+	}
+
+	/**
+	 * @brief 表 (誤差が大きいセルでは細分した表) を補間する
+	 *
+	 */
+	bool sampleTable(const DateTime& epoch, const Wgs84& position, FootprintSample& sample, FootprintSource& source, std::size_t threads) {
+		const std::shared_ptr<const FootprintTable> coarse = recentTable(epoch, threads);
+		const double latitude = position.latitude().degrees(), longitude = position.longitude().degrees();
+		if (!coarse->sample(latitude, longitude, position.altitude(), sample)) {
+			return false;
+		}
+		if (sample.error <= m_config.tolerance) {
+			return true;
+		}
+		const std::shared_ptr<const FootprintTable> fine = refinement(*coarse, sample.cell, threads);
+		if (!fine || !fine->sample(latitude, longitude, position.altitude(), sample) || !(sample.error <= m_config.tolerance)) {
+			return false;
+		}
+		source = FootprintSource::Refined;
+		return true;
+	}
+
+	std::shared_ptr<const FootprintTable> recentTable(const DateTime& epoch, std::size_t threads) {
+		for (const auto& recent : m_recent) {
+			if (recent && recent->epoch() == epoch) {
+				return recent;
+			}
+		}
+		m_recent[1] = std::move(m_recent[0]);
+		m_recent[0] = table(epoch, threads);
+		return m_recent[0];
+	}
+
+	std::shared_ptr<const FootprintTable> table(const DateTime& epoch, std::size_t threads) {
+		return share(m_shared->tables, epoch.ticks(), std::numeric_limits<std::size_t>::max(), [&] {
+			std::vector<FootprintTracer> tracers(threads, m_tracer);
+			return FootprintTable::build(tracers, epoch, m_lattice, m_config.footprint_altitude);
+		});
+	}
+
+	/**
+	 * @brief セルを細分した表を取得する (なければ作る。保持数の上限に達していればnullptr)
+	 *
+	 */
+	std::shared_ptr<const FootprintTable> refinement(const FootprintTable& coarse, std::size_t cell, std::size_t threads) {
+		return share(m_shared->refinements, std::make_pair(coarse.epoch().ticks(), cell), m_config.max_refinements, [&] {
+			std::vector<FootprintTracer> tracers(threads, m_tracer);
+			const FootprintLattice lattice = coarse.cellLattice(cell, m_config.refine_factor);
+			return FootprintTable::build(tracers, coarse.epoch(), lattice, m_config.footprint_altitude);
+		});
+	}
+
+	/**
+	 * @brief 共有の表をキーごとに一度だけ作る
+	 * @remark 作成中の表は登録だけしてロックの外で作る。同じキーを求める複製はその完成を待ち、別のキーは待たない
+	 *
+	 * @param tables 共有の表 (m_shared->mutexで守る)
+	 * @param key キー
+	 * @param limit 保持数の上限 (達していれば作らずにnullptrを返す)
+	 * @param build 表を作る関数
+	 */
+	template <typename Key, typename Build>
+	std::shared_ptr<const FootprintTable> share(std::map<Key, TableFuture>& tables, const Key& key, std::size_t limit, Build&& build) {
+		std::promise<std::shared_ptr<const FootprintTable>> promise;
+		TableFuture pending;
+		{
+			std::lock_guard<std::mutex> lock(m_shared->mutex);
+			auto found = tables.find(key);
+			if (found != tables.end()) {
+				pending = found->second;
+			} else if (tables.size() >= limit) {
+				return nullptr;
+			} else {
+				tables.emplace(key, promise.get_future().share());
+			}
+		}
+		if (pending.valid()) {
+			return pending.get();
+		}
+
+		std::shared_ptr<const FootprintTable> built;
+		try {
+			built = std::make_shared<const FootprintTable>(build());
+		} catch (...) {
+			{
+				std::lock_guard<std::mutex> lock(m_shared->mutex);
+				tables.erase(key);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+		promise.set_value(built);
+		return built;
+	}
+
+	/**
+	 * @brief 時刻の前後の表の時刻と、後の表の重みを求める
+	 *
+	 */
+	double bracket(const DateTime& epoch, DateTime& before, DateTime& after) const {
+		if (epoch < m_epochs.front()) {
+			throw std::runtime_error("FootprintAtlas: epoch is before the first model");
+		}
+		std::int64_t lower, upper;
+		if (epoch <= m_epochs.back()) {
+			const auto it = std::lower_bound(m_epochs.begin(), m_epochs.end(), epoch);
+			if (*it == epoch) {
+				before = after = epoch;
+				return 0.0;
+			}
+			lower = (it - 1)->ticks();
+			upper = it->ticks();
+		} else {
+			if (!m_extrapolated) {
+				throw std::runtime_error("FootprintAtlas: epoch is after the last model");
+			}
+			const std::int64_t k = (epoch.ticks() - m_epochs.back().ticks()) / m_interval;
+			lower = m_epochs.back().ticks() + k * m_interval;
+			upper = lower + m_interval;
+		}
+		before = DateTime(lower);
+		after = DateTime(upper);
+		if (epoch.ticks() == lower) {
+			after = before;
+			return 0.0;
+		}
+		return static_cast<double>(epoch.ticks() - lower) / static_cast<double>(upper - lower);
+	}
+
+	FootprintResult result(const Wgs84& position, const FootprintSample& sample, FootprintSource source) const {
+		constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+		const DateTime& epoch = position.epoch();
+		const auto footprint = [&](bool valid, const Eigen::Vector3d& direction) {
+			if (!valid) {
+				return Wgs84(epoch, Degree{nan}, Degree{nan}, m_config.footprint_altitude);
+			}
+			const Wgs84 point = Ecef(epoch, m_tracer.shellPoint(direction)).toWgs84();
+			return Wgs84(epoch, point.longitude(), point.latitude(), m_config.footprint_altitude);
+		};
+		FootprintResult out{footprint(sample.north_valid, sample.north), footprint(sample.south_valid, sample.south)};
+		out.north_valid = sample.north_valid;
+		out.south_valid = sample.south_valid;
+		out.error = source == FootprintSource::Traced ? 0.0 : sample.error;
+		out.source = source;
+		if (sample.north_valid && sample.south_valid) {
+			const Eigen::Vector3d x = position.toEcef().elements();
+			out.northern = (x - m_tracer.shellPoint(sample.north)).norm() <= (x - m_tracer.shellPoint(sample.south)).norm();
+		} else {
+			out.northern = sample.north_valid;
+		}
+		return out;
+	}
+};
+
+GEOMAG_NAMESPACE_END
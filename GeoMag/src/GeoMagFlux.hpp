@@ -11,8 +11,11 @@
 
 #pragma once
 
+#include <vector>
+
 #include "Eigen/Geometry"
 #include "Igrf.hpp"
+#include "Parallel.hpp"
 
 GEOMAG_NAMESPACE_BEGIN
 
@@ -41,6 +44,15 @@ class GeoMagFlux : protected Igrf {
 	 */
 	GeoMagFlux(std::istream& is, MagFluxUnit unit = MagFluxUnit::Si) : Igrf(is) { setScaling(unit); };
 
+	/**
+	 * @brief 時間方向にBスプラインで表現されたモデルセットでモデルを生成する
+	 *
+	 * @param spline_model_set
+	 */
+	GeoMagFlux(const SplineModelSet& spline_model_set, MagFluxUnit unit = MagFluxUnit::Si) : Igrf(spline_model_set) {
+		setScaling(unit);
+	};
+
 	/**
 	 * @brief 任意位置での磁束密度を取得する
 	 *
@@ -49,7 +61,7 @@ class GeoMagFlux : protected Igrf {
 	 */
 	Eigen::Vector3d operator()(const Ecef& position) {
 		Eigen::Vector3d mag_density;
-		updatePositionAndMag(position, mag_density);
+		updatePositionAndMag(position, mag_density, m_accuracy);
 		return mag_density * m_unit_scale;
 	}
 
@@ -61,7 +73,7 @@ class GeoMagFlux : protected Igrf {
 	 */
 	Eigen::Vector3d operator()(const Wgs84& position) {
 		Eigen::Vector3d mag_density;
-		updatePositionAndMag(position, mag_density);
+		updatePositionAndMag(position, mag_density, m_accuracy);
 		return mag_density * m_unit_scale;
 	}
 
@@ -83,8 +95,193 @@ class GeoMagFlux : protected Igrf {
 	 */
 	Eigen::Vector3d operator()(const DateTime& dt, const Wgs84Position& position) { return operator()(Wgs84{dt, position}); }
 
+	/**
+	 * @brief 選んだ量だけを求める
+	 * @remark Oに含まれない量の漸化式・和・回転はコンパイル時に取り除かれる。FieldOutput::Fieldでoperator()と同じ磁束密度になる
+	 *
+	 * @tparam O 求める量 (FieldOutputの組み合わせ)
+	 * @param position ECEF座標系での位置 (成分は地心球座標系のNED)
+	 * @return FieldSample 評価結果 (要求しなかった量は0)
+	 */
+	template <FieldOutput O>
+	FieldSample field(const Ecef& position) {
+		FieldSample sample;
+		updateField<O>(position, sample, m_accuracy);
+		return scaled(sample);
+	}
+
+	/**
+	 * @brief 選んだ量だけを求める
+	 *
+	 * @tparam O 求める量 (FieldOutputの組み合わせ)
+	 * @param position WGS84回転楕円座標系での位置
+	 * @return FieldSample 評価結果 (要求しなかった量は0)
+	 */
+	template <FieldOutput O>
+	FieldSample field(const Wgs84& position) {
+		FieldSample sample;
+		updateField<O>(position, sample, m_accuracy);
+		return scaled(sample);
+	}
+
+	/**
+	 * @brief 任意位置での磁束密度をECEF座標系の成分で取得する
+	 *
+	 * @param position ECEF座標系での位置
+	 * @return Eigen::Vector3d 磁束密度 (ECEF成分)
+	 */
+	Eigen::Vector3d ecefFlux(const Ecef& position) {
+		// Ecef入力では地心球座標系のNED成分が得られるので、地心緯度経度で回転する
+		const Eigen::Vector3d ned = operator()(position);
+		const double p = std::sqrt(position.x() * position.x() + position.y() * position.y());
+		const double r = std::sqrt(p * p + position.z() * position.z());
+		const double sin_lat = r > 0.0 ? position.z() / r : 0.0;
+		const double cos_lat = r > 0.0 ? p / r : 1.0;
+		const double sin_lon = p > 0.0 ? position.y() / p : 0.0;
+		const double cos_lon = p > 0.0 ? position.x() / p : 1.0;
+		return nedToEcef(ned, sin_lat, cos_lat, sin_lon, cos_lon);
+	}
+
+	/**
+	 * @brief NED成分のベクトルをECEF成分に回転する
+	 *
+	 * @param ned NED成分のベクトル
+	 * @param sin_lat 緯度の正弦
+	 * @param cos_lat 緯度の余弦
+	 * @param sin_lon 経度の正弦
+	 * @param cos_lon 経度の余弦
+	 * @return Eigen::Vector3d ECEF成分のベクトル
+	 */
+	static Eigen::Vector3d nedToEcef(const Eigen::Vector3d& ned, double sin_lat, double cos_lat, double sin_lon, double cos_lon) {
+		const double n = ned(0), e = ned(1), d = ned(2);
+		const double up = -d;
+		const double horizontal = cos_lat * up - sin_lat * n; // 赤道面内の外向き成分
+		return Eigen::Vector3d{horizontal * cos_lon - e * sin_lon, horizontal * sin_lon + e * cos_lon, cos_lat * n + sin_lat * up};
+	}
+
+	/**
+	 * @brief ECEF成分のベクトルをNED成分に回転する (nedToEcefの逆)
+	 *
+	 * @param ecef ECEF成分のベクトル
+	 * @param sin_lat 緯度の正弦
+	 * @param cos_lat 緯度の余弦
+	 * @param sin_lon 経度の正弦
+	 * @param cos_lon 経度の余弦
+	 * @return Eigen::Vector3d NED成分のベクトル
+	 */
+	static Eigen::Vector3d ecefToNed(const Eigen::Vector3d& ecef, double sin_lat, double cos_lat, double sin_lon, double cos_lon) {
+		const double radial = cos_lon * ecef.x() + sin_lon * ecef.y(); // 赤道面内の外向き成分
+		return Eigen::Vector3d{-sin_lat * radial + cos_lat * ecef.z(), -sin_lon * ecef.x() + cos_lon * ecef.y(), -cos_lat * radial - sin_lat * ecef.z()};
+	}
+
+	/**
+	 * @brief 複数の位置での磁束密度をまとめて取得する
+	 * @remark スレッドごとに評価器を複製するので、この評価器自体は変更されない
+	 *
+	 * @tparam Position 位置の型 (EcefまたはWgs84)
+	 * @param positions 位置の配列
+	 * @param mag_densities 磁束密度の配列 (positionsと同じ大きさに変更される)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& positions, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) const {
+		constexpr std::size_t chunk = 256;
+		mag_densities.resize(positions.size());
+		std::vector<GeoMagFlux> evaluators(std::min(Parallel::threadCount(num_threads), positions.size() / chunk + 1), *this);
+		Parallel::forEachChunk(
+		  0, positions.size(), chunk,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  auto& evaluator = evaluators[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  mag_densities[i] = evaluator(positions[i]);
+			  }
+		  },
+		  evaluators.size());
+	}
+
+	/**
+	 * @brief 複数の位置で選んだ量だけをまとめて求める
+	 *
+	 * @tparam O 求める量 (FieldOutputの組み合わせ)
+	 * @tparam Position 位置の型 (EcefまたはWgs84)
+	 * @param positions 位置の配列
+	 * @param samples 評価結果の配列 (positionsと同じ大きさに変更される)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <FieldOutput O, typename Position>
+	void evaluate(const std::vector<Position>& positions, std::vector<FieldSample>& samples, std::size_t num_threads = 0) const {
+		constexpr std::size_t chunk = 256;
+		samples.resize(positions.size());
+		std::vector<GeoMagFlux> evaluators(std::min(Parallel::threadCount(num_threads), positions.size() / chunk + 1), *this);
+		Parallel::forEachChunk(
+		  0, positions.size(), chunk,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  auto& evaluator = evaluators[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  samples[i] = evaluator.field<O>(positions[i]);
+			  }
+		  },
+		  evaluators.size());
+	}
+
+	/**
+	 * @brief 緯度と高度が等しく、経度が等間隔に並ぶ点の列 (格子の1行) での磁束密度をまとめて取得する
+	 * @remark 緯度に依存する項を行で共有するので、点ごとに評価するより大幅に速い。精度の設定に依らずExactで計算する
+	 *
+	 * @param dt 時刻
+	 * @param latitude 測地緯度
+	 * @param altitude 楕円体高 [m]
+	 * @param west 最初の点の経度
+	 * @param step 経度の間隔
+	 * @param count 点の数
+	 * @param mag_densities count個の磁束密度 (測地座標系のNED成分) を書き込む配列
+	 */
+	void evaluateRow(const DateTime& dt, const Angle& latitude, double altitude, const Angle& west, const Angle& step, std::size_t count,
+					 Eigen::Vector3d* mag_densities) {
+		modelAt(dt);
+		m_row_longitudes.resize(count);
+		for (std::size_t i = 0; i < count; i++) {
+			m_row_longitudes[i] = west.radians() + step.radians() * static_cast<double>(i);
+		}
+		calculateMagDensityRow(latitude.radians(), altitude, m_row_longitudes.data(), count, mag_densities);
+		for (std::size_t i = 0; i < count; i++) {
+			mag_densities[i] *= m_unit_scale;
+		}
+	}
+
 	void setOutputUnit(MagFluxUnit unit) { setScaling(unit); }
 
+	/**
+	 * @brief 計算精度を設定する
+	 * @remark Fast/ApproximateではEcef入力を三角関数を使わずに処理するので、その出力はExactと同じく地心球座標系のNED成分になる
+	 *
+	 * @param accuracy 計算精度
+	 */
+	void setAccuracy(Accuracy accuracy) { m_accuracy = accuracy; }
+	Accuracy accuracy() const { return m_accuracy; }
+
+	/**
+	 * @brief [nT]から出力単位への倍率
+	 *
+	 */
+	double unitScale() const { return m_unit_scale; }
+	MagFluxUnit unit() const { return m_unit; }
+
+	/**
+	 * @brief 指定した時刻のガウス係数を取得する
+	 * @remark 係数は[nT]で、g10, g11, h11, g20, ...の順に並ぶ
+	 *
+	 * @param dt 時刻
+	 * @return const Model& モデル (次に別の時刻で評価するまで有効)
+	 */
+	const Model& model(const DateTime& dt) { return modelAt(dt); }
+
+	/**
+	 * @brief モデルセットの指紋 (係数とエポックが同じなら同じ値)
+	 *
+	 */
+	std::uint64_t fingerprint() const { return modelFingerprint(); }
+
   private:
 	static constexpr double nanotesla_to_tesla = 1.0e-9;	  // [nT] ->
 	static constexpr double nanotesla_to_microtesla = 1.0e-3; // [nT] -> [uT]
@@ -92,7 +289,17 @@ class GeoMagFlux : protected Igrf {
 
 	MagFluxUnit m_unit;
 	double m_unit_scale;
+	Accuracy m_accuracy = Accuracy::Exact;
 	std::string m_unit_symbol;
+	std::vector<double> m_row_longitudes; // evaluateRowで行ごとに使い回す経度 [rad]
+
+	FieldSample scaled(FieldSample sample) const {
+		sample.field *= m_unit_scale;
+		sample.secular_variation *= m_unit_scale;
+		sample.radial_gradient *= m_unit_scale;
+		sample.potential *= m_unit_scale;
+		return sample;
+	}
 
 	void setScaling(MagFluxUnit unit) {
 		m_unit = unit;
@@ -143,14 +350,24 @@ struct MagFluxComponent {
 	Angle inclination;
 	Angle declination;
 
-	MagFluxComponent(const Eigen::Vector3d& mag_density) {
+	MagFluxComponent(const Eigen::Vector3d& mag_density, Accuracy accuracy = Accuracy::Exact) {
+		switch (accuracy) {
+			case Accuracy::Fast: set<Accuracy::Fast>(mag_density); return;
+			case Accuracy::Approximate: set<Accuracy::Approximate>(mag_density); return;
+			default: set<Accuracy::Exact>(mag_density); return;
+		}
+	}
+
+  private:
+	template <Accuracy A>
+	void set(const Eigen::Vector3d& mag_density) {
 		north = mag_density(0);
 		east = mag_density(1);
 		down = mag_density(2);
-		total = mag_density.norm();
-		horizontal = std::sqrt(north * north + east * east);
-		inclination = Radian{std::atan2(down, horizontal)};
-		declination = Radian{std::atan2(east, north)};
+		total = A == Accuracy::Exact ? mag_density.norm() : FastMath::sqrt<A>(mag_density.squaredNorm());
+		horizontal = FastMath::sqrt<A>(north * north + east * east);
+		inclination = Radian{FastMath::atan2<A>(down, horizontal)};
+		declination = Radian{FastMath::atan2<A>(east, north)};
 	}
 };
 
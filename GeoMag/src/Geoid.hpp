@@ -0,0 +1,456 @@
+/**
+ * @file Geoid.hpp
+ * @author Kaiji Takeuchi
+ * @brief ジオイド高の格子とその補間 (平均海面高度と楕円体高の変換)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "MappedFile.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief ジオイド高の補間方法
+ *
+ */
+enum class GeoidInterpolation {
+	Bilinear, // 周囲2x2点の双線形補間
+	Bicubic,  // 周囲4x4点の3次畳み込み補間 (Catmull-Rom)
+};
+
+/**
+ * @brief ジオイド格子のバイナリ形式のヘッダ (64 byte)
+ * @remark ヘッダの後に南の行から順に、各行は西から東へfloat32のジオイド高 [m] がrows * cols個並ぶ。バイト順はホストの順
+ *
+ */
+struct GeoidGridHeader {
+	static constexpr std::uint32_t current_version = 1;
+
+	static const char* magicString() { return "GMGEOID"; } // 終端の0を含めて8 byte
+
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t value_size; // 値の大きさ [byte] (4)
+	std::uint32_t rows;		  // 緯度方向の点数
+	std::uint32_t cols;		  // 経度方向の点数
+	double south;			  // 最初の行の緯度 [deg]
+	double west;			  // 最初の列の経度 [deg]
+	double dlat;			  // 緯度の間隔 [deg]
+	double dlon;			  // 経度の間隔 [deg]
+	std::uint64_t reserved;
+};
+
+static_assert(sizeof(GeoidGridHeader) == 64, "GeoidGridHeader: unexpected padding");
+
+/**
+ * @brief 全球のジオイド高 (楕円体からジオイドまでの高さ) の格子
+ * @remark バイナリ形式のファイルはメモリに割り当てて読むので、EGM2008の1分格子 (約900MB) でも開くだけなら時間もメモリもかからない。
+ *         経度方向が360度を覆う格子は経度を周期的に扱う。極を越える補間はせず、最端の行で打ち切る
+ *
+ */
+class GeoidGrid {
+  public:
+	/**
+	 * @brief バイナリ形式のファイルを割り当てる
+	 *
+	 * @param path ファイルのパス (saveで書き出したもの)
+	 */
+	explicit GeoidGrid(const std::string& path) : m_file(path, MappedFile::Access::Random) {
+		if (m_file.size() < sizeof(GeoidGridHeader)) {
+			throw std::runtime_error("GeoidGrid: " + path + " is too small");
+		}
+		GeoidGridHeader header;
+		std::memcpy(&header, m_file.data(), sizeof(header));
+		if (std::memcmp(header.magic, GeoidGridHeader::magicString(), sizeof(header.magic)) != 0) {
+			throw std::runtime_error("GeoidGrid: " + path + " is not a geoid grid");
+		}
+		if (header.version != GeoidGridHeader::current_version || header.value_size != sizeof(float)) {
+			throw std::runtime_error("GeoidGrid: unsupported version of " + path);
+		}
+		if (m_file.size() != sizeof(GeoidGridHeader) + std::size_t{header.rows} * header.cols * sizeof(float)) {
+			throw std::runtime_error("GeoidGrid: size of " + path + " does not match its header");
+		}
+		setGeometry(header.rows, header.cols, header.south, header.west, header.dlat, header.dlon);
+		m_values = reinterpret_cast<const float*>(m_file.data() + sizeof(GeoidGridHeader));
+	}
+
+	/**
+	 * @brief テキスト形式 (EGM96のWW15MGH.GRDと同じ形式) の格子を読み込む
+	 * @remark 先頭に「南端 北端 西端 東端 緯度間隔 経度間隔」[deg] があり、北の行から順に各行は西から東へ値が並ぶ
+	 *
+	 * @param is 入力ストリーム
+	 */
+	explicit GeoidGrid(std::istream& is) {
+		double south, north, west, east, dlat, dlon;
+		if (!(is >> south >> north >> west >> east >> dlat >> dlon) || !(dlat > 0.0) || !(dlon > 0.0) || !(north > south) || !(east > west)) {
+			throw std::runtime_error("GeoidGrid: invalid grid header");
+		}
+		const std::size_t rows = static_cast<std::size_t>(std::llround((north - south) / dlat)) + 1;
+		const std::size_t cols = static_cast<std::size_t>(std::llround((east - west) / dlon)) + 1;
+		m_storage.resize(rows * cols);
+		for (std::size_t i = 0; i < rows; i++) {
+			float* row = m_storage.data() + (rows - 1 - i) * cols; // 南の行から並べ直す
+			for (std::size_t j = 0; j < cols; j++) {
+				if (!(is >> row[j])) {
+					throw std::runtime_error("GeoidGrid: grid has fewer values than its header");
+				}
+			}
+		}
+		setGeometry(rows, cols, south, west, dlat, dlon);
+		m_values = m_storage.data();
+	}
+
+	/**
+	 * @brief 値を与えて格子を作る
+	 *
+	 * @param rows 緯度方向の点数
+	 * @param cols 経度方向の点数
+	 * @param south 最初の行の緯度 [deg]
+	 * @param west 最初の列の経度 [deg]
+	 * @param dlat 緯度の間隔 [deg]
+	 * @param dlon 経度の間隔 [deg]
+	 * @param values 南の行から順に並べたジオイド高 [m]
+	 */
+	GeoidGrid(std::size_t rows, std::size_t cols, double south, double west, double dlat, double dlon, std::vector<float> values)
+	  : m_storage(std::move(values)) {
+		if (m_storage.size() != rows * cols) {
+			throw std::runtime_error("GeoidGrid: number of values does not match the grid size");
+		}
+		setGeometry(rows, cols, south, west, dlat, dlon);
+		m_values = m_storage.data();
+	}
+
+	GeoidGrid(GeoidGrid&&) = default;
+	GeoidGrid& operator=(GeoidGrid&&) = default;
+
+	/**
+	 * @brief バイナリ形式で書き出す
+	 *
+	 * @param path ファイルのパス
+	 */
+	void save(const std::string& path) const {
+		GeoidGridHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, GeoidGridHeader::magicString(), sizeof(header.magic));
+		header.version = GeoidGridHeader::current_version;
+		header.value_size = sizeof(float);
+		header.rows = static_cast<std::uint32_t>(m_rows);
+		header.cols = static_cast<std::uint32_t>(m_cols);
+		header.south = m_south;
+		header.west = m_west;
+		header.dlat = m_dlat;
+		header.dlon = m_dlon;
+
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		ofs.write(reinterpret_cast<const char*>(m_values), static_cast<std::streamsize>(m_rows * m_cols * sizeof(float)));
+		if (!ofs) {
+			throw std::runtime_error("GeoidGrid: failed to write " + path);
+		}
+	}
+
+	/**
+	 * @brief ジオイド高を求める
+	 *
+	 * @param latitude 緯度 [deg]
+	 * @param longitude 経度 [deg]
+	 * @param interpolation 補間方法
+	 * @return double ジオイド高 [m]
+	 */
+	auto undulation(double latitude, double longitude, GeoidInterpolation interpolation = GeoidInterpolation::Bilinear) const -> double {
+		return interpolation == GeoidInterpolation::Bicubic ? bicubic(latitude, longitude) : bilinear(latitude, longitude);
+	}
+
+	auto undulation(const Wgs84& position, GeoidInterpolation interpolation = GeoidInterpolation::Bilinear) const -> double {
+		return undulation(position.latitude().degrees(), position.longitude().degrees(), interpolation);
+	}
+
+	/**
+	 * @brief 平均海面からの高度を楕円体高に変換する
+	 *
+	 * @param position 高度を平均海面からの高さ [m] とした位置
+	 * @return Wgs84 高度を楕円体高とした位置
+	 */
+	auto toEllipsoidal(const Wgs84& position, GeoidInterpolation interpolation = GeoidInterpolation::Bilinear) const -> Wgs84 {
+		return Wgs84(position.epoch(), position.longitude(), position.latitude(), position.altitude() + undulation(position, interpolation));
+	}
+
+	/**
+	 * @brief 楕円体高を平均海面からの高度に変換する
+	 *
+	 */
+	auto toMsl(const Wgs84& position, GeoidInterpolation interpolation = GeoidInterpolation::Bilinear) const -> Wgs84 {
+		return Wgs84(position.epoch(), position.longitude(), position.latitude(), position.altitude() - undulation(position, interpolation));
+	}
+
+	/**
+	 * @brief ジオイド高をまとめて求める
+	 *
+	 * @param latitudes 緯度の配列 [deg]
+	 * @param longitudes 経度の配列 [deg]
+	 * @param undulations ジオイド高を書き込む配列 [m]
+	 * @param count 要素数
+	 * @param interpolation 補間方法
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	void undulations(const double* latitudes, const double* longitudes, double* undulations, std::size_t count,
+					 GeoidInterpolation interpolation = GeoidInterpolation::Bilinear, std::size_t num_threads = 0) const {
+		convert(latitudes, longitudes, nullptr, undulations, count, 1.0, interpolation, num_threads);
+	}
+
+	/**
+	 * @brief 平均海面からの高度をまとめて楕円体高に変換する
+	 * @remark 配列を1回ずつ読み書きするだけなので、格子がキャッシュに収まればメモリ帯域で律速する。heightsとellipsoidal_heightsは同じ配列でもよい
+	 *
+	 * @param latitudes 緯度の配列 [deg]
+	 * @param longitudes 経度の配列 [deg]
+	 * @param heights 平均海面からの高度の配列 [m]
+	 * @param ellipsoidal_heights 楕円体高を書き込む配列 [m]
+	 * @param count 要素数
+	 */
+	void toEllipsoidal(const double* latitudes, const double* longitudes, const double* heights, double* ellipsoidal_heights, std::size_t count,
+					   GeoidInterpolation interpolation = GeoidInterpolation::Bilinear, std::size_t num_threads = 0) const {
+		convert(latitudes, longitudes, heights, ellipsoidal_heights, count, 1.0, interpolation, num_threads);
+	}
+
+	/**
+	 * @brief 楕円体高をまとめて平均海面からの高度に変換する
+	 *
+	 */
+	void toMsl(const double* latitudes, const double* longitudes, const double* ellipsoidal_heights, double* heights, std::size_t count,
+			   GeoidInterpolation interpolation = GeoidInterpolation::Bilinear, std::size_t num_threads = 0) const {
+		convert(latitudes, longitudes, ellipsoidal_heights, heights, count, -1.0, interpolation, num_threads);
+	}
+
+	std::size_t rows() const { return m_rows; }
+	std::size_t cols() const { return m_cols; }
+	double south() const { return m_south; }
+	double west() const { return m_west; }
+	double latitudeStep() const { return m_dlat; }
+	double longitudeStep() const { return m_dlon; }
+	bool global() const { return m_period > 0; }
+
+	/**
+	 * @brief 格子点の値
+	 *
+	 * @param row 行 (南から)
+	 * @param col 列 (西から)
+	 */
+	float value(std::size_t row, std::size_t col) const { return m_values[row * m_cols + col]; }
+
+  private:
+	MappedFile m_file;
+	std::vector<float> m_storage;
+	const float* m_values = nullptr;
+	std::size_t m_rows = 0, m_cols = 0;
+	double m_south = 0.0, m_west = 0.0, m_dlat = 1.0, m_dlon = 1.0;
+	std::size_t m_period = 0; // 360度に当たる列数 (全球でなければ0)
+
+	void setGeometry(std::size_t rows, std::size_t cols, double south, double west, double dlat, double dlon) {
+		if (rows < 2 || cols < 2 || !(dlat > 0.0) || !(dlon > 0.0)) {
+			throw std::runtime_error("GeoidGrid: grid must have at least 2x2 points and positive spacing");
+		}
+		m_rows = rows;
+		m_cols = cols;
+		m_south = south;
+		m_west = west;
+		m_dlat = dlat;
+		m_dlon = dlon;
+		const double period = 360.0 / dlon;
+		const std::size_t columns = static_cast<std::size_t>(std::llround(period));
+		m_period = std::fabs(period - static_cast<double>(columns)) < 1.0e-6 && cols >= columns ? columns : 0;
+	}
+
+	/**
+	 * @brief 緯度から行の位置を求める
+	 *
+	 * @param row 補間に使う下側の行 (0 <= row <= rows - 2)
+	 * @param t 行の間の位置 [0, 1]
+	 */
+	void rowPosition(double latitude, std::size_t& row, double& t) const {
+		const double y = std::min(std::max((latitude - m_south) / m_dlat, 0.0), static_cast<double>(m_rows - 1));
+		row = std::min(static_cast<std::size_t>(y), m_rows - 2);
+		t = y - static_cast<double>(row);
+	}
+
+	/**
+	 * @brief 経度から列の位置を求める
+	 *
+	 * @param col 補間に使う左側の列
+	 * @param t 列の間の位置 [0, 1]
+	 */
+	void colPosition(double longitude, std::size_t& col, double& t) const {
+		double x = (longitude - m_west) / m_dlon;
+		if (m_period > 0) {
+			const double period = static_cast<double>(m_period);
+			x -= std::floor(x / period) * period;
+			col = std::min(static_cast<std::size_t>(x), m_period - 1);
+		} else {
+			x = std::min(std::max(x, 0.0), static_cast<double>(m_cols - 1));
+			col = std::min(static_cast<std::size_t>(x), m_cols - 2);
+		}
+		t = x - static_cast<double>(col);
+	}
+
+	/**
+	 * @brief 左側の列からoffsetだけずらした列 (全球なら周期的、そうでなければ端で打ち切る)
+	 *
+	 */
+	std::size_t colOffset(std::size_t col, std::ptrdiff_t offset) const {
+		if (m_period > 0) {
+			return static_cast<std::size_t>(static_cast<std::ptrdiff_t>(col + m_period) + offset) % m_period;
+		}
+		const std::ptrdiff_t c = static_cast<std::ptrdiff_t>(col) + offset;
+		return static_cast<std::size_t>(std::min(std::max<std::ptrdiff_t>(c, 0), static_cast<std::ptrdiff_t>(m_cols) - 1));
+	}
+
+	auto bilinear(double latitude, double longitude) const -> double {
+		std::size_t row, col;
+		double ty, tx;
+		rowPosition(latitude, row, ty);
+		colPosition(longitude, col, tx);
+		const std::size_t col1 = colOffset(col, 1);
+		const float* lower = m_values + row * m_cols;
+		const float* upper = lower + m_cols;
+		const double v0 = lower[col] + (lower[col1] - lower[col]) * tx;
+		const double v1 = upper[col] + (upper[col1] - upper[col]) * tx;
+		return v0 + (v1 - v0) * ty;
+	}
+
+	/**
+	 * @brief Catmull-Romの重み
+	 *
+	 */
+	static void cubicWeights(double t, double w[4]) {
+		w[0] = ((-t + 2.0) * t - 1.0) * t * 0.5;
+		w[1] = ((3.0 * t - 5.0) * t * t + 2.0) * 0.5;
+		w[2] = ((-3.0 * t + 4.0) * t + 1.0) * t * 0.5;
+		w[3] = (t - 1.0) * t * t * 0.5;
+	}
+
+	auto bicubic(double latitude, double longitude) const -> double {
+		std::size_t row, col;
+		double ty, tx;
+		rowPosition(latitude, row, ty);
+		colPosition(longitude, col, tx);
+
+		double wy[4], wx[4];
+		cubicWeights(ty, wy);
+		cubicWeights(tx, wx);
+		std::size_t cols[4];
+		for (std::ptrdiff_t k = 0; k < 4; k++) {
+			cols[k] = colOffset(col, k - 1);
+		}
+
+		double sum = 0.0;
+		for (std::ptrdiff_t k = 0; k < 4; k++) {
+			const std::ptrdiff_t r = std::min(std::max<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(row) + k - 1, 0), static_cast<std::ptrdiff_t>(m_rows) - 1);
+			const float* line = m_values + static_cast<std::size_t>(r) * m_cols;
+			sum += wy[k] * (wx[0] * line[cols[0]] + wx[1] * line[cols[1]] + wx[2] * line[cols[2]] + wx[3] * line[cols[3]]);
+		}
+		return sum;
+	}
+
+	/**
+	 * @brief output = heights + sign * ジオイド高 (heightsがnullptrならジオイド高のみ)
+	 *
+	 */
+	void convert(const double* latitudes, const double* longitudes, const double* heights, double* output, std::size_t count, double sign,
+				 GeoidInterpolation interpolation, std::size_t num_threads) const {
+		constexpr std::size_t chunk = 4096;
+		Parallel::forEachChunk(
+		  0, count, chunk,
+		  [&](std::size_t, std::size_t begin, std::size_t end) {
+			  if (interpolation == GeoidInterpolation::Bicubic) {
+				  for (std::size_t i = begin; i < end; i++) {
+					  output[i] = (heights != nullptr ? heights[i] : 0.0) + sign * bicubic(latitudes[i], longitudes[i]);
+				  }
+			  } else {
+				  for (std::size_t i = begin; i < end; i++) {
+					  output[i] = (heights != nullptr ? heights[i] : 0.0) + sign * bilinear(latitudes[i], longitudes[i]);
+				  }
+			  }
+		  },
+		  num_threads);
+	}
+};
+
+/**
+ * @brief 平均海面からの高度で与えた位置で磁束密度を求める評価器
+ * @remark 楕円体高への変換は評価の直前に行う。geoidはこの評価器より長く残しておく
+ *
+ */
+class MslGeoMagFlux {
+  public:
+	/**
+	 * @brief Construct a new Msl Geo Mag Flux object
+	 *
+	 * @param flux 評価器
+	 * @param geoid ジオイド高の格子
+	 * @param interpolation ジオイド高の補間方法
+	 */
+	MslGeoMagFlux(const GeoMagFlux& flux, const GeoidGrid& geoid, GeoidInterpolation interpolation = GeoidInterpolation::Bilinear)
+	  : m_flux(flux), m_geoid(geoid), m_interpolation(interpolation) {}
+
+	/**
+	 * @brief 平均海面からの高度で与えた位置での磁束密度を取得する
+	 *
+	 * @param position 高度を平均海面からの高さ [m] とした位置
+	 * @return Eigen::Vector3d 磁束密度
+	 */
+	Eigen::Vector3d operator()(const Wgs84& position) { return m_flux(m_geoid.toEllipsoidal(position, m_interpolation)); }
+
+	/**
+	 * @brief 平均海面からの高度で与えた複数の位置での磁束密度をまとめて取得する
+	 * @remark 楕円体高への変換は各スレッドが評価の直前に行うので、変換した位置の配列は作らない
+	 *
+	 * @param positions 高度を平均海面からの高さ [m] とした位置の配列
+	 * @param mag_densities 磁束密度の配列 (positionsと同じ大きさに変更される)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	void evaluate(const std::vector<Wgs84>& positions, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) const {
+		constexpr std::size_t chunk = 256;
+		mag_densities.resize(positions.size());
+		std::vector<GeoMagFlux> evaluators(std::min(Parallel::threadCount(num_threads), positions.size() / chunk + 1), m_flux);
+		Parallel::forEachChunk(
+		  0, positions.size(), chunk,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  auto& evaluator = evaluators[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  mag_densities[i] = evaluator(m_geoid.toEllipsoidal(positions[i], m_interpolation));
+			  }
+		  },
+		  evaluators.size());
+	}
+
+	GeoMagFlux& flux() { return m_flux; }
+	const GeoidGrid& geoid() const { return m_geoid; }
+
+  private:
+	GeoMagFlux m_flux;
+	const GeoidGrid& m_geoid;
+	GeoidInterpolation m_interpolation;
+};
+
+GEOMAG_NAMESPACE_END
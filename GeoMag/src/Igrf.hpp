@@ -13,7 +13,10 @@
 
 #include "Coordinate.hpp"
 #include "Essential.hpp"
+#include "FastMath.hpp"
+#include "FieldOutput.hpp"
 #include "Model.hpp"
+#include "SplineModel.hpp"
 
 GEOMAG_NAMESPACE_BEGIN
 class Igrf {
@@ -39,9 +42,34 @@ class Igrf {
 	 */
 	Igrf(std::istream& is) : m_model_set(is){};
 
+	/**
+	 * @brief 時間方向にBスプラインで表現されたモデルセットでモデルを生成する
+	 *
+	 * @param spline_model_set
+	 */
+	Igrf(const SplineModelSet& spline_model_set) : m_model_set(std::vector<Model>{}), m_spline_model_set(spline_model_set){};
+
   private:
-	Model m_model;										 // IGRF model
-	ModelSet m_model_set;								 // IGRF model set
+	/**
+	 * @brief 次数ごとの合成 (Fast/Approximate) のために並べ替えたガウス係数
+	 * @remark 添字はルジャンドル陪関数と同じ n(n+1)/2 + m。m = 0 の h は0
+	 *
+	 */
+	struct DegreeCoefficients {
+		static constexpr std::size_t size = (Model::max_degree + 1) * (Model::max_degree + 2) / 2;
+		std::array<double, size> g;
+		std::array<double, size> h;
+		std::array<double, size> mg; // m * g
+		std::array<double, size> mh; // m * h
+	};
+
+	Model m_model;						 // IGRF model
+	Model m_model_rate;					 // IGRF model secular variation [nT/year]
+	ModelSet m_model_set;				 // IGRF model set
+	SplineModelSet m_spline_model_set;	 // B-spline model set
+	BSplineBasisCache m_spline_cache;	 // B-spline basis cache
+	DegreeCoefficients m_degree_model;	 // m_modelを並べ替えたもの
+	bool m_degree_model_valid = false;	 // m_degree_modelがm_modelと一致しているか
 
 	/**
 	 * @brief 線形補間によりモデルを生成する
@@ -78,6 +106,17 @@ class Igrf {
 	 * @param dt 初期化するモデルの時刻
 	 */
 	void initializeModel(const DateTime& dt) {
+		// 同じエポックであれば前回のモデルをそのまま使う
+		if (m_model.type != ModelType::Unknown && m_model.epoch == dt) {
+			return;
+		}
+
+		m_degree_model_valid = false;
+		if (!m_spline_model_set.empty()) {
+			m_spline_model_set.evaluate(dt, m_model, m_spline_cache);
+			return;
+		}
+
 		Model last, next;
 
 		// Select model
@@ -96,127 +135,652 @@ class Igrf {
 	}
 
 	/**
-	 * @brief 磁束密度を計算する
+	 * @brief モデルの係数の時間微分を初期化する
+	 * @remark 線形補間では前後のモデルの差、線形外挿ではSVの係数そのもの、Bスプラインでは基底の微分を使う
 	 *
+	 * @param dt 時刻
+	 */
+	void initializeModelRate(const DateTime& dt) {
+		if (m_model_rate.type != ModelType::Unknown && m_model_rate.epoch == dt) {
+			return;
+		}
+
+		if (!m_spline_model_set.empty()) {
+			m_spline_model_set.evaluateRate(dt, m_model_rate);
+			return;
+		}
+
+		Model last, next;
+		m_model_set.select(dt, last, next);
+		if (next.type != ModelType::Sv) {
+			const double span = (double)(next.epoch.year() - last.epoch.year());
+			std::transform(last.coefficients.begin(), last.coefficients.end(), next.coefficients.begin(), m_model_rate.coefficients.begin(),
+						   [span](double a, double b) { return (b - a) / span; });
+		} else {
+			m_model_rate.coefficients = next.coefficients;
+		}
+		m_model_rate.epoch = dt;
+		m_model_rate.type = ModelType::Sv;
+	}
+
+	/**
+	 * @brief 次数ごとの合成に使う係数をm_modelから作る
+	 * @remark モデルが変わってから最初にFast/Approximateで評価するときだけ並べ替える
+	 *
+	 */
+	void prepareDegreeModel() {
+		if (m_degree_model_valid) {
+			return;
+		}
+		std::size_t k = 1, c_idx = 0;
+		for (int n = 1; n <= static_cast<int>(Model::max_degree); n++) {
+			for (int m = 0; m <= n; m++, k++) {
+				const double g = m_model.coefficients[c_idx++];
+				const double h = m == 0 ? 0.0 : m_model.coefficients[c_idx++];
+				m_degree_model.g[k] = g;
+				m_degree_model.h[k] = h;
+				m_degree_model.mg[k] = m * g;
+				m_degree_model.mh[k] = m * h;
+			}
+		}
+		m_degree_model_valid = true;
+	}
+
+	/**
+	 * @brief 選んだ量を計算する
+	 *
+	 * @tparam O 求める量
+	 * @tparam A 精度
 	 * @tparam T 位置情報の型
 	 * @param position 座標系情報を持った位置
-	 * @param mag_density その位置での磁束密度 [nT]
+	 * @param sample その位置での評価結果 [nT]
 	 */
-	template <typename T>
-	void calculateMagDensity(const CoordinateBase<T> position, Eigen::Vector3d& mag_density) {
+	template <FieldOutput O, Accuracy A = Accuracy::Exact, typename T>
+	void calculateField(const CoordinateBase<T> position, FieldSample& sample) {
 		constexpr std::size_t max_degree = Model::max_degree;
-		constexpr double earth_radius = 6371.2e3; // IGRFはこれ[m]
 
 		double r = position.elements().altitude;					 // distance
 		const double phi = position.elements().longitude.radians();	 // longitude
 		const double theta = position.elements().latitude.radians(); // latitude
 
-		double cos_theta = std::sin(theta); // colatitude
-		double sin_theta = std::cos(theta);
+		double cos_theta, sin_theta; // colatitude
+		FastMath::sincos<A>(theta, cos_theta, sin_theta);
 		double cos_delta = 0.0, sin_delta = 0.0;
 
 		if (position.type() == CoordinateType::GeocentricSpherical) {
 			cos_delta = 1.0;
 			sin_delta = 0.0;
 		} else if (position.type() == CoordinateType::Wgs84) {
-			constexpr auto a = constant::wgs84_a;
-			constexpr auto b = constant::wgs84_b;
-			constexpr auto aa = a * a;
-			constexpr auto bb = b * b;
-			const auto h = r;
-			const auto a2sint2 = aa * sin_theta * sin_theta;
-			const auto b2cost2 = bb * cos_theta * cos_theta;
-			const auto rho2 = a2sint2 + b2cost2;
-			const auto rho = std::sqrt(rho2);
-			r = std::sqrt((aa * a2sint2 + bb * b2cost2) / rho2 + r * r + 2 * r * rho);
-			cos_delta = (h + rho) / r;
-			sin_delta = (aa - bb) / rho * sin_theta * cos_theta / r;
-			const double cos_theta_gd = cos_theta;
-			cos_theta = cos_theta_gd * cos_delta - sin_theta * sin_delta;
-			sin_theta = sin_theta * cos_delta + cos_theta_gd * sin_delta;
+			toGeocentric<A>(r, cos_theta, sin_theta, cos_delta, sin_delta);
 		} else {
 			throw std::runtime_error("Invalid coordinate type");
 		}
+		if (A != Accuracy::Exact && sin_theta == 0.0) {
+			// 極ではm = 1の項を極限で扱う必要があるので、標準ライブラリの経路で求める
+			calculateField<O>(position, sample);
+			return;
+		}
 
 		std::array<double, max_degree> cos_phi; // cos(m*phi)
 		std::array<double, max_degree> sin_phi; // sin(m*phi)
-		for (std::size_t m = 1; m <= max_degree; m++) {
-			cos_phi[m - 1] = std::cos(m * phi);
-			sin_phi[m - 1] = std::sin(m * phi);
+		if (A == Accuracy::Exact) {
+			for (std::size_t m = 1; m <= max_degree; m++) {
+				cos_phi[m - 1] = std::cos(m * phi);
+				sin_phi[m - 1] = std::sin(m * phi);
+			}
+		} else {
+			FastMath::sincos<A>(phi, sin_phi[0], cos_phi[0]);
+			multipleAngles(cos_phi, sin_phi);
 		}
 
-		constexpr std::size_t p_size = (max_degree + 1) * (max_degree + 2) / 2;
-		std::array<double, p_size> p{0};   // Legendre polynomial
-		std::array<double, p_size> d_p{0}; // Derivative of Legendre polynomial
-		p[0] = 1;
-		p[2] = sin_theta;
-		d_p[0] = 0;
-		d_p[2] = cos_theta;
+		if (A == Accuracy::Exact) {
+			synthesizeField<O>(r, cos_theta, sin_theta, cos_phi, sin_phi, cos_delta, sin_delta, sample);
+		} else {
+			synthesizeFieldByDegree<O>(r, cos_theta, sin_theta, cos_phi, sin_phi, cos_delta, sin_delta, sample);
+		}
+	}
 
-		double b_r = 0, b_t = 0, b_p = 0;
-		double ratio = (earth_radius / r) * (earth_radius / r);
+	/**
+	 * @brief ECEF位置から三角関数を使わずに選んだ量を計算する
+	 * @remark 地心球座標系のNED成分を返す。自転軸上 (x = y = 0) では経度が決まらないので標準ライブラリの経路で求める
+	 *
+	 * @tparam O 求める量
+	 * @tparam A 精度
+	 * @param position ECEF座標系での位置
+	 * @param sample その位置での評価結果 [nT]
+	 */
+	template <FieldOutput O, Accuracy A>
+	void calculateFieldFromEcef(const Ecef& position, FieldSample& sample) {
+		constexpr std::size_t max_degree = Model::max_degree;
 
-		// Lag
-		int c_idx = 1, n = 0, m = 1;
+		const double x = position.x(), y = position.y(), z = position.z();
+		const double p2 = x * x + y * y;
+		if (p2 == 0.0) {
+			calculateField<O>(position.toGeocentricSpherical(), sample);
+			return;
+		}
+		const double r2 = p2 + z * z;
+		const double inv_p = FastMath::rsqrt<A>(p2);
+		const double inv_r = FastMath::rsqrt<A>(r2);
+		const double r = r2 * inv_r;
+
+		std::array<double, max_degree> cos_phi; // cos(m*phi)
+		std::array<double, max_degree> sin_phi; // sin(m*phi)
+		cos_phi[0] = x * inv_p;
+		sin_phi[0] = y * inv_p;
+		multipleAngles(cos_phi, sin_phi);
+
+		synthesizeFieldByDegree<O>(r, z * inv_r, p2 * inv_p * inv_r, cos_phi, sin_phi, 1.0, 0.0, sample);
+	}
+
+	/**
+	 * @brief cos(phi), sin(phi)から倍角の値を漸化式で求める
+	 *
+	 */
+	static void multipleAngles(std::array<double, Model::max_degree>& cos_phi, std::array<double, Model::max_degree>& sin_phi) {
+		for (std::size_t m = 1; m < Model::max_degree; m++) {
+			cos_phi[m] = cos_phi[m - 1] * cos_phi[0] - sin_phi[m - 1] * sin_phi[0];
+			sin_phi[m] = sin_phi[m - 1] * cos_phi[0] + cos_phi[m - 1] * sin_phi[0];
+		}
+	}
+
+	/**
+	 * @brief ルジャンドル陪関数の漸化式の係数 (位置に依らないので一度だけ計算する)
+	 *
+	 */
+	struct LegendreCoefficients {
+		static constexpr std::size_t size = (Model::max_degree + 1) * (Model::max_degree + 2) / 2;
+		std::array<double, size> diagonal; // P_n^n = diagonal * sin(theta) * P_(n-1)^(n-1) (P_1^1 では1)
+		std::array<double, size> left;	   // P_n^m = left * cos(theta) * P_(n-1)^m - right * P_(n-2)^m
+		std::array<double, size> right;
+
+		LegendreCoefficients() : diagonal{0}, left{0}, right{0} {
+			int n = 0, m = 1;
+			for (std::size_t p_idx = 2; p_idx <= size; p_idx++) {
+				if (n < m) {
+					n++;
+					m = 0;
+				}
+				const int p_lag0 = p_idx - 1;
+				if (n == m) {
+					diagonal[p_lag0] = m == 1 ? 1.0 : std::sqrt(1 - 1 / (double)(2 * m));
+				} else {
+					left[p_lag0] = (2 * n - 1) / std::sqrt(n * n - m * m);
+					right[p_lag0] = std::sqrt((n - 1) * (n - 1) - m * m) / std::sqrt(n * n - m * m);
+				}
+				m++;
+			}
+		}
+
+		static const LegendreCoefficients& instance() {
+			static const LegendreCoefficients coefficients;
+			return coefficients;
+		}
+	};
+
+	/**
+	 * @brief 測地座標 (WGS84) の余緯度と楕円体高を地心座標に変換する
+	 *
+	 * @tparam A 精度
+	 * @param r 楕円体高 [m] を受け取り、地心距離 [m] を返す
+	 * @param cos_theta 測地余緯度の余弦を受け取り、地心余緯度の余弦を返す
+	 * @param sin_theta 測地余緯度の正弦を受け取り、地心余緯度の正弦を返す
+	 * @param cos_delta 測地座標系への回転角の余弦
+	 * @param sin_delta 測地座標系への回転角の正弦
+	 */
+	template <Accuracy A>
+	static void toGeocentric(double& r, double& cos_theta, double& sin_theta, double& cos_delta, double& sin_delta) {
+		constexpr auto a = constant::wgs84_a;
+		constexpr auto b = constant::wgs84_b;
+		constexpr auto aa = a * a;
+		constexpr auto bb = b * b;
+		const auto h = r;
+		const auto a2sint2 = aa * sin_theta * sin_theta;
+		const auto b2cost2 = bb * cos_theta * cos_theta;
+		const auto rho2 = a2sint2 + b2cost2;
+		const auto rho = FastMath::sqrt<A>(rho2);
+		r = FastMath::sqrt<A>((aa * a2sint2 + bb * b2cost2) / rho2 + r * r + 2 * r * rho);
+		cos_delta = (h + rho) / r;
+		sin_delta = (aa - bb) / rho * sin_theta * cos_theta / r;
+		const double cos_theta_gd = cos_theta;
+		cos_theta = cos_theta_gd * cos_delta - sin_theta * sin_delta;
+		sin_theta = sin_theta * cos_delta + cos_theta_gd * sin_delta;
+	}
+
+	using LegendreTable = std::array<double, LegendreCoefficients::size>; // (n, m)の順に並べたルジャンドル陪関数
+
+	/**
+	 * @brief ルジャンドル陪関数 (シュミットの準正規化) とその余緯度微分を漸化式で求める
+	 * @remark 点ごとの合成と行の合成で共有する。次数nと位数mの値は添字 n(n+1)/2 + m に入る
+	 *
+	 * @tparam NeedDerivative 余緯度微分 (d_p) を求めるか
+	 * @param cos_theta 余緯度の余弦
+	 * @param sin_theta 余緯度の正弦
+	 * @param p P_n^m
+	 * @param d_p dP_n^m/dθ (NeedDerivativeがfalseなら書き込まない)
+	 */
+	template <bool NeedDerivative>
+	static void legendre(double cos_theta, double sin_theta, LegendreTable& p, LegendreTable& d_p) {
+		constexpr std::size_t p_size = LegendreCoefficients::size;
+		const auto& coefficients = LegendreCoefficients::instance();
+
+		p[0] = 1;
+		if (NeedDerivative) {
+			d_p[0] = 0;
+		}
+
+		int n = 0, m = 1;
 		for (std::size_t p_idx = 2; p_idx <= p_size; p_idx++) {
 			if (n < m) {
 				n++;
 				m = 0;
-				ratio *= earth_radius / r;
 			}
 
-			const int p_lag0 = p_idx - 1;
-			if (n == m && p_lag0 != 2) {
-				const int p_lag1 = p_idx - n - 2;
-				const double cof = std::sqrt(1 - 1 / (double)(2 * m));
+			const std::size_t p_lag0 = p_idx - 1;
+			if (n == m) {
+				const std::size_t p_lag1 = p_idx - n - 2;
+				const double cof = coefficients.diagonal[p_lag0];
 				p[p_lag0] = cof * sin_theta * p[p_lag1];
-				d_p[p_lag0] = cof * (sin_theta * d_p[p_lag1] + cos_theta * p[p_lag1]);
-			} else if (p_lag0 != 2) {
-				const int p_lag1 = p_idx - n - 1;
-				const int p_lag2 = p_idx - 2 * n;
-				const double cofl = (2 * n - 1) / std::sqrt(n * n - m * m);
-				const double cofr = std::sqrt((n - 1) * (n - 1) - m * m) / std::sqrt(n * n - m * m);
+				if (NeedDerivative) {
+					d_p[p_lag0] = cof * (sin_theta * d_p[p_lag1] + cos_theta * p[p_lag1]);
+				}
+			} else {
+				const std::size_t p_lag1 = p_idx - n - 1;
+				const std::size_t p_lag2 = p_idx - 2 * n;
+				const double cofl = coefficients.left[p_lag0];
+				const double cofr = coefficients.right[p_lag0];
 				p[p_lag0] = cofl * cos_theta * p[p_lag1] - cofr * p[p_lag2];
-				d_p[p_lag0] = cofl * (cos_theta * d_p[p_lag1] - sin_theta * p[p_lag1]) - cofr * d_p[p_lag2];
+				if (NeedDerivative) {
+					d_p[p_lag0] = cofl * (cos_theta * d_p[p_lag1] - sin_theta * p[p_lag1]) - cofr * d_p[p_lag2];
+				}
 			}
+			m++;
+		}
+	}
 
-			if (m == 0) {
-				const double c_lag0 = c_idx - 1;
-				const double& gh_cof = m_model.coefficients[c_lag0];
-				const double cof = ratio * gh_cof;
-				b_r += (n + 1) * cof * p[p_lag0];
-				b_t -= cof * d_p[p_lag0];
-				c_idx++;
-			} else {
-				const double m_lag0 = m - 1;
-				const double c_lag0 = c_idx - 1;
-				const double& gh_cof0 = m_model.coefficients[c_lag0];
-				const double& gh_cof1 = m_model.coefficients[c_lag0 + 1];
-				const double cof = ratio * (gh_cof0 * cos_phi[m_lag0] + gh_cof1 * sin_phi[m_lag0]);
-				b_r += (n + 1) * cof * p[p_lag0];
-				b_t -= cof * d_p[p_lag0];
-				if (sin_theta == 0.0) {
-					b_p -= cos_theta * ratio * (gh_cof1 * cos_phi[m_lag0] - gh_cof0 * sin_phi[m_lag0]) * p[p_lag0];
+	/**
+	 * @brief 球面調和展開を合成する
+	 * @remark Oに含まれない量の項は定数の条件で外れるので、コンパイラが漸化式 (d_p) や和、回転ごと取り除く。
+	 *         測地座標系への回転は北向きと下向きの成分を混ぜるので、Geodeticではどちらか一方でも動径と余緯度の両方の和を求める
+	 *
+	 * @tparam O 求める量
+	 * @param r 地心距離 [m]
+	 * @param cos_theta 余緯度の余弦
+	 * @param sin_theta 余緯度の正弦
+	 * @param cos_phi cos(m*phi)
+	 * @param sin_phi sin(m*phi)
+	 * @param cos_delta 測地座標系への回転角の余弦
+	 * @param sin_delta 測地座標系への回転角の正弦
+	 * @param sample 評価結果 [nT]
+	 */
+	template <FieldOutput O>
+	void synthesizeField(double r, double cos_theta, double sin_theta, const std::array<double, Model::max_degree>& cos_phi,
+						 const std::array<double, Model::max_degree>& sin_phi, double cos_delta, double sin_delta, FieldSample& sample) const {
+		constexpr bool geodetic = hasFieldOutput(O, FieldOutput::Geodetic);
+		constexpr bool need_r = hasFieldOutput(O, FieldOutput::Down) || (geodetic && hasFieldOutput(O, FieldOutput::North));
+		constexpr bool need_t = hasFieldOutput(O, FieldOutput::North) || (geodetic && hasFieldOutput(O, FieldOutput::Down));
+		constexpr bool need_p = hasFieldOutput(O, FieldOutput::East);
+		constexpr bool potential = hasFieldOutput(O, FieldOutput::Potential);
+		constexpr bool rate = hasFieldOutput(O, FieldOutput::SecularVariation);
+		constexpr bool gradient = hasFieldOutput(O, FieldOutput::RadialGradient);
+		constexpr double earth_radius = 6371.2e3; // IGRFはこれ[m]
+
+		LegendreTable p{0};	  // Legendre polynomial
+		LegendreTable d_p{0}; // Derivative of Legendre polynomial (need_tの場合だけ求める)
+		legendre<need_t>(cos_theta, sin_theta, p, d_p);
+
+		double b_r = 0, b_t = 0, b_p = 0; // 磁束密度
+		double s_r = 0, s_t = 0, s_p = 0; // 時間微分
+		double g_r = 0, g_t = 0, g_p = 0; // 動径方向の微分
+		double v = 0;					  // ポテンシャル
+		double ratio = (earth_radius / r) * (earth_radius / r);
+		double d_ratio = 0; // 次数nの項は(a/r)^(n+2)に比例するので、動径微分は -(n+2)/r 倍
+		const double inv_sin_theta = sin_theta == 0.0 ? 0.0 : 1 / sin_theta;
+
+		std::size_t p_idx = 1, c_idx = 1;
+		for (int n = 1; n <= static_cast<int>(Model::max_degree); n++) {
+			ratio *= earth_radius / r;
+			d_ratio = -(n + 2) / r;
+			for (int m = 0; m <= n; m++) {
+				// gh: g cos(mφ) + h sin(mφ)、hg: h cos(mφ) - g sin(mφ) (m = 0ではgとhは0)
+				const double& g = m_model.coefficients[c_idx - 1];
+				double gh = g, hg = 0, gh_rate = 0, hg_rate = 0;
+				if (rate) {
+					gh_rate = m_model_rate.coefficients[c_idx - 1];
+				}
+				if (m != 0) {
+					const std::size_t m_lag0 = m - 1;
+					const double& h = m_model.coefficients[c_idx];
+					gh = g * cos_phi[m_lag0] + h * sin_phi[m_lag0];
+					hg = h * cos_phi[m_lag0] - g * sin_phi[m_lag0];
+					if (rate) {
+						const double g_rate = m_model_rate.coefficients[c_idx - 1], h_rate = m_model_rate.coefficients[c_idx];
+						gh_rate = g_rate * cos_phi[m_lag0] + h_rate * sin_phi[m_lag0];
+						hg_rate = h_rate * cos_phi[m_lag0] - g_rate * sin_phi[m_lag0];
+					}
+				}
+
+				const double cof = ratio * gh;
+				if (need_r) {
+					const double term = (n + 1) * cof * p[p_idx];
+					b_r += term;
+					if (gradient) {
+						g_r += d_ratio * term;
+					}
+					if (rate) {
+						s_r += (n + 1) * ratio * gh_rate * p[p_idx];
+					}
+				}
+				if (need_t) {
+					const double term = cof * d_p[p_idx];
+					b_t -= term;
+					if (gradient) {
+						g_t -= d_ratio * term;
+					}
+					if (rate) {
+						s_t -= ratio * gh_rate * d_p[p_idx];
+					}
+				}
+				if (need_p && m != 0) {
+					// 極 (sin(theta) = 0) では m P_n^m / sin(theta) の代わりに cos(theta) P_n^m を使う
+					const double term = sin_theta == 0.0 ? cos_theta * ratio * hg * p[p_idx] : inv_sin_theta * ratio * m * hg * p[p_idx];
+					b_p -= term;
+					if (gradient) {
+						g_p -= d_ratio * term;
+					}
+					if (rate) {
+						s_p -= (sin_theta == 0.0 ? cos_theta : inv_sin_theta * m) * ratio * hg_rate * p[p_idx];
+					}
+				}
+				if (potential) {
+					v += r * cof * p[p_idx];
+				}
+				c_idx += m == 0 ? 1 : 2;
+				p_idx++;
+			}
+		}
+
+		const auto ned = [&](double radial, double theta, double phi) -> Eigen::Vector3d {
+			if (geodetic) {
+				return Eigen::Vector3d{-theta * cos_delta - radial * sin_delta, phi, theta * sin_delta - radial * cos_delta};
+			}
+			return Eigen::Vector3d{-theta, phi, -radial};
+		};
+		sample.field = ned(b_r, b_t, b_p);
+		if (rate) {
+			sample.secular_variation = ned(s_r, s_t, s_p);
+		}
+		if (gradient) {
+			sample.radial_gradient = ned(g_r, g_t, g_p);
+		}
+		if (potential) {
+			sample.potential = v;
+		}
+	}
+
+	/**
+	 * @brief 球面調和展開を次数ごとにまとめて合成する (Fast/Approximate用)
+	 * @remark ルジャンドル陪関数の漸化式を和と同じループで進め、(a/r)^(n+2) と (n+1) は次数ごとの和にまとめて掛ける。
+	 *         東向き成分は 1/sin(theta) を最後に一度だけ掛けるので、極 (sin(theta) = 0) では呼ばない。
+	 *         永年変化は係数の並べ替えを持たないのでsynthesizeFieldで求める
+	 *
+	 * @tparam O 求める量
+	 * @param r 地心距離 [m]
+	 * @param cos_theta 余緯度の余弦
+	 * @param sin_theta 余緯度の正弦 (0以外)
+	 * @param cos_phi cos(m*phi)
+	 * @param sin_phi sin(m*phi)
+	 * @param cos_delta 測地座標系への回転角の余弦
+	 * @param sin_delta 測地座標系への回転角の正弦
+	 * @param sample 評価結果 [nT]
+	 */
+	template <FieldOutput O>
+	void synthesizeFieldByDegree(double r, double cos_theta, double sin_theta, const std::array<double, Model::max_degree>& cos_phi,
+								 const std::array<double, Model::max_degree>& sin_phi, double cos_delta, double sin_delta,
+								 FieldSample& sample) {
+		constexpr bool geodetic = hasFieldOutput(O, FieldOutput::Geodetic);
+		constexpr bool need_r = hasFieldOutput(O, FieldOutput::Down) || (geodetic && hasFieldOutput(O, FieldOutput::North));
+		constexpr bool need_t = hasFieldOutput(O, FieldOutput::North) || (geodetic && hasFieldOutput(O, FieldOutput::Down));
+		constexpr bool need_p = hasFieldOutput(O, FieldOutput::East);
+		constexpr bool potential = hasFieldOutput(O, FieldOutput::Potential);
+		constexpr bool gradient = hasFieldOutput(O, FieldOutput::RadialGradient);
+		constexpr double earth_radius = 6371.2e3; // IGRFはこれ[m]
+		constexpr int max_degree = static_cast<int>(Model::max_degree);
+		if (hasFieldOutput(O, FieldOutput::SecularVariation)) {
+			synthesizeField<O>(r, cos_theta, sin_theta, cos_phi, sin_phi, cos_delta, sin_delta, sample);
+			return;
+		}
+
+		prepareDegreeModel();
+		const auto& recurrence = LegendreCoefficients::instance();
+		const auto& c = m_degree_model;
+
+		// m = 0 も同じ式で扱えるように cos(0) = 1, sin(0) = 0 を先頭に置く
+		std::array<double, max_degree + 1> cos_m, sin_m;
+		cos_m[0] = 1.0;
+		sin_m[0] = 0.0;
+		std::copy(cos_phi.begin(), cos_phi.end(), cos_m.begin() + 1);
+		std::copy(sin_phi.begin(), sin_phi.end(), sin_m.begin() + 1);
+
+		LegendreTable p;
+		LegendreTable d_p;
+		p[0] = 1;
+		d_p[0] = 0;
+
+		double b_r = 0, b_t = 0, b_p = 0; // 磁束密度
+		double g_r = 0, g_t = 0, g_p = 0; // 動径方向の微分
+		double v = 0;					  // ポテンシャル
+		const double a_r = earth_radius / r;
+		double ratio = a_r * a_r;
+
+		std::size_t k = 1;
+		for (int n = 1; n <= max_degree; n++) {
+			ratio *= a_r;
+			double sum_r = 0, sum_t = 0, sum_p = 0; // Σ_m (g cos + h sin) P、同 dP、Σ_m m (h cos - g sin) P
+			for (int m = 0; m <= n; m++, k++) {
+				double p_k, d_p_k = 0;
+				if (m < n) {
+					const double left = recurrence.left[k], right = recurrence.right[k];
+					p_k = left * cos_theta * p[k - n] - right * p[k + 1 - 2 * n];
+					if (need_t) {
+						d_p_k = left * (cos_theta * d_p[k - n] - sin_theta * p[k - n]) - right * d_p[k + 1 - 2 * n];
+					}
 				} else {
-					b_p -= 1 / sin_theta * ratio * m * (gh_cof1 * cos_phi[m_lag0] - gh_cof0 * sin_phi[m_lag0]) * p[p_lag0];
+					const double diagonal = recurrence.diagonal[k];
+					p_k = diagonal * sin_theta * p[k - n - 1];
+					if (need_t) {
+						d_p_k = diagonal * (sin_theta * d_p[k - n - 1] + cos_theta * p[k - n - 1]);
+					}
+				}
+				p[k] = p_k;
+				d_p[k] = d_p_k;
+
+				if (need_r || potential) {
+					sum_r += (c.g[k] * cos_m[m] + c.h[k] * sin_m[m]) * p_k;
+				}
+				if (need_t) {
+					sum_t += (c.g[k] * cos_m[m] + c.h[k] * sin_m[m]) * d_p_k;
+				}
+				if (need_p) {
+					sum_p += (c.mh[k] * cos_m[m] - c.mg[k] * sin_m[m]) * p_k;
 				}
-				c_idx += 2;
 			}
-			m++;
+
+			const double d_ratio = -(n + 2) / r; // 次数nの項は(a/r)^(n+2)に比例する
+			const double term_r = (n + 1) * ratio * sum_r, term_t = ratio * sum_t, term_p = ratio * sum_p;
+			b_r += term_r;
+			b_t -= term_t;
+			b_p -= term_p;
+			if (gradient) {
+				g_r += d_ratio * term_r;
+				g_t -= d_ratio * term_t;
+				g_p -= d_ratio * term_p;
+			}
+			if (potential) {
+				v += r * ratio * sum_r;
+			}
+		}
+		b_p /= sin_theta;
+		g_p /= sin_theta;
+
+		const auto ned = [&](double radial, double theta, double phi) -> Eigen::Vector3d {
+			if (geodetic) {
+				return Eigen::Vector3d{-theta * cos_delta - radial * sin_delta, phi, theta * sin_delta - radial * cos_delta};
+			}
+			return Eigen::Vector3d{-theta, phi, -radial};
+		};
+		sample.field = ned(b_r, b_t, b_p);
+		if (gradient) {
+			sample.radial_gradient = ned(g_r, g_t, g_p);
+		}
+		if (potential) {
+			sample.potential = v;
 		}
-		mag_density << -b_t * cos_delta - b_r * sin_delta, b_p, b_t * sin_delta - b_r * cos_delta;
 	}
 
   protected:
+	/**
+	 * @brief 使っているモデルセットの指紋
+	 *
+	 */
+	std::uint64_t modelFingerprint() const {
+		return m_spline_model_set.empty() ? m_model_set.fingerprint() : m_spline_model_set.fingerprint();
+	}
+
+	/**
+	 * @brief 緯度と高度が等しい点の列 (格子の1行) の磁束密度をまとめて計算する
+	 * @remark ルジャンドル陪関数と動径の項は行で共通なので一度だけ求め、次数nについて先に和をとって位数mごとの係数にまとめる。
+	 *         各点では位数mについての和 (max_degree + 1項) だけを計算する
+	 *
+	 * @param latitude 測地緯度 [rad]
+	 * @param altitude 楕円体高 [m]
+	 * @param longitudes 経度の配列 [rad]
+	 * @param count 点の数
+	 * @param mag_densities 測地座標系のNED成分の磁束密度 [nT]
+	 */
+	void calculateMagDensityRow(double latitude, double altitude, const double* longitudes, std::size_t count,
+								Eigen::Vector3d* mag_densities) const {
+		constexpr std::size_t max_degree = Model::max_degree;
+		constexpr double earth_radius = 6371.2e3; // IGRFはこれ[m]
+
+		// calculateFieldのWgs84と同じ地心座標への変換
+		double r = altitude;
+		double cos_theta = std::sin(latitude), sin_theta = std::cos(latitude); // colatitude
+		double cos_delta = 0.0, sin_delta = 0.0;
+		toGeocentric<Accuracy::Exact>(r, cos_theta, sin_theta, cos_delta, sin_delta);
+
+		LegendreTable p{0};
+		LegendreTable d_p{0};
+		legendre<true>(cos_theta, sin_theta, p, d_p);
+
+		// 位数mごとの係数: b_r = Σ_m (r_g[m] cos(mφ) + r_h[m] sin(mφ))、b_tも同様、b_p = Σ_m (p_h[m] cos(mφ) - p_g[m] sin(mφ))
+		std::array<double, max_degree + 1> r_g{0}, r_h{0}, t_g{0}, t_h{0}, p_g{0}, p_h{0};
+		double ratio = (earth_radius / r) * (earth_radius / r);
+		const double inv_sin_theta = sin_theta == 0.0 ? 0.0 : 1 / sin_theta;
+
+		std::size_t p_idx = 1, c_idx = 1;
+		for (int n = 1; n <= static_cast<int>(max_degree); n++) {
+			ratio *= earth_radius / r;
+			for (int m = 0; m <= n; m++) {
+				const double radial = (n + 1) * ratio * p[p_idx];
+				const double tangential = -ratio * d_p[p_idx];
+				const double g = m_model.coefficients[c_idx - 1];
+				r_g[m] += radial * g;
+				t_g[m] += tangential * g;
+				if (m != 0) {
+					const double h = m_model.coefficients[c_idx];
+					const double azimuthal = -(sin_theta == 0.0 ? cos_theta : inv_sin_theta * m) * ratio * p[p_idx];
+					r_h[m] += radial * h;
+					t_h[m] += tangential * h;
+					p_g[m] += azimuthal * g;
+					p_h[m] += azimuthal * h;
+				}
+				c_idx += m == 0 ? 1 : 2;
+				p_idx++;
+			}
+		}
+
+		std::array<double, max_degree> cos_phi; // cos(m*phi)
+		std::array<double, max_degree> sin_phi; // sin(m*phi)
+		for (std::size_t i = 0; i < count; i++) {
+			cos_phi[0] = std::cos(longitudes[i]);
+			sin_phi[0] = std::sin(longitudes[i]);
+			multipleAngles(cos_phi, sin_phi);
+
+			double b_r = r_g[0], b_t = t_g[0], b_p = 0;
+			for (std::size_t k = 1; k <= max_degree; k++) {
+				b_r += r_g[k] * cos_phi[k - 1] + r_h[k] * sin_phi[k - 1];
+				b_t += t_g[k] * cos_phi[k - 1] + t_h[k] * sin_phi[k - 1];
+				b_p += p_h[k] * cos_phi[k - 1] - p_g[k] * sin_phi[k - 1];
+			}
+			mag_densities[i] << -b_t * cos_delta - b_r * sin_delta, b_p, b_t * sin_delta - b_r * cos_delta;
+		}
+	}
+
+	/**
+	 * @brief 指定した時刻のモデルを取得する
+	 *
+	 * @param dt 時刻
+	 * @return const Model& ガウス係数 (次にモデルを初期化するまで有効)
+	 */
+	const Model& modelAt(const DateTime& dt) {
+		initializeModel(dt);
+		return m_model;
+	}
+
+	/**
+	 * @brief 位置を更新して選んだ量を求める
+	 *
+	 * @tparam O 求める量
+	 * @param position ECEF座標系での位置ベクトル
+	 * @param sample その位置での評価結果 [nT] (成分は地心球座標系のNED)
+	 * @param accuracy 計算精度
+	 */
+	template <FieldOutput O>
+	void updateField(const Ecef& position, FieldSample& sample, Accuracy accuracy = Accuracy::Exact) {
+		initializeModel(position.epoch());
+		if (hasFieldOutput(O, FieldOutput::SecularVariation)) {
+			initializeModelRate(position.epoch());
+		}
+		switch (accuracy) {
+			case Accuracy::Fast: calculateFieldFromEcef<O, Accuracy::Fast>(position, sample); return;
+			case Accuracy::Approximate: calculateFieldFromEcef<O, Accuracy::Approximate>(position, sample); return;
+			default: calculateField<O>(position.toGeocentricSpherical(), sample); return;
+		}
+	}
+
+	/**
+	 * @brief 位置を更新して選んだ量を求める
+	 *
+	 * @tparam O 求める量
+	 * @param position WGS84回転楕円座標系での位置
+	 * @param sample その位置での評価結果 [nT]
+	 * @param accuracy 計算精度
+	 */
+	template <FieldOutput O>
+	void updateField(const Wgs84& position, FieldSample& sample, Accuracy accuracy = Accuracy::Exact) {
+		initializeModel(position.epoch());
+		if (hasFieldOutput(O, FieldOutput::SecularVariation)) {
+			initializeModelRate(position.epoch());
+		}
+		switch (accuracy) {
+			case Accuracy::Fast: calculateField<O, Accuracy::Fast>(position, sample); return;
+			case Accuracy::Approximate: calculateField<O, Accuracy::Approximate>(position, sample); return;
+			default: calculateField<O>(position, sample); return;
+		}
+	}
+
 	/**
 	 * @brief 位置と磁束密度を更新する
 	 *
 	 * @param position ECEF座標系での位置ベクトル
 	 * @param mag_density その位置での磁束密度 [nT]
+	 * @param accuracy 計算精度
 	 */
-	void updatePositionAndMag(const Ecef& position, Eigen::Vector3d& mag_density) {
-		initializeModel(position.epoch());
-		calculateMagDensity(position.toGeocentricSpherical(), mag_density);
+	void updatePositionAndMag(const Ecef& position, Eigen::Vector3d& mag_density, Accuracy accuracy = Accuracy::Exact) {
+		FieldSample sample;
+		updateField<FieldOutput::Field>(position, sample, accuracy);
+		mag_density = sample.field;
 	}
 
 	/**
@@ -224,10 +788,12 @@ class Igrf {
 	 *
 	 * @param position WGS84回転楕円座標系での位置
 	 * @param mag_density その位置での磁束密度 [nT]
+	 * @param accuracy 計算精度
 	 */
-	void updatePositionAndMag(const Wgs84& position, Eigen::Vector3d& mag_density) {
-		initializeModel(position.epoch());
-		calculateMagDensity(position, mag_density);
+	void updatePositionAndMag(const Wgs84& position, Eigen::Vector3d& mag_density, Accuracy accuracy = Accuracy::Exact) {
+		FieldSample sample;
+		updateField<FieldOutput::Field>(position, sample, accuracy);
+		mag_density = sample.field;
 	}
 };
 GEOMAG_NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,841 @@
+/**
+ * @file LStar.hpp
+ * @author Kaiji Takeuchi
+ * @brief 磁力線の追跡と漂流殻の探索によるRoedererのL*の計算
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../../Eigen/Core"
+#include "../../Eigen/Geometry"
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "FieldLine.hpp"
+#include "GeoMagFlux.hpp"
+#include "MemoCache.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief L*の求め方
+ *
+ */
+enum class LStarMode {
+	Exact,	   // 問い合わせごとに漂流殻を探す (結果はキャッシュで共有する)
+	Tabulated, // 時刻の刻みごとに (Bm, K) の表を作って補間する (表の外では Exact と同じ)
+};
+
+/**
+ * @brief L*の計算結果の状態
+ *
+ */
+enum class LStarStatus {
+	Ok,
+	Lost,		  // 反射点が損失高度より下にある (バウンス・漂流の損失円錐)
+	Open,		  // 漂流殻が閉じない (探索範囲の外に出る)
+	NotConverged, // 根の探索が評価回数の上限に達した (L*は最後の推定値)
+};
+
+/**
+ * @brief L*の計算の設定
+ *
+ */
+struct LStarConfig {
+	LStarMode mode = LStarMode::Exact;
+	std::size_t azimuths = 24;		   // 漂流殻を代表する磁力線の数 (双極子座標の経度方向に等間隔)
+	double step = 0.04;				   // 磁力線の積分の刻み (地心距離に対する比)
+	std::size_t max_steps = 2000;	   // 磁力線を片側にたどる刻み数の上限
+	std::size_t max_iterations = 24;   // 磁力線1本あたりの根の探索での追跡回数の上限 (囲い込みを含む)
+	double tolerance = 1.0e-4;		   // 根の探索の相対許容誤差
+	double loss_altitude = 100.0e3;	   // これより低い反射点の粒子は失われるとみなす [m]
+	double max_radius = 15.0;		   // 漂流殻を探す地心距離の上限 [地球半径]
+	TimeSpan epoch_step = Days(1);	   // 時刻の刻み (同じ刻みの問い合わせは刻みの中心の磁場で計算する)
+	double cache_step = 1.0e-3;		   // キャッシュのキーにするBmとIの相対刻み
+	std::size_t cache_capacity = 1 << 16;
+	double table_min_field = 100.0;	   // 表のBmの下限 [nT]
+	double table_max_field = 45000.0;  // 表のBmの上限 [nT]
+	std::size_t table_field_nodes = 40; // 表のBm方向の節点数 (対数で等間隔)
+	double table_max_k = 2.5;		   // 表のKの上限 [G^1/2 RE]
+	std::size_t table_k_nodes = 24;	   // 表のK方向の節点数 (平方根で等間隔)
+	std::size_t num_threads = 0;	   // スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief L*の計算結果
+ *
+ */
+struct LStarResult {
+	double lstar = std::numeric_limits<double>::quiet_NaN();		// L* [地球半径]
+	double mirror_field = std::numeric_limits<double>::quiet_NaN(); // 反射点の磁束密度Bm [nT]
+	double i = std::numeric_limits<double>::quiet_NaN();			// 第2断熱不変量の積分I [地球半径]
+	double k = std::numeric_limits<double>::quiet_NaN();			// K = I sqrt(Bm) [G^1/2 RE]
+	LStarStatus status = LStarStatus::Ok;
+};
+
+/**
+ * @brief 1本の磁力線をたどった結果
+ *
+ */
+struct FieldLineTrace {
+	double i = 0.0;												 // 反射点の間の積分 I = ∫ sqrt(1 - B/Bm) ds [m]
+	double min_field = std::numeric_limits<double>::infinity();	 // 磁力線上の磁束密度の最小値 [nT]
+	double mirror_radius = std::numeric_limits<double>::infinity(); // 低い方の反射点の地心距離 [m]
+	bool grounded = false;										 // 反射点の前に地表に達した
+	bool escaped = false;										 // 反射点の前に探索範囲の外に出た
+};
+
+/**
+ * @brief 1つの時刻の磁場で磁力線をたどる
+ * @remark 磁力線の方向をFieldLineStepper (RK4) で積分し、刻みは地心距離に比例させる。磁束密度は[nT]で扱う
+ *
+ */
+class FieldLineTracer {
+  public:
+	static constexpr double reference_radius = 6371.2e3; // IGRFの基準半径 [m] (L*の単位、足跡を求める球)
+
+	FieldLineTracer(const GeoMagFlux& flux, const LStarConfig& config) : m_stepper(flux), m_config(config) {}
+
+	/**
+	 * @brief 磁場の時刻を設定し、双極子の軸を求める
+	 *
+	 */
+	void setEpoch(const DateTime& epoch) {
+		if (m_ready && epoch.ticks() == m_stepper.epoch().ticks()) {
+			return;
+		}
+		m_stepper.setEpoch(epoch);
+		const Model& model = m_stepper.model(epoch);
+		const Eigen::Vector3d moment{model.coefficients[1], model.coefficients[2], model.coefficients[0]}; // (g11, h11, g10)
+		m_dipole_field = moment.norm();
+		m_axis = -moment / m_dipole_field; // 北の地磁気極の方向
+		m_axis_y = m_axis.cross(Eigen::Vector3d::UnitX()).normalized();
+		m_axis_x = m_axis_y.cross(m_axis);
+		m_ready = true;
+	}
+
+	const DateTime& epoch() const { return m_stepper.epoch(); }
+
+	/**
+	 * @brief 双極子成分の赤道での磁束密度B0 [nT]
+	 *
+	 */
+	double dipoleField() const { return m_dipole_field; }
+
+	/**
+	 * @brief 双極子の赤道面で、双極子座標の経度azimuthの方向の単位ベクトル
+	 *
+	 */
+	Eigen::Vector3d equatorialDirection(double azimuth) const { return std::cos(azimuth) * m_axis_x + std::sin(azimuth) * m_axis_y; }
+
+	/**
+	 * @brief 磁束密度 [nT] (ECEF成分)
+	 *
+	 */
+	Eigen::Vector3d field(const Eigen::Vector3d& position) { return m_stepper.field(position); }
+
+	/**
+	 * @brief 磁力線を両方向にたどり、反射点Bmの間の積分と最小の磁束密度を求める
+	 *
+	 * @param start 磁力線上の点 (ECEF) [m]
+	 * @param mirror_field 反射点の磁束密度Bm [nT]
+	 */
+	FieldLineTrace trace(const Eigen::Vector3d& start, double mirror_field) {
+		FieldLineTrace line;
+		const Eigen::Vector3d b0 = field(start);
+		const double start_magnitude = b0.norm();
+		const double surface = reference_radius;
+		const double outer = m_config.max_radius * reference_radius;
+		double first[2] = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+		double first_step = 0.0;
+		line.min_field = start_magnitude;
+
+		for (int side = 0; side < 2; side++) {
+			const double direction = side == 0 ? 1.0 : -1.0;
+			Eigen::Vector3d x = start, b = b0;
+			double magnitude = start_magnitude, before = std::numeric_limits<double>::infinity(), previous_step = 0.0;
+			double f = 1.0 - magnitude / mirror_field;
+			bool mirrored = false;
+			for (std::size_t n = 0; n < m_config.max_steps; n++) {
+				const double h = m_config.step * x.norm();
+				Eigen::Vector3d b_next;
+				const Eigen::Vector3d x_next = m_stepper.advance(x, b, direction * h, b_next);
+				const double r = x_next.norm();
+				if (r < surface) {
+					line.grounded = true;
+					mirrored = true;
+					break;
+				}
+				if (r > outer) {
+					line.escaped = true;
+					mirrored = true;
+					break;
+				}
+				const double next_magnitude = b_next.norm();
+				const double f_next = 1.0 - next_magnitude / mirror_field;
+				line.i += segment(f, f_next, h);
+				if (f >= 0.0 && f_next < 0.0) {
+					const double t = f / (f - f_next);
+					line.mirror_radius = std::min(line.mirror_radius, (x + t * (x_next - x)).norm());
+				}
+				if (n == 0) {
+					first[side] = next_magnitude;
+					first_step = h;
+				} else if (magnitude < before && magnitude <= next_magnitude) {
+					// 刻みの間にある極小を放物線で求める
+					line.min_field = std::min(line.min_field, parabolaMinimum(previous_step, h, before, magnitude, next_magnitude));
+				}
+				line.min_field = std::min(line.min_field, next_magnitude);
+				before = magnitude;
+				previous_step = h;
+				x = x_next;
+				b = b_next;
+				magnitude = next_magnitude;
+				f = f_next;
+				if (f < 0.0 && magnitude > before) {
+					mirrored = true; // 反射点を越えて磁場が強くなり続ける側に入った
+					break;
+				}
+			}
+			if (!mirrored) {
+				line.escaped = true;
+			}
+		}
+		if (first[0] >= start_magnitude && first[1] >= start_magnitude && std::isfinite(first[0]) && std::isfinite(first[1])) {
+			line.min_field = std::min(line.min_field, parabolaMinimum(first_step, first_step, first[1], start_magnitude, first[0]));
+		}
+		if (start_magnitude >= mirror_field && line.i == 0.0) {
+			line.mirror_radius = std::min(line.mirror_radius, start.norm());
+		}
+		return line;
+	}
+
+	/**
+	 * @brief 磁力線を磁場の向きにたどり、北半球の基準球 (半径 reference_radius) との交点を求める
+	 *
+	 * @param start 磁力線上の点 (ECEF) [m]
+	 * @param footprint 交点 (ECEF) [m]
+	 * @return bool 交点が見つかったか
+	 */
+	bool footprint(const Eigen::Vector3d& start, Eigen::Vector3d& footprint) {
+		const double outer = m_config.max_radius * reference_radius;
+		Eigen::Vector3d x = start, b = field(start);
+		for (std::size_t n = 0; n < m_config.max_steps; n++) {
+			// 基準球の近くでは刻みを縮めて交点を正確にする
+			const double r0 = x.norm();
+			const double h = std::max(m_config.step * std::min(r0, 2.0 * (r0 - reference_radius) + 0.01 * reference_radius), 1.0);
+			Eigen::Vector3d b_next;
+			const Eigen::Vector3d x_next = m_stepper.advance(x, b, h, b_next);
+			const double r = x_next.norm();
+			if (r <= reference_radius) {
+				const double t = (r0 - reference_radius) / (r0 - r);
+				footprint = x + t * (x_next - x);
+				footprint *= reference_radius / footprint.norm();
+				return true;
+			}
+			if (r > outer) {
+				return false;
+			}
+			x = x_next;
+			b = b_next;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief 基準球上の双極子座標の経度azimuthに沿って、極から余緯度colatitudeまでの下向きの磁束を積分する
+	 *
+	 * @return double ∫ (-B_r) R^2 sinθ dθ [nT m^2]
+	 */
+	double capFlux(double colatitude, double azimuth) {
+		constexpr int intervals = 16; // シンプソン則の区間数 (偶数)
+		const Eigen::Vector3d horizontal = equatorialDirection(azimuth);
+		const double radius = reference_radius; // Eigenのスカラー倍は参照で受けるので、クラス外の定義が要らないようにコピーする
+		const double h = colatitude / intervals;
+		double sum = 0.0;
+		for (int k = 0; k <= intervals; k++) {
+			const double theta = h * k;
+			const Eigen::Vector3d unit = std::cos(theta) * m_axis + std::sin(theta) * horizontal;
+			const double down = -field(radius * unit).dot(unit);
+			const double weight = k == 0 || k == intervals ? 1.0 : (k % 2 == 1 ? 4.0 : 2.0);
+			sum += weight * down * std::sin(theta);
+		}
+		return sum * h / 3.0 * radius * radius;
+	}
+
+	/**
+	 * @brief 点の双極子座標 (余緯度, 経度) [rad]
+	 *
+	 */
+	std::pair<double, double> dipoleCoordinates(const Eigen::Vector3d& position) const {
+		const double z = position.dot(m_axis);
+		const double x = position.dot(m_axis_x), y = position.dot(m_axis_y);
+		return {std::atan2(std::sqrt(x * x + y * y), z), std::atan2(y, x)};
+	}
+
+  private:
+	FieldLineStepper m_stepper;
+	LStarConfig m_config;
+	bool m_ready = false;
+	double m_dipole_field = 0.0;
+	Eigen::Vector3d m_axis = Eigen::Vector3d::UnitZ(), m_axis_x = Eigen::Vector3d::UnitX(), m_axis_y = Eigen::Vector3d::UnitY();
+
+	/**
+	 * @brief 1刻み分の sqrt(1 - B/Bm) の積分 (反射点を含む刻みでは 1 - B/Bm を線形とみなして端の平方根を正確に積分する)
+	 *
+	 */
+	static double segment(double f0, double f1, double ds) {
+		if (f0 >= 0.0 && f1 >= 0.0) {
+			return 0.5 * (std::sqrt(f0) + std::sqrt(f1)) * ds;
+		}
+		if (f0 > 0.0) {
+			return 2.0 / 3.0 * f0 / (f0 - f1) * ds * std::sqrt(f0);
+		}
+		if (f1 > 0.0) {
+			return 2.0 / 3.0 * f1 / (f1 - f0) * ds * std::sqrt(f1);
+		}
+		return 0.0;
+	}
+
+	/**
+	 * @brief 位置 -a, 0, b での値 ym, y0, yp を通る放物線の最小値
+	 *
+	 */
+	static double parabolaMinimum(double a, double b, double ym, double y0, double yp) {
+		const double c2 = (a * (yp - y0) + b * (ym - y0)) / (a * b * (a + b));
+		const double c1 = ((yp - y0) - c2 * b * b) / b;
+		return c2 > 0.0 ? y0 - c1 * c1 / (4.0 * c2) : y0;
+	}
+};
+
+/**
+ * @brief 1つの時刻での (Bm, K) に対するL*の表
+ * @remark Bmは対数、Kは平方根で等間隔に節点を置き、双線形補間する。節点のどれかが求まらない (NaN) 場合はNaNを返す
+ *
+ */
+class LStarTable {
+  public:
+	LStarTable(double min_field, double max_field, std::size_t field_nodes, double max_k, std::size_t k_nodes)
+	  : m_min_field(min_field), m_max_field(max_field), m_field_nodes(field_nodes), m_max_k(max_k), m_k_nodes(k_nodes),
+		m_values(field_nodes * k_nodes, std::numeric_limits<double>::quiet_NaN()) {
+		if (!(min_field > 0.0) || !(max_field > min_field) || field_nodes < 2 || !(max_k > 0.0) || k_nodes < 2) {
+			throw std::runtime_error("LStarTable: invalid table axes");
+		}
+	}
+
+	std::size_t fieldNodes() const { return m_field_nodes; }
+	std::size_t kNodes() const { return m_k_nodes; }
+
+	/**
+	 * @brief 節点のBm [nT]
+	 *
+	 */
+	double field(std::size_t index) const {
+		const double u = static_cast<double>(index) / static_cast<double>(m_field_nodes - 1);
+		return m_min_field * std::exp(std::log(m_max_field / m_min_field) * u);
+	}
+
+	/**
+	 * @brief 節点のK [G^1/2 RE]
+	 *
+	 */
+	double k(std::size_t index) const {
+		const double u = static_cast<double>(index) / static_cast<double>(m_k_nodes - 1);
+		return m_max_k * u * u;
+	}
+
+	double& value(std::size_t field_index, std::size_t k_index) { return m_values[field_index * m_k_nodes + k_index]; }
+	double value(std::size_t field_index, std::size_t k_index) const { return m_values[field_index * m_k_nodes + k_index]; }
+
+	/**
+	 * @brief L*を補間する
+	 *
+	 * @param mirror_field Bm [nT]
+	 * @param k K [G^1/2 RE]
+	 * @return double L* (表の外や節点が求まらない場合はNaN)
+	 */
+	double lookup(double mirror_field, double k) const {
+		const double u =
+		  std::log(mirror_field / m_min_field) / std::log(m_max_field / m_min_field) * static_cast<double>(m_field_nodes - 1);
+		const double v = std::sqrt(std::max(k, 0.0) / m_max_k) * static_cast<double>(m_k_nodes - 1);
+		if (!(u >= 0.0) || !(v >= 0.0) || u > static_cast<double>(m_field_nodes - 1) || v > static_cast<double>(m_k_nodes - 1)) {
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+		const std::size_t i = std::min(static_cast<std::size_t>(u), m_field_nodes - 2);
+		const std::size_t j = std::min(static_cast<std::size_t>(v), m_k_nodes - 2);
+		const double tu = u - static_cast<double>(i), tv = v - static_cast<double>(j);
+		const double a = value(i, j) + (value(i, j + 1) - value(i, j)) * tv;
+		const double b = value(i + 1, j) + (value(i + 1, j + 1) - value(i + 1, j)) * tv;
+		return a + (b - a) * tu;
+	}
+
+  private:
+	double m_min_field, m_max_field;
+	std::size_t m_field_nodes;
+	double m_max_k;
+	std::size_t m_k_nodes;
+	std::vector<double> m_values;
+};
+
+/**
+ * @brief RoedererのL*を求める
+ * @remark 問い合わせ点の磁力線をたどって反射点の磁束密度Bmと積分Iを求め、双極子座標の経度ごとに (Bm, I) が等しい磁力線を根の探索で見つける。
+ *         それらの足跡で囲まれた極冠の磁束Φから L* = 2π B0 RE^2 / Φ とする。L*は時刻と (Bm, I) だけで決まるので、
+ *         結果は (時刻の刻み, Bm, I) を量子化したキーでキャッシュに共有し、表のモードでは時刻の刻みごとに (Bm, K) の表を作る。
+ *         評価器の複製はキャッシュと表を共有する。磁場は内部磁場 (GeoMagFluxのモデル) だけで、外部磁場は含まない
+ *
+ */
+class LStarEngine {
+  public:
+	/**
+	 * @brief Construct a new LStar Engine object
+	 *
+	 * @param flux 磁場の評価器 (精度の設定もそのまま使う)
+	 * @param config 設定
+	 */
+	LStarEngine(const GeoMagFlux& flux, const LStarConfig& config = LStarConfig{})
+	  : m_tracer(flux, config), m_config(config), m_shared(std::make_shared<Shared>(config)) {
+		if (config.azimuths < 4 || !(config.step > 0.0) || config.max_iterations < 2 || !(config.tolerance > 0.0) ||
+			config.epoch_step.ticks() <= 0 || !(config.cache_step > 0.0)) {
+			throw std::runtime_error("LStarEngine: invalid configuration");
+		}
+	}
+
+	/**
+	 * @brief L*を求める
+	 *
+	 * @param position 位置
+	 * @param pitch_angle その位置での局所ピッチ角
+	 */
+	LStarResult operator()(const Ecef& position, const Angle& pitch_angle = Degree{90.0}) {
+		const std::int64_t bucket = epochBucket(position.epoch());
+		m_tracer.setEpoch(bucketEpoch(bucket));
+		const Eigen::Vector3d x = position.elements();
+		const double sin_alpha = std::sin(pitch_angle.radians());
+		const double mirror_field = m_tracer.field(x).norm() / (sin_alpha * sin_alpha);
+
+		LStarResult result;
+		const FieldLineTrace line = m_tracer.trace(x, mirror_field);
+		result.mirror_field = mirror_field;
+		result.i = line.i / FieldLineTracer::reference_radius;
+		result.k = result.i * std::sqrt(mirror_field * gauss_per_nanotesla);
+		if (line.grounded || line.mirror_radius < FieldLineTracer::reference_radius + m_config.loss_altitude) {
+			result.status = LStarStatus::Lost;
+			return result;
+		}
+		if (line.escaped) {
+			result.status = LStarStatus::Open;
+			return result;
+		}
+		if (m_config.mode == LStarMode::Tabulated) {
+			const double lstar = table(bucket, Parallel::threadCount(m_config.num_threads))->lookup(mirror_field, result.k);
+			if (std::isfinite(lstar)) {
+				result.lstar = lstar;
+				return result;
+			}
+		}
+		const ShellResult shell = driftShell(bucket, mirror_field, result.i, line.min_field, shellThreads());
+		result.lstar = shell.lstar;
+		result.status = shell.status;
+		return result;
+	}
+
+	template <typename Position>
+	LStarResult operator()(const Position& position, const Angle& pitch_angle = Degree{90.0}) {
+		return operator()(position.toEcef(), pitch_angle);
+	}
+
+	/**
+	 * @brief 1つの問い合わせのL*を、漂流殻の磁力線を並列にたどって求める
+	 *
+	 */
+	LStarResult parallel(const Ecef& position, const Angle& pitch_angle = Degree{90.0}) {
+		LStarEngine engine(*this);
+		engine.m_parallel = true;
+		return engine(position, pitch_angle);
+	}
+
+	/**
+	 * @brief 漂流殻 (Bm, I) のL*を求める
+	 *
+	 * @param epoch 時刻
+	 * @param mirror_field Bm [nT]
+	 * @param i I [地球半径]
+	 * @return LStarResult 結果 (statusはLost/Open/NotConvergedのいずれか、またはOk)
+	 */
+	LStarResult driftShell(const DateTime& epoch, double mirror_field, double i) {
+		const std::int64_t bucket = epochBucket(epoch);
+		m_tracer.setEpoch(bucketEpoch(bucket));
+		LStarResult result;
+		result.mirror_field = mirror_field;
+		result.i = i;
+		result.k = i * std::sqrt(mirror_field * gauss_per_nanotesla);
+		const ShellResult shell = driftShell(bucket, mirror_field, i, mirror_field, shellThreads());
+		result.lstar = shell.lstar;
+		result.status = shell.status;
+		return result;
+	}
+
+	/**
+	 * @brief 複数の位置のL*をまとめて求める
+	 * @remark 問い合わせごとにスレッドへ割り当てる。表のモードでは、含まれる時刻の刻みの表を先にすべて作る
+	 *
+	 * @tparam Position 位置の型 (Ecef, Wgs84, Eci)
+	 * @param positions 位置の配列
+	 * @param pitch_angle 局所ピッチ角
+	 * @param results 結果の配列 (positionsと同じ大きさに変更される)
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& positions, const Angle& pitch_angle, std::vector<LStarResult>& results) const {
+		results.resize(positions.size());
+		const std::size_t threads = Parallel::threadCount(m_config.num_threads);
+		if (m_config.mode == LStarMode::Tabulated) {
+			std::set<std::int64_t> buckets;
+			for (const auto& position : positions) {
+				buckets.insert(epochBucket(position.epoch()));
+			}
+			LStarEngine engine(*this);
+			for (std::int64_t bucket : buckets) {
+				engine.table(bucket, threads);
+			}
+		}
+		std::vector<LStarEngine> engines(std::min(threads, positions.size() + 1), *this);
+		Parallel::forEachChunk(
+		  0, positions.size(), 4,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  auto& engine = engines[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  results[i] = engine(positions[i], pitch_angle);
+			  }
+		  },
+		  engines.size());
+	}
+
+	/**
+	 * @brief 時刻の刻みの (Bm, K) の表を取得する (なければ作る)
+	 *
+	 */
+	std::shared_ptr<const LStarTable> table(const DateTime& epoch) {
+		return table(epochBucket(epoch), Parallel::threadCount(m_config.num_threads));
+	}
+
+	/**
+	 * @brief キャッシュの利用状況
+	 *
+	 */
+	MemoStats cacheStats() const { return m_shared->cache.stats(); }
+
+  private:
+	static constexpr double gauss_per_nanotesla = 1.0e-5;
+	static constexpr std::uint32_t cache_outputs = 0x4c53; // キャッシュのキーでL*の結果を区別する値
+
+	/**
+	 * @brief 漂流殻の探索結果
+	 *
+	 */
+	struct ShellResult {
+		double lstar = std::numeric_limits<double>::quiet_NaN();
+		LStarStatus status = LStarStatus::Ok;
+	};
+
+	/**
+	 * @brief 評価器の複製で共有する状態
+	 *
+	 */
+	struct Shared {
+		explicit Shared(const LStarConfig& config) : cache(cacheConfig(config)) {}
+
+		MemoCache cache;
+		std::mutex mutex;
+		std::map<std::int64_t, std::shared_future<std::shared_ptr<const LStarTable>>> tables; // 作成中の表も含む
+	};
+
+	FieldLineTracer m_tracer;
+	LStarConfig m_config;
+	std::shared_ptr<Shared> m_shared;
+	bool m_parallel = false;
+
+	static MemoConfig cacheConfig(const LStarConfig& config) {
+		MemoConfig memo;
+		memo.capacity = config.cache_capacity;
+		memo.epoch_step = config.epoch_step;
+		return memo;
+	}
+
+	std::int64_t epochBucket(const DateTime& epoch) const {
+		const std::int64_t step = m_config.epoch_step.ticks();
+		return (epoch.ticks() + step / 2) / step;
+	}
+
+	DateTime bucketEpoch(std::int64_t bucket) const { return DateTime(bucket * m_config.epoch_step.ticks()); }
+
+	std::size_t shellThreads() const { return m_parallel ? Parallel::threadCount(m_config.num_threads) : 1; }
+
+	/**
+	 * @brief 状態の重さ (複数の磁力線の状態をまとめるときに重い方を採る)
+	 *
+	 */
+	static int severity(LStarStatus status) {
+		switch (status) {
+			case LStarStatus::Open: return 3;
+			case LStarStatus::Lost: return 2;
+			case LStarStatus::NotConverged: return 1;
+			default: return 0;
+		}
+	}
+
+	/**
+	 * @brief 漂流殻を探してL*を求める (キャッシュを先に引く)
+	 *
+	 * @param guess_field 漂流殻の磁力線の最小の磁束密度の目安 [nT] (探索の初期値に使う)
+	 */
+	ShellResult driftShell(std::int64_t bucket, double mirror_field, double i, double guess_field, std::size_t threads) {
+		MemoKey key;
+		key.a = std::llround(std::log(mirror_field) / m_config.cache_step);
+		key.b = std::llround(std::log1p(i / 0.01) / m_config.cache_step); // 0.01 RE より大きいIでは相対刻み、小さいIでは絶対刻み
+		key.epoch = bucket;
+		key.outputs = cache_outputs;
+		Eigen::Vector3d cached;
+		if (m_shared->cache.find(key, cached)) {
+			ShellResult shell;
+			shell.lstar = cached(0);
+			shell.status = static_cast<LStarStatus>(static_cast<int>(cached(1)));
+			return shell;
+		}
+		const ShellResult shell = searchShell(mirror_field, i, guess_field, threads);
+		m_shared->cache.insert(key, Eigen::Vector3d{shell.lstar, static_cast<double>(static_cast<int>(shell.status)), 0.0});
+		return shell;
+	}
+
+	/**
+	 * @brief 双極子座標の経度ごとに (Bm, I) の等しい磁力線を探し、足跡の囲む極冠の磁束からL*を求める
+	 * @remark 各経度の磁力線は双極子の赤道面上の地心距離ρで表し、Iはρに対して単調に増えるので、囲い込みとIllinois法で根を探す。
+	 *         I≈0 (赤道で反射する粒子) では、磁力線の最小の磁束密度がBmに等しくなるρを探す
+	 *
+	 */
+	ShellResult searchShell(double mirror_field, double i, double guess_field, std::size_t threads) {
+		const std::size_t count = m_config.azimuths;
+		const double target = i * FieldLineTracer::reference_radius;
+		const bool equatorial = i < 1.0e-4;
+		const double guess = std::cbrt(m_tracer.dipoleField() / std::min(guess_field, mirror_field)); // 双極子で赤道の磁束密度が等しい距離
+		std::vector<double> colatitudes(count), longitudes(count);
+		std::vector<LStarStatus> statuses(count, LStarStatus::Ok);
+		std::vector<char> found(count, 0);
+		std::vector<FieldLineTracer> tracers(std::min(threads, count), m_tracer);
+
+		Parallel::forEach(
+		  0, count,
+		  [&](std::size_t thread_index, std::size_t j) {
+			  FieldLineTracer& tracer = tracers[thread_index];
+			  const double azimuth = 2.0 * constant::pi * static_cast<double>(j) / static_cast<double>(count);
+			  const Eigen::Vector3d direction = tracer.equatorialDirection(azimuth);
+			  FieldLineTrace line;
+			  const auto residual = [&](double rho) {
+				  line = tracer.trace(rho * FieldLineTracer::reference_radius * direction, mirror_field);
+				  if (line.escaped) {
+					  return 1.0;
+				  }
+				  return equatorial ? (mirror_field - line.min_field) / mirror_field : (line.i - target) / target;
+			  };
+			  double rho = 0.0;
+			  statuses[j] = findRoot(residual, guess, rho);
+			  if (statuses[j] != LStarStatus::Ok && statuses[j] != LStarStatus::NotConverged) {
+				  return;
+			  }
+			  residual(rho);
+			  if (line.grounded) {
+				  statuses[j] = LStarStatus::Lost;
+				  return;
+			  }
+			  if (line.mirror_radius < FieldLineTracer::reference_radius + m_config.loss_altitude) {
+				  statuses[j] = LStarStatus::Lost; // 漂流の途中で損失円錐に入る (L*は求める)
+			  }
+			  Eigen::Vector3d foot;
+			  if (!tracer.footprint(rho * FieldLineTracer::reference_radius * direction, foot)) {
+				  statuses[j] = LStarStatus::Open;
+				  return;
+			  }
+			  const auto coordinates = tracer.dipoleCoordinates(foot);
+			  colatitudes[j] = coordinates.first;
+			  longitudes[j] = coordinates.second;
+			  found[j] = 1;
+		  },
+		  tracers.size());
+
+		ShellResult result;
+		for (LStarStatus status : statuses) {
+			result.status = severity(status) > severity(result.status) ? status : result.status;
+		}
+		if (std::find(found.begin(), found.end(), 0) != found.end()) {
+			return result;
+		}
+
+		// 足跡の経度順に並べ、経度方向は台形則で積分する
+		std::vector<std::size_t> order(count);
+		for (std::size_t j = 0; j < count; j++) {
+			order[j] = j;
+		}
+		std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return longitudes[a] < longitudes[b]; });
+		std::vector<double> cap(count);
+		Parallel::forEach(
+		  0, count, [&](std::size_t thread_index, std::size_t j) { cap[j] = tracers[thread_index].capFlux(colatitudes[j], longitudes[j]); },
+		  tracers.size());
+		double flux = 0.0;
+		for (std::size_t n = 0; n < count; n++) {
+			const std::size_t a = order[n], b = order[(n + 1) % count];
+			const double width = n + 1 < count ? longitudes[b] - longitudes[a] : longitudes[b] + 2.0 * constant::pi - longitudes[a];
+			flux += 0.5 * (cap[a] + cap[b]) * width;
+		}
+		constexpr double radius = FieldLineTracer::reference_radius;
+		result.lstar = 2.0 * constant::pi * m_tracer.dipoleField() * radius * radius / flux;
+		return result;
+	}
+
+	/**
+	 * @brief 単調に増える関数の根を、初期値からの囲い込みとIllinois法で探す
+	 * @remark 関数の評価回数 (磁力線の追跡回数) は max_iterations を超えない
+	 *
+	 * @param rho 根 (NotConvergedの場合は最後の推定値)
+	 */
+	template <typename Residual>
+	LStarStatus findRoot(Residual& residual, double guess, double& rho) const {
+		constexpr double expansion = 1.25;
+		std::size_t evaluations = 1;
+		double lo = std::max(guess, 1.0), hi = lo;
+		double f_lo = residual(lo), f_hi = f_lo;
+		if (f_lo < 0.0) {
+			while (f_hi < 0.0) {
+				lo = hi;
+				f_lo = f_hi;
+				hi = lo * expansion;
+				if (hi > m_config.max_radius || evaluations >= m_config.max_iterations) {
+					return LStarStatus::Open;
+				}
+				f_hi = residual(hi);
+				evaluations++;
+			}
+		} else {
+			while (f_lo >= 0.0) {
+				hi = lo;
+				f_hi = f_lo;
+				lo = hi / expansion;
+				if (lo < 1.0 || evaluations >= m_config.max_iterations) {
+					return LStarStatus::Lost;
+				}
+				f_lo = residual(lo);
+				evaluations++;
+			}
+		}
+
+		int side = 0;
+		rho = 0.5 * (lo + hi);
+		while (evaluations < m_config.max_iterations) {
+			rho = (lo * f_hi - hi * f_lo) / (f_hi - f_lo);
+			if (!(rho > lo && rho < hi)) {
+				rho = 0.5 * (lo + hi);
+			}
+			const double f = residual(rho);
+			evaluations++;
+			if (std::fabs(f) < m_config.tolerance || hi - lo < m_config.tolerance * rho) {
+				return LStarStatus::Ok;
+			}
+			if (f > 0.0) {
+				hi = rho;
+				f_hi = f;
+				if (side == 1) {
+					f_lo *= 0.5;
+				}
+				side = 1;
+			} else {
+				lo = rho;
+				f_lo = f;
+				if (side == -1) {
+					f_hi *= 0.5;
+				}
+				side = -1;
+			}
+		}
+		return LStarStatus::NotConverged;
+	}
+
+	/**
+	 * @brief 表を取得する (なければ作る)
+	 * @remark 作成中の表は登録だけしてロックの外で作る。同じ時刻の刻みの表を求める複製はその完成を待ち、別の刻みは待たない
+	 *
+	 */
+	std::shared_ptr<const LStarTable> table(std::int64_t bucket, std::size_t threads) {
+		std::promise<std::shared_ptr<const LStarTable>> promise;
+		std::shared_future<std::shared_ptr<const LStarTable>> pending;
+		{
+			std::lock_guard<std::mutex> lock(m_shared->mutex);
+			auto found = m_shared->tables.find(bucket);
+			if (found == m_shared->tables.end()) {
+				m_shared->tables.emplace(bucket, promise.get_future().share());
+			} else {
+				pending = found->second;
+			}
+		}
+		if (pending.valid()) {
+			return pending.get();
+		}
+
+		std::shared_ptr<const LStarTable> table;
+		try {
+			table = buildTable(bucket, threads);
+		} catch (...) {
+			{
+				std::lock_guard<std::mutex> lock(m_shared->mutex);
+				m_shared->tables.erase(bucket);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+		promise.set_value(table);
+		return table;
+	}
+
+	/**
+	 * @brief 時刻の刻みの表を作る
+	 *
+	 */
+	std::shared_ptr<const LStarTable> buildTable(std::int64_t bucket, std::size_t threads) {
+		auto table = std::make_shared<LStarTable>(m_config.table_min_field, m_config.table_max_field, m_config.table_field_nodes,
+												  m_config.table_max_k, m_config.table_k_nodes);
+		m_tracer.setEpoch(bucketEpoch(bucket));
+		std::vector<LStarEngine> engines(threads, *this);
+		const std::size_t columns = table->kNodes();
+		Parallel::forEach(
+		  0, table->fieldNodes() * columns,
+		  [&](std::size_t thread_index, std::size_t node) {
+			  LStarEngine& engine = engines[thread_index];
+			  const double field = table->field(node / columns);
+			  const double i = table->k(node % columns) / std::sqrt(field * gauss_per_nanotesla);
+			  const ShellResult shell = engine.driftShell(bucket, field, i, field, 1);
+			  if (shell.status == LStarStatus::Ok) {
+				  table->value(node / columns, node % columns) = shell.lstar;
+			  }
+		  },
+		  threads);
+		return table;
+	}
+};
+
+GEOMAG_NAMESPACE_END
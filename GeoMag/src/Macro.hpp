@@ -55,6 +55,27 @@
 	TELEMETRY_ASSRET_CONVERTER_REQUEST_VERSION(major, minor, patch)
 #endif
 
+// POSIXのファイル記述子・mmapが使えるか (0を定義すると標準ライブラリだけの実装になる)
+#ifndef GEOMAG_HAS_POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#define GEOMAG_HAS_POSIX 1
+#else
+#define GEOMAG_HAS_POSIX 0
+#endif
+#endif
+
+// io_uringが使えるか (Linuxで、カーネルのヘッダがある場合)
+#ifndef GEOMAG_HAS_IO_URING
+#if GEOMAG_HAS_POSIX && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define GEOMAG_HAS_IO_URING 1
+#endif
+#endif
+#endif
+#ifndef GEOMAG_HAS_IO_URING
+#define GEOMAG_HAS_IO_URING 0
+#endif
+
 #define GEOMAG_CODE_GEN_CONCAT_EX(tag, type) tag ## _ ## type
 #define GEOMAG_CODE_GEN_CONCAT(tag, type) GEOMAG_CODE_GEN_CONCAT_EX(tag, type)
 #define GEOMAG_CODE_GEN_TAG koyoh_acs_GEOMAG_code_gen
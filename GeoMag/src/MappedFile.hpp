@@ -0,0 +1,192 @@
+/**
+ * @file MappedFile.hpp
+ * @author Kaiji Takeuchi
+ * @brief 読み込み専用のメモリマップトファイル
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include "Essential.hpp"
+
+#if GEOMAG_HAS_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <memory>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief ファイルを読み込み専用でメモリに割り当てる
+ * @remark 読み込みはページフォルトで必要な部分だけ行われ、同じファイルを開いた複数のプロセスでページキャッシュを共有する。
+ *         mmapがない環境では開くときにファイル全体をメモリに読み込み、advise・prefetchは何もしない
+ *
+ */
+class MappedFile {
+  public:
+	/**
+	 * @brief アクセスの傾向 (madviseに渡す)
+	 *
+	 */
+	enum class Access {
+		Normal,
+		Sequential, // 先頭から順に読む (先読みを増やす)
+		Random,		// 位置を飛ばして読む (先読みしない)
+	};
+
+	MappedFile() = default;
+
+	/**
+	 * @brief Construct a new Mapped File object
+	 *
+	 * @param path ファイルのパス
+	 * @param access アクセスの傾向
+	 */
+	explicit MappedFile(const std::string& path, Access access = Access::Normal) {
+#if GEOMAG_HAS_POSIX
+		const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			throwError("MappedFile: " + path, errno);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			const int error = errno;
+			::close(fd);
+			throwError("MappedFile: " + path, error);
+		}
+		m_size = static_cast<std::size_t>(st.st_size);
+		if (m_size > 0) {
+			void* ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr == MAP_FAILED) {
+				const int error = errno;
+				::close(fd);
+				throwError("MappedFile: " + path, error);
+			}
+			m_data = static_cast<const char*>(ptr);
+			advise(access);
+		}
+		::close(fd); // 割り当ては記述子を閉じても残る
+#else
+		static_cast<void>(access);
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) {
+			throw std::runtime_error("MappedFile: " + path + ": cannot open");
+		}
+		m_size = static_cast<std::size_t>(file.tellg());
+		m_buffer.reset(new char[std::max<std::size_t>(m_size, 1)]);
+		file.seekg(0);
+		if (!file.read(m_buffer.get(), static_cast<std::streamsize>(m_size))) {
+			throw std::runtime_error("MappedFile: " + path + ": cannot read");
+		}
+		if (m_size > 0) {
+			m_data = m_buffer.get();
+		}
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept : m_data(other.m_data), m_size(other.m_size) {
+#if !GEOMAG_HAS_POSIX
+		m_buffer = std::move(other.m_buffer);
+#endif
+		other.m_data = nullptr;
+		other.m_size = 0;
+	}
+
+	MappedFile& operator=(MappedFile&& other) noexcept {
+		if (this != &other) {
+			unmap();
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+#if !GEOMAG_HAS_POSIX
+			std::swap(m_buffer, other.m_buffer);
+#endif
+		}
+		return *this;
+	}
+
+	~MappedFile() { unmap(); }
+
+	/**
+	 * @brief アクセスの傾向を伝える
+	 *
+	 */
+	void advise(Access access) const {
+#if GEOMAG_HAS_POSIX
+		if (m_data == nullptr) {
+			return;
+		}
+		switch (access) {
+			case Access::Sequential: madvise(const_cast<char*>(m_data), m_size, MADV_SEQUENTIAL); return;
+			case Access::Random: madvise(const_cast<char*>(m_data), m_size, MADV_RANDOM); return;
+			default: return;
+		}
+#else
+		static_cast<void>(access);
+#endif
+	}
+
+	/**
+	 * @brief 範囲を先に読み込むよう求める (ブロックしない)
+	 *
+	 */
+	void prefetch(std::size_t offset = 0, std::size_t length = static_cast<std::size_t>(-1)) const {
+#if GEOMAG_HAS_POSIX
+		if (m_data == nullptr || offset >= m_size) {
+			return;
+		}
+		const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		const std::size_t begin = offset / page * page;
+		length = std::min(length, m_size - offset) + (offset - begin);
+		madvise(const_cast<char*>(m_data) + begin, length, MADV_WILLNEED);
+#else
+		static_cast<void>(offset);
+		static_cast<void>(length);
+#endif
+	}
+
+	const char* data() const { return m_data; }
+	std::size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+  private:
+	const char* m_data = nullptr;
+	std::size_t m_size = 0;
+#if !GEOMAG_HAS_POSIX
+	std::unique_ptr<char[]> m_buffer; // 読み込んだファイル全体
+#endif
+
+	static void throwError(const std::string& name, int error) { throw std::runtime_error(name + ": " + std::strerror(error)); }
+
+	void unmap() {
+#if GEOMAG_HAS_POSIX
+		if (m_data != nullptr) {
+			munmap(const_cast<char*>(m_data), m_size);
+		}
+#else
+		m_buffer.reset();
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+};
+
+GEOMAG_NAMESPACE_END
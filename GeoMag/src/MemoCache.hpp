@@ -0,0 +1,390 @@
+/**
+ * @file MemoCache.hpp
+ * @author Kaiji Takeuchi
+ * @brief 量子化した問い合わせの結果を共有するメモ化キャッシュ
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief メモ化の設定
+ *
+ */
+struct MemoConfig {
+	double angle_step = 1.0e-4;		   // 緯度経度の刻み [deg] (1e-4度は約11m)
+	double altitude_step = 10.0;	   // 高度の刻み [m]
+	double position_step = 10.0;	   // ECEF座標の刻み [m]
+	TimeSpan epoch_step = Days(1);	   // 時刻の刻み
+	std::size_t capacity = 1 << 20;	   // 保持する結果の数の上限
+	std::size_t shards = 16;		   // ロックを分ける数
+};
+
+/**
+ * @brief キャッシュのキー
+ *
+ */
+struct MemoKey {
+	std::int64_t a = 0, b = 0, c = 0; // 量子化した位置 (Wgs84: 緯度・経度・高度, Ecef: x・y・z)
+	std::int64_t epoch = 0;			  // 量子化した時刻
+	std::uint32_t model = 0;		  // モデルの識別子
+	std::uint32_t outputs = 0;		  // 出力の種類 (単位・精度・座標系)
+
+	bool operator==(const MemoKey& other) const {
+		return a == other.a && b == other.b && c == other.c && epoch == other.epoch && model == other.model && outputs == other.outputs;
+	}
+
+	auto hash() const -> std::uint64_t {
+		std::uint64_t h = 0x9e3779b97f4a7c15ULL;
+		for (std::uint64_t v : {static_cast<std::uint64_t>(a), static_cast<std::uint64_t>(b), static_cast<std::uint64_t>(c),
+								static_cast<std::uint64_t>(epoch), (static_cast<std::uint64_t>(model) << 32) | outputs}) {
+			h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+			h = (h ^ (h >> 31)) * 0xbf58476d1ce4e5b9ULL;
+		}
+		return h ^ (h >> 29);
+	}
+};
+
+/**
+ * @brief キャッシュの利用状況
+ *
+ */
+struct MemoStats {
+	std::size_t hits = 0;
+	std::size_t misses = 0;
+	std::size_t evictions = 0;
+	std::size_t entries = 0;
+	std::size_t capacity = 0;
+
+	double hitRate() const { return hits + misses > 0 ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0; }
+};
+
+/**
+ * @brief シャードに分けた固定容量のハッシュ表
+ * @remark 各シャードは容量分の要素を最初に確保し、満杯になるとCLOCK法で追い出す。メモリは容量で決まり、挿入でヒープを使わない
+ *
+ */
+class MemoCache {
+  public:
+	explicit MemoCache(const MemoConfig& config = MemoConfig{}) : m_config(config) {
+		if (!(config.angle_step > 0.0) || !(config.altitude_step > 0.0) || !(config.position_step > 0.0) || config.epoch_step.ticks() <= 0) {
+			throw std::runtime_error("MemoCache: quantization steps must be positive");
+		}
+		const std::size_t shards = roundUp(std::max<std::size_t>(config.shards, 1));
+		const std::size_t per_shard = std::max<std::size_t>((config.capacity + shards - 1) / shards, 1);
+		m_shards.reserve(shards);
+		for (std::size_t i = 0; i < shards; i++) {
+			m_shards.emplace_back(new Shard(per_shard));
+		}
+		m_shard_mask = shards - 1;
+	}
+
+	/**
+	 * @brief 結果を探す
+	 *
+	 * @return bool 見つかったか
+	 */
+	auto find(const MemoKey& key, Eigen::Vector3d& value) -> bool {
+		const std::uint64_t hash = key.hash();
+		Shard& shard = *m_shards[hash & m_shard_mask];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		const std::size_t slot = shard.lookup(key, hash);
+		if (slot == Shard::npos) {
+			shard.misses++;
+			return false;
+		}
+		shard.hits++;
+		shard.entries[slot].referenced = true;
+		value = shard.entries[slot].value;
+		return true;
+	}
+
+	/**
+	 * @brief 結果を登録する
+	 *
+	 */
+	void insert(const MemoKey& key, const Eigen::Vector3d& value) {
+		const std::uint64_t hash = key.hash();
+		Shard& shard = *m_shards[hash & m_shard_mask];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.insert(key, hash, value);
+	}
+
+	void clear() {
+		for (auto& shard : m_shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			shard->clear();
+		}
+	}
+
+	auto stats() const -> MemoStats {
+		MemoStats stats;
+		for (const auto& shard : m_shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			stats.hits += shard->hits;
+			stats.misses += shard->misses;
+			stats.evictions += shard->evictions;
+			stats.entries += shard->size;
+			stats.capacity += shard->entries.size();
+		}
+		return stats;
+	}
+
+	const MemoConfig& config() const { return m_config; }
+
+	/**
+	 * @brief WGS84座標と時刻を量子化する
+	 *
+	 * @param position 位置
+	 * @param key 位置と時刻を設定するキー
+	 * @return Wgs84 量子化した格子点の位置 (この点で評価する)
+	 */
+	auto quantize(const Wgs84& position, MemoKey& key) const -> Wgs84 {
+		const double lon = std::remainder(position.longitude().degrees(), 360.0); // [-180, 180]
+		key.a = static_cast<std::int64_t>(std::llround(position.latitude().degrees() / m_config.angle_step));
+		key.b = static_cast<std::int64_t>(std::llround(lon / m_config.angle_step));
+		key.c = static_cast<std::int64_t>(std::llround(position.altitude() / m_config.altitude_step));
+		if (key.b * m_config.angle_step >= 180.0) {
+			key.b = static_cast<std::int64_t>(std::llround(-180.0 / m_config.angle_step)); // 180度と-180度を同じ点にする
+		}
+		const DateTime epoch = quantize(position.epoch(), key);
+		return Wgs84(epoch, Degree{key.b * m_config.angle_step}, Degree{key.a * m_config.angle_step}, key.c * m_config.altitude_step);
+	}
+
+	auto quantize(const Ecef& position, MemoKey& key) const -> Ecef {
+		key.a = static_cast<std::int64_t>(std::llround(position.x() / m_config.position_step));
+		key.b = static_cast<std::int64_t>(std::llround(position.y() / m_config.position_step));
+		key.c = static_cast<std::int64_t>(std::llround(position.z() / m_config.position_step));
+		const DateTime epoch = quantize(position.epoch(), key);
+		return Ecef(epoch, key.a * m_config.position_step, key.b * m_config.position_step, key.c * m_config.position_step);
+	}
+
+  private:
+	/**
+	 * @brief 1つのシャード
+	 *
+	 */
+	struct Shard {
+		static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+		struct Entry {
+			MemoKey key;
+			std::uint64_t hash = 0;
+			Eigen::Vector3d value = Eigen::Vector3d::Zero();
+			bool referenced = false;
+		};
+
+		explicit Shard(std::size_t capacity) : entries(capacity), index(roundUp(capacity * 2)), mask(index.size() - 1) {}
+
+		std::mutex mutex;
+		std::vector<Entry> entries;		   // 要素 (容量分を最初に確保する)
+		std::vector<std::uint32_t> index; // 開番地法の索引 (要素番号+1, 0は空き)
+		std::size_t mask;
+		std::size_t size = 0;
+		std::size_t hand = 0; // CLOCKの針
+		std::size_t hits = 0, misses = 0, evictions = 0;
+
+		auto lookup(const MemoKey& key, std::uint64_t hash) const -> std::size_t {
+			for (std::size_t i = (hash >> 8) & mask;; i = (i + 1) & mask) {
+				const std::uint32_t slot = index[i];
+				if (slot == 0) {
+					return npos;
+				}
+				const Entry& entry = entries[slot - 1];
+				if (entry.hash == hash && entry.key == key) {
+					return slot - 1;
+				}
+			}
+		}
+
+		void insert(const MemoKey& key, std::uint64_t hash, const Eigen::Vector3d& value) {
+			const std::size_t found = lookup(key, hash);
+			if (found != npos) {
+				entries[found].value = value;
+				entries[found].referenced = true;
+				return;
+			}
+
+			std::size_t slot;
+			if (size < entries.size()) {
+				slot = size++;
+			} else {
+				// CLOCK: 参照ビットが立っていれば下ろして次へ、立っていなければ追い出す
+				while (entries[hand].referenced) {
+					entries[hand].referenced = false;
+					hand = (hand + 1) % entries.size();
+				}
+				slot = hand;
+				hand = (hand + 1) % entries.size();
+				erase(slot);
+				evictions++;
+			}
+
+			Entry& entry = entries[slot];
+			entry.key = key;
+			entry.hash = hash;
+			entry.value = value;
+			entry.referenced = false;
+			std::size_t i = (hash >> 8) & mask;
+			while (index[i] != 0) {
+				i = (i + 1) & mask;
+			}
+			index[i] = static_cast<std::uint32_t>(slot + 1);
+		}
+
+		/**
+		 * @brief 索引から要素を取り除く (後ろの要素を詰めて探索の連鎖を保つ)
+		 *
+		 */
+		void erase(std::size_t slot) {
+			std::size_t i = (entries[slot].hash >> 8) & mask;
+			while (index[i] != slot + 1) {
+				i = (i + 1) & mask;
+			}
+			for (std::size_t j = (i + 1) & mask; index[j] != 0; j = (j + 1) & mask) {
+				const std::size_t home = (entries[index[j] - 1].hash >> 8) & mask;
+				// jの要素の本来の位置がiからjの間 (循環) になければiに移せる
+				const bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+				if (!between) {
+					index[i] = index[j];
+					i = j;
+				}
+			}
+			index[i] = 0;
+		}
+
+		void clear() {
+			std::fill(index.begin(), index.end(), 0);
+			for (auto& entry : entries) {
+				entry.referenced = false;
+			}
+			size = hand = 0;
+			hits = misses = evictions = 0;
+		}
+	};
+
+	MemoConfig m_config;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+	std::size_t m_shard_mask = 0;
+
+	auto quantize(const DateTime& epoch, MemoKey& key) const -> DateTime {
+		const std::int64_t step = m_config.epoch_step.ticks();
+		const std::int64_t ticks = epoch.ticks();
+		key.epoch = (ticks + step / 2) / step;
+		return DateTime(key.epoch * step);
+	}
+
+	static auto roundUp(std::size_t n) -> std::size_t {
+		std::size_t size = 1;
+		while (size < n) {
+			size <<= 1;
+		}
+		return size;
+	}
+};
+
+/**
+ * @brief メモ化キャッシュを前に置いた評価器
+ * @remark 量子化した格子点で評価するので、同じキーには常に同じ値を返す。キャッシュは複数の評価器・スレッドで共有できるが、
+ *         評価器自体はスレッドごとに用意する
+ *
+ */
+class MemoizedGeoMagFlux {
+  public:
+	/**
+	 * @brief Construct a new Memoized Geo Mag Flux object
+	 *
+	 * @param flux 評価器
+	 * @param cache 共有するキャッシュ
+	 * @remark キーのモデル識別子は評価器のモデルセットの指紋から求めるので、異なるモデルの評価器で同じキャッシュを共有できる
+	 */
+	MemoizedGeoMagFlux(const GeoMagFlux& flux, std::shared_ptr<MemoCache> cache)
+	  : m_flux(flux), m_cache(std::move(cache)), m_model_id(foldFingerprint(flux.fingerprint())) {
+		if (!m_cache) {
+			throw std::runtime_error("MemoizedGeoMagFlux: cache is null");
+		}
+	}
+
+	/**
+	 * @brief 磁束密度を取得する
+	 *
+	 * @param position WGS84座標系での位置
+	 * @return Eigen::Vector3d 磁束密度 (測地座標系のNED成分)
+	 */
+	Eigen::Vector3d operator()(const Wgs84& position) { return lookup(position, 0); }
+
+	/**
+	 * @brief 磁束密度を取得する
+	 *
+	 * @param position ECEF座標系での位置
+	 * @return Eigen::Vector3d 磁束密度 (地心球座標系のNED成分)
+	 */
+	Eigen::Vector3d operator()(const Ecef& position) { return lookup(position, 1); }
+
+	/**
+	 * @brief 複数の位置での磁束密度をまとめて取得する
+	 *
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& positions, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) const {
+		constexpr std::size_t chunk = 256;
+		mag_densities.resize(positions.size());
+		std::vector<MemoizedGeoMagFlux> evaluators(std::min(Parallel::threadCount(num_threads), positions.size() / chunk + 1), *this);
+		Parallel::forEachChunk(
+		  0, positions.size(), chunk,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			  auto& evaluator = evaluators[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  mag_densities[i] = evaluator(positions[i]);
+			  }
+		  },
+		  evaluators.size());
+	}
+
+	const MemoCache& cache() const { return *m_cache; }
+
+  private:
+	GeoMagFlux m_flux;
+	std::shared_ptr<MemoCache> m_cache;
+	std::uint32_t m_model_id;
+
+	static auto foldFingerprint(std::uint64_t fingerprint) -> std::uint32_t {
+		return static_cast<std::uint32_t>(fingerprint ^ (fingerprint >> 32));
+	}
+
+	template <typename Position>
+	auto lookup(const Position& position, std::uint32_t frame) -> Eigen::Vector3d {
+		MemoKey key;
+		const Position lattice = m_cache->quantize(position, key);
+		key.model = m_model_id;
+		key.outputs = static_cast<std::uint32_t>(m_flux.unit()) | (static_cast<std::uint32_t>(m_flux.accuracy()) << 8) | (frame << 16);
+
+		Eigen::Vector3d value;
+		if (!m_cache->find(key, value)) {
+			value = m_flux(lattice);
+			m_cache->insert(key, value);
+		}
+		return value;
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -13,6 +13,8 @@
 #pragma once
 #include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iterator>
 #include <sstream>
@@ -22,6 +24,34 @@
 #include "Macro.hpp"
 
 GEOMAG_NAMESPACE_BEGIN
+/**
+ * @brief モデルの指紋に値を1つ混ぜる (FNV-1a を64ビット値ごとに適用)
+ *
+ * @param hash これまでの指紋
+ * @param value 混ぜる値
+ * @return std::uint64_t 新しい指紋
+ */
+inline std::uint64_t mixFingerprint(std::uint64_t hash, std::uint64_t value) {
+	constexpr std::uint64_t prime = 0x100000001b3ull;
+	for (int i = 0; i < 8; i++) {
+		hash = (hash ^ ((value >> (8 * i)) & 0xffu)) * prime;
+	}
+	return hash;
+}
+
+/**
+ * @brief 係数の配列を指紋に混ぜる (値のビット列をそのまま使う)
+ *
+ */
+inline std::uint64_t mixFingerprint(std::uint64_t hash, const double* values, std::size_t count) {
+	for (std::size_t i = 0; i < count; i++) {
+		std::uint64_t bits;
+		std::memcpy(&bits, &values[i], sizeof(bits));
+		hash = mixFingerprint(hash, bits);
+	}
+	return hash;
+}
+
 /**
  * @brief モデルの種類
  *
@@ -33,6 +63,7 @@ enum class ModelType {
 	Sv,			  // Secular Variation
 	Interpolated, // Interpolated Model
 	Extrapolated, // Extrapolated Model
+	Spline,		  // B-spline Model
 };
 
 /**
@@ -119,6 +150,21 @@ class ModelSet {
 	auto begin() const { return m_models.begin(); }
 	auto end() const { return m_models.end(); }
 
+	/**
+	 * @brief 全モデルのエポック・種類・係数から求めた指紋
+	 * @remark 同じ係数のモデルセットは同じ値になる。メモ化キャッシュでモデルを区別するのに使う
+	 *
+	 */
+	std::uint64_t fingerprint() const {
+		std::uint64_t hash = 0xcbf29ce484222325ull;
+		for (const auto& model : m_models) {
+			hash = mixFingerprint(hash, static_cast<std::uint64_t>(model.epoch.ticks()));
+			hash = mixFingerprint(hash, static_cast<std::uint64_t>(static_cast<int>(model.type)));
+			hash = mixFingerprint(hash, model.coefficients.data(), model.coefficients.size());
+		}
+		return hash;
+	}
+
   private:
 	static constexpr char* model_file_comment_header = (char*)"#";
 	static constexpr char* model_file_model_header = (char*)"c/s";
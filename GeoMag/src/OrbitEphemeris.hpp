@@ -0,0 +1,912 @@
+/**
+ * @file OrbitEphemeris.hpp
+ * @author Kaiji Takeuchi
+ * @brief 軌道エフェメリス (CCSDS OEM, SP3) の読み込みと補間
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "DateTime.hpp"
+#include "Essential.hpp"
+#include "MappedFile.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 軌道の座標系
+ * @remark EciはこのライブラリのEciと同じく、GMSTで回転すればEcefになる瞬時の赤道座標系 (章動は無視する)
+ *
+ */
+enum class OrbitFrame { Eci, Ecef };
+
+/**
+ * @brief ファイルの時刻系
+ *
+ */
+enum class OrbitTimeScale {
+	Utc,
+	Tai,
+	Gps,	 // TAI - 19 s (GAL, QZS, IRNも同じ)
+	Tt,		 // TAI + 32.184 s (TDBもこれとみなす)
+	Glonass, // UTC + 3 h
+	Beidou,	 // GPS - 14 s
+};
+
+/**
+ * @brief 補間の方法
+ *
+ */
+enum class OrbitInterpolation {
+	Lagrange, // 位置だけを使うラグランジュ補間 (次数 points - 1)
+	Hermite,  // 位置と速度を使うエルミート補間 (次数 2 * points - 1)
+};
+
+/**
+ * @brief 時刻系の変換
+ *
+ */
+struct OrbitTimeHelper {
+	/**
+	 * @brief TAI - UTC [s]
+	 *
+	 * @param utc UTCのティック数
+	 */
+	static int taiMinusUtc(std::int64_t utc) {
+		struct Leap {
+			int year, month, seconds;
+		};
+		static const Leap leaps[] = {{1972, 1, 10}, {1972, 7, 11}, {1973, 1, 12}, {1974, 1, 13}, {1975, 1, 14}, {1976, 1, 15}, {1977, 1, 16},
+									 {1978, 1, 17}, {1979, 1, 18}, {1980, 1, 19}, {1981, 7, 20}, {1982, 7, 21}, {1983, 7, 22}, {1985, 7, 23},
+									 {1988, 1, 24}, {1990, 1, 25}, {1991, 1, 26}, {1992, 7, 27}, {1993, 7, 28}, {1994, 7, 29}, {1996, 1, 30},
+									 {1997, 7, 31}, {1999, 1, 32}, {2006, 1, 33}, {2009, 1, 34}, {2012, 7, 35}, {2015, 7, 36}, {2017, 1, 37}};
+		static const std::vector<std::int64_t> starts = [] {
+			std::vector<std::int64_t> ticks;
+			for (const auto& leap : leaps) {
+				ticks.push_back(DateTime(leap.year, leap.month, 1, 0, 0, 0).ticks());
+			}
+			return ticks;
+		}();
+		const std::size_t i = static_cast<std::size_t>(std::upper_bound(starts.begin(), starts.end(), utc) - starts.begin());
+		return i == 0 ? leaps[0].seconds : leaps[i - 1].seconds;
+	}
+
+	/**
+	 * @brief 時刻系のティック数をUTCのティック数に変換する
+	 *
+	 */
+	static std::int64_t toUtc(std::int64_t ticks, OrbitTimeScale scale) {
+		constexpr std::int64_t second = constant::ticks_per_second;
+		std::int64_t tai;
+		switch (scale) {
+			case OrbitTimeScale::Utc: return ticks;
+			case OrbitTimeScale::Glonass: return ticks - 3 * constant::ticks_per_hour;
+			case OrbitTimeScale::Tai: tai = ticks; break;
+			case OrbitTimeScale::Gps: tai = ticks + 19 * second; break;
+			case OrbitTimeScale::Beidou: tai = ticks + 33 * second; break;
+			case OrbitTimeScale::Tt: tai = ticks - 32184000; break;
+			default: throw std::runtime_error("OrbitTimeHelper: unknown time scale");
+		}
+		// うるう秒の境界付近でも正しくなるよう、UTCの推定値で表を引き直す
+		const std::int64_t guess = tai - taiMinusUtc(tai - 37 * second) * second;
+		return tai - taiMinusUtc(guess) * second;
+	}
+
+	/**
+	 * @brief IAU 1976歳差でJ2000平均赤道座標 (EME2000, GCRF) を日付の平均赤道座標に回転する
+	 *
+	 */
+	static Eigen::Matrix3d precession(std::int64_t utc) {
+		const double t = DateTime(utc).j2000() / constant::jd_century;
+		constexpr double arcsec = constant::pi / (180.0 * 3600.0);
+		const double zeta = (2306.2181 + (0.30188 + 0.017998 * t) * t) * t * arcsec;
+		const double z = (2306.2181 + (1.09468 + 0.018203 * t) * t) * t * arcsec;
+		const double theta = (2004.3109 - (0.42665 + 0.041833 * t) * t) * t * arcsec;
+		const double cz = std::cos(zeta), sz = std::sin(zeta), cZ = std::cos(z), sZ = std::sin(z), ct = std::cos(theta), st = std::sin(theta);
+		Eigen::Matrix3d p;
+		p << cz * cZ * ct - sz * sZ, -sz * cZ * ct - cz * sZ, -cZ * st, cz * sZ * ct + sz * cZ, -sz * sZ * ct + cz * cZ, -sZ * st, cz * st, -sz * st, ct;
+		return p;
+	}
+};
+
+/**
+ * @brief 1つの物体の軌道 (構造体の配列ではなく成分ごとの配列で持つ)
+ *
+ */
+struct OrbitTrack {
+	std::string object;						 // 物体名 (OEMのOBJECT_NAME、SP3の衛星番号)
+	OrbitFrame frame = OrbitFrame::Ecef;	 // 座標系
+	std::vector<std::int64_t> ticks;		 // UTCのティック数 (狭義単調増加)
+	std::vector<double> x, y, z;			 // 位置 [m]
+	std::vector<double> vx, vy, vz;			 // 速度 [m/s] (ない場合は空)
+
+	std::size_t size() const { return ticks.size(); }
+	bool empty() const { return ticks.empty(); }
+	bool hasVelocity() const { return !vx.empty(); }
+	DateTime epoch(std::size_t i) const { return DateTime(ticks[i]); }
+	Eigen::Vector3d position(std::size_t i) const { return Eigen::Vector3d{x[i], y[i], z[i]}; }
+	Eigen::Vector3d velocity(std::size_t i) const { return Eigen::Vector3d{vx[i], vy[i], vz[i]}; }
+
+	void reserve(std::size_t count, bool velocity) {
+		for (auto* v : {&x, &y, &z}) {
+			v->reserve(v->size() + count);
+		}
+		ticks.reserve(ticks.size() + count);
+		if (velocity) {
+			for (auto* v : {&vx, &vy, &vz}) {
+				v->reserve(v->size() + count);
+			}
+		}
+	}
+
+	/**
+	 * @brief 標本点をそのままEcefの配列にする
+	 *
+	 */
+	std::vector<Ecef> ecef() const {
+		std::vector<Ecef> positions;
+		positions.reserve(size());
+		for (std::size_t i = 0; i < size(); i++) {
+			positions.push_back(frame == OrbitFrame::Ecef ? Ecef(epoch(i), position(i)) : Eci(epoch(i), position(i)).toEcef());
+		}
+		return positions;
+	}
+
+	/**
+	 * @brief 標本点をそのままEciの配列にする
+	 *
+	 */
+	std::vector<Eci> eci() const {
+		std::vector<Eci> positions;
+		positions.reserve(size());
+		for (std::size_t i = 0; i < size(); i++) {
+			positions.push_back(frame == OrbitFrame::Eci ? Eci(epoch(i), position(i)) : Ecef(epoch(i), position(i)).toEci());
+		}
+		return positions;
+	}
+
+	/**
+	 * @brief 任意の時刻の位置を補間する
+	 * @remark 各時刻について、その時刻を中央に含むpoints個の標本点を使う。標本点の範囲外の時刻は例外
+	 *
+	 * @param times UTCのティック数
+	 * @param count 時刻の数
+	 * @param positions 位置 [m] (trackの座標系)
+	 * @param method 補間の方法
+	 * @param points 1回の補間に使う標本点の数 (2以上16以下)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	void interpolate(const std::int64_t* times, std::size_t count, Eigen::Vector3d* positions, OrbitInterpolation method = OrbitInterpolation::Lagrange,
+					 std::size_t points = 8, std::size_t num_threads = 0) const {
+		if (points < 2 || points > max_points || points > size()) {
+			throw std::runtime_error("OrbitTrack: invalid number of interpolation points");
+		}
+		if (method == OrbitInterpolation::Hermite && !hasVelocity()) {
+			throw std::runtime_error("OrbitTrack: Hermite interpolation needs velocities");
+		}
+		Parallel::forEachChunk(
+		  0, count, 1024,
+		  [&](std::size_t, std::size_t b, std::size_t e) {
+			  for (std::size_t i = b; i < e; i++) {
+				  positions[i] = method == OrbitInterpolation::Hermite ? hermite(times[i], points) : lagrange(times[i], points);
+			  }
+		  },
+		  num_threads);
+	}
+
+	/**
+	 * @brief 任意の時刻の位置を補間してEcefの配列にする
+	 *
+	 */
+	std::vector<Ecef> ecef(const std::vector<DateTime>& times, OrbitInterpolation method = OrbitInterpolation::Lagrange, std::size_t points = 8,
+						   std::size_t num_threads = 0) const {
+		const std::vector<Eigen::Vector3d> r = interpolated(times, method, points, num_threads);
+		std::vector<Ecef> positions;
+		positions.reserve(times.size());
+		for (std::size_t i = 0; i < times.size(); i++) {
+			positions.push_back(frame == OrbitFrame::Ecef ? Ecef(times[i], r[i]) : Eci(times[i], r[i]).toEcef());
+		}
+		return positions;
+	}
+
+	/**
+	 * @brief 任意の時刻の位置を補間してEciの配列にする
+	 *
+	 */
+	std::vector<Eci> eci(const std::vector<DateTime>& times, OrbitInterpolation method = OrbitInterpolation::Lagrange, std::size_t points = 8,
+						 std::size_t num_threads = 0) const {
+		const std::vector<Eigen::Vector3d> r = interpolated(times, method, points, num_threads);
+		std::vector<Eci> positions;
+		positions.reserve(times.size());
+		for (std::size_t i = 0; i < times.size(); i++) {
+			positions.push_back(frame == OrbitFrame::Eci ? Eci(times[i], r[i]) : Ecef(times[i], r[i]).toEci());
+		}
+		return positions;
+	}
+
+	static constexpr std::size_t max_points = 16;
+
+  private:
+	std::vector<Eigen::Vector3d> interpolated(const std::vector<DateTime>& times, OrbitInterpolation method, std::size_t points,
+											  std::size_t num_threads) const {
+		std::vector<std::int64_t> t(times.size());
+		for (std::size_t i = 0; i < times.size(); i++) {
+			t[i] = times[i].ticks();
+		}
+		std::vector<Eigen::Vector3d> r(times.size());
+		interpolate(t.data(), t.size(), r.data(), method, points, num_threads);
+		return r;
+	}
+
+	/**
+	 * @brief 時刻を中央に含む標本点の窓の先頭
+	 *
+	 */
+	std::size_t window(std::int64_t t, std::size_t points) const {
+		if (t < ticks.front() || t > ticks.back()) {
+			throw std::runtime_error("OrbitTrack: " + object + ": time outside the ephemeris");
+		}
+		const std::size_t upper = static_cast<std::size_t>(std::upper_bound(ticks.begin(), ticks.end(), t) - ticks.begin());
+		const std::size_t first = upper > points / 2 ? upper - points / 2 : 0;
+		return std::min(first, size() - points);
+	}
+
+	Eigen::Vector3d lagrange(std::int64_t t, std::size_t points) const {
+		const std::size_t first = window(t, points);
+		constexpr double second = constant::ticks_per_second;
+		const double s = (t - ticks[first]) / second;
+		Eigen::Vector3d r = Eigen::Vector3d::Zero();
+		for (std::size_t j = 0; j < points; j++) {
+			const double sj = (ticks[first + j] - ticks[first]) / second;
+			double weight = 1.0;
+			for (std::size_t k = 0; k < points; k++) {
+				if (k != j) {
+					const double sk = (ticks[first + k] - ticks[first]) / second;
+					weight *= (s - sk) / (sj - sk);
+				}
+			}
+			r += weight * position(first + j);
+		}
+		return r;
+	}
+
+	/**
+	 * @brief 重複節点の差分商によるエルミート補間
+	 *
+	 */
+	Eigen::Vector3d hermite(std::int64_t t, std::size_t points) const {
+		const std::size_t first = window(t, points);
+		constexpr double second = constant::ticks_per_second;
+		const std::size_t n = 2 * points;
+		std::array<double, 2 * max_points> nodes;
+		std::array<Eigen::Vector3d, 2 * max_points> table; // 差分商の表の対角を上書きで求める
+		for (std::size_t j = 0; j < points; j++) {
+			nodes[2 * j] = nodes[2 * j + 1] = (ticks[first + j] - ticks[first]) / second;
+			table[2 * j] = table[2 * j + 1] = position(first + j);
+		}
+		// 1階: 同じ節点では速度、異なる節点では差分
+		std::array<Eigen::Vector3d, 2 * max_points> previous = table;
+		for (std::size_t i = n - 1; i >= 1; i--) {
+			table[i] = (i % 2 == 1) ? velocity(first + i / 2) : Eigen::Vector3d((previous[i] - previous[i - 1]) / (nodes[i] - nodes[i - 1]));
+		}
+		for (std::size_t order = 2; order < n; order++) {
+			for (std::size_t i = n - 1; i >= order; i--) {
+				table[i] = (table[i] - table[i - 1]) / (nodes[i] - nodes[i - order]);
+			}
+		}
+		// ニュートン形式をホーナー法で評価する
+		const double s = (t - ticks[first]) / second;
+		Eigen::Vector3d r = table[n - 1];
+		for (std::size_t i = n - 1; i >= 1; i--) {
+			r = table[i - 1] + (s - nodes[i - 1]) * r;
+		}
+		return r;
+	}
+};
+
+/**
+ * @brief 読み込んだエフェメリス (物体ごとの軌道)
+ *
+ */
+struct OrbitFile {
+	std::vector<OrbitTrack> tracks;
+
+	/**
+	 * @brief 物体名で軌道を探す
+	 *
+	 */
+	const OrbitTrack& track(const std::string& object) const {
+		for (const auto& track : tracks) {
+			if (track.object == object) {
+				return track;
+			}
+		}
+		throw std::runtime_error("OrbitFile: no track for " + object);
+	}
+};
+
+/**
+ * @brief 行と数値を、ファイルを割り当てたメモリの上でそのまま読む
+ *
+ */
+struct OrbitTextHelper {
+	struct Line {
+		const char* begin;
+		const char* end;
+
+		std::size_t size() const { return static_cast<std::size_t>(end - begin); }
+		bool startsWith(const char* prefix) const {
+			const std::size_t n = std::strlen(prefix);
+			return size() >= n && std::memcmp(begin, prefix, n) == 0;
+		}
+		std::string str() const { return std::string(begin, end); }
+	};
+
+	/**
+	 * @brief 次の行を取り出す (行末の\rは除く)
+	 *
+	 */
+	static bool nextLine(const char*& p, const char* end, Line& line) {
+		if (p >= end) {
+			return false;
+		}
+		const char* newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+		line.begin = p;
+		line.end = newline != nullptr ? newline : end;
+		p = newline != nullptr ? newline + 1 : end;
+		if (line.end > line.begin && line.end[-1] == '\r') {
+			line.end--;
+		}
+		return true;
+	}
+
+	static void skipSpaces(const char*& p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+	}
+
+	static Line trim(Line line) {
+		skipSpaces(line.begin, line.end);
+		while (line.end > line.begin && (line.end[-1] == ' ' || line.end[-1] == '\t')) {
+			line.end--;
+		}
+		return line;
+	}
+
+	/**
+	 * @brief 空白に続く整数を読む
+	 *
+	 */
+	static bool parseInt(const char*& p, const char* end, long long& value) {
+		skipSpaces(p, end);
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p++ == '-';
+		}
+		const char* start = p;
+		long long v = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			v = v * 10 + (*p++ - '0');
+		}
+		value = negative ? -v : v;
+		return p > start;
+	}
+
+	/**
+	 * @brief 空白に続く実数を読む
+	 * @remark 仮数が2^53未満で10の指数が22以下なら1回の乗除算で正しく丸めた値になる (Clingerの方法)。それ以外はstrtodに任せる。
+	 *         FortranのD指数も受け付ける
+	 *
+	 */
+	static bool parseDouble(const char*& p, const char* end, double& value) {
+		static const double powers[] = {1e0,  1e1,	1e2,  1e3,	1e4,  1e5,	1e6,  1e7,	1e8,  1e9,	1e10, 1e11,
+										1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+		skipSpaces(p, end);
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p++ == '-';
+		}
+		std::uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+				digits += mantissa != 0;
+			} else {
+				exponent++;
+			}
+			p++;
+			any = true;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && *p >= '0' && *p <= '9') {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+				p++;
+				any = true;
+			}
+		}
+		if (!any) {
+			p = start;
+			return false;
+		}
+		if (p < end && (*p == 'e' || *p == 'E' || *p == 'd' || *p == 'D')) {
+			const char* mark = p++;
+			long long e;
+			if (parseInt(p, end, e) && p > mark + 1 && mark[1] != ' ') {
+				exponent += static_cast<int>(e);
+			} else {
+				p = mark;
+			}
+		}
+		if (mantissa < (std::uint64_t{1} << 53) && exponent >= -22 && exponent <= 22) {
+			const double m = static_cast<double>(mantissa);
+			value = exponent >= 0 ? m * powers[exponent] : m / powers[-exponent];
+		} else {
+			char buffer[64];
+			const std::size_t n = std::min<std::size_t>(static_cast<std::size_t>(p - start), sizeof(buffer) - 1);
+			std::memcpy(buffer, start, n);
+			buffer[n] = '\0';
+			for (std::size_t i = 0; i < n; i++) {
+				if (buffer[i] == 'd' || buffer[i] == 'D') {
+					buffer[i] = 'e';
+				}
+			}
+			value = std::strtod(buffer, nullptr);
+			return true;
+		}
+		if (negative) {
+			value = -value;
+		}
+		return true;
+	}
+};
+
+/**
+ * @brief 軌道エフェメリスのファイルを読む
+ * @remark ファイルをメモリに割り当て、行をコピーせずにその場で解析する。配列は標本点の数を数えてから一度だけ確保する
+ *
+ */
+struct OrbitReader {
+	/**
+	 * @brief 形式を先頭から判定して読む
+	 *
+	 */
+	static OrbitFile load(const std::string& path) {
+		const MappedFile file(path, MappedFile::Access::Sequential);
+		if (file.size() >= 1 && file.data()[0] == '#') {
+			return parseSp3(file.data(), file.size(), path);
+		}
+		return parseOem(file.data(), file.size(), path);
+	}
+
+	static OrbitFile loadOem(const std::string& path) {
+		const MappedFile file(path, MappedFile::Access::Sequential);
+		return parseOem(file.data(), file.size(), path);
+	}
+
+	static OrbitFile loadSp3(const std::string& path) {
+		const MappedFile file(path, MappedFile::Access::Sequential);
+		return parseSp3(file.data(), file.size(), path);
+	}
+
+	/**
+	 * @brief CCSDS OEM (KVN形式) を解析する
+	 * @remark EME2000/GCRF/ICRF/J2000は歳差を適用してEci、TOD/MOD/TEMEはそのままEci、ITRF系はEcefとして読む。
+	 *         同じ物体・座標系の区間は1つの軌道につなぎ、前の区間と重なる時刻の行は捨てる
+	 *
+	 */
+	static OrbitFile parseOem(const char* data, std::size_t size, const std::string& name = "OEM") {
+		using Line = OrbitTextHelper::Line;
+		OrbitFile file;
+		const char* p = data;
+		const char* end = data + size;
+		Line line;
+		std::size_t line_number = 0;
+		bool in_meta = false, in_covariance = false, precess = false;
+		OrbitTrack* track = nullptr;
+		OrbitTimeScale scale = OrbitTimeScale::Utc;
+		std::string object, object_id, frame_name, center, time_system;
+		DayCache days;
+
+		while (OrbitTextHelper::nextLine(p, end, line)) {
+			line_number++;
+			const Line text = OrbitTextHelper::trim(line);
+			if (text.size() == 0 || text.startsWith("COMMENT")) {
+				continue;
+			}
+			if (in_covariance) {
+				in_covariance = !text.startsWith("COVARIANCE_STOP");
+				continue;
+			}
+			if (text.startsWith("META_START")) {
+				in_meta = true;
+				object.clear(), object_id.clear(), frame_name.clear(), center.clear(), time_system.clear();
+				continue;
+			}
+			if (in_meta) {
+				if (text.startsWith("META_STOP")) {
+					in_meta = false;
+					OrbitFrame frame;
+					if (!parseFrame(frame_name, frame, precess) || (!center.empty() && center != "EARTH")) {
+						throw std::runtime_error(name + ":" + std::to_string(line_number) + ": unsupported REF_FRAME/CENTER_NAME " + frame_name + "/" + center);
+					}
+					if (!parseTimeScale(time_system, scale)) {
+						throw std::runtime_error(name + ":" + std::to_string(line_number) + ": unsupported TIME_SYSTEM " + time_system);
+					}
+					track = &findTrack(file, object.empty() ? object_id : object, frame);
+					track->reserve(countLines(p, end, "META_START"), true);
+					continue;
+				}
+				const char* equal = static_cast<const char*>(std::memchr(text.begin, '=', text.size()));
+				if (equal != nullptr) {
+					const std::string key = OrbitTextHelper::trim(Line{text.begin, equal}).str();
+					const std::string value = OrbitTextHelper::trim(Line{equal + 1, text.end}).str();
+					if (key == "OBJECT_NAME") {
+						object = value;
+					} else if (key == "OBJECT_ID") {
+						object_id = value;
+					} else if (key == "REF_FRAME") {
+						frame_name = value;
+					} else if (key == "CENTER_NAME") {
+						center = value;
+					} else if (key == "TIME_SYSTEM") {
+						time_system = value;
+					}
+				}
+				continue;
+			}
+			if (text.startsWith("COVARIANCE_START")) {
+				in_covariance = true;
+				continue;
+			}
+			if (std::memchr(text.begin, '=', text.size()) != nullptr) {
+				continue; // ヘッダ
+			}
+			if (track == nullptr) {
+				throw std::runtime_error(name + ":" + std::to_string(line_number) + ": data before metadata");
+			}
+
+			const char* q = text.begin;
+			std::int64_t ticks;
+			double value[6];
+			if (!parseIsoEpoch(q, text.end, days, ticks)) {
+				throw std::runtime_error(name + ":" + std::to_string(line_number) + ": invalid epoch");
+			}
+			int count = 0;
+			while (count < 6 && OrbitTextHelper::parseDouble(q, text.end, value[count])) {
+				count++;
+			}
+			if (count != 6) {
+				throw std::runtime_error(name + ":" + std::to_string(line_number) + ": expected position and velocity");
+			}
+			ticks = OrbitTimeHelper::toUtc(ticks, scale);
+			if (!track->empty() && ticks <= track->ticks.back()) {
+				continue;
+			}
+			Eigen::Vector3d r{value[0] * 1e3, value[1] * 1e3, value[2] * 1e3}, v{value[3] * 1e3, value[4] * 1e3, value[5] * 1e3};
+			if (precess) {
+				const Eigen::Matrix3d rotation = OrbitTimeHelper::precession(ticks);
+				r = rotation * r;
+				v = rotation * v;
+			}
+			push(*track, ticks, r);
+			track->vx.push_back(v.x()), track->vy.push_back(v.y()), track->vz.push_back(v.z());
+		}
+		return file;
+	}
+
+	/**
+	 * @brief SP3 (a/c/d) を解析する
+	 * @remark 位置は[km]、速度は[dm/s]で書かれている。位置が0の標本 (欠測) は捨てる。座標系はEcef。
+	 *         V行が欠けた標本を含む軌道は速度を持たないものとする (Hermite補間は例外を投げる)
+	 *
+	 */
+	static OrbitFile parseSp3(const char* data, std::size_t size, const std::string& name = "SP3") {
+		using Line = OrbitTextHelper::Line;
+		OrbitFile file;
+		const char* p = data;
+		const char* end = data + size;
+		Line line;
+		std::size_t line_number = 0;
+		std::size_t epochs = 0;
+		bool velocity = false, time_system_read = false, has_epoch = false;
+		OrbitTimeScale scale = OrbitTimeScale::Gps;
+		std::int64_t epoch = 0;
+		OrbitTrack* last = nullptr; // 直前のP行の軌道 (続くV行で速度を埋める)
+		std::size_t guess = 0;
+
+		while (OrbitTextHelper::nextLine(p, end, line)) {
+			line_number++;
+			if (line.size() == 0) {
+				continue;
+			}
+			const auto error = [&](const char* message) { return std::runtime_error(name + ":" + std::to_string(line_number) + ": " + message); };
+			switch (line.begin[0]) {
+				case '#':
+					if (line_number == 1) {
+						if (line.size() < 40) {
+							throw error("invalid header");
+						}
+						velocity = line.begin[2] == 'V';
+						const char* q = line.begin + 32;
+						long long n;
+						if (OrbitTextHelper::parseInt(q, line.end, n)) {
+							epochs = static_cast<std::size_t>(std::max(n, 0LL));
+						}
+					}
+					break;
+				case '%':
+					if (line.startsWith("%c") && !time_system_read && line.size() >= 12) {
+						time_system_read = true;
+						const std::string system = OrbitTextHelper::trim(Line{line.begin + 9, line.begin + 12}).str();
+						if (!system.empty() && system != "ccc" && !parseTimeScale(system, scale)) {
+							throw error("unsupported time system");
+						}
+					}
+					break;
+				case '*': {
+					const char* q = line.begin + 1;
+					long long year, month, day, hour, minute;
+					double second;
+					if (!OrbitTextHelper::parseInt(q, line.end, year) || !OrbitTextHelper::parseInt(q, line.end, month) ||
+						!OrbitTextHelper::parseInt(q, line.end, day) || !OrbitTextHelper::parseInt(q, line.end, hour) ||
+						!OrbitTextHelper::parseInt(q, line.end, minute) || !OrbitTextHelper::parseDouble(q, line.end, second)) {
+						throw error("invalid epoch");
+					}
+					epoch = OrbitTimeHelper::toUtc(DateTime(static_cast<int>(year), static_cast<int>(month), static_cast<int>(day), 0, 0, 0).ticks() +
+													 hour * constant::ticks_per_hour + minute * constant::ticks_per_minute +
+													 std::llround(second * constant::ticks_per_second),
+												   scale);
+					has_epoch = true;
+					last = nullptr;
+					guess = 0;
+					break;
+				}
+				case 'P':
+				case 'V': {
+					if (line.size() < 4 || !has_epoch) {
+						if (!has_epoch && line.size() >= 4) {
+							throw error("record before the first epoch");
+						}
+						break;
+					}
+					char id[3] = {line.begin[1] == ' ' ? 'G' : line.begin[1], line.begin[2] == ' ' ? '0' : line.begin[2], line.begin[3]};
+					const char* q = line.begin + 4;
+					double value[3];
+					for (double& v : value) {
+						if (!OrbitTextHelper::parseDouble(q, line.end, v)) {
+							throw error("invalid record");
+						}
+					}
+					if (line.begin[0] == 'V') {
+						if (last != nullptr && last->object.compare(0, 3, id, 3) == 0 && last->hasVelocity()) {
+							last->vx.back() = value[0] * 0.1, last->vy.back() = value[1] * 0.1, last->vz.back() = value[2] * 0.1;
+						}
+						break;
+					}
+					last = nullptr;
+					if (value[0] == 0.0 && value[1] == 0.0 && value[2] == 0.0) {
+						break; // 欠測
+					}
+					OrbitTrack& track = findSatellite(file, id, guess, epochs, velocity);
+					if (!track.empty() && epoch <= track.ticks.back()) {
+						break;
+					}
+					push(track, epoch, Eigen::Vector3d{value[0] * 1e3, value[1] * 1e3, value[2] * 1e3});
+					if (velocity) {
+						const double nan = std::numeric_limits<double>::quiet_NaN();
+						track.vx.push_back(nan), track.vy.push_back(nan), track.vz.push_back(nan);
+					}
+					last = &track;
+					break;
+				}
+				default:
+					if (line.startsWith("EOF")) {
+						dropIncompleteVelocities(file);
+						return file;
+					}
+					break;
+			}
+		}
+		dropIncompleteVelocities(file);
+		return file;
+	}
+
+  private:
+	/**
+	 * @brief 同じ日付の日の始まりのティック数を使い回す
+	 *
+	 */
+	struct DayCache {
+		int year = 0, month = 0, day = 0; // day_of_yearの場合はmonth = 0
+		std::int64_t ticks = 0;
+	};
+
+	/**
+	 * @brief 速度が埋まらなかった (NaNが残る) 軌道の速度を捨てる
+	 *
+	 */
+	static void dropIncompleteVelocities(OrbitFile& file) {
+		for (auto& track : file.tracks) {
+			const auto missing = [](double v) { return std::isnan(v); };
+			if (std::any_of(track.vx.begin(), track.vx.end(), missing)) {
+				track.vx.clear(), track.vy.clear(), track.vz.clear();
+			}
+		}
+	}
+
+	static void push(OrbitTrack& track, std::int64_t ticks, const Eigen::Vector3d& r) {
+		track.ticks.push_back(ticks);
+		track.x.push_back(r.x()), track.y.push_back(r.y()), track.z.push_back(r.z());
+	}
+
+	static OrbitTrack& findTrack(OrbitFile& file, const std::string& object, OrbitFrame frame) {
+		for (auto& track : file.tracks) {
+			if (track.object == object && track.frame == frame) {
+				return track;
+			}
+		}
+		file.tracks.emplace_back();
+		file.tracks.back().object = object;
+		file.tracks.back().frame = frame;
+		return file.tracks.back();
+	}
+
+	/**
+	 * @brief 衛星番号の軌道を探す (エポックごとの衛星の並びは同じなので、前の行の次から探す)
+	 *
+	 */
+	static OrbitTrack& findSatellite(OrbitFile& file, const char (&id)[3], std::size_t& guess, std::size_t epochs, bool velocity) {
+		const std::size_t count = file.tracks.size();
+		for (std::size_t k = 0; k < count; k++) {
+			const std::size_t i = (guess + k) % count;
+			if (file.tracks[i].object.compare(0, 3, id, 3) == 0) {
+				guess = i + 1;
+				return file.tracks[i];
+			}
+		}
+		file.tracks.emplace_back();
+		OrbitTrack& track = file.tracks.back();
+		track.object.assign(id, 3);
+		track.frame = OrbitFrame::Ecef;
+		track.reserve(epochs, velocity);
+		guess = count + 1;
+		return track;
+	}
+
+	/**
+	 * @brief 次のmarkerまで (なければ末尾まで) の行数を数える
+	 *
+	 */
+	static std::size_t countLines(const char* p, const char* end, const char* marker) {
+		const char* stop = std::search(p, end, marker, marker + std::strlen(marker));
+		std::size_t lines = 0;
+		while (p < stop) {
+			const char* newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(stop - p)));
+			if (newline == nullptr) {
+				return lines + 1;
+			}
+			lines++;
+			p = newline + 1;
+		}
+		return lines;
+	}
+
+	static bool parseFrame(const std::string& name, OrbitFrame& frame, bool& precess) {
+		precess = false;
+		if (name.compare(0, 4, "ITRF") == 0 || name.compare(0, 3, "IGS") == 0 || name == "EFG" || name == "ECEF") {
+			frame = OrbitFrame::Ecef;
+			return true;
+		}
+		frame = OrbitFrame::Eci;
+		if (name == "EME2000" || name == "GCRF" || name == "ICRF" || name == "J2000") {
+			precess = true;
+			return true;
+		}
+		return name == "TOD" || name == "MOD" || name == "TEME";
+	}
+
+	static bool parseTimeScale(const std::string& name, OrbitTimeScale& scale) {
+		if (name == "UTC") {
+			scale = OrbitTimeScale::Utc;
+		} else if (name == "TAI") {
+			scale = OrbitTimeScale::Tai;
+		} else if (name == "GPS" || name == "GAL" || name == "QZS" || name == "IRN") {
+			scale = OrbitTimeScale::Gps;
+		} else if (name == "TT" || name == "TDB") {
+			scale = OrbitTimeScale::Tt;
+		} else if (name == "GLO") {
+			scale = OrbitTimeScale::Glonass;
+		} else if (name == "BDT") {
+			scale = OrbitTimeScale::Beidou;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief YYYY-MM-DDThh:mm:ss[.s*] またはYYYY-DDDThh:mm:ss[.s*] を読む
+	 *
+	 */
+	static bool parseIsoEpoch(const char*& p, const char* end, DayCache& cache, std::int64_t& ticks) {
+		const auto number = [&](int digits, int& value) {
+			value = 0;
+			for (int i = 0; i < digits; i++, p++) {
+				if (p >= end || *p < '0' || *p > '9') {
+					return false;
+				}
+				value = value * 10 + (*p - '0');
+			}
+			return true;
+		};
+		const auto expect = [&](char c) { return p < end && *p++ == c; };
+		int year, month = 0, day, hour, minute, second;
+		if (!number(4, year) || !expect('-')) {
+			return false;
+		}
+		if (p + 3 < end && p[3] == 'T') {
+			if (!number(3, day)) {
+				return false;
+			}
+		} else if (!number(2, month) || !expect('-') || !number(2, day)) {
+			return false;
+		}
+		if (!expect('T') || !number(2, hour) || !expect(':') || !number(2, minute) || !expect(':') || !number(2, second)) {
+			return false;
+		}
+		std::int64_t fraction = 0; // [tick]
+		if (p < end && *p == '.') {
+			p++;
+			std::int64_t scale = constant::ticks_per_second;
+			int round = 0;
+			while (p < end && *p >= '0' && *p <= '9') {
+				if (scale > 1) {
+					scale /= 10;
+					fraction += (*p - '0') * scale;
+				} else if (round == 0) {
+					round = *p >= '5' ? 1 : -1;
+				}
+				p++;
+			}
+			fraction += round > 0;
+		}
+		if (p < end && *p == 'Z') {
+			p++;
+		}
+		if (cache.year != year || cache.month != month || cache.day != day) {
+			cache.year = year, cache.month = month, cache.day = day;
+			cache.ticks = month == 0 ? DateTime(year, 1, 1, 0, 0, 0).ticks() + (day - 1) * constant::ticks_per_day
+									 : DateTime(year, month, day, 0, 0, 0).ticks();
+		}
+		ticks = cache.ticks + hour * constant::ticks_per_hour + minute * constant::ticks_per_minute + second * constant::ticks_per_second + fraction;
+		return true;
+	}
+};
+
+GEOMAG_NAMESPACE_END
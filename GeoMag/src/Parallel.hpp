@@ -0,0 +1,380 @@
+/**
+ * @file Parallel.hpp
+ * @author Kaiji Takeuchi
+ * @brief 区間を分割して並列に処理するヘルパ
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Essential.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+struct Parallel {
+	/**
+	 * @brief 実際に使用するスレッド数を取得する
+	 *
+	 * @param num_threads 要求スレッド数 (0の場合はハードウェアの並列数)
+	 * @return std::size_t スレッド数 (1以上)
+	 */
+	static auto threadCount(std::size_t num_threads = 0) -> std::size_t {
+		if (num_threads == 0) {
+			num_threads = std::thread::hardware_concurrency();
+		}
+		return std::max<std::size_t>(num_threads, 1);
+	}
+
+	/**
+	 * @brief [begin, end) をchunk個ずつ動的に割り当てて並列に処理する
+	 * @remark 呼び出しスレッドもスレッド番号0として処理に参加する
+	 *
+	 * @param begin 開始インデックス
+	 * @param end 終了インデックス
+	 * @param chunk 1回に割り当てる要素数
+	 * @param func func(thread_index, chunk_begin, chunk_end)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <typename Func>
+	static auto forEachChunk(std::size_t begin, std::size_t end, std::size_t chunk, Func&& func, std::size_t num_threads = 0) -> void {
+		if (end <= begin) {
+			return;
+		}
+
+		chunk = std::max<std::size_t>(chunk, 1);
+		const std::size_t num_chunks = (end - begin + chunk - 1) / chunk;
+		const std::size_t threads = std::min(threadCount(num_threads), num_chunks);
+
+		if (threads == 1) {
+			for (std::size_t b = begin; b < end; b += chunk) {
+				func(std::size_t{0}, b, std::min(b + chunk, end));
+			}
+			return;
+		}
+
+		std::atomic<std::size_t> next{0};
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto worker = [&](std::size_t thread_index) {
+			try {
+				for (std::size_t c = next.fetch_add(1); c < num_chunks; c = next.fetch_add(1)) {
+					const std::size_t b = begin + c * chunk;
+					func(thread_index, b, std::min(b + chunk, end));
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+				next.store(num_chunks);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		pool.reserve(threads - 1);
+		for (std::size_t t = 1; t < threads; t++) {
+			pool.emplace_back(worker, t);
+		}
+		worker(0);
+		for (auto& th : pool) {
+			th.join();
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	/**
+	 * @brief [begin, end) の各要素を並列に処理する
+	 *
+	 * @param begin 開始インデックス
+	 * @param end 終了インデックス
+	 * @param func func(thread_index, index)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <typename Func>
+	static auto forEach(std::size_t begin, std::size_t end, Func&& func, std::size_t num_threads = 0) -> void {
+		forEachChunk(
+		  begin, end, 1,
+		  [&func](std::size_t thread_index, std::size_t b, std::size_t e) {
+			  for (std::size_t i = b; i < e; i++) {
+				  func(thread_index, i);
+			  }
+		  },
+		  num_threads);
+	}
+};
+
+/**
+ * @brief 常駐するスレッドの組で区間を静的に分割して処理する
+ * @remark スレッドiは常に区間のi番目の部分を受け持つので、最初に書き込んだスレッドのNUMAノードにページが割り当たる (first-touch)。
+ *         呼び出しごとにスレッドを作らず、ヒープも使わない
+ *
+ */
+class WorkerTeam {
+  public:
+	/**
+	 * @brief Construct a new Worker Team object
+	 *
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数。呼び出しスレッドを含む)
+	 */
+	explicit WorkerTeam(std::size_t num_threads = 0) : m_size(Parallel::threadCount(num_threads)) {
+		m_threads.reserve(m_size - 1);
+		for (std::size_t t = 1; t < m_size; t++) {
+			m_threads.emplace_back([this, t] { work(t); });
+		}
+	}
+
+	WorkerTeam(const WorkerTeam&) = delete;
+	WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+	~WorkerTeam() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_start.notify_all();
+		for (auto& thread : m_threads) {
+			thread.join();
+		}
+	}
+
+	std::size_t size() const { return m_size; }
+
+	/**
+	 * @brief [0, count) をスレッド数で等分して処理する
+	 *
+	 * @param count 要素数
+	 * @param func func(thread_index, begin, end)
+	 */
+	template <typename Func>
+	void run(std::size_t count, Func&& func) {
+		using F = typename std::remove_reference<Func>::type;
+		if (m_size == 1 || count < m_size) {
+			func(std::size_t{0}, std::size_t{0}, count);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_invoke = [](void* context, std::size_t thread_index, std::size_t begin, std::size_t end) {
+				(*static_cast<F*>(context))(thread_index, begin, end);
+			};
+			m_context = const_cast<void*>(static_cast<const void*>(&func));
+			m_count = count;
+			m_pending = m_size - 1;
+			m_error = nullptr;
+			m_generation++;
+		}
+		m_start.notify_all();
+
+		execute(0);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+		if (m_error) {
+			std::rethrow_exception(m_error);
+		}
+	}
+
+  private:
+	std::size_t m_size;
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_start;
+	std::condition_variable m_done;
+	void (*m_invoke)(void*, std::size_t, std::size_t, std::size_t) = nullptr;
+	void* m_context = nullptr;
+	std::size_t m_count = 0;
+	std::size_t m_pending = 0;
+	std::size_t m_generation = 0;
+	std::exception_ptr m_error;
+	bool m_stop = false;
+
+	void execute(std::size_t thread_index) {
+		const std::size_t begin = m_count * thread_index / m_size;
+		const std::size_t end = m_count * (thread_index + 1) / m_size;
+		try {
+			m_invoke(m_context, thread_index, begin, end);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_error) {
+				m_error = std::current_exception();
+			}
+		}
+	}
+
+	void work(std::size_t thread_index) {
+		std::size_t generation = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_start.wait(lock, [&] { return m_stop || m_generation != generation; });
+				if (m_stop) {
+					return;
+				}
+				generation = m_generation;
+			}
+			execute(thread_index);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_pending--;
+			}
+			m_done.notify_one();
+		}
+	}
+};
+
+/**
+ * @brief 常駐するスレッドで投入されたタスクを順に処理する
+ * @remark タスクはfunc(thread_index)の形で呼ばれるので、スレッドごとの作業領域を添字で引ける。
+ *         タスクが投げた例外は最初の1つだけを保持し、waitで再送出する
+ *
+ */
+class ThreadPool {
+  public:
+	/**
+	 * @brief Construct a new Thread Pool object
+	 *
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	explicit ThreadPool(std::size_t num_threads = 0) : m_size(Parallel::threadCount(num_threads)) {
+		m_threads.reserve(m_size);
+		for (std::size_t t = 0; t < m_size; t++) {
+			m_threads.emplace_back([this, t] { work(t); });
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * @brief 実行中のタスクの完了を待って終了する (未着手のタスクは破棄する)
+	 *
+	 */
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_tasks.clear();
+		}
+		m_ready.notify_all();
+		for (auto& thread : m_threads) {
+			thread.join();
+		}
+	}
+
+	std::size_t size() const { return m_size; }
+
+	/**
+	 * @brief タスクを投入する
+	 *
+	 * @param task task(thread_index)
+	 */
+	void submit(std::function<void(std::size_t)> task) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(std::move(task));
+			m_pending++;
+		}
+		m_ready.notify_one();
+	}
+
+	/**
+	 * @brief 未着手のタスクを破棄する
+	 *
+	 * @return std::size_t 破棄したタスクの数
+	 */
+	std::size_t cancel() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const std::size_t count = m_tasks.size();
+		m_tasks.clear();
+		m_pending -= count;
+		if (m_pending == 0) {
+			m_done.notify_all();
+		}
+		return count;
+	}
+
+	/**
+	 * @brief 投入したすべてのタスクの完了を待つ
+	 *
+	 */
+	void wait() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+		if (m_error) {
+			std::exception_ptr error = m_error;
+			m_error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+	/**
+	 * @brief 未完了のタスクの数 (実行中を含む)
+	 *
+	 */
+	std::size_t pending() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_pending;
+	}
+
+  private:
+	std::size_t m_size;
+	std::vector<std::thread> m_threads;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::condition_variable m_done;
+	std::deque<std::function<void(std::size_t)>> m_tasks;
+	std::size_t m_pending = 0;
+	std::exception_ptr m_error;
+	bool m_stop = false;
+
+	void work(std::size_t thread_index) {
+		for (;;) {
+			std::function<void(std::size_t)> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_ready.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+				if (m_stop) {
+					return;
+				}
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			try {
+				task(thread_index);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_error) {
+					m_error = std::current_exception();
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_pending == 0) {
+					m_done.notify_all();
+				}
+			}
+		}
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,613 @@
+/**
+ * @file Pipeline.hpp
+ * @author Kaiji Takeuchi
+ * @brief ロックフリーキューで段をつないだストリーム処理パイプライン
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Essential.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 単一生産者・単一消費者の有界リングバッファ
+ * @remark 相手側の位置をキャッシュして、満杯/空のときだけ共有変数を読む
+ *
+ * @tparam T 要素の型
+ */
+template <typename T>
+class SpscQueue {
+  public:
+	/**
+	 * @brief Construct a new Spsc Queue object
+	 *
+	 * @param capacity 容量 (2のべき乗に切り上げる)
+	 */
+	explicit SpscQueue(std::size_t capacity) : m_buffer(roundUp(capacity)), m_mask(m_buffer.size() - 1) {}
+
+	bool tryPush(T& value) {
+		const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head_cache > m_mask) {
+			m_head_cache = m_head.load(std::memory_order_acquire);
+			if (tail - m_head_cache > m_mask) {
+				return false;
+			}
+		}
+		m_buffer[tail & m_mask] = std::move(value);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T& value) {
+		const std::size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail_cache) {
+			m_tail_cache = m_tail.load(std::memory_order_acquire);
+			if (head == m_tail_cache) {
+				return false;
+			}
+		}
+		value = std::move(m_buffer[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	std::size_t capacity() const { return m_buffer.size(); }
+
+  private:
+	static constexpr std::size_t cache_line = 64;
+
+	std::vector<T> m_buffer;
+	std::size_t m_mask;
+	char m_pad0[cache_line];
+	std::atomic<std::size_t> m_head{0}; // 消費者が更新する
+	std::size_t m_tail_cache = 0;		// 消費者が見たtail
+	char m_pad1[cache_line];
+	std::atomic<std::size_t> m_tail{0}; // 生産者が更新する
+	std::size_t m_head_cache = 0;		// 生産者が見たhead
+	char m_pad2[cache_line];
+
+	static auto roundUp(std::size_t n) -> std::size_t {
+		std::size_t size = 2;
+		while (size < n) {
+			size <<= 1;
+		}
+		return size;
+	}
+};
+
+/**
+ * @brief 複数生産者・複数消費者の有界リングバッファ
+ * @ref D. Vyukov, "Bounded MPMC queue"
+ *
+ * @tparam T 要素の型
+ */
+template <typename T>
+class MpmcQueue {
+  public:
+	/**
+	 * @brief Construct a new Mpmc Queue object
+	 *
+	 * @param capacity 容量 (2のべき乗に切り上げる)
+	 */
+	explicit MpmcQueue(std::size_t capacity) : m_cells(roundUp(capacity)), m_mask(m_cells.size() - 1) {
+		for (std::size_t i = 0; i < m_cells.size(); i++) {
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	bool tryPush(T& value) {
+		std::size_t pos = m_enqueue.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = m_cells[pos & m_mask];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+			if (diff == 0) {
+				if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = std::move(value);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_enqueue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool tryPop(T& value) {
+		std::size_t pos = m_dequeue.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = m_cells[pos & m_mask];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = std::move(cell.value);
+					cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_dequeue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::size_t capacity() const { return m_cells.size(); }
+
+  private:
+	static constexpr std::size_t cache_line = 64;
+
+	struct Cell {
+		std::atomic<std::size_t> sequence;
+		T value;
+
+		Cell() : sequence(0), value() {}
+	};
+
+	std::vector<Cell> m_cells;
+	std::size_t m_mask;
+	char m_pad0[cache_line];
+	std::atomic<std::size_t> m_enqueue{0};
+	char m_pad1[cache_line];
+	std::atomic<std::size_t> m_dequeue{0};
+	char m_pad2[cache_line];
+
+	static auto roundUp(std::size_t n) -> std::size_t {
+		std::size_t size = 2;
+		while (size < n) {
+			size <<= 1;
+		}
+		return size;
+	}
+};
+
+/**
+ * @brief 段の間で受け渡すバッチ
+ *
+ * @tparam T 要素の型
+ */
+template <typename T>
+struct PipelineBatch {
+	std::uint64_t sequence = 0; // 入力順の通し番号
+	std::vector<T> items;
+};
+
+/**
+ * @brief 段ごとの統計
+ *
+ */
+struct PipelineStageStats {
+	std::string name;
+	std::size_t threads = 0;
+	std::uint64_t batches = 0;		 // 出力したバッチ数
+	std::uint64_t items = 0;		 // 出力した要素数
+	double busy_seconds = 0.0;		 // 処理関数の実行時間 (全スレッドの合計)
+	double input_wait_seconds = 0.0; // 入力待ちの時間 (全スレッドの合計)
+	double output_wait_seconds = 0.0; // 出力先が満杯で待った時間 (全スレッドの合計、バックプレッシャー)
+	double wall_seconds = 0.0;		 // パイプライン全体の経過時間
+
+	/**
+	 * @brief 稼働率 (処理時間 / (経過時間 * スレッド数))
+	 *
+	 */
+	double utilization() const { return wall_seconds > 0.0 && threads > 0 ? busy_seconds / (wall_seconds * threads) : 0.0; }
+};
+
+/**
+ * @brief 段をロックフリーキューでつないだストリーム処理パイプライン
+ * @remark キューは有界なので、下流が詰まると上流は待たされる (バックプレッシャー)。生産者と消費者が1スレッドずつの接続にはSPSC、それ以外にはMPMCのキューを使う。
+ *         入力段は、出力段がまだ受け取っていないバッチがcapacity個になると待つので、並べ直しのために出力段が保持するバッチもcapacity - 1個までになる
+ *
+ */
+class Pipeline {
+  public:
+	/**
+	 * @brief 段と段をつなぐ接続
+	 *
+	 * @tparam T 要素の型
+	 */
+	template <typename T>
+	class Channel;
+
+	/**
+	 * @brief Construct a new Pipeline object
+	 *
+	 * @param capacity 接続ごとに保持できるバッチ数 (入力段から出力段までの間に同時に存在できるバッチ数でもある)
+	 */
+	explicit Pipeline(std::size_t capacity = 64) : m_capacity(capacity), m_abort(false) {}
+
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator=(const Pipeline&) = delete;
+
+	/**
+	 * @brief 入力段を追加する
+	 * @remark 入力順を保つため1スレッドで実行する
+	 *
+	 * @tparam Out 出力要素の型
+	 * @tparam Func bool(std::vector<Out>& batch)。バッチを埋めて返し、入力が尽きたらfalseを返す
+	 * @param name 段の名前
+	 * @param func 入力関数
+	 * @return Channel<Out>& 出力先
+	 */
+	template <typename Out, typename Func>
+	Channel<Out>& source(const std::string& name, Func func) {
+		m_consumed.emplace_back(new std::atomic<std::uint64_t>(0));
+		auto& output = addChannel<Out>(1, m_consumed.back().get());
+		const std::size_t index = addStage(name, 1);
+		m_workers.push_back(Worker{[this, index, &output, func](std::size_t) mutable {
+			PipelineStageStats stats;
+			PipelineBatch<Out> batch;
+			for (std::uint64_t sequence = 0;;) {
+				if (!waitForWindow(*output.consumed(), sequence, stats)) {
+					break;
+				}
+				batch.items.clear();
+				const auto begin = Clock::now();
+				const bool more = func(batch.items);
+				addSeconds(stats.busy_seconds, begin);
+				if (!batch.items.empty()) {
+					batch.sequence = sequence++;
+					count(stats, batch.items.size());
+					if (!output.push(batch, stats, m_abort)) {
+						break;
+					}
+				}
+				if (!more) {
+					break;
+				}
+			}
+			output.producerDone();
+			merge(index, stats);
+		}, 0});
+		return output;
+	}
+
+	/**
+	 * @brief 変換段を追加する
+	 *
+	 * @tparam Out 出力要素の型
+	 * @tparam In 入力要素の型
+	 * @tparam Func void(std::size_t thread_index, std::vector<In>& input, std::vector<Out>& output)
+	 * @param name 段の名前
+	 * @param input 入力元
+	 * @param threads スレッド数
+	 * @param func 変換関数 (スレッドごとの状態はthread_indexで引く)
+	 * @return Channel<Out>& 出力先
+	 */
+	template <typename Out, typename In, typename Func>
+	Channel<Out>& stage(const std::string& name, Channel<In>& input, std::size_t threads, Func func) {
+		threads = std::max<std::size_t>(threads, 1);
+		auto& output = addChannel<Out>(threads, input.consumed());
+		input.addConsumers(threads);
+		const std::size_t index = addStage(name, threads);
+		for (std::size_t t = 0; t < threads; t++) {
+			m_workers.push_back(Worker{[this, index, &input, &output, func](std::size_t thread_index) mutable {
+				PipelineStageStats stats;
+				PipelineBatch<In> in;
+				PipelineBatch<Out> out;
+				while (input.pop(in, stats, m_abort)) {
+					out.sequence = in.sequence;
+					out.items.clear();
+					const auto begin = Clock::now();
+					func(thread_index, in.items, out.items);
+					addSeconds(stats.busy_seconds, begin);
+					count(stats, out.items.size());
+					if (!output.push(out, stats, m_abort)) {
+						break;
+					}
+				}
+				output.producerDone();
+				merge(index, stats);
+			}, t});
+		}
+		return output;
+	}
+
+	/**
+	 * @brief 出力段を追加する
+	 * @remark 1スレッドで入力順に並べ直して渡す
+	 *
+	 * @tparam In 入力要素の型
+	 * @tparam Func void(std::vector<In>& batch)
+	 * @param name 段の名前
+	 * @param input 入力元
+	 * @param func 出力関数
+	 */
+	template <typename In, typename Func>
+	void sink(const std::string& name, Channel<In>& input, Func func) {
+		input.addConsumers(1);
+		const std::size_t index = addStage(name, 1);
+		m_workers.push_back(Worker{[this, index, &input, func](std::size_t) mutable {
+			PipelineStageStats stats;
+			PipelineBatch<In> batch;
+			std::map<std::uint64_t, std::vector<In>> pending; // 先に届いたバッチ (入力段が待つのでcapacity - 1個まで)
+			std::uint64_t next = 0;
+			auto consume = [&](std::vector<In>& items) {
+				const auto begin = Clock::now();
+				func(items);
+				addSeconds(stats.busy_seconds, begin);
+				count(stats, items.size());
+				next++;
+				input.consumed()->store(next, std::memory_order_release);
+			};
+			while (input.pop(batch, stats, m_abort)) {
+				if (batch.sequence != next) {
+					pending.emplace(batch.sequence, std::move(batch.items));
+					continue;
+				}
+				consume(batch.items);
+				for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+					consume(it->second);
+					pending.erase(it);
+				}
+			}
+			merge(index, stats);
+		}, 0});
+	}
+
+	/**
+	 * @brief パイプラインを実行し、全ての段が終わるまで待つ
+	 * @remark いずれかの段で例外が発生すると全段を止めて再送出する
+	 *
+	 */
+	void run() {
+		for (auto& channel : m_channels) {
+			channel->open(m_capacity);
+		}
+
+		const auto begin = Clock::now();
+		std::vector<std::thread> threads;
+		threads.reserve(m_workers.size());
+		for (auto& worker : m_workers) {
+			threads.emplace_back([this, &worker]() {
+				try {
+					worker.body(worker.thread_index);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (!m_error) {
+						m_error = std::current_exception();
+					}
+					m_abort.store(true);
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		const double wall = std::chrono::duration<double>(Clock::now() - begin).count();
+		for (auto& stats : m_stats) {
+			stats.wall_seconds = wall;
+		}
+		if (m_error) {
+			std::rethrow_exception(m_error);
+		}
+	}
+
+	/**
+	 * @brief 段ごとの統計を取得する
+	 *
+	 */
+	const std::vector<PipelineStageStats>& stats() const { return m_stats; }
+
+  private:
+	using Clock = std::chrono::steady_clock;
+
+	struct ChannelBase {
+		virtual ~ChannelBase() = default;
+		virtual void open(std::size_t capacity) = 0;
+	};
+
+	struct Worker {
+		std::function<void(std::size_t)> body;
+		std::size_t thread_index; // 段の中でのスレッド番号
+	};
+
+	std::size_t m_capacity;
+	std::atomic<bool> m_abort;
+	std::vector<std::unique_ptr<std::atomic<std::uint64_t>>> m_consumed; // 入力段ごとの、出力段が受け取り終えたバッチ数
+	std::vector<std::unique_ptr<ChannelBase>> m_channels;
+	std::vector<Worker> m_workers;
+	std::vector<PipelineStageStats> m_stats;
+	std::mutex m_mutex;
+	std::exception_ptr m_error;
+
+	template <typename T>
+	Channel<T>& addChannel(std::size_t producers, std::atomic<std::uint64_t>* consumed) {
+		m_channels.emplace_back(new Channel<T>(producers, consumed));
+		return static_cast<Channel<T>&>(*m_channels.back());
+	}
+
+	/**
+	 * @brief 出力段がまだ受け取っていないバッチがcapacity個未満になるまで待つ
+	 *
+	 * @param consumed 出力段が受け取り終えたバッチ数
+	 * @param sequence 次に送るバッチの通し番号
+	 * @return false 中断された
+	 */
+	bool waitForWindow(const std::atomic<std::uint64_t>& consumed, std::uint64_t sequence, PipelineStageStats& stats) {
+		const std::uint64_t window = std::max<std::size_t>(m_capacity, 1);
+		if (sequence < consumed.load(std::memory_order_acquire) + window) {
+			return true;
+		}
+		const auto begin = Clock::now();
+		for (std::size_t spin = 0; sequence >= consumed.load(std::memory_order_acquire) + window; spin++) {
+			if (m_abort.load(std::memory_order_relaxed)) {
+				return false;
+			}
+			backoff(spin);
+		}
+		addSeconds(stats.output_wait_seconds, begin);
+		return true;
+	}
+
+	/**
+	 * @brief 待ちの間隔を段階的に延ばす
+	 * @remark コア数よりスレッドが多い場合に空回りで相手の処理を妨げないよう、しばらくしたら譲る
+	 *
+	 */
+	static void backoff(std::size_t spin) {
+		if (spin < 64) {
+			return;
+		}
+		if (spin < 256) {
+			std::this_thread::yield();
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+
+	std::size_t addStage(const std::string& name, std::size_t threads) {
+		PipelineStageStats stats;
+		stats.name = name;
+		stats.threads = threads;
+		m_stats.push_back(stats);
+		return m_stats.size() - 1;
+	}
+
+	static void addSeconds(double& seconds, Clock::time_point begin) {
+		seconds += std::chrono::duration<double>(Clock::now() - begin).count();
+	}
+
+	static void count(PipelineStageStats& stats, std::size_t items) {
+		stats.batches++;
+		stats.items += items;
+	}
+
+	void merge(std::size_t index, const PipelineStageStats& stats) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& total = m_stats[index];
+		total.batches += stats.batches;
+		total.items += stats.items;
+		total.busy_seconds += stats.busy_seconds;
+		total.input_wait_seconds += stats.input_wait_seconds;
+		total.output_wait_seconds += stats.output_wait_seconds;
+	}
+};
+
+template <typename T>
+class Pipeline::Channel : public Pipeline::ChannelBase {
+  public:
+	Channel(std::size_t producers, std::atomic<std::uint64_t>* consumed)
+	  : m_producers(producers), m_consumers(0), m_remaining(producers), m_closed(false), m_consumed(consumed) {}
+
+	void addConsumers(std::size_t consumers) {
+		if (m_consumers != 0) {
+			throw std::runtime_error("Pipeline: a channel can feed only one stage.");
+		}
+		m_consumers = consumers;
+	}
+
+	void open(std::size_t capacity) override {
+		if (m_consumers == 0) {
+			throw std::runtime_error("Pipeline: a channel has no consumer stage.");
+		}
+		if (m_producers == 1 && m_consumers == 1) {
+			m_spsc.reset(new SpscQueue<PipelineBatch<T>>(capacity));
+		} else {
+			m_mpmc.reset(new MpmcQueue<PipelineBatch<T>>(capacity));
+		}
+	}
+
+	/**
+	 * @brief バッチを送る。満杯の間は待つ
+	 *
+	 * @return false 中断された
+	 */
+	bool push(PipelineBatch<T>& batch, PipelineStageStats& stats, const std::atomic<bool>& abort) {
+		if (tryPush(batch)) {
+			return true;
+		}
+		const auto begin = Clock::now();
+		for (std::size_t spin = 0; !tryPush(batch); spin++) {
+			if (abort.load(std::memory_order_relaxed)) {
+				return false;
+			}
+			backoff(spin);
+		}
+		stats.output_wait_seconds += std::chrono::duration<double>(Clock::now() - begin).count();
+		return true;
+	}
+
+	/**
+	 * @brief バッチを受け取る。空の間は待つ
+	 *
+	 * @return false 全ての生産者が終了して空になった、または中断された
+	 */
+	bool pop(PipelineBatch<T>& batch, PipelineStageStats& stats, const std::atomic<bool>& abort) {
+		if (tryPop(batch)) {
+			return true;
+		}
+		const auto begin = Clock::now();
+		bool received = false;
+		for (std::size_t spin = 0;; spin++) {
+			if (tryPop(batch)) {
+				received = true;
+				break;
+			}
+			if (abort.load(std::memory_order_relaxed)) {
+				break;
+			}
+			// closedの後に見えなければ、もう来ない
+			if (m_closed.load(std::memory_order_acquire)) {
+				received = tryPop(batch);
+				break;
+			}
+			backoff(spin);
+		}
+		stats.input_wait_seconds += std::chrono::duration<double>(Clock::now() - begin).count();
+		return received;
+	}
+
+	void producerDone() {
+		if (m_remaining.fetch_sub(1) == 1) {
+			m_closed.store(true, std::memory_order_release);
+		}
+	}
+
+	/**
+	 * @brief このバッチの流れを始めた入力段について、出力段が受け取り終えたバッチ数
+	 *
+	 */
+	std::atomic<std::uint64_t>* consumed() const { return m_consumed; }
+
+  private:
+	using Clock = std::chrono::steady_clock;
+
+	std::size_t m_producers;
+	std::size_t m_consumers;
+	std::atomic<std::size_t> m_remaining;
+	std::atomic<bool> m_closed;
+	std::atomic<std::uint64_t>* m_consumed;
+	std::unique_ptr<SpscQueue<PipelineBatch<T>>> m_spsc;
+	std::unique_ptr<MpmcQueue<PipelineBatch<T>>> m_mpmc;
+
+	bool tryPush(PipelineBatch<T>& batch) { return m_spsc ? m_spsc->tryPush(batch) : m_mpmc->tryPush(batch); }
+	bool tryPop(PipelineBatch<T>& batch) { return m_spsc ? m_spsc->tryPop(batch) : m_mpmc->tryPop(batch); }
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,465 @@
+/**
+ * @file Reduction.hpp
+ * @author Kaiji Takeuchi
+ * @brief 評価結果を保存せずに集計するリダクション (統計・ヒストグラム・極値・領域ごとの集計)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 平均・分散を逐次計算する
+ * @ref B. P. Welford, "Note on a method for calculating corrected sums of squares and products", 1962
+ *
+ */
+class RunningStatistics {
+  public:
+	void add(double x) {
+		m_count++;
+		const double delta = x - m_mean;
+		m_mean += delta / static_cast<double>(m_count);
+		m_m2 += delta * (x - m_mean);
+		m_min = std::min(m_min, x);
+		m_max = std::max(m_max, x);
+	}
+
+	void add(std::size_t, double x) { add(x); }
+
+	/**
+	 * @brief 別に集計した統計を合わせる
+	 * @ref T. F. Chan et al., "Updating formulae and a pairwise algorithm for computing sample variances", 1979
+	 *
+	 */
+	void merge(const RunningStatistics& other) {
+		if (other.m_count == 0) {
+			return;
+		}
+		const std::size_t count = m_count + other.m_count;
+		const double delta = other.m_mean - m_mean;
+		m_mean += delta * static_cast<double>(other.m_count) / static_cast<double>(count);
+		m_m2 += other.m_m2 + delta * delta * static_cast<double>(m_count) * static_cast<double>(other.m_count) / static_cast<double>(count);
+		m_count = count;
+		m_min = std::min(m_min, other.m_min);
+		m_max = std::max(m_max, other.m_max);
+	}
+
+	std::size_t count() const { return m_count; }
+	double mean() const { return m_mean; }
+	double variance() const { return m_count > 1 ? m_m2 / static_cast<double>(m_count - 1) : 0.0; } // 不偏分散
+	double stddev() const { return std::sqrt(variance()); }
+	double min() const { return m_min; }
+	double max() const { return m_max; }
+
+  private:
+	std::size_t m_count = 0;
+	double m_mean = 0.0;
+	double m_m2 = 0.0;
+	double m_min = std::numeric_limits<double>::infinity();
+	double m_max = -std::numeric_limits<double>::infinity();
+};
+
+/**
+ * @brief 最小値・最大値とその要素番号
+ * @remark 同じ値なら小さい要素番号を残すので、集計の順序に依らない
+ *
+ */
+class ExtremaReduction {
+  public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	void add(std::size_t index, double value) {
+		if (value < m_min || (value == m_min && index < m_argmin)) {
+			m_min = value;
+			m_argmin = index;
+		}
+		if (value > m_max || (value == m_max && index < m_argmax)) {
+			m_max = value;
+			m_argmax = index;
+		}
+	}
+
+	void merge(const ExtremaReduction& other) {
+		if (other.m_argmin != npos) {
+			add(other.m_argmin, other.m_min);
+		}
+		if (other.m_argmax != npos) {
+			add(other.m_argmax, other.m_max);
+		}
+	}
+
+	double min() const { return m_min; }
+	double max() const { return m_max; }
+	std::size_t argmin() const { return m_argmin; } // 値がなければnpos
+	std::size_t argmax() const { return m_argmax; }
+
+  private:
+	double m_min = std::numeric_limits<double>::infinity();
+	double m_max = -std::numeric_limits<double>::infinity();
+	std::size_t m_argmin = npos;
+	std::size_t m_argmax = npos;
+};
+
+/**
+ * @brief 等間隔のヒストグラム
+ *
+ */
+class HistogramReduction {
+  public:
+	/**
+	 * @brief Construct a new Histogram Reduction object
+	 *
+	 * @param low 最初のビンの下端
+	 * @param high 最後のビンの上端
+	 * @param bins ビンの数
+	 */
+	HistogramReduction(double low, double high, std::size_t bins) : m_low(low), m_high(high), m_counts(bins, 0) {
+		if (!(high > low) || bins == 0) {
+			throw std::runtime_error("HistogramReduction: invalid range or number of bins");
+		}
+		m_scale = static_cast<double>(bins) / (high - low);
+	}
+
+	void add(std::size_t, double value) {
+		if (value >= m_low && value < m_high) {
+			const std::size_t bin = std::min(static_cast<std::size_t>((value - m_low) * m_scale), m_counts.size() - 1);
+			m_counts[bin]++;
+		} else if (value < m_low) {
+			m_underflow++;
+		} else if (value >= m_high) {
+			m_overflow++;
+		} else {
+			m_invalid++; // NaN
+		}
+	}
+
+	void merge(const HistogramReduction& other) {
+		if (other.m_counts.size() != m_counts.size() || other.m_low != m_low || other.m_high != m_high) {
+			throw std::runtime_error("HistogramReduction: cannot merge histograms with different bins");
+		}
+		for (std::size_t i = 0; i < m_counts.size(); i++) {
+			m_counts[i] += other.m_counts[i];
+		}
+		m_underflow += other.m_underflow;
+		m_overflow += other.m_overflow;
+		m_invalid += other.m_invalid;
+	}
+
+	const std::vector<std::uint64_t>& counts() const { return m_counts; }
+	std::size_t bins() const { return m_counts.size(); }
+	double binLow(std::size_t bin) const { return m_low + static_cast<double>(bin) / m_scale; }
+	double binHigh(std::size_t bin) const { return m_low + static_cast<double>(bin + 1) / m_scale; }
+	std::uint64_t underflow() const { return m_underflow; }
+	std::uint64_t overflow() const { return m_overflow; }
+	std::uint64_t invalid() const { return m_invalid; }
+
+  private:
+	double m_low, m_high, m_scale;
+	std::vector<std::uint64_t> m_counts;
+	std::uint64_t m_underflow = 0, m_overflow = 0, m_invalid = 0;
+};
+
+/**
+ * @brief ラベルのラスタで分けた領域ごとの集計
+ * @remark 要素番号iのラベルは labels[i % labels.size()]。格子を複数の時刻で評価する場合も同じラスタを繰り返し使える。
+ *         regions以上のラベル (陸・海のマスクなど) の要素は集計しない
+ *
+ * @tparam Reducer 領域ごとのリダクション
+ */
+template <typename Reducer>
+class RegionReduction {
+  public:
+	/**
+	 * @brief Construct a new Region Reduction object
+	 *
+	 * @param labels 要素ごとの領域番号 (並列に集計するときは複製せずに共有する)
+	 * @param regions 領域の数
+	 * @param prototype 領域ごとのリダクションの初期値
+	 */
+	RegionReduction(std::shared_ptr<const std::vector<std::uint32_t>> labels, std::size_t regions, const Reducer& prototype = Reducer{})
+	  : m_labels(std::move(labels)), m_regions(regions, prototype) {
+		if (!m_labels || m_labels->empty()) {
+			throw std::runtime_error("RegionReduction: label raster is empty");
+		}
+	}
+
+	void add(std::size_t index, double value) {
+		const std::uint32_t label = (*m_labels)[index % m_labels->size()];
+		if (label < m_regions.size()) {
+			m_regions[label].add(index, value);
+		}
+	}
+
+	void merge(const RegionReduction& other) {
+		if (other.m_regions.size() != m_regions.size()) {
+			throw std::runtime_error("RegionReduction: cannot merge different numbers of regions");
+		}
+		for (std::size_t i = 0; i < m_regions.size(); i++) {
+			m_regions[i].merge(other.m_regions[i]);
+		}
+	}
+
+	std::size_t regions() const { return m_regions.size(); }
+	const Reducer& region(std::size_t label) const { return m_regions[label]; }
+
+  private:
+	std::shared_ptr<const std::vector<std::uint32_t>> m_labels;
+	std::vector<Reducer> m_regions;
+};
+
+/**
+ * @brief 複数のリダクションを1回の評価でまとめて集計する
+ *
+ */
+template <typename... Reducers>
+class ReductionSet {
+  public:
+	explicit ReductionSet(const Reducers&... reducers) : m_reducers(reducers...) {}
+
+	void add(std::size_t index, double value) { apply([index, value](auto& reducer, const auto&) { reducer.add(index, value); }, m_reducers); }
+
+	void merge(const ReductionSet& other) {
+		apply([](auto& reducer, const auto& merged) { reducer.merge(merged); }, other.m_reducers);
+	}
+
+	template <std::size_t I>
+	auto get() const -> const typename std::tuple_element<I, std::tuple<Reducers...>>::type& {
+		return std::get<I>(m_reducers);
+	}
+
+  private:
+	std::tuple<Reducers...> m_reducers;
+
+	template <typename Func, std::size_t... I>
+	void apply(Func&& func, const std::tuple<Reducers...>& other, std::index_sequence<I...>) {
+		const int expand[] = {0, (func(std::get<I>(m_reducers), std::get<I>(other)), 0)...};
+		(void)expand;
+	}
+
+	template <typename Func>
+	void apply(Func&& func, const std::tuple<Reducers...>& other) {
+		apply(std::forward<Func>(func), other, std::index_sequence_for<Reducers...>{});
+	}
+};
+
+template <typename... Reducers>
+auto makeReductionSet(const Reducers&... reducers) -> ReductionSet<Reducers...> {
+	return ReductionSet<Reducers...>(reducers...);
+}
+
+/**
+ * @brief 集計する量
+ *
+ */
+enum class FieldQuantity {
+	North,		 // 北向き成分 [出力単位]
+	East,		 // 東向き成分 [出力単位]
+	Down,		 // 下向き成分 [出力単位]
+	Horizontal,	 // 水平分力 [出力単位]
+	Total,		 // 全磁力 [出力単位]
+	Inclination, // 伏角 [deg]
+	Declination, // 偏角 [deg]
+};
+
+/**
+ * @brief 磁束密度から量を取り出す
+ *
+ */
+struct FieldValue {
+	FieldQuantity quantity;
+
+	auto operator()(const Eigen::Vector3d& mag_density, Accuracy accuracy = Accuracy::Exact) const -> double {
+		switch (quantity) {
+			case FieldQuantity::North: return mag_density(0);
+			case FieldQuantity::East: return mag_density(1);
+			case FieldQuantity::Down: return mag_density(2);
+			default: break;
+		}
+		const MagFluxComponent component{mag_density, accuracy};
+		switch (quantity) {
+			case FieldQuantity::Horizontal: return component.horizontal;
+			case FieldQuantity::Inclination: return component.inclination.degrees();
+			case FieldQuantity::Declination: return component.declination.degrees();
+			default: return component.total;
+		}
+	}
+
+	/**
+	 * @brief 量に必要な成分だけを評価する
+	 * @remark 東向き成分はd_pの漸化式を、全磁力は測地座標系への回転を省く
+	 *
+	 */
+	template <typename Position>
+	auto operator()(GeoMagFlux& flux, const Position& position) const -> double {
+		switch (quantity) {
+			case FieldQuantity::North: return flux.field<FieldOutput::North | FieldOutput::Geodetic>(position).field(0);
+			case FieldQuantity::East: return flux.field<FieldOutput::East | FieldOutput::Geodetic>(position).field(1);
+			case FieldQuantity::Down: return flux.field<FieldOutput::Down | FieldOutput::Geodetic>(position).field(2);
+			case FieldQuantity::Total: return operator()(flux.field<FieldOutput::Vector>(position).field, flux.accuracy());
+			default: return operator()(flux(position), flux.accuracy());
+		}
+	}
+};
+
+/**
+ * @brief 量の年変化率 (永年変化) を中心差分で求める
+ * @remark 偏角・伏角の差は[-180, 180)度に折り返す
+ *
+ */
+struct SecularVariation {
+	FieldQuantity quantity;
+	TimeSpan span = Days(365.25); // 差分をとる時間幅
+
+	template <typename Position>
+	auto operator()(GeoMagFlux& flux, const Position& position) const -> double {
+		const std::int64_t half = span.ticks() / 2;
+		const DateTime before(position.epoch().ticks() - half), after(position.epoch().ticks() + half);
+		const FieldValue value{quantity};
+		double change = value(flux(Position(after, position.elements())), flux.accuracy()) -
+						value(flux(Position(before, position.elements())), flux.accuracy());
+		if (quantity == FieldQuantity::Inclination || quantity == FieldQuantity::Declination) {
+			change -= 360.0 * std::floor((change + 180.0) / 360.0);
+		}
+		return change / (static_cast<double>(2 * half) / constant::ticks_per_day / 365.25);
+	}
+};
+
+/**
+ * @brief 緯度経度の格子と時刻の組 (位置は要素番号から求め、配列を作らない)
+ * @remark 要素番号は ((時刻 * rows) + 行) * cols + 列。行は南から、列は西から並ぶ
+ *
+ */
+struct GeodeticGrid {
+	double south = -90.0;		 // 最初の行の緯度 [deg]
+	double west = -180.0;		 // 最初の列の経度 [deg]
+	double dlat = 1.0;			 // 緯度の間隔 [deg]
+	double dlon = 1.0;			 // 経度の間隔 [deg]
+	std::size_t rows = 181;		 // 緯度方向の点数
+	std::size_t cols = 360;		 // 経度方向の点数
+	double altitude = 0.0;		 // 楕円体高 [m]
+	std::vector<DateTime> epochs; // 時刻
+
+	std::size_t cells() const { return rows * cols; }
+	std::size_t size() const { return rows * cols * epochs.size(); }
+
+	auto position(std::size_t index) const -> Wgs84 {
+		const std::size_t cell = index % cells();
+		return Wgs84(epochs[index / cells()], Degree{west + dlon * static_cast<double>(cell % cols)},
+					 Degree{south + dlat * static_cast<double>(cell / cols)}, altitude);
+	}
+};
+
+/**
+ * @brief リダクションの設定
+ *
+ */
+struct ReductionConfig {
+	std::size_t partitions = 64; // 要素を分ける区間の数 (スレッド数に依らず固定するので結果は常に同じ)
+	std::size_t num_threads = 0; // スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief 評価結果を保存せずに集計する
+ * @remark リダクションは add(index, value) と merge(other) を持つ型。要素は設定の区間数で固定的に分け、各区間は1つのスレッドが順に集計し、
+ *         最後に区間の順に合わせるので、スレッド数や実行順に依らず同じ結果 (浮動小数点の丸めを含む) になる
+ *
+ */
+struct Reduction {
+	/**
+	 * @brief 要素番号から値を求めて集計する
+	 *
+	 * @param count 要素数
+	 * @param prototype リダクションの初期値
+	 * @param func func(thread_index, begin, end, reducer) で [begin, end) をreducerに加える
+	 * @param config 設定
+	 * @return Reducer 集計結果
+	 */
+	template <typename Reducer, typename Func>
+	static auto run(std::size_t count, const Reducer& prototype, Func&& func, const ReductionConfig& config = ReductionConfig{}) -> Reducer {
+		const std::size_t partitions = std::max<std::size_t>(std::min(config.partitions, count), 1);
+		std::vector<Reducer> partials(partitions, prototype);
+		Parallel::forEach(
+		  0, partitions,
+		  [&](std::size_t thread_index, std::size_t k) { func(thread_index, count * k / partitions, count * (k + 1) / partitions, partials[k]); },
+		  std::min(Parallel::threadCount(config.num_threads), partitions));
+
+		Reducer result = prototype;
+		for (const auto& partial : partials) {
+			result.merge(partial);
+		}
+		return result;
+	}
+
+	/**
+	 * @brief 位置から量を求めて集計する (軌道やスイープなど、位置を配列にしない場合)
+	 *
+	 * @param flux 評価器 (スレッドごとに複製する)
+	 * @param count 要素数
+	 * @param position Position position(index)
+	 * @param quantity double quantity(GeoMagFlux&, const Position&) (FieldValue, SecularVariationなど)
+	 * @param prototype リダクションの初期値
+	 * @param config 設定
+	 * @return Reducer 集計結果
+	 */
+	template <typename PositionFunc, typename Quantity, typename Reducer>
+	static auto generate(const GeoMagFlux& flux, std::size_t count, PositionFunc&& position, const Quantity& quantity, const Reducer& prototype,
+						 const ReductionConfig& config = ReductionConfig{}) -> Reducer {
+		std::vector<GeoMagFlux> evaluators(std::min(Parallel::threadCount(config.num_threads), std::max<std::size_t>(count, 1)), flux);
+		ReductionConfig run_config = config;
+		run_config.num_threads = evaluators.size();
+		return run(
+		  count, prototype,
+		  [&](std::size_t thread_index, std::size_t begin, std::size_t end, Reducer& reducer) {
+			  auto& evaluator = evaluators[thread_index];
+			  for (std::size_t i = begin; i < end; i++) {
+				  reducer.add(i, quantity(evaluator, position(i)));
+			  }
+		  },
+		  run_config);
+	}
+
+	/**
+	 * @brief 位置の配列で評価して集計する
+	 *
+	 */
+	template <typename Position, typename Quantity, typename Reducer>
+	static auto evaluate(const GeoMagFlux& flux, const std::vector<Position>& positions, const Quantity& quantity, const Reducer& prototype,
+						 const ReductionConfig& config = ReductionConfig{}) -> Reducer {
+		return generate(
+		  flux, positions.size(), [&positions](std::size_t i) -> const Position& { return positions[i]; }, quantity, prototype, config);
+	}
+
+	/**
+	 * @brief 格子と時刻の組で評価して集計する
+	 * @remark RegionReductionのラベルのラスタは格子の1時刻分 (rows * cols) と同じ並びにする
+	 *
+	 */
+	template <typename Quantity, typename Reducer>
+	static auto evaluate(const GeoMagFlux& flux, const GeodeticGrid& grid, const Quantity& quantity, const Reducer& prototype,
+						 const ReductionConfig& config = ReductionConfig{}) -> Reducer {
+		return generate(
+		  flux, grid.size(), [&grid](std::size_t i) { return grid.position(i); }, quantity, prototype, config);
+	}
+};
+
+GEOMAG_NAMESPACE_END
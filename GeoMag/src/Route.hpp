@@ -0,0 +1,379 @@
+/**
+ * @file Route.hpp
+ * @author Kaiji Takeuchi
+ * @brief 航路に沿った磁場の適応サンプリング
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 区間の種類
+ *
+ */
+enum class LegType {
+	GreatCircle, // 大圏航路
+	Rhumb,		 // 航程線 (等角航路)
+};
+
+/**
+ * @brief 経由点
+ * @remark 高度は次の経由点まで区間の長さに比例して線形に変化する
+ *
+ */
+struct Waypoint {
+	Angle longitude;					  // 経度 (WGS84)
+	Angle latitude;						  // 緯度 (WGS84)
+	double altitude;					  // 高度 [m]
+	LegType leg_type = LegType::GreatCircle; // 次の経由点までの区間の種類
+};
+
+/**
+ * @brief 経由点を結んだ航路
+ * @remark 区間の形状と長さは平均半径の球で計算する
+ *
+ */
+class Route {
+  public:
+	static constexpr double earth_radius = 6371008.8; // 平均半径 [m]
+
+	/**
+	 * @brief Construct a new Route object
+	 *
+	 * @param epoch 磁場を評価する時刻
+	 * @param waypoints 経由点 (2点以上)
+	 */
+	Route(const DateTime& epoch, const std::vector<Waypoint>& waypoints) : m_epoch(epoch), m_waypoints(waypoints) {
+		if (m_waypoints.size() < 2) {
+			throw std::runtime_error("Route: at least two waypoints are required.");
+		}
+		m_leg_offsets.assign(1, 0.0);
+		for (std::size_t i = 0; i + 1 < m_waypoints.size(); i++) {
+			m_leg_offsets.push_back(m_leg_offsets.back() + legLength(i));
+		}
+	}
+
+	const DateTime& epoch() const { return m_epoch; }
+	const std::vector<Waypoint>& waypoints() const { return m_waypoints; }
+	std::size_t legCount() const { return m_waypoints.size() - 1; }
+
+	/**
+	 * @brief 航路の全長 [m]
+	 *
+	 */
+	double length() const { return m_leg_offsets.back(); }
+
+	/**
+	 * @brief 区間の開始点までの距離 [m]
+	 *
+	 */
+	double legOffset(std::size_t leg) const { return m_leg_offsets.at(leg); }
+
+	/**
+	 * @brief 区間の長さ [m]
+	 *
+	 * @param leg 区間番号
+	 */
+	double legLength(std::size_t leg) const {
+		const auto& from = m_waypoints.at(leg);
+		const auto& to = m_waypoints.at(leg + 1);
+		const double lat0 = from.latitude.radians(), lat1 = to.latitude.radians();
+		const double d_lon = AngleHelper::wrapRadian(to.longitude.radians() - from.longitude.radians() + constant::pi) - constant::pi;
+
+		if (from.leg_type == LegType::GreatCircle) {
+			return earth_radius * centralAngle(from, to);
+		}
+
+		const double d_lat = lat1 - lat0;
+		const double d_psi = mercator(lat1) - mercator(lat0);
+		const double q = std::abs(d_psi) > 1e-12 ? d_lat / d_psi : std::cos(lat0);
+		return earth_radius * std::sqrt(d_lat * d_lat + q * q * d_lon * d_lon);
+	}
+
+	/**
+	 * @brief 区間上の位置を求める
+	 * @remark fractionは区間の長さに比例する
+	 *
+	 * @param leg 区間番号
+	 * @param fraction 区間内の割合 [0, 1]
+	 * @return Wgs84 位置
+	 */
+	Wgs84 position(std::size_t leg, double fraction) const {
+		const auto& from = m_waypoints.at(leg);
+		const auto& to = m_waypoints.at(leg + 1);
+		const double altitude = from.altitude + (to.altitude - from.altitude) * fraction;
+		const double lat0 = from.latitude.radians(), lon0 = from.longitude.radians();
+		const double lat1 = to.latitude.radians();
+		const double d_lon = AngleHelper::wrapRadian(to.longitude.radians() - lon0 + constant::pi) - constant::pi;
+
+		double lat, lon;
+		if (from.leg_type == LegType::GreatCircle) {
+			// 単位ベクトルの球面線形補間
+			const Eigen::Vector3d v0 = unitVector(from), v1 = unitVector(to);
+			const double delta = centralAngle(from, to);
+			Eigen::Vector3d v;
+			if (delta < 1e-12) {
+				v = v0;
+			} else {
+				v = (std::sin((1.0 - fraction) * delta) * v0 + std::sin(fraction * delta) * v1) / std::sin(delta);
+			}
+			lat = std::atan2(v.z(), std::sqrt(v.x() * v.x() + v.y() * v.y()));
+			lon = std::atan2(v.y(), v.x());
+		} else {
+			// 緯度について線形にとると距離に比例する。経度はメルカトル緯度に比例させる
+			lat = lat0 + (lat1 - lat0) * fraction;
+			const double d_psi = mercator(lat1) - mercator(lat0);
+			if (std::abs(d_psi) > 1e-12) {
+				lon = lon0 + d_lon * (mercator(lat) - mercator(lat0)) / d_psi;
+			} else {
+				lon = lon0 + d_lon * fraction;
+			}
+			lon = AngleHelper::wrapRadian(lon + constant::pi) - constant::pi;
+		}
+		return Wgs84{m_epoch, Radian{lon}, Radian{lat}, altitude};
+	}
+
+  private:
+	DateTime m_epoch;
+	std::vector<Waypoint> m_waypoints;
+	std::vector<double> m_leg_offsets; // 区間の開始点までの距離 [m]
+
+	static auto unitVector(const Waypoint& w) -> Eigen::Vector3d {
+		const double c = w.latitude.cos();
+		return Eigen::Vector3d{c * w.longitude.cos(), c * w.longitude.sin(), w.latitude.sin()};
+	}
+
+	static auto centralAngle(const Waypoint& from, const Waypoint& to) -> double {
+		const Eigen::Vector3d v0 = unitVector(from), v1 = unitVector(to);
+		return std::atan2(v0.cross(v1).norm(), v0.dot(v1));
+	}
+
+	static auto mercator(double lat) -> double {
+		constexpr double limit = constant::pi / 2 - 1e-9;
+		lat = std::max(-limit, std::min(limit, lat));
+		return std::log(std::tan(constant::pi / 4 + lat / 2));
+	}
+};
+
+/**
+ * @brief 航路上のサンプル点
+ *
+ */
+struct RouteSample {
+	std::size_t leg;			   // 区間番号
+	double fraction;			   // 区間内の割合
+	double distance;			   // 航路の始点からの距離 [m]
+	Wgs84Position position;		   // 位置
+	Eigen::Vector3d mag_density;   // 磁束密度 (測地座標系のNED) [出力単位]
+	Angle declination;			   // 偏角
+	double intensity;			   // 全磁力 [出力単位]
+};
+
+/**
+ * @brief 航路サンプリングの設定
+ *
+ */
+struct RouteSamplingConfig {
+	Angle declination_tolerance = Degree{0.1}; // 隣り合うサンプル間の偏角の変化と補間誤差の上限
+	double intensity_tolerance = 10.0;		   // 隣り合うサンプル間の全磁力の変化と補間誤差の上限 [nT]
+	double min_spacing = 100.0;				   // これより短い区間は分割しない [m]
+	double max_spacing = 0.0;				   // サンプル間隔の上限 [m] (0の場合は制限しない)
+	std::size_t num_threads = 0;			   // スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief 航路に沿って磁場を適応的にサンプリングする
+ * @remark 勾配から必要な分割数を見積もって分割し、中点で線形補間の誤差を確かめる。最後に評価済みの全点で許容誤差を満たす範囲でサンプルを間引く
+ *
+ */
+class RouteSampler {
+  public:
+	/**
+	 * @brief Construct a new Route Sampler object
+	 *
+	 * @param flux 磁場モデル (出力単位と精度もこれに従う)
+	 * @param config 設定
+	 */
+	RouteSampler(const GeoMagFlux& flux, const RouteSamplingConfig& config = RouteSamplingConfig{}) : m_flux(flux), m_config(config) {
+		if (!(m_config.declination_tolerance.radians() > 0.0) || !(m_config.intensity_tolerance > 0.0)) {
+			throw std::runtime_error("RouteSampler: tolerances must be positive.");
+		}
+	}
+
+	/**
+	 * @brief 航路をサンプリングする
+	 * @remark 区間ごとに並列に処理する
+	 *
+	 * @param route 航路
+	 * @return std::vector<RouteSample> 距離順のサンプル
+	 */
+	std::vector<RouteSample> sample(const Route& route) const { return sample(std::vector<Route>{route}).front(); }
+
+	/**
+	 * @brief 複数の航路をサンプリングする
+	 * @remark 全航路の区間をまとめて並列に処理する
+	 *
+	 * @param routes 航路
+	 * @return std::vector<std::vector<RouteSample>> 航路ごとの距離順のサンプル
+	 */
+	std::vector<std::vector<RouteSample>> sample(const std::vector<Route>& routes) const {
+		struct Task {
+			std::size_t route;
+			std::size_t leg;
+		};
+		std::vector<Task> tasks;
+		for (std::size_t r = 0; r < routes.size(); r++) {
+			for (std::size_t l = 0; l < routes[r].legCount(); l++) {
+				tasks.push_back(Task{r, l});
+			}
+		}
+
+		std::vector<std::vector<RouteSample>> leg_samples(tasks.size());
+		std::vector<GeoMagFlux> evaluators(std::min(Parallel::threadCount(m_config.num_threads), std::max<std::size_t>(tasks.size(), 1)), m_flux);
+		Parallel::forEach(
+		  0, tasks.size(),
+		  [&](std::size_t thread_index, std::size_t i) {
+			  leg_samples[i] = sampleLeg(routes[tasks[i].route], tasks[i].leg, evaluators[thread_index]);
+		  },
+		  evaluators.size());
+
+		// 区間の境界の経由点は前の区間の終点と次の区間の始点で重複するので1つにまとめる
+		std::vector<std::vector<RouteSample>> result(routes.size());
+		for (std::size_t i = 0; i < tasks.size(); i++) {
+			auto& samples = result[tasks[i].route];
+			const auto begin = samples.empty() ? leg_samples[i].begin() : leg_samples[i].begin() + 1;
+			samples.insert(samples.end(), begin, leg_samples[i].end());
+		}
+		return result;
+	}
+
+  private:
+	GeoMagFlux m_flux;
+	RouteSamplingConfig m_config;
+
+	static constexpr std::size_t max_pieces = 16; // 勾配から見積もる1回の分割数の上限
+
+	static auto angleDifference(const Angle& a, const Angle& b) -> double {
+		return AngleHelper::wrapRadian(a.radians() - b.radians() + constant::pi) - constant::pi;
+	}
+
+	RouteSample evaluate(const Route& route, std::size_t leg, double fraction, GeoMagFlux& flux) const {
+		const Wgs84 position = route.position(leg, fraction);
+		const Eigen::Vector3d mag_density = flux(position);
+		const MagFluxComponent component{mag_density, flux.accuracy()};
+		return RouteSample{leg,		 fraction, route.legOffset(leg) + fraction * route.legLength(leg), position.elements(), mag_density,
+						   component.declination, component.total};
+	}
+
+	/**
+	 * @brief 2点間の変化量を許容値で割った値
+	 *
+	 */
+	double change(const RouteSample& a, const RouteSample& b) const {
+		const double declination = std::abs(angleDifference(b.declination, a.declination)) / m_config.declination_tolerance.radians();
+		const double intensity = std::abs(b.intensity - a.intensity) / (m_config.intensity_tolerance * m_flux.unitScale());
+		return std::max(declination, intensity);
+	}
+
+	/**
+	 * @brief a-b間の線形補間に対するcの誤差を許容値で割った値
+	 *
+	 */
+	double interpolationError(const RouteSample& a, const RouteSample& b, const RouteSample& c) const {
+		const double t = (c.fraction - a.fraction) / (b.fraction - a.fraction);
+		const double declination = a.declination.radians() + t * angleDifference(b.declination, a.declination);
+		const double intensity = a.intensity + t * (b.intensity - a.intensity);
+		const double e_declination = std::abs(AngleHelper::wrapRadian(c.declination.radians() - declination + constant::pi) - constant::pi);
+		return std::max(e_declination / m_config.declination_tolerance.radians(),
+						std::abs(c.intensity - intensity) / (m_config.intensity_tolerance * m_flux.unitScale()));
+	}
+
+	void refine(const Route& route, std::size_t leg, const RouteSample& a, const RouteSample& b, GeoMagFlux& flux,
+				std::vector<RouteSample>& evaluated) const {
+		const double length = (b.fraction - a.fraction) * route.legLength(leg);
+		if (length <= m_config.min_spacing) {
+			return;
+		}
+
+		double need = change(a, b);
+		if (m_config.max_spacing > 0.0) {
+			need = std::max(need, length / m_config.max_spacing);
+		}
+
+		if (need > 1.0) {
+			// 勾配が一定とみなして必要な分割数を見積もる
+			const std::size_t pieces = std::min(static_cast<std::size_t>(std::ceil(need)), std::size_t{max_pieces});
+			RouteSample prev = a;
+			for (std::size_t i = 1; i <= pieces; i++) {
+				const RouteSample next =
+				  i == pieces ? b : evaluate(route, leg, a.fraction + (b.fraction - a.fraction) * i / static_cast<double>(pieces), flux);
+				if (i != pieces) {
+					evaluated.push_back(next);
+				}
+				refine(route, leg, prev, next, flux, evaluated);
+				prev = next;
+			}
+			return;
+		}
+
+		// 変化量が許容値以内でも区間内で折り返していないか中点で確かめる
+		const RouteSample mid = evaluate(route, leg, (a.fraction + b.fraction) / 2.0, flux);
+		evaluated.push_back(mid);
+		if (interpolationError(a, b, mid) > 1.0) {
+			refine(route, leg, a, mid, flux, evaluated);
+			refine(route, leg, mid, b, flux, evaluated);
+		}
+	}
+
+	std::vector<RouteSample> sampleLeg(const Route& route, std::size_t leg, GeoMagFlux& flux) const {
+		std::vector<RouteSample> evaluated;
+		const RouteSample first = evaluate(route, leg, 0.0, flux);
+		const RouteSample last = evaluate(route, leg, 1.0, flux);
+		evaluated.push_back(first);
+		evaluated.push_back(last);
+		refine(route, leg, first, last, flux, evaluated);
+		std::sort(evaluated.begin(), evaluated.end(), [](const RouteSample& a, const RouteSample& b) { return a.fraction < b.fraction; });
+
+		// 評価済みの全点で許容値を満たす限り、なるべく遠くの点まで1区間で結ぶ
+		std::vector<RouteSample> samples{evaluated.front()};
+		std::size_t anchor = 0;
+		while (anchor + 1 < evaluated.size()) {
+			std::size_t reach = anchor + 1;
+			for (std::size_t j = anchor + 2; j < evaluated.size(); j++) {
+				const double length = (evaluated[j].fraction - evaluated[anchor].fraction) * route.legLength(leg);
+				if (change(evaluated[anchor], evaluated[j]) > 1.0 || (m_config.max_spacing > 0.0 && length > m_config.max_spacing)) {
+					break;
+				}
+				bool ok = true;
+				for (std::size_t k = anchor + 1; k < j && ok; k++) {
+					ok = interpolationError(evaluated[anchor], evaluated[j], evaluated[k]) <= 1.0;
+				}
+				if (!ok) {
+					break;
+				}
+				reach = j;
+			}
+			samples.push_back(evaluated[reach]);
+			anchor = reach;
+		}
+		return samples;
+	}
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,316 @@
+/**
+ * @file SpatialOrder.hpp
+ * @author Kaiji Takeuchi
+ * @brief バッチの問い合わせを空間充填曲線の順に並べ替える前処理
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "Parallel.hpp"
+#include "TimeSpan.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 空間充填曲線の種類
+ *
+ */
+enum class SpaceCurve {
+	Morton,	 // ビットを交互に並べる (計算が軽い)
+	Hilbert, // 隣り合う番号が常に隣り合うセルになる (局所性が高い)
+};
+
+/**
+ * @brief 並べ替えの設定
+ *
+ */
+struct SpatialOrderConfig {
+	SpaceCurve curve = SpaceCurve::Hilbert;
+	unsigned bits = 16;				  // 軸ごとのビット数 (1以上21以下、エポックの区分に使うビットの分だけ減らす)
+	TimeSpan epoch_bucket = TimeSpan(0); // 正の場合、この幅でエポックを区分し、区分の順に並べてから区分内を曲線の順に並べる
+	std::size_t num_threads = 0;		 // スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief 空間充填曲線の番号
+ *
+ */
+struct SpaceCurveHelper {
+	/**
+	 * @brief 下位21ビットを3ビットおきに広げる
+	 *
+	 */
+	static std::uint64_t spread(std::uint64_t x) {
+		x &= 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffffULL;
+		x = (x | x << 16) & 0x1f0000ff0000ffULL;
+		x = (x | x << 8) & 0x100f00f00f00f00fULL;
+		x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+		x = (x | x << 2) & 0x1249249249249249ULL;
+		return x;
+	}
+
+	static std::uint64_t morton(std::uint32_t x, std::uint32_t y, std::uint32_t z) { return spread(x) << 2 | spread(y) << 1 | spread(z); }
+
+	/**
+	 * @brief 3次元のヒルベルト曲線の番号
+	 * @remark 座標を転置形式に変換してからビットを交互に並べる (Skilling, "Programming the Hilbert curve", 2004)
+	 *
+	 * @param bits 軸ごとのビット数
+	 */
+	static std::uint64_t hilbert(std::uint32_t x, std::uint32_t y, std::uint32_t z, unsigned bits) {
+		std::uint32_t axes[3] = {x, y, z};
+		const std::uint32_t top = 1u << (bits - 1);
+		for (std::uint32_t q = top; q > 1; q >>= 1) {
+			const std::uint32_t p = q - 1;
+			// ビットが立っていればaxes[0]の下位を反転、立っていなければaxes[0]と下位を交換する (分岐の予測が当たらないので分岐しない)
+			for (auto& axis : axes) {
+				const std::uint32_t set = 0u - ((axis & q) != 0);
+				const std::uint32_t t = (axes[0] ^ axis) & p & ~set;
+				axes[0] ^= (p & set) | t;
+				axis ^= t;
+			}
+		}
+		axes[1] ^= axes[0];
+		axes[2] ^= axes[1];
+		std::uint32_t t = 0;
+		for (std::uint32_t q = top; q > 1; q >>= 1) {
+			if (axes[2] & q) {
+				t ^= q - 1;
+			}
+		}
+		for (auto& axis : axes) {
+			axis ^= t;
+		}
+		return morton(axes[0], axes[1], axes[2]);
+	}
+};
+
+/**
+ * @brief バッチの問い合わせの順列
+ * @remark 各問い合わせの曲線の番号 (とエポックの区分) を64ビットのキーにして、基数ソートでO(N)で並べる。
+ *         同じ配置のバッチを繰り返す場合は、一度作った順列をそのまま使い回せる
+ *
+ */
+class SpatialOrder {
+  public:
+	SpatialOrder() = default;
+
+	/**
+	 * @brief 位置の配列から順列を作る
+	 * @remark Wgs84は (緯度, 経度, 高度)、Ecef/Eciは (x, y, z) をバッチの外接箱で正規化して曲線の番号にする
+	 *
+	 * @tparam Position 位置の型 (Wgs84, Ecef, Eci)
+	 * @param positions 位置の配列
+	 * @param config 設定
+	 * @return SpatialOrder 順列
+	 */
+	template <typename Position>
+	static SpatialOrder build(const std::vector<Position>& positions, const SpatialOrderConfig& config = SpatialOrderConfig{}) {
+		if (config.bits < 1 || config.bits > 21 || config.epoch_bucket.ticks() < 0) {
+			throw std::runtime_error("SpatialOrder: invalid configuration.");
+		}
+		const std::size_t size = positions.size();
+		SpatialOrder order;
+		order.m_order.resize(size);
+		if (size == 0) {
+			return order;
+		}
+		const std::size_t threads = Parallel::threadCount(config.num_threads);
+
+		// 外接箱とエポックの範囲
+		Eigen::Vector3d lower = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity()), upper = -lower;
+		std::int64_t first_epoch = std::numeric_limits<std::int64_t>::max(), last_epoch = std::numeric_limits<std::int64_t>::min();
+		for (const auto& position : positions) {
+			const Eigen::Vector3d c = coordinates(position);
+			lower = lower.cwiseMin(c);
+			upper = upper.cwiseMax(c);
+			first_epoch = std::min(first_epoch, position.epoch().ticks());
+			last_epoch = std::max(last_epoch, position.epoch().ticks());
+		}
+
+		const std::int64_t bucket = config.epoch_bucket.ticks();
+		const std::uint64_t buckets = bucket > 0 ? static_cast<std::uint64_t>((last_epoch - first_epoch) / bucket) + 1 : 1;
+		const unsigned bucket_bits = bitWidth(buckets - 1);
+		if (bucket_bits > 61) {
+			throw std::runtime_error("SpatialOrder: too many epoch buckets.");
+		}
+		const unsigned bits = std::min(config.bits, (64 - bucket_bits) / 3);
+		const unsigned curve_bits = 3 * bits;
+		const double cells = static_cast<double>((1u << bits) - 1);
+		Eigen::Vector3d scale;
+		for (int k = 0; k < 3; k++) {
+			scale(k) = upper(k) > lower(k) ? cells / (upper(k) - lower(k)) : 0.0;
+		}
+
+		std::vector<std::uint64_t> keys(size);
+		Parallel::forEachChunk(
+		  0, size, 4096,
+		  [&](std::size_t, std::size_t b, std::size_t e) {
+			  for (std::size_t i = b; i < e; i++) {
+				  const Eigen::Vector3d c = (coordinates(positions[i]) - lower).cwiseProduct(scale);
+				  const std::uint32_t x = static_cast<std::uint32_t>(c(0) + 0.5), y = static_cast<std::uint32_t>(c(1) + 0.5),
+									  z = static_cast<std::uint32_t>(c(2) + 0.5);
+				  std::uint64_t key = config.curve == SpaceCurve::Hilbert ? SpaceCurveHelper::hilbert(x, y, z, bits) : SpaceCurveHelper::morton(x, y, z);
+				  if (bucket > 0) {
+					  key |= static_cast<std::uint64_t>((positions[i].epoch().ticks() - first_epoch) / bucket) << curve_bits;
+				  }
+				  keys[i] = key;
+			  }
+		  },
+		  threads);
+
+		for (std::size_t i = 0; i < size; i++) {
+			order.m_order[i] = i;
+		}
+		radixSort(keys, order.m_order, curve_bits + bucket_bits);
+		return order;
+	}
+
+	/**
+	 * @brief k番目に評価する問い合わせの元の番号
+	 *
+	 */
+	const std::vector<std::size_t>& order() const { return m_order; }
+	std::size_t size() const { return m_order.size(); }
+
+	/**
+	 * @brief 並べ替える (sorted[k] = values[order[k]])
+	 *
+	 */
+	template <typename T>
+	std::vector<T> gather(const std::vector<T>& values, std::size_t num_threads = 0) const {
+		check(values.size());
+		std::vector<T> sorted(values); // 既定のコンストラクタが重い型もあるので複製してから上書きする
+		Parallel::forEachChunk(
+		  0, size(), 4096,
+		  [&](std::size_t, std::size_t b, std::size_t e) {
+			  for (std::size_t k = b; k < e; k++) {
+				  sorted[k] = values[m_order[k]];
+			  }
+		  },
+		  Parallel::threadCount(num_threads));
+		return sorted;
+	}
+
+	/**
+	 * @brief 元の順に戻す (values[order[k]] = sorted[k])
+	 *
+	 */
+	template <typename T>
+	std::vector<T> scatter(const std::vector<T>& sorted, std::size_t num_threads = 0) const {
+		check(sorted.size());
+		std::vector<T> values(sorted);
+		Parallel::forEachChunk(
+		  0, size(), 4096,
+		  [&](std::size_t, std::size_t b, std::size_t e) {
+			  for (std::size_t k = b; k < e; k++) {
+				  values[m_order[k]] = sorted[k];
+			  }
+		  },
+		  Parallel::threadCount(num_threads));
+		return values;
+	}
+
+	/**
+	 * @brief 並べ替えた順に評価し、結果を元の順に戻す
+	 *
+	 * @param positions 位置の配列
+	 * @param results 結果の配列 (元の順)
+	 * @param evaluate evaluate(sorted_positions, sorted_results) で並べ替えた配列を評価する関数
+	 */
+	template <typename Position, typename Result, typename Func>
+	void apply(const std::vector<Position>& positions, std::vector<Result>& results, Func&& evaluate, std::size_t num_threads = 0) const {
+		const std::vector<Position> sorted = gather(positions, num_threads);
+		std::vector<Result> sorted_results;
+		evaluate(sorted, sorted_results);
+		results = scatter(sorted_results, num_threads);
+	}
+
+	/**
+	 * @brief evaluate(positions, results, num_threads) を持つ評価器 (GeoMagFlux, MemoizedGeoMagFluxなど) で評価する
+	 *
+	 */
+	template <typename Evaluator, typename Position, typename Result>
+	void evaluate(const Evaluator& evaluator, const std::vector<Position>& positions, std::vector<Result>& results, std::size_t num_threads = 0) const {
+		apply(
+		  positions, results, [&](const std::vector<Position>& sorted, std::vector<Result>& out) { evaluator.evaluate(sorted, out, num_threads); },
+		  num_threads);
+	}
+
+  private:
+	static constexpr unsigned radix_bits = 11;
+
+	std::vector<std::size_t> m_order;
+
+	static Eigen::Vector3d coordinates(const Wgs84& position) {
+		return Eigen::Vector3d{position.latitude().degrees(), position.longitude().degrees(), position.altitude()};
+	}
+	static Eigen::Vector3d coordinates(const Ecef& position) { return position.elements(); }
+	static Eigen::Vector3d coordinates(const Eci& position) { return position.elements(); }
+
+	static unsigned bitWidth(std::uint64_t value) {
+		unsigned width = 0;
+		while (value != 0) {
+			width++;
+			value >>= 1;
+		}
+		return width;
+	}
+
+	void check(std::size_t count) const {
+		if (count != size()) {
+			throw std::runtime_error("SpatialOrder: batch size differs from the permutation.");
+		}
+	}
+
+	/**
+	 * @brief LSD基数ソート (安定)。全要素で同じ桁は飛ばす
+	 *
+	 */
+	static void radixSort(std::vector<std::uint64_t>& keys, std::vector<std::size_t>& order, unsigned key_bits) {
+		constexpr std::size_t buckets = std::size_t{1} << radix_bits;
+		const std::size_t size = keys.size();
+		std::vector<std::uint64_t> next_keys(size);
+		std::vector<std::size_t> next_order(size);
+		std::vector<std::size_t> count(buckets);
+		for (unsigned shift = 0; shift < key_bits; shift += radix_bits) {
+			std::fill(count.begin(), count.end(), 0);
+			for (std::size_t i = 0; i < size; i++) {
+				count[(keys[i] >> shift) & (buckets - 1)]++;
+			}
+			if (std::find(count.begin(), count.end(), size) != count.end()) {
+				continue;
+			}
+			std::size_t offset = 0;
+			for (auto& c : count) {
+				const std::size_t n = c;
+				c = offset;
+				offset += n;
+			}
+			for (std::size_t i = 0; i < size; i++) {
+				const std::size_t slot = count[(keys[i] >> shift) & (buckets - 1)]++;
+				next_keys[slot] = keys[i];
+				next_order[slot] = order[i];
+			}
+			keys.swap(next_keys);
+			order.swap(next_order);
+		}
+	}
+};
+
+GEOMAG_NAMESPACE_END
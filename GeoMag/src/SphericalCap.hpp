@@ -0,0 +1,584 @@
+/**
+ * @file SphericalCap.hpp
+ * @author Kaiji Takeuchi
+ * @brief 球冠調和解析 (SCHA) による地域磁場モデル
+ * @ref G. V. Haines, "Spherical cap harmonic analysis", J. Geophys. Res., 90(B3), 2583-2591, 1985.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 球冠調和展開の1項
+ *
+ */
+struct SphericalCapTerm {
+	std::size_t k; // 指数 (k >= m)
+	std::size_t m; // 位数
+	double n;	   // 実数次数 n_k(m)
+	double g;	   // cos(m*lambda)の係数 [nT]
+	double h;	   // sin(m*lambda)の係数 [nT]
+};
+
+/**
+ * @brief 球冠調和解析 (SCHA) による地域磁場モデル
+ * @remark 次数が非整数なのでルジャンドル陪関数は超幾何級数で計算する。級数係数は球冠ごとに前計算しておく
+ * @remark 球冠座標系の経度はキャップ極から地理的な南へ向かう大円を0とする
+ *
+ */
+class SphericalCapModel {
+  public:
+	static constexpr std::size_t block_size = 64; // バッチ評価で一度に処理する点数
+
+	/**
+	 * @brief Construct a new Spherical Cap Model object
+	 *
+	 * @param pole_latitude キャップ極の地心緯度
+	 * @param pole_longitude キャップ極の経度
+	 * @param half_angle キャップの半頂角 (90度以下)
+	 * @param terms 展開係数
+	 * @param reference_radius 基準半径 [m]
+	 */
+	SphericalCapModel(const Angle& pole_latitude, const Angle& pole_longitude, const Angle& half_angle,
+					  const std::vector<SphericalCapTerm>& terms, double reference_radius = 6371.2e3) {
+		initialize(pole_latitude.radians(), pole_longitude.radians(), half_angle.radians(), terms, reference_radius);
+	}
+
+	/**
+	 * @brief 入力ストリームからモデルを読み込みモデルを生成する
+	 * @remark 1行目: 極の緯度 [deg] 極の経度 [deg] 半頂角 [deg] 基準半径 [km]、以降の行: k m [n] g h。nを省略した場合は根を探索して求める
+	 *
+	 * @param is
+	 */
+	SphericalCapModel(std::istream& is) { read(is); }
+
+	/**
+	 * @brief 球冠の境界条件を満たす実数次数を求める
+	 * @remark k-mが偶数ならdP/dθ(θ0)=0、奇数ならP(θ0)=0の根を小さい順に割り当てる
+	 *
+	 * @param half_angle キャップの半頂角 (90度以下)
+	 * @param m 位数
+	 * @param max_index 最大の指数k
+	 * @return std::vector<double> k = m, ..., max_indexに対応する次数
+	 */
+	static auto degrees(const Angle& half_angle, std::size_t m, std::size_t max_index) -> std::vector<double> {
+		const double theta0 = half_angle.radians();
+		if (!(theta0 > 0.0) || theta0 > constant::pi / 2 + 1e-12) {
+			throw std::runtime_error("SphericalCapModel: half angle must be in (0, 90] degrees.");
+		}
+		if (max_index < m) {
+			return {};
+		}
+
+		std::vector<double> roots_p, roots_dp;
+		const std::size_t needed = max_index - m + 1;
+		const std::size_t needed_p = needed / 2, needed_dp = (needed + 1) / 2;
+
+		// m=0ではn=0が自明な根になる
+		double n = static_cast<double>(m) - 0.25;
+		if (m == 0) {
+			roots_dp.push_back(0.0);
+			n = 0.25;
+		}
+
+		// 同じ種類の根の間隔はおよそπ/θ0なので、その1/20刻みで符号変化を探す
+		const double step = constant::pi / theta0 / 20.0;
+		double f_p = boundaryValue(n, m, theta0, false), f_dp = boundaryValue(n, m, theta0, true);
+		while (roots_p.size() < needed_p || roots_dp.size() < needed_dp) {
+			const double next = n + step;
+			const double g_p = boundaryValue(next, m, theta0, false), g_dp = boundaryValue(next, m, theta0, true);
+			if (f_p * g_p <= 0.0) {
+				roots_p.push_back(bisect(n, next, m, theta0, false));
+			}
+			if (f_dp * g_dp <= 0.0) {
+				roots_dp.push_back(bisect(n, next, m, theta0, true));
+			}
+			n = next;
+			f_p = g_p;
+			f_dp = g_dp;
+		}
+
+		std::vector<double> result(needed);
+		for (std::size_t i = 0; i < needed; i++) {
+			result[i] = (i % 2 == 0) ? roots_dp[i / 2] : roots_p[i / 2];
+		}
+		return result;
+	}
+
+	/**
+	 * @brief 位置が球冠の内側にあるか
+	 *
+	 * @param position ECEF座標系での位置
+	 */
+	bool contains(const Ecef& position) const {
+		const Eigen::Vector3d q = m_rotation * position.elements();
+		return q.z() >= m_cos_half_angle * q.norm();
+	}
+
+	/**
+	 * @brief 任意位置での地域磁場を取得する
+	 *
+	 * @param position ECEF座標系での位置
+	 * @return Eigen::Vector3d 地心球座標系でのNED成分 [nT]
+	 */
+	Eigen::Vector3d operator()(const Ecef& position) const {
+		Eigen::Vector3d mag_density;
+		evaluateBlock(&position.elements(), nullptr, 1, &mag_density);
+		return mag_density;
+	}
+
+	/**
+	 * @brief 任意位置での地域磁場を取得する
+	 *
+	 * @param position WGS84回転楕円座標系での位置
+	 * @return Eigen::Vector3d 測地座標系でのNED成分 [nT]
+	 */
+	Eigen::Vector3d operator()(const Wgs84& position) const {
+		const Eigen::Vector3d ecef = position.toEcef().elements();
+		const double delta = geodeticDelta(position, ecef);
+		Eigen::Vector3d mag_density;
+		evaluateBlock(&ecef, &delta, 1, &mag_density);
+		return mag_density;
+	}
+
+	/**
+	 * @brief 複数の位置での地域磁場をまとめて取得する
+	 * @remark block_size点ごとに項を外側、点を内側にしたループで評価し、項ごとの級数係数と正規化係数の読み込みを点で共有する
+	 *
+	 * @tparam Position 位置の型 (EcefまたはWgs84)
+	 * @param positions 位置の配列
+	 * @param mag_densities 磁束密度の配列 [nT] (positionsと同じ大きさに変更される)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& positions, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) const {
+		mag_densities.resize(positions.size());
+		Parallel::forEachChunk(
+		  0, positions.size(), block_size,
+		  [&](std::size_t, std::size_t begin, std::size_t end) {
+			  std::array<Eigen::Vector3d, block_size> ecef;
+			  std::array<double, block_size> delta;
+			  const bool geodetic = prepare(positions.data() + begin, end - begin, ecef.data(), delta.data());
+			  evaluateBlock(ecef.data(), geodetic ? delta.data() : nullptr, end - begin, mag_densities.data() + begin);
+		  },
+		  num_threads);
+	}
+
+	const std::vector<SphericalCapTerm>& terms() const { return m_terms; }
+	double halfAngle() const { return m_half_angle; }
+	double referenceRadius() const { return m_reference_radius; }
+
+  private:
+	double m_half_angle;						// キャップの半頂角 [rad]
+	double m_cos_half_angle;					// 半頂角の余弦
+	double m_reference_radius;					// 基準半径 [m]
+	Eigen::Matrix3d m_rotation;					// ECEF -> 球冠座標系の回転
+	std::vector<SphericalCapTerm> m_terms;		// 展開係数 (m, kの順に整列)
+	std::vector<double> m_normalization;		// 項ごとのSchmidt正規化係数
+	std::vector<std::size_t> m_series_offset;	// 項ごとの級数係数の先頭 (項数+1個)
+	std::vector<double> m_series;				// 超幾何級数の係数
+	std::size_t m_max_order;					// 最大の位数
+
+	void initialize(double pole_latitude, double pole_longitude, double half_angle, const std::vector<SphericalCapTerm>& terms,
+					double reference_radius) {
+		if (!(half_angle > 0.0) || half_angle > constant::pi / 2 + 1e-12) {
+			throw std::runtime_error("SphericalCapModel: half angle must be in (0, 90] degrees.");
+		}
+		if (terms.empty()) {
+			throw std::runtime_error("SphericalCapModel: no terms.");
+		}
+
+		m_half_angle = half_angle;
+		m_cos_half_angle = std::cos(half_angle);
+		m_reference_radius = reference_radius;
+
+		// 経度方向に回してキャップ極をx-z平面に載せ、余緯度だけ傾けてz軸に合わせる
+		const double colatitude = constant::pi / 2 - pole_latitude;
+		const Eigen::AngleAxisd tilt(-colatitude, Eigen::Vector3d::UnitY());
+		const Eigen::AngleAxisd spin(-pole_longitude, Eigen::Vector3d::UnitZ());
+		m_rotation = (tilt * spin).toRotationMatrix();
+
+		m_terms = terms;
+		std::stable_sort(m_terms.begin(), m_terms.end(),
+						 [](const SphericalCapTerm& a, const SphericalCapTerm& b) { return a.m != b.m ? a.m < b.m : a.k < b.k; });
+		m_max_order = m_terms.back().m;
+
+		// 球冠内で使うx = (1-cosθ)/2の最大値で打ち切れるところまで級数係数を前計算する
+		const double x_max = (1.0 - m_cos_half_angle) / 2.0;
+		m_normalization.clear();
+		m_series.clear();
+		m_series_offset.assign(1, 0);
+		for (const auto& term : m_terms) {
+			if (term.m > term.k || term.n < static_cast<double>(term.m) - 0.5) {
+				throw std::runtime_error("SphericalCapModel: invalid term.");
+			}
+			m_normalization.push_back(normalization(term.n, term.m));
+
+			const double a = static_cast<double>(term.m) - term.n, b = term.n + term.m + 1.0, c = term.m + 1.0;
+			double coefficient = 1.0, power = 1.0;
+			m_series.push_back(coefficient);
+			for (std::size_t j = 0; j < max_series_length; j++) {
+				coefficient *= (a + j) * (b + j) / ((c + j) * (j + 1.0));
+				power *= x_max;
+				if (coefficient == 0.0 || std::abs(coefficient) * power < series_tolerance) {
+					break;
+				}
+				m_series.push_back(coefficient);
+			}
+			m_series_offset.push_back(m_series.size());
+		}
+	}
+
+	static constexpr std::size_t max_series_length = 4096;
+	static constexpr double series_tolerance = 1e-17;
+
+	/**
+	 * @brief Schmidt準正規化の係数 K_n^m
+	 *
+	 */
+	static auto normalization(double n, std::size_t m) -> double {
+		if (m == 0) {
+			return 1.0;
+		}
+		// sqrt(2 (n+m)! / (n-m)!) / (2^m m!)
+		const double log_ratio = std::lgamma(n + m + 1.0) - std::lgamma(n - m + 1.0);
+		return std::exp(0.5 * (std::log(2.0) + log_ratio) - m * std::log(2.0) - std::lgamma(m + 1.0));
+	}
+
+	/**
+	 * @brief 境界θ0でのP_n^m またはdP_n^m/dθ の符号を決める量 (正規化係数と正の因子を除く)
+	 *
+	 */
+	static auto boundaryValue(double n, std::size_t m, double theta0, bool derivative) -> double {
+		const double cos_t = std::cos(theta0), sin_t = std::sin(theta0);
+		const double x = (1.0 - cos_t) / 2.0;
+		const double a = static_cast<double>(m) - n, b = n + m + 1.0, c = m + 1.0;
+		double f = 1.0, d_f = 0.0, coefficient = 1.0, power = 1.0;
+		for (std::size_t j = 0; j < max_series_length; j++) {
+			coefficient *= (a + j) * (b + j) / ((c + j) * (j + 1.0));
+			d_f += (j + 1.0) * coefficient * power;
+			power *= x;
+			f += coefficient * power;
+			if (coefficient == 0.0 || std::abs(coefficient) * power < series_tolerance * std::max(1.0, std::abs(f))) {
+				break;
+			}
+		}
+		if (!derivative) {
+			return f;
+		}
+		return m == 0 ? d_f : m * cos_t * f + sin_t * sin_t * d_f / 2.0;
+	}
+
+	static auto bisect(double low, double high, std::size_t m, double theta0, bool derivative) -> double {
+		double f_low = boundaryValue(low, m, theta0, derivative);
+		for (int i = 0; i < 100 && high - low > 1e-13 * high; i++) {
+			const double mid = (low + high) / 2.0;
+			const double f_mid = boundaryValue(mid, m, theta0, derivative);
+			if (f_low * f_mid <= 0.0) {
+				high = mid;
+			} else {
+				low = mid;
+				f_low = f_mid;
+			}
+		}
+		return (low + high) / 2.0;
+	}
+
+	/**
+	 * @brief 測地緯度と地心緯度の差
+	 *
+	 */
+	static auto geodeticDelta(const Wgs84& position, const Eigen::Vector3d& ecef) -> double {
+		const double geocentric_latitude = std::atan2(ecef.z(), std::sqrt(ecef.x() * ecef.x() + ecef.y() * ecef.y()));
+		return position.latitude().radians() - geocentric_latitude;
+	}
+
+	static auto prepare(const Ecef* positions, std::size_t size, Eigen::Vector3d* ecef, double*) -> bool {
+		for (std::size_t i = 0; i < size; i++) {
+			ecef[i] = positions[i].elements();
+		}
+		return false;
+	}
+
+	static auto prepare(const Wgs84* positions, std::size_t size, Eigen::Vector3d* ecef, double* delta) -> bool {
+		for (std::size_t i = 0; i < size; i++) {
+			ecef[i] = positions[i].toEcef().elements();
+			delta[i] = geodeticDelta(positions[i], ecef[i]);
+		}
+		return true;
+	}
+
+	/**
+	 * @brief block_size点以下をまとめて評価する
+	 *
+	 * @param ecef ECEF位置 [m]
+	 * @param delta 測地緯度と地心緯度の差 (nullptrの場合は地心球座標系のNEDで出力する)
+	 * @param size 点数
+	 * @param mag_density 磁束密度 [nT]
+	 */
+	void evaluateBlock(const Eigen::Vector3d* ecef, const double* delta, std::size_t size, Eigen::Vector3d* mag_density) const {
+		alignas(64) double cos_t[block_size], sin_t[block_size], x[block_size], log_ratio[block_size];
+		alignas(64) double cos_l[block_size], sin_l[block_size], cos_ml[block_size], sin_ml[block_size], sin_m1[block_size];
+		alignas(64) double f[block_size], d_f[block_size];
+		alignas(64) double b_r[block_size] = {0}, b_t[block_size] = {0}, b_l[block_size] = {0};
+
+		// 球冠座標系での余緯度と経度
+		for (std::size_t i = 0; i < size; i++) {
+			const Eigen::Vector3d q = m_rotation * ecef[i];
+			const double rho = std::sqrt(q.x() * q.x() + q.y() * q.y());
+			const double r = std::sqrt(rho * rho + q.z() * q.z());
+			cos_t[i] = q.z() / r;
+			sin_t[i] = rho / r;
+			cos_l[i] = rho > 0.0 ? q.x() / rho : 1.0;
+			sin_l[i] = rho > 0.0 ? q.y() / rho : 0.0;
+			x[i] = (1.0 - cos_t[i]) / 2.0;
+			log_ratio[i] = std::log(m_reference_radius / r);
+			cos_ml[i] = 1.0;
+			sin_ml[i] = 0.0;
+			sin_m1[i] = 1.0;
+		}
+
+		std::size_t t = 0;
+		for (std::size_t m = 0; m <= m_max_order; m++) {
+			if (m == 1) {
+				std::copy(cos_l, cos_l + size, cos_ml);
+				std::copy(sin_l, sin_l + size, sin_ml);
+			} else if (m > 1) {
+				for (std::size_t i = 0; i < size; i++) {
+					const double c = cos_ml[i] * cos_l[i] - sin_ml[i] * sin_l[i];
+					sin_ml[i] = sin_ml[i] * cos_l[i] + cos_ml[i] * sin_l[i];
+					cos_ml[i] = c;
+					sin_m1[i] *= sin_t[i]; // sin^(m-1)θ
+				}
+			}
+
+			for (; t < m_terms.size() && m_terms[t].m == m; t++) {
+				const auto& term = m_terms[t];
+				const double* series = m_series.data() + m_series_offset[t];
+				const std::size_t length = m_series_offset[t + 1] - m_series_offset[t];
+
+				// F(x)とF'(x)をホーナー法で同時に評価する
+				for (std::size_t i = 0; i < size; i++) {
+					f[i] = series[length - 1];
+					d_f[i] = 0.0;
+				}
+				for (std::size_t j = length - 1; j-- > 0;) {
+					const double s = series[j];
+					for (std::size_t i = 0; i < size; i++) {
+						d_f[i] = d_f[i] * x[i] + f[i];
+						f[i] = f[i] * x[i] + s;
+					}
+				}
+
+				const double k_nm = m_normalization[t];
+				const double g = term.g, h = term.h, n = term.n, dm = static_cast<double>(m);
+				for (std::size_t i = 0; i < size; i++) {
+					const double ratio = std::exp((n + 2.0) * log_ratio[i]); // (a/r)^(n+2)
+					const double gc = g * cos_ml[i] + h * sin_ml[i];
+					double p, d_p, p_over_sin;
+					if (m == 0) {
+						p = k_nm * f[i];
+						d_p = k_nm * d_f[i] * sin_t[i] / 2.0;
+						p_over_sin = 0.0;
+					} else {
+						p_over_sin = k_nm * sin_m1[i] * f[i];
+						p = p_over_sin * sin_t[i];
+						d_p = k_nm * sin_m1[i] * (dm * cos_t[i] * f[i] + sin_t[i] * sin_t[i] * d_f[i] / 2.0);
+					}
+					b_r[i] += (n + 1.0) * ratio * gc * p;
+					b_t[i] -= ratio * gc * d_p;
+					b_l[i] += ratio * dm * (g * sin_ml[i] - h * cos_ml[i]) * p_over_sin;
+				}
+			}
+		}
+
+		// 球冠座標系のNED -> ECEF -> 元の位置でのNED
+		for (std::size_t i = 0; i < size; i++) {
+			const double north = -b_t[i], east = b_l[i], up = b_r[i];
+			const double horizontal = sin_t[i] * up - cos_t[i] * north;
+			const Eigen::Vector3d cap{horizontal * cos_l[i] - east * sin_l[i], horizontal * sin_l[i] + east * cos_l[i],
+									  sin_t[i] * north + cos_t[i] * up};
+			const Eigen::Vector3d v = m_rotation.transpose() * cap;
+
+			const Eigen::Vector3d& p = ecef[i];
+			const double rho = std::sqrt(p.x() * p.x() + p.y() * p.y());
+			const double r = std::sqrt(rho * rho + p.z() * p.z());
+			const double sin_lat = p.z() / r, cos_lat = rho / r;
+			const double cos_lon = rho > 0.0 ? p.x() / rho : 1.0, sin_lon = rho > 0.0 ? p.y() / rho : 0.0;
+			const double radial = cos_lon * v.x() + sin_lon * v.y();
+			const double n_gc = -sin_lat * radial + cos_lat * v.z();
+			const double e_gc = -sin_lon * v.x() + cos_lon * v.y();
+			const double d_gc = -cos_lat * radial - sin_lat * v.z();
+
+			if (delta) {
+				const double cos_d = std::cos(delta[i]), sin_d = std::sin(delta[i]);
+				mag_density[i] << n_gc * cos_d + d_gc * sin_d, e_gc, -n_gc * sin_d + d_gc * cos_d;
+			} else {
+				mag_density[i] << n_gc, e_gc, d_gc;
+			}
+		}
+	}
+
+	void read(std::istream& is) {
+		std::vector<std::vector<double>> rows;
+		std::string line;
+		while (std::getline(is, line)) {
+			const auto pos = line.find_first_not_of(" \t\r");
+			if (pos == std::string::npos || line[pos] == '#') {
+				continue;
+			}
+			std::istringstream iss(line);
+			std::vector<double> row;
+			double value;
+			while (iss >> value) {
+				row.push_back(value);
+			}
+			rows.push_back(row);
+		}
+
+		if (rows.empty() || rows.front().size() < 3) {
+			throw std::runtime_error("SphericalCapModel: invalid header.");
+		}
+		const auto& header = rows.front();
+		const double half_angle = AngleHelper::degreeToRadian(header[2]);
+		const double reference_radius = header.size() >= 4 ? header[3] * 1e3 : 6371.2e3;
+
+		std::vector<SphericalCapTerm> terms;
+		std::vector<std::vector<double>> degree_table; // 位数ごとの根 (必要になったときだけ求める)
+		for (std::size_t i = 1; i < rows.size(); i++) {
+			const auto& row = rows[i];
+			if (row.size() != 4 && row.size() != 5) {
+				throw std::runtime_error("SphericalCapModel: invalid term row.");
+			}
+			SphericalCapTerm term;
+			term.k = static_cast<std::size_t>(row[0]);
+			term.m = static_cast<std::size_t>(row[1]);
+			term.g = row[row.size() - 2];
+			term.h = row[row.size() - 1];
+			if (term.m > term.k) {
+				throw std::runtime_error("SphericalCapModel: invalid term row.");
+			}
+			if (row.size() == 5) {
+				term.n = row[2];
+			} else {
+				if (degree_table.size() <= term.m) {
+					degree_table.resize(term.m + 1);
+				}
+				auto& table = degree_table[term.m];
+				if (table.size() <= term.k - term.m) {
+					table = degrees(Radian{half_angle}, term.m, term.k);
+				}
+				term.n = table[term.k - term.m];
+			}
+			terms.push_back(term);
+		}
+
+		initialize(AngleHelper::degreeToRadian(header[0]), AngleHelper::degreeToRadian(header[1]), half_angle, terms, reference_radius);
+	}
+};
+
+/**
+ * @brief 主磁場と球冠調和の地域磁場を合成した磁束密度
+ * @remark 球冠の外側では地域磁場を加えない
+ *
+ */
+class RegionalGeoMagFlux {
+  public:
+	/**
+	 * @brief Construct a new Regional Geo Mag Flux object
+	 *
+	 * @param main_field 主磁場 (出力単位もこれに従う)
+	 * @param regional_field 地域磁場
+	 */
+	RegionalGeoMagFlux(const GeoMagFlux& main_field, const SphericalCapModel& regional_field)
+	  : m_main_field(main_field), m_regional_field(regional_field) {}
+
+	/**
+	 * @brief 任意位置での磁束密度を取得する
+	 *
+	 * @param position ECEF座標系での位置
+	 * @return Eigen::Vector3d 磁束密度
+	 */
+	Eigen::Vector3d operator()(const Ecef& position) {
+		Eigen::Vector3d mag_density = m_main_field(position);
+		if (m_regional_field.contains(position)) {
+			mag_density += m_regional_field(position) * m_main_field.unitScale();
+		}
+		return mag_density;
+	}
+
+	/**
+	 * @brief 任意位置での磁束密度を取得する
+	 *
+	 * @param position WGS84回転楕円座標系での位置
+	 * @return Eigen::Vector3d 磁束密度
+	 */
+	Eigen::Vector3d operator()(const Wgs84& position) {
+		Eigen::Vector3d mag_density = m_main_field(position);
+		if (m_regional_field.contains(position.toEcef())) {
+			mag_density += m_regional_field(position) * m_main_field.unitScale();
+		}
+		return mag_density;
+	}
+
+	/**
+	 * @brief 複数の位置での磁束密度をまとめて取得する
+	 * @remark 先に球冠の内側の位置を選び、地域磁場はその位置でだけ評価する
+	 *
+	 * @tparam Position 位置の型 (EcefまたはWgs84)
+	 * @param positions 位置の配列
+	 * @param mag_densities 磁束密度の配列 (positionsと同じ大きさに変更される)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	template <typename Position>
+	void evaluate(const std::vector<Position>& positions, std::vector<Eigen::Vector3d>& mag_densities, std::size_t num_threads = 0) const {
+		m_main_field.evaluate(positions, mag_densities, num_threads);
+
+		std::vector<std::size_t> inside;
+		std::vector<Position> inside_positions;
+		for (std::size_t i = 0; i < positions.size(); i++) {
+			if (m_regional_field.contains(positions[i].toEcef())) {
+				inside.push_back(i);
+				inside_positions.push_back(positions[i]);
+			}
+		}
+		if (inside.empty()) {
+			return;
+		}
+
+		std::vector<Eigen::Vector3d> regional;
+		m_regional_field.evaluate(inside_positions, regional, num_threads);
+		const double scale = m_main_field.unitScale();
+		for (std::size_t j = 0; j < inside.size(); j++) {
+			mag_densities[inside[j]] += regional[j] * scale;
+		}
+	}
+
+	const SphericalCapModel& regionalField() const { return m_regional_field; }
+
+  private:
+	GeoMagFlux m_main_field;
+	SphericalCapModel m_regional_field;
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,409 @@
+/**
+ * @file SplineModel.hpp
+ * @author Kaiji Takeuchi
+ * @brief 時間方向にBスプラインで表現された磁場モデル (CHAOS等)
+ * @ref https://www.space.dtu.dk/english/research/scientific_data_and_models/magnetic_field_models
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../Eigen/Cholesky"
+#include "Essential.hpp"
+#include "Model.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief エポックごとのBスプライン基底のキャッシュ
+ * @remark 1エポックにつき1回だけ基底を計算し、全係数で共有する
+ *
+ */
+struct BSplineBasisCache {
+	static constexpr std::size_t max_order = 8;
+
+	std::int64_t ticks = std::numeric_limits<std::int64_t>::min(); // キャッシュしたエポック [ticks]
+	double time = 0.0;											   // キャッシュしたエポック [year]
+	std::size_t span = 0;										   // ノット区間のインデックス
+	std::array<double, max_order> weights{};					   // 区間内で非ゼロの基底関数の値
+};
+
+/**
+ * @brief 時間方向にBスプラインで表現されたモデルセット
+ *
+ */
+class SplineModelSet {
+  public:
+	using Coefficients = std::array<double, Model::max_coefficient_size>;
+
+	/**
+	 * @brief Construct a new Spline Model Set object
+	 * @remark 空のモデルセットになる
+	 *
+	 */
+	SplineModelSet() : m_order(0) {}
+
+	/**
+	 * @brief Construct a new Spline Model Set object
+	 *
+	 * @param order スプラインの階数 (次数 + 1)
+	 * @param knots ノット列 [year] (広義単調増加, 制御点数 + order 個)
+	 * @param control 制御点 (g/h係数)
+	 */
+	SplineModelSet(std::size_t order, const std::vector<double>& knots, const std::vector<Coefficients>& control) {
+		initialize(order, knots, control);
+	}
+
+	/**
+	 * @brief SHC形式のストリームからモデルセットを読み込む
+	 *
+	 * @param is SHC形式のストリーム
+	 */
+	SplineModelSet(std::istream& is) : m_order(0) { readShc(is); }
+
+	/**
+	 * @brief 区分線形のモデルセットを2階(1次)のBスプラインに変換する
+	 * @remark 末尾のSVモデルは次のエポックでの制御点に変換する
+	 *
+	 * @param model_set モデルセット
+	 * @return SplineModelSet
+	 */
+	static SplineModelSet fromModelSet(const ModelSet& model_set) {
+		std::vector<double> knots;
+		std::vector<Coefficients> control;
+
+		for (const auto& m : model_set) {
+			const double year = m.epoch.year();
+			if (m.type == ModelType::Sv) {
+				if (control.empty()) {
+					throw std::runtime_error("SplineModelSet: SV model without main field model.");
+				}
+				Coefficients c;
+				const double span = year - knots.back();
+				std::transform(control.back().begin(), control.back().end(), m.coefficients.begin(), c.begin(),
+							   [span](double a, double b) { return a + span * b; });
+				control.push_back(c);
+			} else {
+				control.push_back(m.coefficients);
+			}
+			knots.push_back(year);
+		}
+
+		if (control.size() < 2) {
+			throw std::runtime_error("SplineModelSet: at least two models are required.");
+		}
+		knots.insert(knots.begin(), knots.front());
+		knots.push_back(knots.back());
+		return SplineModelSet(2, knots, control);
+	}
+
+	bool empty() const { return m_control_size == 0; }
+	std::size_t order() const { return m_order; }
+	std::size_t controlSize() const { return m_control_size; }
+	const std::vector<double>& knots() const { return m_knots; }
+
+	/**
+	 * @brief 次数・ノット・制御点から求めた指紋 (ModelSet::fingerprintと同じ使い方)
+	 *
+	 */
+	std::uint64_t fingerprint() const {
+		std::uint64_t hash = mixFingerprint(0xcbf29ce484222325ull, static_cast<std::uint64_t>(ModelType::Spline));
+		hash = mixFingerprint(hash, static_cast<std::uint64_t>(m_order));
+		hash = mixFingerprint(hash, m_knots.data(), m_knots.size());
+		return mixFingerprint(hash, m_control.data(), m_control.size());
+	}
+
+	/**
+	 * @brief モデルが有効な期間の先頭 [year]
+	 *
+	 */
+	double beginYear() const { return empty() ? 0.0 : m_knots[m_order - 1]; }
+
+	/**
+	 * @brief モデルが有効な期間の末尾 [year]
+	 *
+	 */
+	double endYear() const { return empty() ? 0.0 : m_knots[m_control_size]; }
+
+	/**
+	 * @brief 基底関数を更新する
+	 * @remark キャッシュ済みのノット区間から順方向に探索するので、時刻順のストリームでは区間探索がほぼ定数時間になる
+	 *
+	 * @param time 時刻 [year]
+	 * @param cache 基底のキャッシュ
+	 */
+	void basis(double time, BSplineBasisCache& cache) const {
+		if (empty()) {
+			throw std::runtime_error("SplineModelSet is empty.");
+		}
+		if (time < beginYear() || time > endYear()) {
+			throw std::runtime_error("SplineModelSet: no model is found.");
+		}
+
+		cache.time = time;
+		cache.span = findSpan(time, cache.span);
+
+		// de Boor-Cox recurrence (The NURBS Book, A2.2)
+		const std::size_t p = m_order - 1;
+		const std::size_t span = cache.span;
+		std::array<double, BSplineBasisCache::max_order> left, right;
+		auto& n = cache.weights;
+		n[0] = 1.0;
+		for (std::size_t j = 1; j <= p; j++) {
+			left[j] = time - m_knots[span + 1 - j];
+			right[j] = m_knots[span + j] - time;
+			double saved = 0.0;
+			for (std::size_t r = 0; r < j; r++) {
+				const double temp = n[r] / (right[r + 1] + left[j - r]);
+				n[r] = saved + right[r + 1] * temp;
+				saved = left[j - r] * temp;
+			}
+			n[j] = saved;
+		}
+	}
+
+	/**
+	 * @brief 任意エポックでのモデルを生成する
+	 *
+	 * @param dt 作成するモデルの時刻
+	 * @param model 生成されるモデル
+	 * @param cache 基底のキャッシュ
+	 */
+	void evaluate(const DateTime& dt, Model& model, BSplineBasisCache& cache) const {
+		if (cache.ticks != dt.ticks()) {
+			basis(dt.fractionalYears(), cache);
+			cache.ticks = dt.ticks();
+		}
+
+		const std::size_t p = m_order - 1;
+		const double* control = &m_control[(cache.span - p) * Model::max_coefficient_size];
+		auto& coeff = model.coefficients;
+		std::fill(coeff.begin(), coeff.end(), 0.0);
+		for (std::size_t j = 0; j <= p; j++) {
+			const double w = cache.weights[j];
+			const double* row = control + j * Model::max_coefficient_size;
+			for (std::size_t c = 0; c < Model::max_coefficient_size; c++) {
+				coeff[c] += w * row[c];
+			}
+		}
+		model.epoch = dt;
+		model.type = ModelType::Spline;
+	}
+
+	/**
+	 * @brief 任意エポックでの係数の時間微分を生成する
+	 * @remark 階数を1つ下げた基底と隣り合う制御点の差で表す (The NURBS Book, Eq. 3.3)
+	 *
+	 * @param dt 作成するモデルの時刻
+	 * @param rate 係数の時間微分 [nT/year] (typeはSv)
+	 */
+	void evaluateRate(const DateTime& dt, Model& rate) const {
+		const double time = dt.fractionalYears();
+		if (empty()) {
+			throw std::runtime_error("SplineModelSet is empty.");
+		}
+		if (time < beginYear() || time > endYear()) {
+			throw std::runtime_error("SplineModelSet: no model is found.");
+		}
+
+		auto& coeff = rate.coefficients;
+		std::fill(coeff.begin(), coeff.end(), 0.0);
+		rate.epoch = dt;
+		rate.type = ModelType::Sv;
+		const std::size_t p = m_order - 1;
+		if (p == 0) {
+			return;
+		}
+
+		// 次数p-1の基底 N_(span-p+1+k, p-1), k = 0..p-1
+		const std::size_t span = findSpan(time, 0);
+		std::array<double, BSplineBasisCache::max_order> n, left, right;
+		n[0] = 1.0;
+		for (std::size_t j = 1; j < p; j++) {
+			left[j] = time - m_knots[span + 1 - j];
+			right[j] = m_knots[span + j] - time;
+			double saved = 0.0;
+			for (std::size_t r = 0; r < j; r++) {
+				const double temp = n[r] / (right[r + 1] + left[j - r]);
+				n[r] = saved + right[r + 1] * temp;
+				saved = left[j - r] * temp;
+			}
+			n[j] = saved;
+		}
+
+		for (std::size_t k = 0; k < p; k++) {
+			const std::size_t i = span - p + 1 + k;
+			const double width = m_knots[i + p] - m_knots[i];
+			if (width <= 0.0) {
+				continue;
+			}
+			const double w = n[k] * static_cast<double>(p) / width;
+			const double* row = &m_control[i * Model::max_coefficient_size];
+			const double* previous = row - Model::max_coefficient_size;
+			for (std::size_t c = 0; c < Model::max_coefficient_size; c++) {
+				coeff[c] += w * (row[c] - previous[c]);
+			}
+		}
+	}
+
+  private:
+	std::size_t m_order;			// スプラインの階数
+	std::size_t m_control_size = 0; // 制御点の数
+	std::vector<double> m_knots;	// ノット列 [year]
+	std::vector<double> m_control;	// 制御点 (制御点ごとにmax_coefficient_size個ずつ並べる)
+
+	void initialize(std::size_t order, const std::vector<double>& knots, const std::vector<Coefficients>& control) {
+		if (order < 1 || order > BSplineBasisCache::max_order) {
+			throw std::runtime_error("SplineModelSet: invalid spline order.");
+		}
+		if (control.empty() || knots.size() != control.size() + order) {
+			throw std::runtime_error("SplineModelSet: knots size must be control size + order.");
+		}
+		if (!std::is_sorted(knots.begin(), knots.end()) || !(knots[control.size()] > knots[order - 1])) {
+			throw std::runtime_error("SplineModelSet: knots must be non-decreasing.");
+		}
+
+		m_order = order;
+		m_control_size = control.size();
+		m_knots = knots;
+		m_control.resize(m_control_size * Model::max_coefficient_size);
+		for (std::size_t i = 0; i < m_control_size; i++) {
+			std::copy(control[i].begin(), control[i].end(), m_control.begin() + i * Model::max_coefficient_size);
+		}
+	}
+
+	/**
+	 * @brief timeを含むノット区間を探す (The NURBS Book, A2.1)
+	 *
+	 * @param time 時刻 [year]
+	 * @param hint 前回のノット区間
+	 */
+	std::size_t findSpan(double time, std::size_t hint) const {
+		const std::size_t p = m_order - 1;
+		const std::size_t n = m_control_size - 1;
+		if (time >= m_knots[n + 1]) {
+			return n;
+		}
+
+		// 順方向のストリームでは前回の区間から進めるだけで済む
+		if (hint >= p && hint <= n && time >= m_knots[hint]) {
+			while (time >= m_knots[hint + 1]) {
+				hint++;
+			}
+			return hint;
+		}
+
+		std::size_t low = p, high = n + 1;
+		std::size_t mid = (low + high) / 2;
+		while (time < m_knots[mid] || time >= m_knots[mid + 1]) {
+			if (time < m_knots[mid]) {
+				high = mid;
+			} else {
+				low = mid;
+			}
+			mid = (low + high) / 2;
+		}
+		return mid;
+	}
+
+	/**
+	 * @brief SHC形式のモデルを読み込む
+	 * @remark SHC形式はスプラインを時刻ごとの値で表現しているので、最小二乗でBスプライン係数に戻す。Model::max_degreeを超える次数は切り捨てる
+	 *
+	 * @param is SHC形式のストリーム
+	 */
+	void readShc(std::istream& is) {
+		std::vector<double> tokens;
+		std::string line;
+		while (std::getline(is, line)) {
+			const auto pos = line.find_first_not_of(" \t\r");
+			if (pos == std::string::npos || line[pos] == '#') {
+				continue;
+			}
+			std::istringstream iss(line);
+			double value;
+			while (iss >> value) {
+				tokens.push_back(value);
+			}
+		}
+
+		// ヘッダ: N_min N_max N_times spline_order N_step
+		if (tokens.size() < 5) {
+			throw std::runtime_error("SplineModelSet: invalid SHC header.");
+		}
+		const std::size_t num_times = static_cast<std::size_t>(tokens[2]);
+		const std::size_t order = static_cast<std::size_t>(tokens[3]);
+		const std::size_t step = static_cast<std::size_t>(tokens[4]);
+		if (order < 2 || order > BSplineBasisCache::max_order || step < 1 || num_times < 2 || (num_times - 1) % step != 0) {
+			throw std::runtime_error("SplineModelSet: unsupported SHC spline parameters.");
+		}
+		if (tokens.size() < 5 + num_times || (tokens.size() - 5 - num_times) % (num_times + 2) != 0) {
+			throw std::runtime_error("SplineModelSet: invalid SHC body.");
+		}
+
+		const std::vector<double> times(tokens.begin() + 5, tokens.begin() + 5 + num_times);
+
+		// ブレークポイントの両端をorder-1回重ねてノット列を作る
+		std::vector<double> knots(order - 1, times.front());
+		for (std::size_t i = 0; i < num_times; i += step) {
+			knots.push_back(times[i]);
+		}
+		knots.insert(knots.end(), order - 1, times.back());
+		const std::size_t control_size = knots.size() - order;
+
+		// 係数行列: 行が時刻、列がg/h係数
+		Eigen::MatrixXd values = Eigen::MatrixXd::Zero(num_times, Model::max_coefficient_size);
+		for (std::size_t row = 5 + num_times; row < tokens.size(); row += num_times + 2) {
+			const int n = static_cast<int>(tokens[row]);
+			const int m = static_cast<int>(tokens[row + 1]);
+			if (n < 1 || n > static_cast<int>(Model::max_degree) || std::abs(m) > n) {
+				continue;
+			}
+			// g_n^m -> n^2-1+(2m-1), h_n^m -> n^2-1+2m (g_n^0 -> n^2-1)
+			const int am = std::abs(m);
+			const std::size_t index = n * n - 1 + (am == 0 ? 0 : (m > 0 ? 2 * am - 1 : 2 * am));
+			for (std::size_t i = 0; i < num_times; i++) {
+				values(i, index) = tokens[row + 2 + i];
+			}
+		}
+
+		// 全係数で同じ基底を共有するので、コロケーション行列は1つで済む
+		m_order = order;
+		m_control_size = control_size;
+		m_knots = knots;
+		Eigen::MatrixXd collocation = Eigen::MatrixXd::Zero(num_times, control_size);
+		BSplineBasisCache cache;
+		for (std::size_t i = 0; i < num_times; i++) {
+			basis(times[i], cache);
+			for (std::size_t j = 0; j < order; j++) {
+				collocation(i, cache.span - (order - 1) + j) = cache.weights[j];
+			}
+		}
+		const Eigen::MatrixXd solved = (collocation.transpose() * collocation).ldlt().solve(collocation.transpose() * values);
+
+		std::vector<Coefficients> control(control_size);
+		for (std::size_t i = 0; i < control_size; i++) {
+			for (std::size_t c = 0; c < Model::max_coefficient_size; c++) {
+				control[i][c] = solved(i, c);
+			}
+		}
+		initialize(order, knots, control);
+	}
+};
+
+GEOMAG_NAMESPACE_END
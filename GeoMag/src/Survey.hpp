@@ -0,0 +1,489 @@
+/**
+ * @file Survey.hpp
+ * @author Kaiji Takeuchi
+ * @brief 磁気探査データの逐次処理 (主磁場の除去、日変化補正、タイライン調整の統計)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Reduction.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 移動局 (航空機・船) の全磁力の測定値
+ *
+ */
+struct SurveyReading {
+	DateTime time;
+	double longitude = 0.0; // [deg]
+	double latitude = 0.0;	// [deg]
+	double altitude = 0.0;	// [m]
+	double total = 0.0;		// 全磁力 [nT]
+	int line = 0;			// 測線番号
+	bool tie = false;		// タイラインならtrue
+};
+
+/**
+ * @brief 基準局の全磁力の測定値
+ *
+ */
+struct BaseReading {
+	DateTime time;
+	double total = 0.0; // 全磁力 [nT]
+};
+
+/**
+ * @brief 1つの測定値の処理結果
+ *
+ */
+struct SurveyResult {
+	SurveyReading reading;
+	double main_field = 0.0; // 主磁場の全磁力 [nT]
+	double diurnal = 0.0;	 // 日変化補正量 (基準局の値 - 基準値) [nT]
+	double anomaly = 0.0;	 // 残差異常 (観測値 - 主磁場 - 日変化) [nT]
+	bool base_valid = true;	 // 日変化補正ができたか (falseの場合diurnalは0)
+};
+
+/**
+ * @brief 基準局の時系列を移動局の時刻に合わせて補間する
+ * @remark 両方の時系列が時刻順に届くことを前提に、前後2点だけを保持する
+ *
+ */
+class BaseStationMerger {
+  public:
+	/**
+	 * @brief Construct a new Base Station Merger object
+	 *
+	 * @param max_gap 補間を許す基準局の測定間隔
+	 * @param datum 日変化の基準値 [nT] (NaNの場合は基準局の最初の値)
+	 */
+	explicit BaseStationMerger(const TimeSpan& max_gap = Minutes(5), double datum = std::numeric_limits<double>::quiet_NaN())
+	  : m_max_gap(max_gap), m_datum(datum) {}
+
+	/**
+	 * @brief 時刻tでの日変化補正量を求める
+	 *
+	 * @param time 移動局の時刻 (前回以降)
+	 * @param source bool(BaseReading&) 基準局の次の測定値を返す。終端ならfalse
+	 * @param diurnal 日変化補正量 [nT]
+	 * @return bool 補間できたか
+	 */
+	template <typename BaseSource>
+	auto correction(const DateTime& time, BaseSource& source, double& diurnal) -> bool {
+		if (m_has_time && time < m_last_time) {
+			throw std::runtime_error("BaseStationMerger: rover readings are not in time order");
+		}
+		m_last_time = time;
+		m_has_time = true;
+
+		// tより後の測定値が1つ窓に入るまで読み進める
+		BaseReading reading;
+		while (!m_exhausted && (m_window.empty() || m_window.back().time < time)) {
+			if (!source(reading)) {
+				m_exhausted = true;
+				break;
+			}
+			if (!m_window.empty() && reading.time < m_window.back().time) {
+				throw std::runtime_error("BaseStationMerger: base readings are not in time order");
+			}
+			if (std::isnan(m_datum)) {
+				m_datum = reading.total;
+			}
+			m_window.push_back(reading);
+		}
+		while (m_window.size() >= 2 && m_window[1].time <= time) {
+			m_window.pop_front();
+		}
+
+		diurnal = 0.0;
+		if (m_window.empty() || time < m_window.front().time) {
+			return false;
+		}
+		const BaseReading& before = m_window.front();
+		if (before.time == time) {
+			diurnal = before.total - m_datum;
+			return true;
+		}
+		if (m_window.size() < 2) {
+			return false;
+		}
+		const BaseReading& after = m_window[1];
+		const TimeSpan gap = after.time - before.time;
+		if (gap.ticks() > m_max_gap.ticks()) {
+			return false;
+		}
+		const double w = static_cast<double>((time - before.time).ticks()) / static_cast<double>(gap.ticks());
+		diurnal = before.total + w * (after.total - before.total) - m_datum;
+		return true;
+	}
+
+	double datum() const { return m_datum; }
+
+  private:
+	TimeSpan m_max_gap;
+	double m_datum;
+	std::deque<BaseReading> m_window;
+	bool m_exhausted = false;
+	DateTime m_last_time;
+	bool m_has_time = false;
+};
+
+/**
+ * @brief 測線ごとの統計
+ *
+ */
+struct SurveyLineStatistics {
+	int line = 0;
+	bool tie = false;
+	RunningStatistics anomaly; // 残差異常
+	RunningStatistics mistie;  // 交点での食い違い (この測線 - タイライン)
+
+	/**
+	 * @brief タイラインに合わせるためにこの測線に加える一定値 [nT]
+	 *
+	 */
+	double shift() const { return mistie.count() > 0 ? -mistie.mean() : 0.0; }
+};
+
+/**
+ * @brief 測線とタイラインの交点での食い違いを逐次集計する
+ * @remark 各測線の隣り合う測定値を結んだ線分を格子のセルに登録し、種類の異なる線分が交わる点で両方の残差異常を補間して比べる。
+ *         1つのセルに線分を残す測線は種類ごとにcell_lines本までで、超えるとその種類で最も古い測線の線分を捨てる。
+ *         メモリの上限は 通過したセルの数 x 2 x cell_lines x (セルを1回通る線分の数 ≒ cell_size / 測定間隔) 本の線分で、
+ *         調査範囲の面積で決まり測定値の数によらない。同じセルを種類ごとにcell_lines本より多くの測線が通ると、
+ *         古い測線との交点を見落とすことがある (dropped()で数える)
+ *
+ */
+class TieLineLeveling {
+  public:
+	/**
+	 * @brief Construct a new Tie Line Leveling object
+	 *
+	 * @param cell_size セルの大きさ [m] (測定間隔より大きくする。これより長い線分は測線の途切れとみなす)
+	 * @param cell_lines 1つのセルに線分を残す測線の数 (測線とタイラインそれぞれ)
+	 */
+	explicit TieLineLeveling(double cell_size = 50.0, std::size_t cell_lines = 8) : m_cell_size(cell_size), m_cell_lines(cell_lines) {
+		if (!(cell_size > 0.0)) {
+			throw std::runtime_error("TieLineLeveling: cell size must be positive");
+		}
+		if (cell_lines == 0) {
+			throw std::runtime_error("TieLineLeveling: cell must hold at least one line");
+		}
+	}
+
+	void add(const SurveyReading& reading, double anomaly) {
+		auto& line = m_lines[reading.line];
+		line.statistics.line = reading.line;
+		line.statistics.tie = reading.tie;
+		line.statistics.anomaly.add(anomaly);
+
+		const Point point{reading.longitude, reading.latitude, anomaly};
+		if (line.has_last) {
+			const Segment segment{reading.line, reading.tie, line.last, point};
+			if (length(segment) <= m_cell_size) {
+				const std::uint64_t first = cellKey(segment.p0.longitude, segment.p0.latitude);
+				const std::uint64_t second = cellKey(segment.p1.longitude, segment.p1.latitude);
+				insert(first, segment);
+				if (second != first) {
+					insert(second, segment);
+				}
+			}
+		}
+		line.last = point;
+		line.has_last = true;
+	}
+
+	/**
+	 * @brief 測線ごとの統計 (測線番号順)
+	 *
+	 */
+	auto lines() const -> std::vector<SurveyLineStatistics> {
+		std::vector<SurveyLineStatistics> lines;
+		lines.reserve(m_lines.size());
+		for (const auto& line : m_lines) {
+			lines.push_back(line.second.statistics);
+		}
+		return lines;
+	}
+
+	const RunningStatistics& mistie() const { return m_mistie; }
+	std::size_t crossovers() const { return m_mistie.count(); }
+	std::size_t cells() const { return m_cells.size(); }
+	std::size_t dropped() const { return m_dropped; } // セルの上限を超えて線分を捨てた測線の延べ数
+
+  private:
+	struct Point {
+		double longitude; // [deg]
+		double latitude;  // [deg]
+		double anomaly;	  // [nT]
+	};
+
+	struct Segment {
+		int line;
+		bool tie;
+		Point p0, p1;
+	};
+
+	struct LineState {
+		SurveyLineStatistics statistics;
+		Point last;
+		bool has_last = false;
+	};
+
+	static constexpr double meters_per_degree = 111319.49079327357; // 赤道での1度の長さ
+
+	double m_cell_size;
+	std::size_t m_cell_lines;
+	std::size_t m_dropped = 0;
+	std::unordered_map<std::uint64_t, std::vector<Segment>> m_cells;
+	std::map<int, LineState> m_lines;
+	RunningStatistics m_mistie;
+
+	/**
+	 * @brief 線分をセルに登録し、セル内にある種類の異なる線分との交点を調べる
+	 * @remark 交点がこのセルにある場合だけ数えて、2つのセルに登録された線分の交点を二重に数えないようにする
+	 *
+	 */
+	void insert(std::uint64_t key, const Segment& segment) {
+		auto& cell = m_cells[key];
+		for (const auto& other : cell) {
+			if (other.tie == segment.tie || other.line == segment.line) {
+				continue;
+			}
+			double s, t;
+			if (!intersect(segment, other, s, t)) {
+				continue;
+			}
+			const double longitude = segment.p0.longitude + s * (segment.p1.longitude - segment.p0.longitude);
+			const double latitude = segment.p0.latitude + s * (segment.p1.latitude - segment.p0.latitude);
+			if (cellKey(longitude, latitude) != key) {
+				continue;
+			}
+			const double a = segment.p0.anomaly + s * (segment.p1.anomaly - segment.p0.anomaly);
+			const double b = other.p0.anomaly + t * (other.p1.anomaly - other.p0.anomaly);
+			// 食い違いは常に 測線 - タイライン とする
+			const double mistie = segment.tie ? b - a : a - b;
+			m_lines[segment.tie ? other.line : segment.line].statistics.mistie.add(mistie);
+			m_mistie.add(mistie);
+		}
+		retire(cell, segment);
+		cell.push_back(segment);
+	}
+
+	/**
+	 * @brief セルに新しい測線が入るとき、同じ種類の測線が上限まであれば最も古い測線の線分を捨てる
+	 * @remark 線分は登録順に並んでいるので、同じ種類で最初の線分の測線が最も古い
+	 *
+	 */
+	void retire(std::vector<Segment>& cell, const Segment& segment) {
+		std::vector<int> lines;
+		for (const auto& other : cell) {
+			if (other.line == segment.line) {
+				return;
+			}
+			if (other.tie == segment.tie && std::find(lines.begin(), lines.end(), other.line) == lines.end()) {
+				lines.push_back(other.line);
+			}
+		}
+		if (lines.size() < m_cell_lines) {
+			return;
+		}
+		const int oldest = lines.front();
+		cell.erase(std::remove_if(cell.begin(), cell.end(), [&](const Segment& other) { return other.line == oldest; }), cell.end());
+		++m_dropped;
+	}
+
+	/**
+	 * @brief 2つの線分の交点を求める
+	 *
+	 * @param s 交点のaでの位置 [0, 1]
+	 * @param t 交点のbでの位置 [0, 1]
+	 */
+	static auto intersect(const Segment& a, const Segment& b, double& s, double& t) -> bool {
+		// 短い線分なので、経度を緯度の余弦で縮めた平面で考える
+		const double c = std::cos(a.p0.latitude * constant::pi / 180.0);
+		const double ax = (a.p1.longitude - a.p0.longitude) * c, ay = a.p1.latitude - a.p0.latitude;
+		const double bx = (b.p1.longitude - b.p0.longitude) * c, by = b.p1.latitude - b.p0.latitude;
+		const double dx = (b.p0.longitude - a.p0.longitude) * c, dy = b.p0.latitude - a.p0.latitude;
+		const double denominator = ax * by - ay * bx;
+		if (denominator == 0.0) {
+			return false; // 平行
+		}
+		s = (dx * by - dy * bx) / denominator;
+		t = (dx * ay - dy * ax) / denominator;
+		return s >= 0.0 && s <= 1.0 && t >= 0.0 && t <= 1.0;
+	}
+
+	static auto length(const Segment& segment) -> double {
+		const double c = std::cos(segment.p0.latitude * constant::pi / 180.0);
+		const double x = (segment.p1.longitude - segment.p0.longitude) * c, y = segment.p1.latitude - segment.p0.latitude;
+		return std::sqrt(x * x + y * y) * meters_per_degree;
+	}
+
+	auto cellKey(double longitude, double latitude) const -> std::uint64_t {
+		// 緯度の帯ごとに、帯の中央の緯度で経度方向の長さを決める
+		const double row = std::floor(latitude * meters_per_degree / m_cell_size);
+		const double center = (row + 0.5) * m_cell_size / meters_per_degree * constant::pi / 180.0;
+		const double width = m_cell_size / std::max(meters_per_degree * std::cos(center), 1.0);
+		const double column = std::floor(longitude / width);
+		const auto r = static_cast<std::uint64_t>(static_cast<std::int64_t>(row) + (std::int64_t{1} << 31));
+		const auto c = static_cast<std::uint64_t>(static_cast<std::int64_t>(column) + (std::int64_t{1} << 31));
+		return (r << 32) | (c & 0xffffffffULL);
+	}
+};
+
+/**
+ * @brief 探査データ処理の設定
+ *
+ */
+struct SurveyConfig {
+	std::size_t batch_size = 4096;		   // 1度に評価する測定値の数
+	std::size_t threads = 0;			   // 評価スレッド数 (0の場合はハードウェアの並列数)
+	TimeSpan epoch_resolution = Days(1);   // 主磁場を評価する時刻の刻み (この刻みで時刻を丸めてモデルを使い回す)
+	TimeSpan max_base_gap = Minutes(5);	   // 基準局の測定間隔の許容値
+	double base_datum = std::numeric_limits<double>::quiet_NaN(); // 日変化の基準値 [nT] (NaNの場合は基準局の最初の値)
+	double cell_size = 50.0;			   // 交点を探すセルの大きさ [m]
+	std::size_t cell_lines = 8;			   // 1つのセルに線分を残す測線の数 (測線とタイラインそれぞれ)
+};
+
+/**
+ * @brief 磁気探査データを逐次処理する
+ * @remark 移動局の測定値をbatch_size個ずつ読み、基準局と時刻を合わせて日変化を補正し、主磁場を除いた残差異常を出力する。
+ *         保持するのは1バッチと基準局の前後2点、タイライン調整の格子だけ
+ *
+ */
+class SurveyReducer {
+  public:
+	/**
+	 * @brief Construct a new Survey Reducer object
+	 *
+	 * @param flux 主磁場の評価器 (出力単位は問わない)
+	 * @param config 設定
+	 */
+	explicit SurveyReducer(const GeoMagFlux& flux, const SurveyConfig& config = SurveyConfig{})
+	  : m_flux(flux), m_config(config), m_base(config.max_base_gap, config.base_datum), m_leveling(config.cell_size, config.cell_lines) {
+		if (m_config.epoch_resolution.ticks() <= 0) {
+			throw std::runtime_error("SurveyReducer: epoch resolution must be positive");
+		}
+		m_config.batch_size = std::max<std::size_t>(m_config.batch_size, 1);
+	}
+
+	/**
+	 * @brief 基準局と合わせて処理する
+	 *
+	 * @param rover bool(SurveyReading&) 移動局の次の測定値を返す。終端ならfalse
+	 * @param base bool(BaseReading&) 基準局の次の測定値を返す。終端ならfalse
+	 * @param sink void(const std::vector<SurveyResult>&) バッチごとの処理結果を受け取る
+	 */
+	template <typename RoverSource, typename BaseSource, typename Sink>
+	void run(RoverSource&& rover, BaseSource&& base, Sink&& sink) {
+		std::vector<SurveyReading> batch;
+		std::vector<SurveyResult> results;
+		batch.reserve(m_config.batch_size);
+		SurveyReading reading;
+		bool more = true;
+		while (more) {
+			batch.clear();
+			while (batch.size() < m_config.batch_size && (more = rover(reading))) {
+				batch.push_back(reading);
+			}
+			if (batch.empty()) {
+				break;
+			}
+			process(batch, base, results);
+			sink(results);
+		}
+	}
+
+	/**
+	 * @brief 基準局なしで処理する (日変化補正をしない)
+	 *
+	 */
+	template <typename RoverSource, typename Sink>
+	void run(RoverSource&& rover, Sink&& sink) {
+		m_use_base = false;
+		run(rover, [](BaseReading&) { return false; }, sink);
+		m_use_base = true;
+	}
+
+	/**
+	 * @brief 1バッチを処理する
+	 * @remark 複数回呼ぶ場合も時刻順に渡す
+	 *
+	 */
+	template <typename BaseSource>
+	void process(const std::vector<SurveyReading>& batch, BaseSource&& base, std::vector<SurveyResult>& results) {
+		m_positions.clear();
+		m_positions.reserve(batch.size());
+		const std::int64_t resolution = m_config.epoch_resolution.ticks();
+		for (const auto& reading : batch) {
+			// 時刻を刻みに丸めて、同じ刻みの点ではモデルの補間を省く
+			const std::int64_t ticks = reading.time.ticks();
+			const DateTime epoch((ticks + resolution / 2) / resolution * resolution);
+			m_positions.emplace_back(epoch, Degree{reading.longitude}, Degree{reading.latitude}, reading.altitude);
+		}
+		m_flux.evaluate(m_positions, m_fluxes, m_config.threads);
+
+		results.resize(batch.size());
+		const double scale = m_flux.unitScale();
+		for (std::size_t i = 0; i < batch.size(); i++) {
+			auto& result = results[i];
+			result.reading = batch[i];
+			result.main_field = m_fluxes[i].norm() / scale;
+			result.diurnal = 0.0;
+			result.base_valid = !m_use_base || m_base.correction(batch[i].time, base, result.diurnal);
+			result.anomaly = batch[i].total - result.main_field - result.diurnal;
+			if (result.base_valid) {
+				m_anomaly.add(result.anomaly);
+				m_leveling.add(batch[i], result.anomaly);
+			} else {
+				m_rejected++;
+			}
+		}
+	}
+
+	/**
+	 * @brief 日変化補正ができた測定値の残差異常の統計
+	 *
+	 */
+	const RunningStatistics& anomalyStatistics() const { return m_anomaly; }
+	const TieLineLeveling& leveling() const { return m_leveling; }
+
+	/**
+	 * @brief 基準局で補正できなかった測定値の数
+	 *
+	 */
+	std::size_t rejected() const { return m_rejected; }
+
+  private:
+	GeoMagFlux m_flux;
+	SurveyConfig m_config;
+	BaseStationMerger m_base;
+	TieLineLeveling m_leveling;
+	RunningStatistics m_anomaly;
+	std::size_t m_rejected = 0;
+	bool m_use_base = true;
+	std::vector<Wgs84> m_positions;
+	std::vector<Eigen::Vector3d> m_fluxes;
+};
+
+GEOMAG_NAMESPACE_END
@@ -0,0 +1,484 @@
+/**
+ * @file TileService.hpp
+ * @author Kaiji Takeuchi
+ * @brief Webメルカトル (XYZ) タイルを要求に応じて計算し、LRUキャッシュと先読みで配信する
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+#include "Reduction.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 最近使われていないものから捨てるキャッシュ
+ * @remark スレッドセーフではないので、呼び出し側で排他する
+ *
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+  public:
+	explicit LruCache(std::size_t capacity) : m_capacity(std::max<std::size_t>(capacity, 1)) {}
+
+	/**
+	 * @brief 値を取り出し、最近使ったものとして先頭に移す
+	 *
+	 * @return bool 見つかったか
+	 */
+	bool get(const Key& key, Value& value) {
+		const auto it = m_index.find(key);
+		if (it == m_index.end()) {
+			return false;
+		}
+		m_items.splice(m_items.begin(), m_items, it->second);
+		value = it->second->second;
+		return true;
+	}
+
+	bool contains(const Key& key) const { return m_index.count(key) > 0; }
+
+	/**
+	 * @brief 値を入れる (容量を超えたら最も古いものを捨てる)
+	 *
+	 */
+	void put(const Key& key, Value value) {
+		const auto it = m_index.find(key);
+		if (it != m_index.end()) {
+			it->second->second = std::move(value);
+			m_items.splice(m_items.begin(), m_items, it->second);
+			return;
+		}
+		m_items.emplace_front(key, std::move(value));
+		m_index.emplace(key, m_items.begin());
+		if (m_items.size() > m_capacity) {
+			m_index.erase(m_items.back().first);
+			m_items.pop_back();
+		}
+	}
+
+	void clear() {
+		m_items.clear();
+		m_index.clear();
+	}
+
+	std::size_t size() const { return m_items.size(); }
+	std::size_t capacity() const { return m_capacity; }
+
+  private:
+	std::size_t m_capacity;
+	std::list<std::pair<Key, Value>> m_items; // 先頭ほど最近使った
+	std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> m_index;
+};
+
+/**
+ * @brief タイルのキー
+ *
+ */
+struct TileKey {
+	FieldQuantity quantity = FieldQuantity::Total;
+	std::int64_t epoch = 0; // 量子化した時刻
+	std::uint32_t z = 0, x = 0, y = 0;
+
+	bool operator==(const TileKey& other) const {
+		return quantity == other.quantity && epoch == other.epoch && z == other.z && x == other.x && y == other.y;
+	}
+};
+
+struct TileKeyHash {
+	std::size_t operator()(const TileKey& key) const {
+		std::uint64_t h = 0x9e3779b97f4a7c15ULL;
+		for (std::uint64_t v : {static_cast<std::uint64_t>(key.quantity), static_cast<std::uint64_t>(key.epoch),
+								(static_cast<std::uint64_t>(key.z) << 58) ^ (static_cast<std::uint64_t>(key.x) << 29) ^ key.y}) {
+			h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		}
+		return static_cast<std::size_t>(h);
+	}
+};
+
+/**
+ * @brief 値を色に変換する区分線形のカラーマップ
+ *
+ */
+struct TileColormap {
+	struct Stop {
+		double value;
+		std::uint8_t r, g, b;
+	};
+	std::vector<Stop> stops; // 値の昇順
+
+	/**
+	 * @brief 値をRGBAに変換する (範囲外は端の色、NaNは透明)
+	 *
+	 */
+	void operator()(double value, std::uint8_t* rgba) const {
+		if (std::isnan(value) || stops.empty()) {
+			rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0;
+			return;
+		}
+		std::size_t i = 1;
+		while (i < stops.size() && stops[i].value < value) {
+			i++;
+		}
+		const Stop& low = stops[i - 1];
+		const Stop& high = stops[std::min(i, stops.size() - 1)];
+		const double t = high.value > low.value ? std::min(std::max((value - low.value) / (high.value - low.value), 0.0), 1.0) : 0.0;
+		rgba[0] = static_cast<std::uint8_t>(std::lround(low.r + t * (high.r - low.r)));
+		rgba[1] = static_cast<std::uint8_t>(std::lround(low.g + t * (high.g - low.g)));
+		rgba[2] = static_cast<std::uint8_t>(std::lround(low.b + t * (high.b - low.b)));
+		rgba[3] = 255;
+	}
+
+	/**
+	 * @brief 青・白・赤の発散型 (0を中心とする量)
+	 *
+	 */
+	static auto diverging(double low, double high) -> TileColormap {
+		return TileColormap{{{low, 33, 102, 172}, {(low + high) / 2, 247, 247, 247}, {high, 178, 24, 43}}};
+	}
+
+	/**
+	 * @brief 暗い青から黄への順序型 (強度)
+	 *
+	 */
+	static auto sequential(double low, double high) -> TileColormap {
+		const double d = (high - low) / 4;
+		return TileColormap{{{low, 68, 1, 84}, {low + d, 59, 82, 139}, {low + 2 * d, 33, 145, 140}, {low + 3 * d, 94, 201, 98}, {high, 253, 231, 37}}};
+	}
+
+	/**
+	 * @brief 量ごとの既定のカラーマップ (角度は[deg]、磁束密度は[nT])
+	 *
+	 */
+	static auto forQuantity(FieldQuantity quantity) -> TileColormap {
+		switch (quantity) {
+			case FieldQuantity::North: return sequential(-5000.0, 42000.0);
+			case FieldQuantity::East: return diverging(-15000.0, 15000.0);
+			case FieldQuantity::Down: return diverging(-66000.0, 66000.0);
+			case FieldQuantity::Horizontal: return sequential(0.0, 42000.0);
+			case FieldQuantity::Inclination: return diverging(-90.0, 90.0);
+			case FieldQuantity::Declination: return diverging(-30.0, 30.0);
+			default: return sequential(20000.0, 66000.0);
+		}
+	}
+};
+
+/**
+ * @brief タイル配信の設定
+ *
+ */
+struct TileServiceConfig {
+	std::size_t tile_size = 256;	 // タイルの一辺の画素数
+	std::size_t cache_tiles = 1024;	 // キャッシュに保持するタイルの数
+	TimeSpan epoch_step = Days(1);	 // 時刻の刻み (この幅の区間の先頭の時刻で計算する)
+	double altitude = 0.0;			 // 楕円体高 [m]
+	std::size_t prefetch_radius = 1; // 要求されたタイルの周囲何枚まで先読みするか (0で先読みしない)
+	std::size_t prefetch_queue = 64; // 先読みの待ち行列の上限 (超えた分は先読みしない)
+	std::size_t num_threads = 0;	 // 先読みのスレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief タイル配信の統計
+ *
+ */
+struct TileServiceStats {
+	std::uint64_t requests = 0;	  // 要求されたタイルの数
+	std::uint64_t hits = 0;		  // キャッシュにあった数
+	std::uint64_t joined = 0;	  // 計算中のタイルの完了を待った数
+	std::uint64_t rendered = 0;	  // 要求を受けて計算した数
+	std::uint64_t prefetched = 0; // 先読みで計算した数
+};
+
+/**
+ * @brief Webメルカトル (XYZ) タイルを要求に応じて計算する
+ * @remark タイルの各行は緯度が等しく経度が等間隔なので、GeoMagFlux::evaluateRowで1行ずつ合成する。
+ *         要求されたタイルは呼び出したスレッドで計算し (最初の描画の待ち時間を短くするため)、周囲のタイルはスレッドプールで先読みする。
+ *         同じタイルへの同時の要求は1回だけ計算して結果を共有する。値は角度が[deg]、磁束密度が[nT]
+ *
+ */
+class TileService {
+  public:
+	using Tile = std::shared_ptr<const std::vector<float>>; // tile_size * tile_size 個の値 (北の行から、行優先)
+
+	/**
+	 * @brief Construct a new Tile Service object
+	 *
+	 * @param flux 評価器 (複製して使う)
+	 * @param config 設定
+	 */
+	explicit TileService(const GeoMagFlux& flux, const TileServiceConfig& config = TileServiceConfig{})
+	  : m_config(config), m_prototype(flux), m_cache(config.cache_tiles), m_pool(config.num_threads) {
+		if (m_config.tile_size == 0 || m_config.epoch_step.ticks() <= 0) {
+			throw std::runtime_error("TileService: tile size and epoch step must be positive");
+		}
+		m_prototype.setOutputUnit(MagFluxUnit::NanoTesla);
+		m_prefetch_evaluators.reserve(m_pool.size());
+		for (std::size_t i = 0; i < m_pool.size(); i++) {
+			m_prefetch_evaluators.push_back(m_prototype);
+		}
+	}
+
+	~TileService() { m_pool.cancel(); }
+
+	/**
+	 * @brief タイルのキーを作る
+	 *
+	 * @param quantity 量
+	 * @param epoch 時刻 (epoch_stepで量子化する)
+	 * @param z ズームレベル
+	 * @param x 西から数えたタイルの列
+	 * @param y 北から数えたタイルの行
+	 */
+	auto key(FieldQuantity quantity, const DateTime& epoch, std::uint32_t z, std::uint32_t x, std::uint32_t y) const -> TileKey {
+		if (z > max_zoom || x >= (1u << z) || y >= (1u << z)) {
+			throw std::runtime_error("TileService: tile out of range");
+		}
+		const std::int64_t step = m_config.epoch_step.ticks();
+		const std::int64_t ticks = epoch.ticks();
+		TileKey key;
+		key.quantity = quantity;
+		key.epoch = ticks >= 0 ? ticks / step : -((-ticks + step - 1) / step);
+		key.z = z;
+		key.x = x;
+		key.y = y;
+		return key;
+	}
+
+	/**
+	 * @brief タイルの値を取得する
+	 * @remark キャッシュになければこのスレッドで計算し、周囲のタイルの先読みを予約する
+	 *
+	 */
+	auto tile(const TileKey& key) -> Tile {
+		m_requests++;
+		Tile tile = fetch(key, nullptr);
+		prefetchAround(key);
+		return tile;
+	}
+
+	auto tile(FieldQuantity quantity, const DateTime& epoch, std::uint32_t z, std::uint32_t x, std::uint32_t y) -> Tile {
+		return tile(key(quantity, epoch, z, x, y));
+	}
+
+	/**
+	 * @brief タイルを色付けしたRGBA画像で取得する
+	 *
+	 * @return std::vector<std::uint8_t> tile_size * tile_size * 4 byte (北の行から、行優先)
+	 */
+	auto rgba(const TileKey& key, const TileColormap& colormap) -> std::vector<std::uint8_t> {
+		std::vector<std::uint8_t> image;
+		colorize(*tile(key), colormap, image);
+		return image;
+	}
+
+	auto rgba(const TileKey& key) -> std::vector<std::uint8_t> { return rgba(key, TileColormap::forQuantity(key.quantity)); }
+
+	/**
+	 * @brief 値の配列をRGBAに変換する
+	 *
+	 */
+	static void colorize(const std::vector<float>& values, const TileColormap& colormap, std::vector<std::uint8_t>& image) {
+		image.resize(values.size() * 4);
+		for (std::size_t i = 0; i < values.size(); i++) {
+			colormap(values[i], image.data() + 4 * i);
+		}
+	}
+
+	/**
+	 * @brief 予約済みの先読みがすべて終わるまで待つ
+	 *
+	 */
+	void waitPrefetch() { m_pool.wait(); }
+
+	auto stats() const -> TileServiceStats {
+		TileServiceStats stats;
+		stats.requests = m_requests.load();
+		stats.hits = m_hits.load();
+		stats.joined = m_joined.load();
+		stats.rendered = m_rendered.load();
+		stats.prefetched = m_prefetched.load();
+		return stats;
+	}
+
+	const TileServiceConfig& config() const { return m_config; }
+
+	/**
+	 * @brief タイル内の画素の行の中心の緯度 [deg]
+	 *
+	 */
+	static double pixelLatitude(std::uint32_t z, std::uint32_t y, std::size_t row, std::size_t tile_size) {
+		const double v = (y + (row + 0.5) / static_cast<double>(tile_size)) / std::ldexp(1.0, static_cast<int>(z));
+		return std::atan(std::sinh(constant::pi * (1.0 - 2.0 * v))) * 180.0 / constant::pi;
+	}
+
+	/**
+	 * @brief タイル内の画素の列の中心の経度 [deg]
+	 *
+	 */
+	static double pixelLongitude(std::uint32_t z, std::uint32_t x, std::size_t col, std::size_t tile_size) {
+		return (x + (col + 0.5) / static_cast<double>(tile_size)) / std::ldexp(1.0, static_cast<int>(z)) * 360.0 - 180.0;
+	}
+
+	static constexpr std::uint32_t max_zoom = 30;
+
+  private:
+	TileServiceConfig m_config;
+	GeoMagFlux m_prototype;
+	std::mutex m_mutex; // m_cacheとm_inflightを守る
+	LruCache<TileKey, Tile, TileKeyHash> m_cache;
+	std::unordered_map<TileKey, std::shared_future<Tile>, TileKeyHash> m_inflight;
+	std::mutex m_evaluator_mutex;
+	std::vector<std::unique_ptr<GeoMagFlux>> m_free_evaluators; // 要求を処理するスレッドが借りる評価器
+	std::vector<GeoMagFlux> m_prefetch_evaluators;				// 先読みのスレッドごとの評価器
+	std::atomic<std::uint64_t> m_requests{0}, m_hits{0}, m_joined{0}, m_rendered{0}, m_prefetched{0};
+	ThreadPool m_pool; // 最初に破棄され、実行中の先読みを待つ
+
+	/**
+	 * @brief キャッシュ・計算中のタイル・新たな計算の順にタイルを得る
+	 *
+	 * @param key キー
+	 * @param evaluator 先読みのスレッドの評価器 (nullptrの場合は要求の処理で、評価器を借りる)
+	 * @return Tile タイル (先読みで、すでにあるか計算中の場合はnullptr)
+	 */
+	auto fetch(const TileKey& key, GeoMagFlux* evaluator) -> Tile {
+		const bool prefetch = evaluator != nullptr;
+		std::promise<Tile> promise;
+		std::shared_future<Tile> pending;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Tile tile;
+			if (m_cache.get(key, tile)) {
+				if (prefetch) {
+					return nullptr;
+				}
+				m_hits++;
+				return tile;
+			}
+			const auto it = m_inflight.find(key);
+			if (it == m_inflight.end()) {
+				m_inflight.emplace(key, promise.get_future().share());
+			} else if (prefetch) {
+				return nullptr;
+			} else {
+				pending = it->second;
+				m_joined++;
+			}
+		}
+		if (pending.valid()) {
+			return pending.get();
+		}
+
+		Tile tile;
+		try {
+			if (prefetch) {
+				tile = render(key, *evaluator);
+			} else {
+				std::unique_ptr<GeoMagFlux> borrowed = acquireEvaluator();
+				tile = render(key, *borrowed);
+				releaseEvaluator(std::move(borrowed));
+			}
+		} catch (...) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_inflight.erase(key);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cache.put(key, tile);
+			m_inflight.erase(key);
+		}
+		promise.set_value(tile);
+		(prefetch ? m_prefetched : m_rendered)++;
+		return tile;
+	}
+
+	/**
+	 * @brief タイルを1行ずつ合成する
+	 *
+	 */
+	auto render(const TileKey& key, GeoMagFlux& evaluator) const -> Tile {
+		const std::size_t n = m_config.tile_size;
+		const DateTime epoch(key.epoch * m_config.epoch_step.ticks());
+		const double step = 360.0 / (std::ldexp(1.0, static_cast<int>(key.z)) * static_cast<double>(n));
+		const double west = pixelLongitude(key.z, key.x, 0, n);
+		const FieldValue value{key.quantity};
+
+		auto values = std::make_shared<std::vector<float>>(n * n);
+		std::vector<Eigen::Vector3d> row(n);
+		for (std::size_t j = 0; j < n; j++) {
+			evaluator.evaluateRow(epoch, Degree{pixelLatitude(key.z, key.y, j, n)}, m_config.altitude, Degree{west}, Degree{step}, n, row.data());
+			for (std::size_t i = 0; i < n; i++) {
+				(*values)[j * n + i] = static_cast<float>(value(row[i]));
+			}
+		}
+		return values;
+	}
+
+	/**
+	 * @brief 周囲のタイルの先読みを予約する (経度方向は周期的につなぐ)
+	 *
+	 */
+	void prefetchAround(const TileKey& center) {
+		const std::int64_t radius = static_cast<std::int64_t>(m_config.prefetch_radius);
+		const std::int64_t tiles = std::int64_t{1} << center.z;
+		for (std::int64_t dy = -radius; dy <= radius; dy++) {
+			for (std::int64_t dx = -radius; dx <= radius; dx++) {
+				const std::int64_t y = center.y + dy;
+				if ((dx == 0 && dy == 0) || y < 0 || y >= tiles || m_pool.pending() >= m_config.prefetch_queue) {
+					continue;
+				}
+				TileKey key = center;
+				key.x = static_cast<std::uint32_t>(((center.x + dx) % tiles + tiles) % tiles);
+				key.y = static_cast<std::uint32_t>(y);
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (m_cache.contains(key) || m_inflight.count(key) > 0) {
+						continue;
+					}
+				}
+				m_pool.submit([this, key](std::size_t thread_index) { fetch(key, &m_prefetch_evaluators[thread_index]); });
+			}
+		}
+	}
+
+	auto acquireEvaluator() -> std::unique_ptr<GeoMagFlux> {
+		std::lock_guard<std::mutex> lock(m_evaluator_mutex);
+		if (m_free_evaluators.empty()) {
+			return std::unique_ptr<GeoMagFlux>(new GeoMagFlux(m_prototype));
+		}
+		std::unique_ptr<GeoMagFlux> evaluator = std::move(m_free_evaluators.back());
+		m_free_evaluators.pop_back();
+		return evaluator;
+	}
+
+	void releaseEvaluator(std::unique_ptr<GeoMagFlux> evaluator) {
+		std::lock_guard<std::mutex> lock(m_evaluator_mutex);
+		m_free_evaluators.push_back(std::move(evaluator));
+	}
+};
+
+GEOMAG_NAMESPACE_END
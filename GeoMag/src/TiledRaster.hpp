@@ -0,0 +1,543 @@
+/**
+ * @file TiledRaster.hpp
+ * @author Kaiji Takeuchi
+ * @brief タイルに分けたラスタの書き出しと、メモリマップによる部分読み込み
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Essential.hpp"
+#include "FileHandle.hpp"
+#include "GeoMagFlux.hpp"
+#include "MappedFile.hpp"
+#include "Parallel.hpp"
+#include "Reduction.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief タイルの圧縮方法
+ *
+ */
+enum class TileCodec : std::uint32_t {
+	None = 0,		// 圧縮しない
+	ShuffleRle = 1, // 前の値とのXOR、バイトごとの並べ替え、ランレングス符号化 (可逆)
+};
+
+/**
+ * @brief ラスタの大きさと格子
+ *
+ */
+struct TiledRasterInfo {
+	std::size_t width = 0;		   // 列数 (経度方向)
+	std::size_t height = 0;		   // 行数 (緯度方向)
+	std::size_t layers = 1;		   // 層の数 (時刻・高度・成分など)
+	std::size_t tile_width = 256;  // タイルの列数
+	std::size_t tile_height = 256; // タイルの行数
+	double south = 0.0;			   // 最初の行の緯度 [deg]
+	double west = 0.0;			   // 最初の列の経度 [deg]
+	double dlat = 1.0;			   // 緯度の間隔 [deg]
+	double dlon = 1.0;			   // 経度の間隔 [deg]
+
+	std::size_t tilesX() const { return (width + tile_width - 1) / tile_width; }
+	std::size_t tilesY() const { return (height + tile_height - 1) / tile_height; }
+	std::size_t tileCount() const { return tilesX() * tilesY() * layers; }
+	std::size_t tileIndex(std::size_t layer, std::size_t tile_x, std::size_t tile_y) const { return (layer * tilesY() + tile_y) * tilesX() + tile_x; }
+
+	/**
+	 * @brief タイルの実際の大きさ (右端・上端のタイルは小さくなる)
+	 *
+	 */
+	std::size_t tileWidth(std::size_t tile_x) const { return std::min(tile_width, width - tile_x * tile_width); }
+	std::size_t tileHeight(std::size_t tile_y) const { return std::min(tile_height, height - tile_y * tile_height); }
+};
+
+/**
+ * @brief タイルの符号化
+ *
+ */
+struct TileCodecHelper {
+	/**
+	 * @brief ShuffleRleで符号化する
+	 * @remark 滑らかな場では隣の値と符号・指数・仮数の上位が一致するので、XORした上位バイトの面は0が続き、ランレングスでよく縮む
+	 *
+	 * @param values 値
+	 * @param count 値の数
+	 * @param output 符号 (末尾に追加する)
+	 */
+	static void encode(const float* values, std::size_t count, std::vector<std::uint8_t>& output) {
+		std::vector<std::uint8_t> planes(count * 4);
+		std::uint32_t previous = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			std::uint32_t bits;
+			std::memcpy(&bits, values + i, sizeof(bits));
+			const std::uint32_t x = bits ^ previous;
+			previous = bits;
+			for (std::size_t b = 0; b < 4; b++) {
+				planes[b * count + i] = static_cast<std::uint8_t>(x >> (24 - 8 * b)); // 上位バイトから
+			}
+		}
+
+		// PackBits: 制御バイトcが128未満ならc+1バイトの生データ、128以上なら次の1バイトをc-126回繰り返す
+		const std::size_t size = planes.size();
+		std::size_t i = 0;
+		while (i < size) {
+			std::size_t run = 1;
+			while (i + run < size && run < 129 && planes[i + run] == planes[i]) {
+				run++;
+			}
+			if (run >= 2) {
+				output.push_back(static_cast<std::uint8_t>(run + 126));
+				output.push_back(planes[i]);
+				i += run;
+				continue;
+			}
+			std::size_t literal = 1;
+			while (i + literal < size && literal < 128 && !(i + literal + 1 < size && planes[i + literal] == planes[i + literal + 1])) {
+				literal++;
+			}
+			output.push_back(static_cast<std::uint8_t>(literal - 1));
+			output.insert(output.end(), planes.begin() + static_cast<std::ptrdiff_t>(i), planes.begin() + static_cast<std::ptrdiff_t>(i + literal));
+			i += literal;
+		}
+	}
+
+	/**
+	 * @brief ShuffleRleの符号を復号する
+	 *
+	 * @return bool 符号が正しいか
+	 */
+	static auto decode(const std::uint8_t* input, std::size_t size, float* values, std::size_t count) -> bool {
+		std::vector<std::uint8_t> planes(count * 4);
+		std::size_t out = 0;
+		for (std::size_t i = 0; i < size;) {
+			const std::uint8_t c = input[i++];
+			if (c < 128) {
+				const std::size_t literal = c + 1u;
+				if (i + literal > size || out + literal > planes.size()) {
+					return false;
+				}
+				std::memcpy(planes.data() + out, input + i, literal);
+				i += literal;
+				out += literal;
+			} else {
+				const std::size_t run = c - 126u;
+				if (i >= size || out + run > planes.size()) {
+					return false;
+				}
+				std::memset(planes.data() + out, input[i++], run);
+				out += run;
+			}
+		}
+		if (out != planes.size()) {
+			return false;
+		}
+
+		std::uint32_t previous = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			std::uint32_t x = 0;
+			for (std::size_t b = 0; b < 4; b++) {
+				x = (x << 8) | planes[b * count + i];
+			}
+			previous ^= x;
+			std::memcpy(values + i, &previous, sizeof(previous));
+		}
+		return true;
+	}
+};
+
+/**
+ * @brief タイルラスタのファイル形式
+ * @remark [ヘッダ][タイル (書き終えた順)][索引: タイルごとの位置・大きさ・圧縮方法][末尾: 索引の位置・タイル数・識別子]。
+ *         値はfloat32、タイル内は行優先。書かれなかったタイルは大きさ0で、読むとNaNになる。バイト順はホストの順
+ *
+ */
+struct TiledRasterFormat {
+	struct Header {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t reserved0;
+		std::uint32_t width, height, layers;
+		std::uint32_t tile_width, tile_height;
+		std::uint32_t reserved1;
+		double south, west, dlat, dlon;
+		std::uint64_t reserved2;
+	};
+
+	struct IndexEntry {
+		std::uint64_t offset;
+		std::uint32_t size; // [byte] (0は書かれていないタイル)
+		std::uint32_t codec;
+	};
+
+	struct Trailer {
+		std::uint64_t index_offset;
+		std::uint64_t tile_count;
+		char magic[8];
+	};
+
+	static constexpr std::uint32_t version = 1;
+	static const char* headerMagic() { return "GMTILE1"; } // 終端の0を含めて8 byte
+	static const char* trailerMagic() { return "GMTIDX1"; }
+};
+
+static_assert(sizeof(TiledRasterFormat::Header) == 80, "TiledRasterFormat: unexpected header padding");
+static_assert(sizeof(TiledRasterFormat::IndexEntry) == 16, "TiledRasterFormat: unexpected index padding");
+static_assert(sizeof(TiledRasterFormat::Trailer) == 24, "TiledRasterFormat: unexpected trailer padding");
+
+/**
+ * @brief タイルラスタを書き出す
+ * @remark writeTileは複数のスレッドから同時に呼べる。圧縮は呼び出したスレッドで行い、書き込み位置だけを排他的に確保して
+ *         位置を指定して書くので、タイルは計算し終えた順にそのままディスクへ流れる
+ *
+ */
+class TiledRasterWriter {
+  public:
+	/**
+	 * @brief Construct a new Tiled Raster Writer object
+	 *
+	 * @param path ファイルのパス
+	 * @param info ラスタの大きさと格子
+	 * @param codec タイルの圧縮方法 (縮まないタイルは圧縮せずに書く)
+	 */
+	TiledRasterWriter(const std::string& path, const TiledRasterInfo& info, TileCodec codec = TileCodec::ShuffleRle)
+	  : m_info(info), m_codec(codec), m_index(info.tileCount(), TiledRasterFormat::IndexEntry{0, 0, 0}) {
+		if (info.width == 0 || info.height == 0 || info.layers == 0 || info.tile_width == 0 || info.tile_height == 0) {
+			throw std::runtime_error("TiledRasterWriter: raster and tile sizes must be positive");
+		}
+		m_file = FileHandle(path, FileHandle::Mode::Write, "TiledRasterWriter");
+
+		TiledRasterFormat::Header header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, TiledRasterFormat::headerMagic(), sizeof(header.magic));
+		header.version = TiledRasterFormat::version;
+		header.width = static_cast<std::uint32_t>(info.width);
+		header.height = static_cast<std::uint32_t>(info.height);
+		header.layers = static_cast<std::uint32_t>(info.layers);
+		header.tile_width = static_cast<std::uint32_t>(info.tile_width);
+		header.tile_height = static_cast<std::uint32_t>(info.tile_height);
+		header.south = info.south;
+		header.west = info.west;
+		header.dlat = info.dlat;
+		header.dlon = info.dlon;
+		writeAt(&header, sizeof(header), 0);
+		m_offset = sizeof(header);
+	}
+
+	TiledRasterWriter(const TiledRasterWriter&) = delete;
+	TiledRasterWriter& operator=(const TiledRasterWriter&) = delete;
+
+	~TiledRasterWriter() {
+		try {
+			close();
+		} catch (...) {
+		}
+	}
+
+	/**
+	 * @brief タイルを書く
+	 *
+	 * @param layer 層
+	 * @param tile_x タイルの列
+	 * @param tile_y タイルの行
+	 * @param values tileWidth(tile_x) * tileHeight(tile_y) 個の値 (行優先)
+	 */
+	void writeTile(std::size_t layer, std::size_t tile_x, std::size_t tile_y, const float* values) {
+		if (layer >= m_info.layers || tile_x >= m_info.tilesX() || tile_y >= m_info.tilesY()) {
+			throw std::runtime_error("TiledRasterWriter: tile out of range");
+		}
+		const std::size_t count = m_info.tileWidth(tile_x) * m_info.tileHeight(tile_y);
+		const std::size_t raw_size = count * sizeof(float);
+
+		const void* data = values;
+		std::size_t size = raw_size;
+		TileCodec codec = TileCodec::None;
+		std::vector<std::uint8_t> encoded;
+		if (m_codec == TileCodec::ShuffleRle) {
+			encoded.reserve(raw_size / 2);
+			TileCodecHelper::encode(values, count, encoded);
+			if (encoded.size() < raw_size) {
+				data = encoded.data();
+				size = encoded.size();
+				codec = TileCodec::ShuffleRle;
+			}
+		}
+
+		const std::uint64_t offset = m_offset.fetch_add(size);
+		writeAt(data, size, offset);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_index[m_info.tileIndex(layer, tile_x, tile_y)] = TiledRasterFormat::IndexEntry{offset, static_cast<std::uint32_t>(size), static_cast<std::uint32_t>(codec)};
+		m_written += size;
+	}
+
+	/**
+	 * @brief 索引を書いて閉じる
+	 *
+	 */
+	void close() {
+		if (!m_file.isOpen()) {
+			return;
+		}
+		const std::uint64_t index_offset = m_offset.load();
+		writeAt(m_index.data(), m_index.size() * sizeof(TiledRasterFormat::IndexEntry), index_offset);
+		TiledRasterFormat::Trailer trailer;
+		trailer.index_offset = index_offset;
+		trailer.tile_count = m_index.size();
+		std::memcpy(trailer.magic, TiledRasterFormat::trailerMagic(), sizeof(trailer.magic));
+		writeAt(&trailer, sizeof(trailer), index_offset + m_index.size() * sizeof(TiledRasterFormat::IndexEntry));
+		m_file.close();
+	}
+
+	const TiledRasterInfo& info() const { return m_info; }
+	std::uint64_t bytesWritten() const { return m_written; } // タイルの合計 [byte]
+
+  private:
+	TiledRasterInfo m_info;
+	TileCodec m_codec;
+	FileHandle m_file;
+	std::atomic<std::uint64_t> m_offset{0};
+	std::mutex m_mutex;
+	std::vector<TiledRasterFormat::IndexEntry> m_index;
+	std::atomic<std::uint64_t> m_written{0};
+
+	void writeAt(const void* data, std::size_t size, std::uint64_t offset) {
+		const char* ptr = static_cast<const char*>(data);
+		while (size > 0) {
+			const std::ptrdiff_t n = m_file.writeAt(ptr, size, static_cast<std::int64_t>(offset));
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::runtime_error(std::string("TiledRasterWriter: write: ") + std::strerror(errno));
+			}
+			ptr += n;
+			size -= static_cast<std::size_t>(n);
+			offset += static_cast<std::uint64_t>(n);
+		}
+	}
+};
+
+/**
+ * @brief タイルラスタをメモリに割り当てて読む
+ * @remark 読むのは要求したタイルのページだけ。const関数は複数のスレッドから同時に呼べる
+ *
+ */
+class TiledRasterReader {
+  public:
+	explicit TiledRasterReader(const std::string& path) : m_file(path, MappedFile::Access::Random) {
+		if (m_file.size() < sizeof(TiledRasterFormat::Header) + sizeof(TiledRasterFormat::Trailer)) {
+			throw std::runtime_error("TiledRasterReader: " + path + " is too small");
+		}
+		TiledRasterFormat::Header header;
+		std::memcpy(&header, m_file.data(), sizeof(header));
+		if (std::memcmp(header.magic, TiledRasterFormat::headerMagic(), sizeof(header.magic)) != 0 || header.version != TiledRasterFormat::version) {
+			throw std::runtime_error("TiledRasterReader: " + path + " is not a tiled raster");
+		}
+		m_info.width = header.width;
+		m_info.height = header.height;
+		m_info.layers = header.layers;
+		m_info.tile_width = header.tile_width;
+		m_info.tile_height = header.tile_height;
+		m_info.south = header.south;
+		m_info.west = header.west;
+		m_info.dlat = header.dlat;
+		m_info.dlon = header.dlon;
+		if (m_info.width == 0 || m_info.height == 0 || m_info.layers == 0 || m_info.tile_width == 0 || m_info.tile_height == 0) {
+			throw std::runtime_error("TiledRasterReader: " + path + " has an invalid tile size");
+		}
+		// 壊れたヘッダでタイル数の積があふれないよう、ファイルに入る索引の数で先に抑える
+		const std::size_t max_tiles =
+		  (m_file.size() - sizeof(TiledRasterFormat::Header) - sizeof(TiledRasterFormat::Trailer)) / sizeof(TiledRasterFormat::IndexEntry);
+		if (m_info.tilesX() > max_tiles || m_info.tilesY() > max_tiles / m_info.tilesX() ||
+			m_info.layers > max_tiles / (m_info.tilesX() * m_info.tilesY())) {
+			throw std::runtime_error("TiledRasterReader: " + path + " has a corrupt header");
+		}
+
+		TiledRasterFormat::Trailer trailer;
+		std::memcpy(&trailer, m_file.data() + m_file.size() - sizeof(trailer), sizeof(trailer));
+		if (std::memcmp(trailer.magic, TiledRasterFormat::trailerMagic(), sizeof(trailer.magic)) != 0) {
+			throw std::runtime_error("TiledRasterReader: " + path + " has no index (the writer was not closed)");
+		}
+		if (trailer.tile_count != m_info.tileCount() || trailer.index_offset < sizeof(TiledRasterFormat::Header) ||
+			trailer.index_offset + trailer.tile_count * sizeof(TiledRasterFormat::IndexEntry) + sizeof(trailer) != m_file.size()) {
+			throw std::runtime_error("TiledRasterReader: " + path + " has a corrupt index");
+		}
+		m_index.resize(trailer.tile_count);
+		std::memcpy(m_index.data(), m_file.data() + trailer.index_offset, m_index.size() * sizeof(TiledRasterFormat::IndexEntry));
+		for (const auto& entry : m_index) {
+			if (entry.size > 0 && (entry.offset < sizeof(TiledRasterFormat::Header) || entry.offset > trailer.index_offset ||
+								   entry.size > trailer.index_offset - entry.offset)) {
+				throw std::runtime_error("TiledRasterReader: " + path + " has a corrupt index");
+			}
+		}
+	}
+
+	const TiledRasterInfo& info() const { return m_info; }
+
+	bool hasTile(std::size_t layer, std::size_t tile_x, std::size_t tile_y) const {
+		return m_index[checkedIndex(layer, tile_x, tile_y)].size > 0;
+	}
+
+	/**
+	 * @brief タイルを読む
+	 *
+	 * @param values tileWidth(tile_x) * tileHeight(tile_y) 個の値を書き込む配列 (書かれていないタイルはNaN)
+	 */
+	void readTile(std::size_t layer, std::size_t tile_x, std::size_t tile_y, float* values) const {
+		const auto& entry = m_index[checkedIndex(layer, tile_x, tile_y)];
+		const std::size_t count = m_info.tileWidth(tile_x) * m_info.tileHeight(tile_y);
+		const char* data = m_file.data() + entry.offset;
+		if (entry.size == 0) {
+			std::fill(values, values + count, std::numeric_limits<float>::quiet_NaN());
+		} else if (entry.codec == static_cast<std::uint32_t>(TileCodec::None)) {
+			if (entry.size != count * sizeof(float)) {
+				throw std::runtime_error("TiledRasterReader: corrupt tile");
+			}
+			std::memcpy(values, data, entry.size);
+		} else if (entry.codec == static_cast<std::uint32_t>(TileCodec::ShuffleRle)) {
+			if (!TileCodecHelper::decode(reinterpret_cast<const std::uint8_t*>(data), entry.size, values, count)) {
+				throw std::runtime_error("TiledRasterReader: corrupt tile");
+			}
+		} else {
+			throw std::runtime_error("TiledRasterReader: unknown tile codec");
+		}
+	}
+
+	/**
+	 * @brief 矩形の範囲を読む
+	 * @remark 範囲に重なるタイルだけを復号する
+	 *
+	 * @param layer 層
+	 * @param x 最初の列
+	 * @param y 最初の行
+	 * @param width 列数
+	 * @param height 行数
+	 * @param values width * height 個の値を書き込む配列 (行優先)
+	 */
+	void readWindow(std::size_t layer, std::size_t x, std::size_t y, std::size_t width, std::size_t height, float* values) const {
+		if (layer >= m_info.layers || x + width > m_info.width || y + height > m_info.height) {
+			throw std::runtime_error("TiledRasterReader: window out of range");
+		}
+		if (width == 0 || height == 0) {
+			return;
+		}
+		std::vector<float> tile(m_info.tile_width * m_info.tile_height);
+		for (std::size_t ty = y / m_info.tile_height; ty <= (y + height - 1) / m_info.tile_height; ty++) {
+			for (std::size_t tx = x / m_info.tile_width; tx <= (x + width - 1) / m_info.tile_width; tx++) {
+				readTile(layer, tx, ty, tile.data());
+				const std::size_t tile_x0 = tx * m_info.tile_width, tile_y0 = ty * m_info.tile_height, tile_w = m_info.tileWidth(tx);
+				const std::size_t col_begin = std::max(x, tile_x0), col_end = std::min(x + width, tile_x0 + tile_w);
+				const std::size_t row_begin = std::max(y, tile_y0), row_end = std::min(y + height, tile_y0 + m_info.tileHeight(ty));
+				for (std::size_t row = row_begin; row < row_end; row++) {
+					std::copy(tile.data() + (row - tile_y0) * tile_w + (col_begin - tile_x0), tile.data() + (row - tile_y0) * tile_w + (col_end - tile_x0),
+							  values + (row - y) * width + (col_begin - x));
+				}
+			}
+		}
+	}
+
+	auto window(std::size_t layer, std::size_t x, std::size_t y, std::size_t width, std::size_t height) const -> std::vector<float> {
+		std::vector<float> values(width * height);
+		readWindow(layer, x, y, width, height, values.data());
+		return values;
+	}
+
+  private:
+	MappedFile m_file;
+	TiledRasterInfo m_info;
+	std::vector<TiledRasterFormat::IndexEntry> m_index;
+
+	std::size_t checkedIndex(std::size_t layer, std::size_t tile_x, std::size_t tile_y) const {
+		if (layer >= m_info.layers || tile_x >= m_info.tilesX() || tile_y >= m_info.tilesY()) {
+			throw std::runtime_error("TiledRasterReader: tile out of range");
+		}
+		return m_info.tileIndex(layer, tile_x, tile_y);
+	}
+};
+
+/**
+ * @brief 格子の磁場をタイルラスタに書き出す
+ *
+ */
+struct TiledRaster {
+	/**
+	 * @brief 格子と時刻の組を評価してタイルごとに書き出す
+	 * @remark (時刻, タイル) を単位に並列に評価し、評価し終えたタイルから書く。層は 時刻 * quantities.size() + 量 の順に並ぶ
+	 *
+	 * @param flux 評価器 (スレッドごとに複製する)
+	 * @param grid 格子と時刻の組
+	 * @param quantities 書き出す量 (各点で1回だけ評価してすべての量を求める)
+	 * @param writer 書き出し先 (infoの大きさと層の数は格子に合わせておく)
+	 * @param num_threads スレッド数 (0の場合はハードウェアの並列数)
+	 */
+	static void synthesize(const GeoMagFlux& flux, const GeodeticGrid& grid, const std::vector<FieldQuantity>& quantities, TiledRasterWriter& writer,
+						   std::size_t num_threads = 0) {
+		const TiledRasterInfo& info = writer.info();
+		if (info.width != grid.cols || info.height != grid.rows || info.layers != grid.epochs.size() * quantities.size()) {
+			throw std::runtime_error("TiledRaster: writer does not match the grid");
+		}
+		const std::size_t tiles = info.tilesX() * info.tilesY();
+		const std::size_t tasks = tiles * grid.epochs.size();
+		std::vector<GeoMagFlux> evaluators(std::min(Parallel::threadCount(num_threads), std::max<std::size_t>(tasks, 1)), flux);
+		std::vector<std::vector<float>> buffers(evaluators.size());
+
+		Parallel::forEach(
+		  0, tasks,
+		  [&](std::size_t thread_index, std::size_t task) {
+			  auto& evaluator = evaluators[thread_index];
+			  auto& buffer = buffers[thread_index];
+			  const std::size_t epoch = task / tiles, tile_x = task % tiles % info.tilesX(), tile_y = task % tiles / info.tilesX();
+			  const std::size_t width = info.tileWidth(tile_x), height = info.tileHeight(tile_y), count = width * height;
+			  buffer.resize(count * quantities.size());
+			  for (std::size_t row = 0; row < height; row++) {
+				  for (std::size_t col = 0; col < width; col++) {
+					  const std::size_t cell = (tile_y * info.tile_height + row) * grid.cols + tile_x * info.tile_width + col;
+					  const Eigen::Vector3d mag_density = evaluator(grid.position(epoch * grid.cells() + cell));
+					  for (std::size_t q = 0; q < quantities.size(); q++) {
+						  buffer[q * count + row * width + col] = static_cast<float>(FieldValue{quantities[q]}(mag_density, evaluator.accuracy()));
+					  }
+				  }
+			  }
+			  for (std::size_t q = 0; q < quantities.size(); q++) {
+				  writer.writeTile(epoch * quantities.size() + q, tile_x, tile_y, buffer.data() + q * count);
+			  }
+		  },
+		  evaluators.size());
+	}
+
+	/**
+	 * @brief 格子に合わせたラスタの情報
+	 *
+	 */
+	static auto info(const GeodeticGrid& grid, std::size_t quantities, std::size_t tile_size = 256) -> TiledRasterInfo {
+		TiledRasterInfo info;
+		info.width = grid.cols;
+		info.height = grid.rows;
+		info.layers = grid.epochs.size() * quantities;
+		info.tile_width = info.tile_height = tile_size;
+		info.south = grid.south;
+		info.west = grid.west;
+		info.dlat = grid.dlat;
+		info.dlon = grid.dlon;
+		return info;
+	}
+};
+
+GEOMAG_NAMESPACE_END
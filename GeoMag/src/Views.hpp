@@ -0,0 +1,341 @@
+/**
+ * @file Views.hpp
+ * @author Kaiji Takeuchi
+ * @brief 座標変換・磁場の評価・成分の導出をつなげる遅延評価ビュー
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Coordinate.hpp"
+#include "Essential.hpp"
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief 左辺値の範囲を参照で保持する
+ *
+ * @tparam Range 範囲の型
+ */
+template <typename Range>
+class RangeReference {
+  public:
+	explicit RangeReference(Range& range) : m_range(&range) {}
+
+	auto begin() const -> decltype(std::begin(std::declval<Range&>())) { return std::begin(*m_range); }
+	auto end() const -> decltype(std::end(std::declval<Range&>())) { return std::end(*m_range); }
+
+  private:
+	Range* m_range;
+};
+
+/**
+ * @brief ビューが保持する範囲の型 (左辺値なら参照、右辺値なら値)
+ *
+ */
+template <typename Range>
+using ViewStorage = typename std::conditional<std::is_lvalue_reference<Range>::value, RangeReference<typename std::remove_reference<Range>::type>,
+											  typename std::decay<Range>::type>::type;
+
+/**
+ * @brief 要素ごとに関数を適用するビュー
+ * @remark 参照先を走査するたびに関数を呼ぶので、中間の配列を作らない
+ *
+ * @tparam Base 元の範囲
+ * @tparam Func 要素に適用する関数
+ */
+template <typename Base, typename Func>
+class TransformView {
+	using BaseIterator = typename std::decay<decltype(std::declval<const Base&>().begin())>::type;
+
+  public:
+	class Iterator {
+	  public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = typename std::decay<decltype(std::declval<const Func&>()(*std::declval<BaseIterator&>()))>::type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type*;
+		using reference = value_type;
+
+		Iterator() = default;
+		Iterator(BaseIterator it, const Func* func) : m_it(it), m_func(func) {}
+
+		reference operator*() const { return (*m_func)(*m_it); }
+
+		Iterator& operator++() {
+			++m_it;
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator copy = *this;
+			++m_it;
+			return copy;
+		}
+
+		bool operator==(const Iterator& other) const { return m_it == other.m_it; }
+		bool operator!=(const Iterator& other) const { return m_it != other.m_it; }
+
+	  private:
+		BaseIterator m_it{};
+		const Func* m_func = nullptr;
+	};
+
+	TransformView(Base base, Func func) : m_base(std::move(base)), m_func(std::move(func)) {}
+
+	Iterator begin() const { return Iterator(m_base.begin(), &m_func); }
+	Iterator end() const { return Iterator(m_base.end(), &m_func); }
+
+  private:
+	Base m_base;
+	Func m_func;
+};
+
+/**
+ * @brief 磁場を評価するビュー
+ * @remark 元の範囲からchunk個ずつ位置を取り出して複数のスレッドで評価する。保持するのはchunk個分のバッファだけ。
+ *         1スレッドではまとめても速くならないので、1要素ずつ評価する
+ *
+ * @tparam Base 位置 (EcefまたはWgs84) の範囲
+ */
+template <typename Base>
+class FieldView {
+	using BaseIterator = typename std::decay<decltype(std::declval<const Base&>().begin())>::type;
+	using Position = typename std::decay<decltype(*std::declval<BaseIterator&>())>::type;
+
+	/**
+	 * @brief 走査ごとの状態 (スレッド、評価器とバッファ)
+	 * @remark スレッドと評価器は走査の間使い続けるので、チャンクごとに作り直さず、エポックのキャッシュも次のチャンクに引き継ぐ
+	 *
+	 */
+	struct State {
+		State(const GeoMagFlux& flux, BaseIterator b, BaseIterator e, std::size_t c, std::size_t t)
+		  : team(t), evaluators(team.size(), flux), it(b), end(e), chunk(team.size() == 1 ? 1 : c) {}
+
+		WorkerTeam team;
+		std::vector<GeoMagFlux> evaluators; // スレッドごとの評価器
+		BaseIterator it, end;
+		std::size_t chunk;
+		std::vector<Position> positions;
+		std::vector<Eigen::Vector3d> fluxes;
+
+		/**
+		 * @brief 次のchunk個を評価する
+		 *
+		 * @return bool 評価した要素があるか
+		 */
+		auto fill() -> bool {
+			positions.clear();
+			for (; positions.size() < chunk && it != end; ++it) {
+				positions.push_back(*it);
+			}
+			fluxes.resize(positions.size());
+			team.run(positions.size(), [this](std::size_t thread_index, std::size_t begin, std::size_t end) {
+				auto& evaluator = evaluators[thread_index];
+				for (std::size_t i = begin; i < end; i++) {
+					fluxes[i] = evaluator(positions[i]);
+				}
+			});
+			return !positions.empty();
+		}
+	};
+
+  public:
+	class Iterator {
+	  public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = Eigen::Vector3d;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Eigen::Vector3d*;
+		using reference = const Eigen::Vector3d&;
+
+		Iterator() = default;
+
+		explicit Iterator(std::shared_ptr<State> state) : m_state(std::move(state)) {
+			if (!m_state->fill()) {
+				m_state.reset();
+			}
+		}
+
+		reference operator*() const { return m_state->fluxes[m_index]; }
+		pointer operator->() const { return &m_state->fluxes[m_index]; }
+
+		Iterator& operator++() {
+			m_position++;
+			if (++m_index == m_state->fluxes.size()) {
+				m_index = 0;
+				if (!m_state->fill()) {
+					m_state.reset(); // 終端
+				}
+			}
+			return *this;
+		}
+
+		void operator++(int) { ++*this; }
+
+		bool operator==(const Iterator& other) const {
+			return m_state == nullptr || other.m_state == nullptr ? m_state == other.m_state : m_position == other.m_position;
+		}
+		bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+	  private:
+		std::shared_ptr<State> m_state; // 終端ではnullptr
+		std::size_t m_index = 0;
+		std::size_t m_position = 0;
+	};
+
+	FieldView(Base base, const GeoMagFlux& flux, std::size_t chunk, std::size_t threads)
+	  : m_base(std::move(base)), m_flux(flux), m_chunk(std::max<std::size_t>(chunk, 1)), m_threads(threads) {}
+
+	/**
+	 * @brief 走査を始める
+	 * @remark 入力イテレータなので、走査のたびに元の範囲の先頭から評価し直す
+	 *
+	 */
+	Iterator begin() const { return Iterator(std::make_shared<State>(m_flux, m_base.begin(), m_base.end(), m_chunk, m_threads)); }
+	Iterator end() const { return Iterator(); }
+
+	Accuracy accuracy() const { return m_flux.accuracy(); }
+
+  private:
+	Base m_base;
+	GeoMagFlux m_flux;
+	std::size_t m_chunk;
+	std::size_t m_threads;
+};
+
+/**
+ * @brief 要素ごとの変換を表すアダプタ (range | adaptor でビューを作る)
+ *
+ */
+template <typename Func>
+struct TransformAdaptor {
+	Func func;
+
+	template <typename Range>
+	friend auto operator|(Range&& range, const TransformAdaptor& adaptor) -> TransformView<ViewStorage<Range>, Func> {
+		return TransformView<ViewStorage<Range>, Func>(ViewStorage<Range>(std::forward<Range>(range)), adaptor.func);
+	}
+};
+
+/**
+ * @brief 磁場の評価を表すアダプタ
+ *
+ */
+struct FieldAdaptor {
+	const GeoMagFlux* flux;
+	std::size_t chunk;
+	std::size_t threads;
+
+	template <typename Range>
+	friend auto operator|(Range&& range, const FieldAdaptor& adaptor) -> FieldView<ViewStorage<Range>> {
+		return FieldView<ViewStorage<Range>>(ViewStorage<Range>(std::forward<Range>(range)), *adaptor.flux, adaptor.chunk, adaptor.threads);
+	}
+};
+
+struct ViewFunction {
+	struct ToEcef {
+		template <typename Position>
+		auto operator()(const Position& position) const -> Ecef {
+			return position.toEcef();
+		}
+	};
+
+	struct ToWgs84 {
+		template <typename Position>
+		auto operator()(const Position& position) const -> Wgs84 {
+			return position.toWgs84();
+		}
+	};
+
+	struct Components {
+		Accuracy accuracy = Accuracy::Exact; // 偏角・伏角を求める逆正接の精度
+
+		auto operator()(const Eigen::Vector3d& mag_density) const -> MagFluxComponent { return MagFluxComponent{mag_density, accuracy}; }
+	};
+};
+
+/**
+ * @brief 範囲が評価した磁場の精度 (磁場を評価するビューなら評価器の精度、それ以外はExact)
+ *
+ */
+template <typename Range>
+auto viewAccuracy(const Range&) -> Accuracy {
+	return Accuracy::Exact;
+}
+
+template <typename Base>
+auto viewAccuracy(const FieldView<Base>& view) -> Accuracy {
+	return view.accuracy();
+}
+
+/**
+ * @brief 磁場から成分を求めるアダプタ
+ * @remark 直前が磁場を評価するビューなら、その評価器の精度で偏角・伏角を求める
+ *
+ */
+struct ComponentsAdaptor {
+	template <typename Range>
+	friend auto operator|(Range&& range, const ComponentsAdaptor&) -> TransformView<ViewStorage<Range>, ViewFunction::Components> {
+		const ViewFunction::Components func{viewAccuracy(range)};
+		return TransformView<ViewStorage<Range>, ViewFunction::Components>(ViewStorage<Range>(std::forward<Range>(range)), func);
+	}
+};
+
+namespace views {
+
+/**
+ * @brief 位置をECEFに変換する
+ *
+ */
+constexpr TransformAdaptor<ViewFunction::ToEcef> to_ecef{};
+
+/**
+ * @brief 位置をWGS84に変換する
+ *
+ */
+constexpr TransformAdaptor<ViewFunction::ToWgs84> to_wgs84{};
+
+/**
+ * @brief 磁場 (NED成分) を評価する
+ * @remark fluxはビューを作るときに複製するので、ビューより先に破棄してもよい
+ *
+ * @param flux 評価器
+ * @param chunk まとめて評価する要素数 (threadsが1なら使わない)
+ * @param threads chunkを評価するスレッド数 (1の場合は走査するスレッドだけで1要素ずつ評価する)
+ */
+inline auto field(const GeoMagFlux& flux, std::size_t chunk = 256, std::size_t threads = 1) -> FieldAdaptor {
+	return FieldAdaptor{&flux, chunk, threads};
+}
+
+/**
+ * @brief 磁場から偏角・伏角・全磁力などを求める
+ * @remark views::fieldの直後では評価器の精度 (GeoMagFlux::setAccuracy) に従う
+ *
+ */
+constexpr ComponentsAdaptor components{};
+
+/**
+ * @brief 任意の関数を要素ごとに適用する
+ *
+ */
+template <typename Func>
+auto transform(Func func) -> TransformAdaptor<Func> {
+	return TransformAdaptor<Func>{std::move(func)};
+}
+
+} // namespace views
+
+GEOMAG_NAMESPACE_END
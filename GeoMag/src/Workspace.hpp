@@ -0,0 +1,363 @@
+/**
+ * @file Workspace.hpp
+ * @author Kaiji Takeuchi
+ * @brief バッチ処理の一時配列を使い回すアリーナ (Huge Page対応)
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include "Essential.hpp"
+
+#if GEOMAG_HAS_POSIX
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "GeoMagFlux.hpp"
+#include "Parallel.hpp"
+
+GEOMAG_NAMESPACE_BEGIN
+
+/**
+ * @brief Huge Pageの使い方
+ * @remark mmapがない環境ではどれも通常のmallocで確保する
+ *
+ */
+enum class HugePages {
+	None,		 // 通常のページ
+	Transparent, // madvise(MADV_HUGEPAGE) でTransparent Huge Pageを勧める
+	Explicit,	 // MAP_HUGETLBで予約済みのHuge Pageを使う (確保できなければTransparent)
+};
+
+/**
+ * @brief ワークスペースの設定
+ *
+ */
+struct WorkspaceConfig {
+	HugePages huge_pages = HugePages::Transparent;
+	std::size_t block_size = std::size_t{64} << 20; // 最初に確保する大きさ [byte]
+	std::size_t threads = 0;						// 評価スレッド数 (0の場合はハードウェアの並列数)
+};
+
+/**
+ * @brief ワークスペースの使用状況
+ *
+ */
+struct WorkspaceStats {
+	std::size_t capacity = 0;	  // 確保済みの大きさ [byte]
+	std::size_t in_use = 0;		  // 現在のバッチで使っている大きさ [byte]
+	std::size_t high_water = 0;	  // 1バッチで使った最大の大きさ [byte]
+	std::size_t mappings = 0;	  // ブロックを確保した回数
+	std::size_t huge_mappings = 0; // MAP_HUGETLBで確保できた回数
+};
+
+/**
+ * @brief アリーナ上の配列
+ * @remark アリーナをresetするまで有効
+ *
+ */
+template <typename T>
+class ArenaSpan {
+  public:
+	ArenaSpan() = default;
+	ArenaSpan(T* data, std::size_t size) : m_data(data), m_size(size) {}
+
+	T* data() const { return m_data; }
+	std::size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	T* begin() const { return m_data; }
+	T* end() const { return m_data + m_size; }
+	T& operator[](std::size_t i) const { return m_data[i]; }
+
+  private:
+	T* m_data = nullptr;
+	std::size_t m_size = 0;
+};
+
+/**
+ * @brief mmapで確保した領域を先頭から切り出すアリーナ
+ * @remark reset後は同じ領域を使い回す。1バッチで複数のブロックを使った場合は、次のresetで合計の大きさの1ブロックにまとめ直すので、
+ *         同じ大きさのバッチを繰り返せば2回目以降はmmapもmallocも呼ばない。
+ *         mmapした直後のページには触れないので、各ページは最初に書き込んだスレッドのNUMAノードに割り当たる。
+ *         mmapがない環境ではmallocで確保し、Huge Pageの指定は無視する
+ *
+ */
+class WorkspaceArena {
+  public:
+	static constexpr std::size_t alignment = 64;		   // キャッシュラインに揃える
+	static constexpr std::size_t huge_page_size = 2 << 20; // x86-64のHuge Page
+
+	explicit WorkspaceArena(HugePages huge_pages = HugePages::Transparent, std::size_t block_size = std::size_t{64} << 20)
+	  : m_huge_pages(huge_pages), m_block_size(std::max(block_size, std::size_t{huge_page_size})) {}
+
+	WorkspaceArena(const WorkspaceArena&) = delete;
+	WorkspaceArena& operator=(const WorkspaceArena&) = delete;
+
+	~WorkspaceArena() { release(); }
+
+	/**
+	 * @brief 初期化しない領域を確保する
+	 *
+	 * @param bytes 大きさ [byte]
+	 * @return void* alignmentに揃えた先頭
+	 */
+	auto allocateBytes(std::size_t bytes) -> void* {
+		bytes = (std::max<std::size_t>(bytes, 1) + alignment - 1) / alignment * alignment;
+		if (m_blocks.empty() || m_blocks[m_current].used + bytes > m_blocks[m_current].size) {
+			nextBlock(bytes);
+		}
+		Block& block = m_blocks[m_current];
+		void* ptr = static_cast<char*>(block.data) + block.used;
+		block.used += bytes;
+		m_stats.in_use += bytes;
+		m_stats.high_water = std::max(m_stats.high_water, m_stats.in_use);
+		return ptr;
+	}
+
+	/**
+	 * @brief 初期化しない配列を確保する
+	 *
+	 * @tparam T 要素の型 (トリビアルな型)
+	 */
+	template <typename T>
+	auto allocate(std::size_t count) -> ArenaSpan<T> {
+		static_assert(std::is_trivially_destructible<T>::value, "WorkspaceArena: element type must be trivially destructible");
+		return ArenaSpan<T>(static_cast<T*>(allocateBytes(count * sizeof(T))), count);
+	}
+
+	/**
+	 * @brief すべての配列を解放して次のバッチに備える
+	 *
+	 */
+	void reset() {
+		if (m_blocks.size() > 1) {
+			// 1バッチに収まるように、使った大きさの合計で1ブロックに確保し直す
+			std::size_t total = 0;
+			for (const auto& block : m_blocks) {
+				total += block.size;
+			}
+			release();
+			m_blocks.reserve(4);
+			m_blocks.push_back(map(total));
+		}
+		for (auto& block : m_blocks) {
+			block.used = 0;
+		}
+		m_current = 0;
+		m_stats.in_use = 0;
+	}
+
+	auto stats() const -> WorkspaceStats {
+		WorkspaceStats stats = m_stats;
+		for (const auto& block : m_blocks) {
+			stats.capacity += block.size;
+		}
+		return stats;
+	}
+
+  private:
+	struct Block {
+		void* data;
+		std::size_t size;
+		std::size_t used;
+		void* base; // mallocで確保した場合の先頭 (mmapの場合はnullptr)
+	};
+
+	HugePages m_huge_pages;
+	std::size_t m_block_size;
+	std::vector<Block> m_blocks;
+	std::size_t m_current = 0;
+	WorkspaceStats m_stats;
+
+	void nextBlock(std::size_t bytes) {
+		if (!m_blocks.empty() && m_current + 1 < m_blocks.size() && m_blocks[m_current + 1].size >= bytes) {
+			m_current++;
+			return;
+		}
+		std::size_t size = m_block_size;
+		for (const auto& block : m_blocks) {
+			size = std::max(size, block.size * 2); // 足りなくなるたびに倍にする
+		}
+		if (m_blocks.capacity() == m_blocks.size()) {
+			m_blocks.reserve(std::max<std::size_t>(m_blocks.size() * 2, 4));
+		}
+		m_blocks.push_back(map(std::max(size, bytes)));
+		m_current = m_blocks.size() - 1;
+	}
+
+	auto map(std::size_t size) -> Block {
+		size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+		m_stats.mappings++;
+
+#if GEOMAG_HAS_POSIX
+#ifdef MAP_HUGETLB
+		if (m_huge_pages == HugePages::Explicit) {
+			void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ptr != MAP_FAILED) {
+				m_stats.huge_mappings++;
+				return Block{ptr, size, 0, nullptr};
+			}
+		}
+#endif
+
+		// Huge Pageの境界に揃えるために余分に確保して前後を返す
+		const std::size_t padding = m_huge_pages == HugePages::None ? 0 : huge_page_size;
+		void* raw = mmap(nullptr, size + padding, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		char* ptr = static_cast<char*>(raw);
+		if (padding > 0) {
+			const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(raw);
+			const std::size_t head = (huge_page_size - address % huge_page_size) % huge_page_size;
+			if (head > 0) {
+				munmap(raw, head);
+			}
+			if (padding - head > 0) {
+				munmap(ptr + head + size, padding - head);
+			}
+			ptr += head;
+#ifdef MADV_HUGEPAGE
+			madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+		}
+		return Block{ptr, size, 0, nullptr};
+#else
+		void* raw = std::malloc(size + alignment);
+		if (raw == nullptr) {
+			throw std::bad_alloc();
+		}
+		const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(raw);
+		return Block{static_cast<char*>(raw) + (alignment - address % alignment) % alignment, size, 0, raw};
+#endif
+	}
+
+	void release() {
+		for (const auto& block : m_blocks) {
+			if (block.base != nullptr) {
+				std::free(block.base);
+			} else {
+#if GEOMAG_HAS_POSIX
+				munmap(block.data, block.size);
+#endif
+			}
+		}
+		m_blocks.clear();
+		m_current = 0;
+	}
+};
+
+/**
+ * @brief 大きなバッチを繰り返し評価するためのワークスペース
+ * @remark スレッドごとの評価器、常駐スレッド、アリーナを保持し、2回目以降の同じ大きさのバッチではメモリを確保しない
+ *
+ */
+class BatchWorkspace {
+  public:
+	/**
+	 * @brief Construct a new Batch Workspace object
+	 *
+	 * @param flux 評価器 (スレッドの数だけ複製する)
+	 * @param config 設定
+	 */
+	explicit BatchWorkspace(const GeoMagFlux& flux, const WorkspaceConfig& config = WorkspaceConfig{})
+	  : m_team(config.threads), m_arena(config.huge_pages, config.block_size), m_evaluators(m_team.size(), flux) {}
+
+	/**
+	 * @brief 評価器を差し替える (精度や単位を変えた場合など)
+	 *
+	 */
+	void setFlux(const GeoMagFlux& flux) {
+		m_evaluators.clear();
+		for (std::size_t t = 0; t < m_team.size(); t++) {
+			m_evaluators.push_back(flux);
+		}
+	}
+
+	/**
+	 * @brief 前のバッチの配列をすべて解放する
+	 *
+	 */
+	void reset() { m_arena.reset(); }
+
+	/**
+	 * @brief 初期化しない一時配列を確保する
+	 *
+	 */
+	template <typename T>
+	auto allocate(std::size_t count) -> ArenaSpan<T> {
+		return m_arena.allocate<T>(count);
+	}
+
+	/**
+	 * @brief 要素を並列に作って配列にする (座標変換の結果など)
+	 * @remark 各要素は評価と同じ分割で作るので、ページは評価するスレッドの側に割り当たる
+	 *
+	 * @param count 要素数
+	 * @param func T func(index)
+	 */
+	template <typename T, typename Func>
+	auto generate(std::size_t count, Func&& func) -> ArenaSpan<T> {
+		ArenaSpan<T> span = m_arena.allocate<T>(count);
+		T* data = span.data();
+		m_team.run(count, [data, &func](std::size_t, std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				new (data + i) T(func(i));
+			}
+		});
+		return span;
+	}
+
+	/**
+	 * @brief 磁束密度をまとめて求める
+	 *
+	 * @tparam Position 位置の型 (EcefまたはWgs84)
+	 * @param positions 位置の配列
+	 * @param count 要素数
+	 * @return ArenaSpan<Eigen::Vector3d> 磁束密度 (次のresetまで有効)
+	 */
+	template <typename Position>
+	auto evaluate(const Position* positions, std::size_t count) -> ArenaSpan<Eigen::Vector3d> {
+		ArenaSpan<Eigen::Vector3d> output = m_arena.allocate<Eigen::Vector3d>(count);
+		Eigen::Vector3d* data = output.data();
+		m_team.run(count, [this, data, positions](std::size_t thread_index, std::size_t begin, std::size_t end) {
+			auto& evaluator = m_evaluators[thread_index];
+			for (std::size_t i = begin; i < end; i++) {
+				new (data + i) Eigen::Vector3d(evaluator(positions[i]));
+			}
+		});
+		return output;
+	}
+
+	template <typename Position>
+	auto evaluate(const std::vector<Position>& positions) -> ArenaSpan<Eigen::Vector3d> {
+		return evaluate(positions.data(), positions.size());
+	}
+
+	template <typename Position>
+	auto evaluate(const ArenaSpan<Position>& positions) -> ArenaSpan<Eigen::Vector3d> {
+		return evaluate(positions.data(), positions.size());
+	}
+
+	auto stats() const -> WorkspaceStats { return m_arena.stats(); }
+	std::size_t threads() const { return m_team.size(); }
+
+  private:
+	WorkerTeam m_team;
+	WorkspaceArena m_arena;
+	std::vector<GeoMagFlux> m_evaluators;
+};
+
+GEOMAG_NAMESPACE_END